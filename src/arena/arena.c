@@ -5,10 +5,49 @@
 #include "arena.h"
 
 
+#define LAYER_HIDDEN ((uint8_t) 0xFF)
+#define BATCHES_LEN ((size_t) 16)
+
+
+/*
+ * A cached layer keeps what was last drawn on it in a target texture the size
+ * of the viewport, along with a signature of the entities that were drawn. The
+ * layer is only drawn again when the signature changes, which happens when any
+ * of its visible entities is added, removed or changed.
+ */
+struct layer {
+    bool cached;
+    sage_texture *tex;
+    struct sage_area_t area;
+    uint64_t sig;
+};
+
+
+/*
+ * A batch is a callback that updates all the players of one class in a single
+ * call, which is given the indices of those players in the arena. The indices
+ * are gathered into the batch afresh on each update.
+ */
+struct batch {
+    sage_id cls;
+    sage_arena_batch_f *fn;
+    size_t *idx;
+    size_t len;
+    size_t cap;
+};
+
+
 static thread_local struct {
     sage_entity **lst;
     size_t len;
     size_t cap;
+    size_t *vis;
+    size_t nvis;
+    uint8_t *lyr;
+    size_t off[SAGE_ARENA_LAYERS + 1];
+    struct layer layers[SAGE_ARENA_LAYERS];
+    struct batch batches[BATCHES_LEN];
+    size_t nbatches;
 } *players = NULL;
 
 
@@ -24,6 +63,18 @@ sage_arena_start(void)
     sage_require (players->lst = malloc (sz));
     for (register size_t i = 0; i < players->cap; i++)
         players->lst [i] = NULL;
+
+    players->nvis = 0;
+    sage_require (players->vis = malloc (sizeof *players->vis * players->cap));
+    sage_require (players->lyr = malloc (sizeof *players->lyr * players->cap));
+
+    for (register size_t i = 0; i < SAGE_ARENA_LAYERS; i++) {
+        players->layers [i].cached = false;
+        players->layers [i].tex = NULL;
+        players->layers [i].sig = 0;
+    }
+
+    players->nbatches = 0;
 }
 
 
@@ -34,20 +85,59 @@ sage_arena_stop(void)
         for (register size_t i = 0; i < players->len; i++)
             sage_entity_free (&players->lst [i]);
 
+        for (register size_t i = 0; i < SAGE_ARENA_LAYERS; i++)
+            sage_texture_free (&players->layers [i].tex);
+
+        for (register size_t i = 0; i < players->nbatches; i++)
+            free (players->batches [i].idx);
+
+        free (players->lyr);
+        free (players->vis);
         free (players->lst);
         free (players);
     }
 }
 
 
+/*
+ * The layer_check() helper function checks that a player is not animated if it
+ * is on a cached layer. An animated player changes what it draws without being
+ * changed itself, so a cached layer would never be redrawn to show it.
+ */
+static inline void layer_check(const sage_entity *ent)
+{
+    sage_assert (!players->layers [sage_entity_layer (ent)].cached
+            || !sage_entity_animated (ent));
+}
+
+
+extern size_t sage_arena_len(void)
+{
+    return players->len;
+}
+
+
 extern const sage_entity *sage_arena_entity(size_t idx)
 {
     return sage_entity_copy (players->lst [idx]);
 }
 
 
+/*
+ * The sage_arena_entity_mutable() interface function gets the slot of the
+ * player at index idx, through which the player can be changed in place. The
+ * slot is only valid until players are next pushed or popped.
+ */
+extern sage_entity **sage_arena_entity_mutable(size_t idx)
+{
+    sage_assert (idx < players->len);
+    return &players->lst [idx];
+}
+
+
 extern void sage_arena_entity_set(size_t idx, const sage_entity *ent)
 {
+    layer_check(ent);
     sage_entity_free(&players->lst[idx]);
     players->lst[idx] = sage_entity_copy(ent);
 }
@@ -56,11 +146,18 @@ extern void sage_arena_entity_set(size_t idx, const sage_entity *ent)
 extern size_t sage_arena_push(const sage_entity *ent)
 {
     sage_assert (ent);
+    layer_check (ent);
 
     if (sage_unlikely (players->len == players->cap)) {
         players->cap *= 2;
         size_t sz = sizeof *players->lst * players->cap;
         sage_require (players->lst = realloc (players->lst, sz));
+
+        sz = sizeof *players->vis * players->cap;
+        sage_require (players->vis = realloc (players->vis, sz));
+
+        sz = sizeof *players->lyr * players->cap;
+        sage_require (players->lyr = realloc (players->lyr, sz));
     }
 
     players->lst[players->len] = sage_entity_copy(ent);
@@ -72,22 +169,249 @@ extern size_t sage_arena_push(const sage_entity *ent)
 
 extern void sage_arena_pop(size_t idx)
 {
+    sage_assert (idx < players->len);
     sage_entity_free (&players->lst [idx]);
-    players->lst [idx] = players->lst [players->len];
-    players->lst [players->len--] = NULL;
+
+    if (idx != --players->len) {
+        players->lst [idx] = players->lst [players->len];
+        sage_entity_id_set (&players->lst [idx], idx);
+    }
+
+    players->lst [players->len] = NULL;
+}
+
+
+static struct batch *batch_find(sage_id cls)
+{
+    for (register size_t i = 0; i < players->nbatches; i++) {
+        if (players->batches [i].cls == cls)
+            return &players->batches [i];
+    }
+
+    return NULL;
 }
 
 
+static void batch_push(struct batch *bat, size_t idx)
+{
+    if (sage_unlikely (bat->len == bat->cap)) {
+        bat->cap = bat->cap ? bat->cap * 2 : 16;
+        size_t sz = sizeof *bat->idx * bat->cap;
+        sage_require (bat->idx = realloc (bat->idx, sz));
+    }
+
+    bat->idx [bat->len++] = idx;
+}
+
+
+/*
+ * The sage_arena_update() interface function runs the update callback of each
+ * player, and then the callback of each batch once over all the players of its
+ * class. Players whose class has a batch are expected to have no update
+ * callback of their own, so that they are not updated twice.
+ */
 extern void sage_arena_update(void)
 {
     for (register size_t i = 0; i < players->len; i++)
         sage_entity_update (&players->lst [i]);
+
+    if (sage_likely (!players->nbatches))
+        return;
+
+    for (register size_t i = 0; i < players->nbatches; i++)
+        players->batches [i].len = 0;
+
+    for (register size_t i = 0; i < players->len; i++) {
+        struct batch *bat = batch_find (sage_entity_class (players->lst [i]));
+        if (bat)
+            batch_push (bat, i);
+    }
+
+    for (register size_t i = 0; i < players->nbatches; i++) {
+        struct batch *bat = &players->batches [i];
+        if (bat->len)
+            bat->fn (bat->cls, bat->idx, bat->len);
+    }
 }
 
 
+/*
+ * The cull() helper function gathers the indices of the players that are at
+ * least partly within the active viewport into the visible index list, grouped
+ * by layer with a counting sort so that each layer's players are contiguous
+ * and in arena order. The range of the list that holds layer n starts at
+ * off[n] and ends just before off[n + 1].
+ */
+static void cull(void)
+{
+    size_t count [SAGE_ARENA_LAYERS] = { 0 };
+
+    for (register size_t i = 0; i < players->len; i++) {
+        const sage_entity *ent = players->lst [i];
+
+        if (sage_entity_visible (ent)) {
+            players->lyr [i] = sage_entity_layer (ent);
+            count [players->lyr [i]]++;
+        } else
+            players->lyr [i] = LAYER_HIDDEN;
+    }
+
+    players->off [0] = 0;
+    for (register size_t i = 0; i < SAGE_ARENA_LAYERS; i++) {
+        players->off [i + 1] = players->off [i] + count [i];
+        count [i] = players->off [i];
+    }
+
+    for (register size_t i = 0; i < players->len; i++) {
+        if (players->lyr [i] != LAYER_HIDDEN)
+            players->vis [count [players->lyr [i]]++] = i;
+    }
+
+    players->nvis = players->off [SAGE_ARENA_LAYERS];
+    sage_stats_cull (players->len - players->nvis);
+}
+
+
+static void layer_draw_direct(size_t from, size_t to)
+{
+    sage_queue_begin ();
+
+    for (register size_t i = from; i < to; i++)
+        sage_entity_draw (players->lst [players->vis [i]]);
+
+    sage_queue_end ();
+}
+
+
+static uint64_t layer_signature(size_t from, size_t to)
+{
+    uint64_t sig = 14695981039346656037u;
+
+    for (register size_t i = from; i < to; i++) {
+        const sage_entity *ent = players->lst [players->vis [i]];
+        layer_check (ent);
+
+        sig = (sig ^ (uint64_t) (uintptr_t) ent) * 1099511628211u;
+        sig = (sig ^ sage_object_revision (ent)) * 1099511628211u;
+    }
+
+    return (sig ^ (to - from)) * 1099511628211u;
+}
+
+
+static void layer_draw(uint8_t idx)
+{
+    struct layer *lyr = &players->layers [idx];
+    size_t from = players->off [idx], to = players->off [idx + 1];
+
+    if (!lyr->cached) {
+        layer_draw_direct (from, to);
+        return;
+    }
+
+    struct sage_area_t area = sage_screen_area ();
+    uint64_t sig = layer_signature (from, to);
+
+    if (!lyr->tex || lyr->area.w != area.w || lyr->area.h != area.h) {
+        sage_texture_free (&lyr->tex);
+        lyr->tex = sage_texture_new_target (0, area);
+        lyr->area = area;
+        lyr->sig = ~sig;
+    }
+
+    if (lyr->sig != sig) {
+        sage_texture_target_begin (lyr->tex);
+        layer_draw_direct (from, to);
+        sage_texture_target_end ();
+        lyr->sig = sig;
+    }
+
+    struct sage_point_t nw = { .x = 0, .y = 0 };
+    sage_texture_draw_clip (lyr->tex, nw, area, area, nw);
+}
+
+
+/*
+ * The sage_arena_draw() interface function draws the visible players layer by
+ * layer, from layer 0 upwards. Layers that are not cached have their players
+ * drawn every frame through the draw queue, so that within a layer players
+ * are drawn from the top of the screen down, and grouped by texture where that
+ * does not change what is seen. Cached layers are composited from their target
+ * textures, and only drawn again when one of their visible players has
+ * changed.
+ */
 extern void sage_arena_draw(void)
 {
-    for (register size_t i = 0; i < players->len; i++)
-        sage_entity_draw (players->lst [i]);
+    cull();
+    sage_batch_begin();
+
+    for (register uint8_t i = 0; i < SAGE_ARENA_LAYERS; i++)
+        layer_draw (i);
+
+    sage_batch_end();
+}
+
+
+/*
+ * The sage_arena_layer_cache() interface function sets whether a layer is
+ * cached. A cached layer is meant for backgrounds, HUDs and other content that
+ * rarely changes; since a cached layer is only drawn again when the state of
+ * its players changes, the draw callbacks of its players must not depend on
+ * anything else, such as the time, unless the layer is invalidated whenever
+ * that changes. For the same reason, animated players must not be put on a
+ * cached layer.
+ */
+extern void
+sage_arena_layer_cache(uint8_t layer, bool cache)
+{
+    sage_assert (layer < SAGE_ARENA_LAYERS);
+    struct layer *lyr = &players->layers [layer];
+
+    lyr->cached = cache;
+    if (!cache)
+        sage_texture_free (&lyr->tex);
+
+    for (register size_t i = 0; cache && i < players->len; i++)
+        layer_check (players->lst [i]);
 }
 
+
+extern void
+sage_arena_layer_invalidate(uint8_t layer)
+{
+    sage_assert (layer < SAGE_ARENA_LAYERS);
+    sage_texture_free (&players->layers [layer].tex);
+}
+
+
+/*
+ * The sage_arena_batch() interface function sets the callback that updates all
+ * the players of class cls in one call, replacing any that was set before;
+ * passing NULL for fn removes it. Batching lets a callback that is costly to
+ * enter, such as a script procedure, be entered once per frame for a class
+ * rather than once per player.
+ */
+extern void
+sage_arena_batch(sage_id cls, sage_arena_batch_f *fn)
+{
+    struct batch *bat = batch_find (cls);
+
+    if (!fn) {
+        if (bat) {
+            free (bat->idx);
+            *bat = players->batches [--players->nbatches];
+        }
+
+        return;
+    }
+
+    if (!bat) {
+        sage_require (players->nbatches < BATCHES_LEN);
+        bat = &players->batches [players->nbatches++];
+        bat->cls = cls;
+        bat->idx = NULL;
+        bat->len = bat->cap = 0;
+    }
+
+    bat->fn = fn;
+}
@@ -26,6 +26,8 @@
 #include "../core/core.h"
 #include "../graphics/graphics.h"
 
+#define SAGE_ARENA_LAYERS ((uint8_t) 8)
+
 typedef struct sage_object sage_entity;
 
 struct sage_entity_vtable {
@@ -78,14 +80,59 @@ extern const sage_object *sage_entity_payload(const sage_entity *ctx);
 
 extern sage_object *sage_entity_payload_mutable(sage_entity **ctx);
 
+extern void sage_entity_payload_set(sage_entity **ctx,
+        const sage_object *payload);
+
 extern bool sage_entity_focused(const sage_entity *ctx);
 
+extern SAGE_HOT bool sage_entity_visible(const sage_entity *ctx);
+
+extern uint8_t sage_entity_layer(const sage_entity *ctx);
+
+extern void sage_entity_layer_set(sage_entity **ctx, uint8_t layer);
+
+extern void sage_entity_animate(sage_entity **ctx, sage_id clip);
+
+extern bool sage_entity_animated(const sage_entity *ctx);
+
 extern void sage_entity_frame(sage_entity **ctx, struct sage_frame_t frm);
 
 extern void sage_entity_update(sage_entity **ctx);
 
 extern void sage_entity_draw(const sage_entity *ctx);
 
+/*
+ * The state of an entity that changes while it is in play, as opposed to what
+ * it takes from its class; an animation clip of 0 means no animation.
+ */
+struct sage_entity_state_t {
+    sage_id cls;
+    float x;
+    float y;
+    struct sage_frame_t frm;
+    struct sage_area_t proj;
+    uint8_t layer;
+    struct sage_animation_state_t anim;
+};
+
+extern void sage_entity_state(const sage_entity *ctx,
+        struct sage_entity_state_t *state);
+
+extern void sage_entity_state_set(sage_entity **ctx,
+        const struct sage_entity_state_t *state);
+
+extern size_t sage_entity_image_size(void);
+
+extern void sage_entity_image(void *img, const sage_entity *ctx);
+
+extern sage_id sage_entity_image_class(const void *img);
+
+extern uint8_t sage_entity_image_layer(const void *img);
+
+extern sage_entity *sage_entity_image_fix(void *img, const sage_entity *cls);
+
+extern bool sage_entity_image_held(const void *img);
+
 /********************************************/
 
 
@@ -183,7 +230,7 @@ inline void sage_entity_list_set_at(sage_entity_list **ctx, size_t idx,
         const sage_entity *obj)
 {
     sage_assert (ctx && idx && obj);
-    sage_object_list_set(ctx, idx, obj);
+    sage_object_list_set_at(ctx, idx, obj);
 }
 
 
@@ -227,6 +274,8 @@ extern void sage_entity_factory_exit(void);
 
 extern void sage_entity_factory_register(const sage_entity *ent);
 
+extern bool sage_entity_factory_has(sage_id id);
+
 extern sage_entity *sage_entity_factory_clone(sage_id id);
 
 
@@ -236,9 +285,15 @@ sage_arena_start(void);
 extern void 
 sage_arena_stop(void);
 
+extern size_t
+sage_arena_len(void);
+
 extern const sage_entity *
 sage_arena_entity(size_t idx);
 
+extern sage_entity **
+sage_arena_entity_mutable(size_t idx);
+
 extern void
 sage_arena_entity_set(size_t idx, const sage_entity *ent);
 
@@ -254,6 +309,17 @@ sage_arena_update(void);
 extern void 
 sage_arena_draw(void);
 
+extern void
+sage_arena_layer_cache(uint8_t layer, bool cache);
+
+extern void
+sage_arena_layer_invalidate(uint8_t layer);
+
+typedef void (sage_arena_batch_f)(sage_id cls, const size_t *idx, size_t len);
+
+extern void
+sage_arena_batch(sage_id cls, sage_arena_batch_f *fn);
+
 
 typedef struct sage_object sage_scene;
 
@@ -301,6 +367,10 @@ extern void sage_scene_entity_pop(sage_scene **ctx, sage_id guid);
 
 extern sage_object *sage_scene_payload(const sage_scene *ctx);
 
+extern const sage_entity_list *sage_scene_entities(const sage_scene *ctx);
+
+extern sage_entity_list **sage_scene_entities_mutable(sage_scene **ctx);
+
 extern void sage_scene_start(sage_scene **ctx);
 
 extern void sage_scene_stop(sage_scene **ctx);
@@ -317,8 +387,122 @@ extern void sage_stage_segue(sage_scene *scn);
 
 extern void sage_stage_interval(sage_scene *scn);
 
+extern void sage_stage_push(sage_scene *scn);
+
 extern void sage_stage_restore(void);
 
+extern void sage_stage_clear(void);
+
+extern size_t sage_stage_len(void);
+
+extern const sage_scene *sage_stage_scene(size_t idx);
+
+
+/** SNAPSHOT **/
+
+
+/*
+ * Hooks that save and load payloads of one type in snapshots of the stage; see
+ * sage_snapshot_payload().
+ */
+struct sage_snapshot_vtable {
+    size_t (*save)(const sage_object *obj, void *bfr, size_t cap);
+    sage_object *(*load)(sage_id id, const void *bfr, size_t len);
+};
+
+
+/*
+ * sage_snapshot_start() - start the snapshot system and its writer thread.
+ * See sage/src/arena/snapshot.c for details.
+ */
+extern void sage_snapshot_start(void);
+
+
+/*
+ * sage_snapshot_stop() - stop the snapshot system once snapshots are written.
+ * See sage/src/arena/snapshot.c for details.
+ */
+extern void sage_snapshot_stop(void);
+
+
+/*
+ * sage_snapshot_payload() - register the snapshot hooks of a payload type.
+ * See sage/src/arena/snapshot.c for details.
+ */
+extern void sage_snapshot_payload(sage_id id,
+        const struct sage_snapshot_vtable *vt);
+
+
+/*
+ * sage_snapshot_scene() - register the v-table of a scene for loading.
+ * See sage/src/arena/snapshot.c for details.
+ */
+extern void sage_snapshot_scene(sage_id id, const struct sage_scene_vtable *vt);
+
+
+/*
+ * sage_snapshot_save() - save the stage to a snapshot in the background.
+ * See sage/src/arena/snapshot.c for details.
+ */
+extern void sage_snapshot_save(const char *path);
+
+
+/*
+ * sage_snapshot_wait() - wait until saved snapshots have been written.
+ * See sage/src/arena/snapshot.c for details.
+ */
+extern void sage_snapshot_wait(void);
+
+
+/*
+ * sage_snapshot_load() - replace the stage with the scenes in a snapshot.
+ * See sage/src/arena/snapshot.c for details.
+ */
+extern bool sage_snapshot_load(const char *path);
+
+
+/** LEVEL **/
+
+
+typedef struct sage_level sage_level;
+
+
+/*
+ * sage_level_bake() - bake the entities of a scene into a level file.
+ * See sage/src/arena/level.c for details.
+ */
+extern bool sage_level_bake(const char *path, const sage_scene *scn);
+
+
+/*
+ * sage_level_load() - map a baked level file into memory.
+ * See sage/src/arena/level.c for details.
+ */
+extern sage_level *sage_level_load(const char *path);
+
+
+/*
+ * sage_level_free() - unmap a level once its entities are no longer used.
+ * The entities of a level borrow the payload, texture and v-table of their
+ * class, which the level keeps alive; a level whose entities are still in use
+ * is not freed. See sage/src/arena/level.c for details.
+ */
+extern void sage_level_free(sage_level **ctx);
+
+
+/*
+ * sage_level_len() - get the number of entities in a level.
+ * See sage/src/arena/level.c for details.
+ */
+extern size_t sage_level_len(const sage_level *ctx);
+
+
+/*
+ * sage_level_populate() - add the entities of a level to a scene.
+ * See sage/src/arena/level.c for details.
+ */
+extern void sage_level_populate(const sage_level *ctx, sage_scene **scn);
+
 extern void sage_stage_update(void);
 
 extern void sage_stage_draw(void);
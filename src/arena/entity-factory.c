@@ -22,7 +22,14 @@ extern void sage_entity_factory_exit(void)
 extern void sage_entity_factory_register(const sage_entity *ent)
 {
     sage_assert (ent);
-    sage_object_map_value_set(map, sage_entity_id(ent), sage_entity_copy(ent));
+    sage_object_map_value_set(map, sage_entity_id(ent), ent);
+}
+
+
+extern bool sage_entity_factory_has(sage_id entid)
+{
+    sage_assert (entid);
+    return sage_object_map_has(map, entid);
 }
 
 
@@ -34,6 +34,8 @@ struct cdata {
     sage_vector *pos;
     sage_sprite *spr;
     sage_object *payload;
+    uint8_t layer;
+    size_t anim;
     struct sage_entity_vtable vt;
 };
 
@@ -49,7 +51,10 @@ static inline void draw_default(const sage_entity *ctx)
     sage_assert (ctx);
     const struct cdata *cd = sage_object_cdata(ctx);
 
-    if (sage_likely (sage_vector_visible(cd->pos)))
+    if (cd->anim)
+        sage_sprite_draw_frame(cd->spr, sage_animation_frame(cd->anim),
+                sage_vector_point(cd->pos));
+    else
         sage_sprite_draw(cd->spr, sage_vector_point(cd->pos));
 }
 
@@ -64,6 +69,8 @@ static struct cdata *cdata_new(sage_id cls, sage_id tex,
     ctx->pos = sage_vector_new_zero();
     ctx->spr = sage_sprite_new(tex, frm);
     ctx->payload = sage_likely (payload) ? sage_object_copy(payload) : NULL;
+    ctx->layer = 0;
+    ctx->anim = 0;
 
     ctx->vt.update = sage_likely (vt->update) ? vt->update : &update_default;
     ctx->vt.draw = sage_likely (vt->draw) ? vt->draw : &draw_default;
@@ -83,6 +90,8 @@ static void *cdata_copy(const void *ctx)
     cp->spr = sage_sprite_copy(hnd->spr);
     cp->payload = sage_likely (hnd->payload) ? sage_object_copy(hnd->payload)
         : NULL;
+    cp->layer = hnd->layer;
+    cp->anim = hnd->anim ? sage_animation_clone(hnd->anim) : 0;
 
     cp->vt.update = hnd->vt.update;
     cp->vt.draw = hnd->vt.draw;
@@ -95,9 +104,13 @@ static void cdata_free(void **ctx)
 {
     struct cdata *hnd = *((struct cdata **) ctx);
 
+    if (hnd->anim)
+        sage_animation_halt(hnd->anim);
+
     sage_object_free(&hnd->payload);
     sage_vector_free(&hnd->pos);
     sage_sprite_free(&hnd->spr);
+    sage_heap_free(ctx);
 }
 
 
@@ -201,6 +214,21 @@ extern sage_object *sage_entity_payload_mutable(sage_entity **ctx)
 }
 
 
+/*
+ * The sage_entity_payload_set() interface function replaces the payload of an
+ * entity with a reference to payload, which may be NULL for no payload.
+ */
+extern void sage_entity_payload_set(sage_entity **ctx,
+        const sage_object *payload)
+{
+    sage_assert (ctx);
+    struct cdata *cd = sage_object_cdata_mutable(ctx);
+
+    sage_object_free(&cd->payload);
+    cd->payload = payload ? sage_object_copy(payload) : NULL;
+}
+
+
 extern bool sage_entity_focused(const sage_entity *ctx)
 {
     sage_assert (ctx);
@@ -223,6 +251,69 @@ extern bool sage_entity_focused(const sage_entity *ctx)
 }
 
 
+/*
+ * The sage_entity_visible() interface function checks whether any part of an
+ * entity's sprite, as projected at its position, falls within the active
+ * viewport.
+ */
+extern SAGE_HOT bool sage_entity_visible(const sage_entity *ctx)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = sage_object_cdata(ctx);
+
+    return sage_screen_visible(sage_vector_point(cd->pos),
+            sage_sprite_projection(cd->spr));
+}
+
+
+extern uint8_t sage_entity_layer(const sage_entity *ctx)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = sage_object_cdata(ctx);
+    return cd->layer;
+}
+
+
+/*
+ * The sage_entity_layer_set() interface function moves an entity to one of the
+ * SAGE_ARENA_LAYERS render layers of the arena; entities start out on layer 0,
+ * and higher layers are drawn over lower ones.
+ */
+extern void sage_entity_layer_set(sage_entity **ctx, uint8_t layer)
+{
+    sage_assert (ctx && layer < SAGE_ARENA_LAYERS);
+    struct cdata *cd = sage_object_cdata_mutable(ctx);
+    cd->layer = layer;
+}
+
+
+/*
+ * The sage_entity_animate() interface function starts the entity playing the
+ * animation clip clip in place of its sprite's current frame, replacing any
+ * clip it was already playing; a clip of 0 stops the animation. The frame is
+ * advanced by the animation system, so an animated entity is not changed from
+ * frame to frame, and must not be drawn on a cached arena layer.
+ */
+extern void sage_entity_animate(sage_entity **ctx, sage_id clip)
+{
+    sage_assert (ctx);
+    struct cdata *cd = sage_object_cdata_mutable(ctx);
+
+    if (cd->anim)
+        sage_animation_halt(cd->anim);
+
+    cd->anim = clip ? sage_animation_play(clip) : 0;
+}
+
+
+extern bool sage_entity_animated(const sage_entity *ctx)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = sage_object_cdata(ctx);
+    return cd->anim;
+}
+
+
 extern void sage_entity_frame(sage_entity **ctx, struct sage_frame_t frm)
 {
     sage_assert (ctx);
@@ -231,18 +322,215 @@ extern void sage_entity_frame(sage_entity **ctx, struct sage_frame_t frm)
 }
 
 
-extern void sage_entity_update(sage_entity **ctx)
+/*
+ * The sage_entity_state() interface function gets the state of an entity that
+ * its class does not determine: its position, layer, sprite frame and scale,
+ * and how far it has got through any animation it is playing. The state is
+ * plain data, and can be saved as it is.
+ */
+extern void sage_entity_state(const sage_entity *ctx,
+        struct sage_entity_state_t *state)
 {
-    sage_assert (ctx);
+    sage_assert (ctx && state);
+    const struct cdata *cd = sage_object_cdata(ctx);
+
+    state->cls = cd->cls;
+    state->x = sage_vector_x(cd->pos);
+    state->y = sage_vector_y(cd->pos);
+    state->frm = sage_sprite_frame_current(cd->spr);
+    state->proj = sage_sprite_projection(cd->spr);
+    state->layer = cd->layer;
+
+    if (cd->anim)
+        state->anim = sage_animation_state(cd->anim);
+    else
+        state->anim = (struct sage_animation_state_t) { .clip = 0 };
+}
+
+
+/*
+ * The sage_entity_state_set() interface function gives an entity the state
+ * saved by sage_entity_state(), other than its class. The sprite is only
+ * taken for writing if its frame or scale differ from the saved ones, as they
+ * seldom do for an entity cloned from its class.
+ */
+extern void sage_entity_state_set(sage_entity **ctx,
+        const struct sage_entity_state_t *state)
+{
+    sage_assert (ctx && state);
     struct cdata *cd = sage_object_cdata_mutable(ctx);
+
+    sage_vector_free(&cd->pos);
+    cd->pos = sage_vector_new(state->x, state->y);
+
+    struct sage_frame_t frm = sage_sprite_frame_current(cd->spr);
+    if (frm.r != state->frm.r || frm.c != state->frm.c)
+        sage_sprite_frame(&cd->spr, state->frm);
+
+    struct sage_area_t proj = sage_sprite_projection(cd->spr);
+    if (proj.w != state->proj.w || proj.h != state->proj.h)
+        sage_sprite_scale(&cd->spr, state->proj);
+
+    sage_assert (state->layer < SAGE_ARENA_LAYERS);
+    cd->layer = state->layer;
+
+    if (cd->anim)
+        sage_animation_halt(cd->anim);
+
+    cd->anim = state->anim.clip ? sage_animation_resume(&state->anim) : 0;
+}
+
+
+/*
+ * The image of an entity holds the images of its position and sprite after its
+ * own, so that the whole entity can be laid out as one record; see
+ * sage/src/core/object.c for what images are. The image_parts() helper function
+ * finds the images of the position and sprite within the entity image at img.
+ */
+static inline void image_parts(void *img, void **pos, void **spr)
+{
+    *pos = (uint8_t *) img + sage_object_image_size(sizeof (struct cdata));
+    *spr = (uint8_t *) *pos + sage_vector_image_size();
+}
+
+
+/*
+ * The sage_entity_image_size() interface function gets the size of the image
+ * of an entity, including the images of its position and sprite.
+ */
+extern size_t sage_entity_image_size(void)
+{
+    return sage_object_image_size(sizeof (struct cdata))
+            + sage_vector_image_size() + sage_sprite_image_size();
+}
+
+
+/*
+ * The sage_entity_image() interface function lays out the image of an entity
+ * at img. The image keeps the ID, class, layer, position and sprite state of
+ * the entity, but not its payload, callbacks or animation, which are taken
+ * from its class when the image is brought to life.
+ */
+extern void sage_entity_image(void *img, const sage_entity *ctx)
+{
+    sage_assert (img && ctx);
+    const struct cdata *hnd = sage_object_cdata(ctx);
+    struct cdata *cd = sage_object_image(img, sage_entity_id(ctx));
+
+    cd->cls = hnd->cls;
+    cd->pos = NULL;
+    cd->spr = NULL;
+    cd->payload = NULL;
+    cd->layer = hnd->layer;
+    cd->anim = 0;
+    cd->vt.update = NULL;
+    cd->vt.draw = NULL;
+
+    void *pos, *spr;
+    image_parts(img, &pos, &spr);
+    sage_vector_image(pos, hnd->pos);
+    sage_sprite_image(spr, hnd->spr);
+}
+
+
+/*
+ * The sage_entity_image_class() interface function gets the class of the
+ * entity image at img, which is needed to bring it to life.
+ */
+extern sage_id sage_entity_image_class(const void *img)
+{
+    sage_assert (img);
+    const struct cdata *cd = (const struct cdata *) ((const uint8_t *) img
+            + sage_object_image_size(0));
+    return cd->cls;
+}
+
+
+/*
+ * The sage_entity_image_layer() interface function gets the layer of the entity
+ * image at img, so that it can be checked before the image is brought to life.
+ */
+extern uint8_t sage_entity_image_layer(const void *img)
+{
+    sage_assert (img);
+    const struct cdata *cd = (const struct cdata *) ((const uint8_t *) img
+            + sage_object_image_size(0));
+    return cd->layer;
+}
+
+
+/*
+ * The sage_entity_image_fix() interface function brings to life the entity
+ * image at img, giving it the payload and callbacks of the entity cls of its
+ * class. The image takes no references to them, and so cls must outlive it.
+ */
+extern sage_entity *sage_entity_image_fix(void *img, const sage_entity *cls)
+{
+    struct sage_object_vtable objvt = {
+        .copy = &cdata_copy,
+        .free = &cdata_free
+    };
+    struct cdata *cd = sage_object_image_fix(img, &objvt);
+
+    sage_assert (cls);
+    const struct cdata *hnd = sage_object_cdata(cls);
+    sage_assert (cd->cls == hnd->cls);
+
+    void *pos, *spr;
+    image_parts(img, &pos, &spr);
+    cd->pos = sage_vector_image_fix(pos);
+    cd->spr = sage_sprite_image_fix(spr, hnd->spr);
+    cd->payload = hnd->payload;
+    cd->anim = 0;
+    cd->vt = hnd->vt;
+
+    return img;
+}
+
+
+/*
+ * The sage_entity_image_held() interface function checks whether references
+ * to the entity image at img, or to the images of its position and sprite, are
+ * still held.
+ */
+extern bool sage_entity_image_held(const void *img)
+{
+    void *pos, *spr;
+    image_parts((void *) img, &pos, &spr);
+
+    return sage_object_image_held(img) || sage_object_image_held(pos)
+            || sage_object_image_held(spr);
+}
+
+
+/*
+ * The sage_entity_update() interface function runs the update callback of an
+ * entity. The callback is only read here, so the entity is not taken for
+ * writing unless the callback itself changes it; an entity that does not
+ * change keeps its revision, and the arena layer it is drawn on stays cached.
+ */
+extern void sage_entity_update(sage_entity **ctx)
+{
+    sage_assert (ctx && *ctx);
+    const struct cdata *cd = sage_object_cdata(*ctx);
     cd->vt.update(ctx);
 }
 
 
+/*
+ * The sage_entity_draw() interface function runs the draw callback of an
+ * entity. If the draw queue is active, the entity's layer and vertical position
+ * are set as the sort context of whatever the callback draws, so that entities
+ * are drawn back to front regardless of the order they are drawn in.
+ */
 extern void sage_entity_draw(const sage_entity *ctx)
 {
     sage_assert (ctx);
     const struct cdata *cd = sage_object_cdata(ctx);
+
+    if (sage_queue_active())
+        sage_queue_context(cd->layer, sage_vector_point(cd->pos).y, 0);
+
     cd->vt.draw(ctx);
 }
 
@@ -1,12 +1,18 @@
 #include <SDL2/SDL.h>
 #include "../graphics/graphics.h"
 #include "../hid/hid.h"
+#include "../script/script.h"
 #include "arena.h"
 
 
+#define UPLOAD_BUDGET ((uint32_t) 2)
+#define SCRIPT_BUDGET ((uint32_t) 500)
+
+
 static thread_local struct {
     bool run;
     SDL_Event event;
+    uint32_t tick;
 } *game = NULL;
 
 
@@ -52,6 +58,9 @@ extern void sage_game_start(void)
         sage_mouse_init();
         sage_keyboard_init();
         sage_texture_factory_init();
+        sage_animation_start();
+        sage_script_start();
+        sage_script_bind_input();
         sage_entity_factory_init();
         sage_arena_start();
         sage_stage_init();
@@ -61,10 +70,15 @@ extern void sage_game_start(void)
 
 extern void sage_game_stop(void)
 {
+    sage_capture_stop();
+    sage_snapshot_stop();
     sage_arena_stop();
     sage_stage_exit();
     sage_entity_factory_exit();
+    sage_script_stop();
+    sage_animation_stop();
     sage_texture_factory_exit();
+    sage_atlas_stop();
     sage_keyboard_exit();
     sage_mouse_exit();
 
@@ -77,13 +91,23 @@ extern void sage_game_run(void)
 {
     // TODO: problem with hues needs to be fixed
     sage_colour_t *black = sage_colour_new_hue (SAGE_HUE_BLACK);
+    game->tick = SDL_GetTicks();
 
     while (sage_likely(game->run)) {
+        sage_screen_wait();
         listen();
+        sage_texture_factory_upload(UPLOAD_BUDGET);
+
+        uint32_t tick = SDL_GetTicks();
+        sage_animation_advance(tick - game->tick);
+        game->tick = tick;
+
         sage_arena_update();
+        sage_script_collect(SCRIPT_BUDGET);
 
         sage_screen_clear(black);
         sage_arena_draw();
+        sage_capture_run();
         sage_screen_render();
     }
 
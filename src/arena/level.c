@@ -0,0 +1,282 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "arena.h"
+
+
+/*
+ * A baked level holds the entities of a scene as entity images, laid out back
+ * to back exactly as the entities are laid out in memory; see
+ * sage/src/core/object.c for what images are. Loading a level maps the file
+ * into memory privately, and brings each image to life by setting the pointers
+ * it holds, so that no entity is allocated, cloned or copied. The entities of
+ * a level are shared with the file until they are written to, at which point
+ * they are copied to the heap as any shared object is.
+ *
+ * An image keeps the ID, class, layer, position and sprite state of an entity;
+ * its payload and callbacks are those of its class, which must be registered
+ * with the entity factory before the level is loaded. An image borrows the
+ * payload, sprite texture and v-table of its class without taking references
+ * to them; the level holds on to a clone of each class it uses for as long as
+ * it is loaded, which keeps them alive, and refuses to be freed while any of
+ * its images is still in use. Entities copied from an image take references of
+ * their own.
+ *
+ * The file begins with a header recording the version of the format and the
+ * size of an entity image, and is only loaded if both match; as images hold
+ * pointers and host byte order fields, a level is only meant to be loaded by
+ * the same build of the library that baked it.
+ */
+
+
+#define LEVEL_MAGIC "SAGELVL"
+#define LEVEL_VERSION ((uint32_t) 1)
+#define LEVEL_DATA ((size_t) 64)
+#define LEVEL_CLASSES_LEN ((size_t) 8)
+
+
+/*
+ * Every page of a level is written to when its images are brought to life, so
+ * the pages are read in up front where the system allows it, rather than one
+ * fault at a time.
+ */
+#ifdef MAP_POPULATE
+#   define LEVEL_MAP_FLAGS (MAP_PRIVATE | MAP_POPULATE)
+#else
+#   define LEVEL_MAP_FLAGS MAP_PRIVATE
+#endif
+
+
+struct level_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t stride;
+    uint64_t count;
+};
+
+
+struct sage_level {
+    uint8_t *map;
+    size_t size;
+    size_t len;
+    size_t stride;
+    sage_entity **cls;
+    size_t ncls;
+    size_t capcls;
+};
+
+
+static inline void *image(const sage_level *ctx, size_t idx)
+{
+    return ctx->map + LEVEL_DATA + idx * ctx->stride;
+}
+
+
+/*
+ * The class_find() helper function gets the entity of class id that the images
+ * of the level ctx are brought to life from, cloning it from the entity factory
+ * the first time it is needed. Images of the same class tend to be baked
+ * together, so the last class found is tried first.
+ */
+static const sage_entity *class_find(sage_level *ctx, sage_id id)
+{
+    if (sage_likely (ctx->ncls && sage_entity_class(ctx->cls[ctx->ncls - 1])
+                == id))
+        return ctx->cls[ctx->ncls - 1];
+
+    for (register size_t i = 0; i < ctx->ncls; i++) {
+        if (sage_entity_class(ctx->cls[i]) == id) {
+            sage_entity *tmp = ctx->cls[i];
+            ctx->cls[i] = ctx->cls[ctx->ncls - 1];
+            ctx->cls[ctx->ncls - 1] = tmp;
+            return tmp;
+        }
+    }
+
+    if (sage_unlikely (ctx->ncls == ctx->capcls)) {
+        ctx->capcls *= 2;
+        ctx->cls = sage_heap_resize(ctx->cls, sizeof *ctx->cls * ctx->capcls);
+    }
+
+    return ctx->cls[ctx->ncls++] = sage_entity_factory_clone(id);
+}
+
+
+/*
+ * The sage_level_bake() interface function bakes the entities of the scene scn
+ * into a level file at path, and returns whether it could be written. The file
+ * is written to a temporary file that is then renamed over any old one.
+ */
+extern bool sage_level_bake(const char *path, const sage_scene *scn)
+{
+    sage_assert (path && scn);
+    const sage_entity_list *ents = sage_scene_entities(scn);
+
+    struct level_header hdr = {
+        .magic = LEVEL_MAGIC,
+        .version = LEVEL_VERSION,
+        .stride = (uint32_t) sage_entity_image_size(),
+        .count = sage_entity_list_len(ents)
+    };
+
+    const size_t size = LEVEL_DATA + hdr.count * hdr.stride;
+    uint8_t *bfr = sage_heap_new(size);
+    memcpy(bfr, &hdr, sizeof hdr);
+
+    sage_entity *ent;
+    for (register size_t i = 0; i < hdr.count; i++) {
+        ent = sage_entity_list_get_at(ents, i + 1);
+        sage_entity_image(bfr + LEVEL_DATA + i * hdr.stride, ent);
+        sage_entity_free(&ent);
+    }
+
+    const size_t len = strlen(path);
+    char *tmp = sage_heap_new(len + sizeof ".tmp");
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", sizeof ".tmp");
+
+    FILE *file = fopen(tmp, "wb");
+    bool ok = file && fwrite(bfr, 1, size, file) == size;
+
+    if (file)
+        ok = !fclose(file) && ok;
+
+    if (!ok || rename(tmp, path)) {
+        printf("%s: cannot write level\n", path);
+        remove(tmp);
+        ok = false;
+    }
+
+    sage_heap_free((void **) &tmp);
+    sage_heap_free((void **) &bfr);
+
+    return ok;
+}
+
+
+/*
+ * The sage_level_load() interface function maps the level file at path into
+ * memory and brings its entities to life. NULL is returned if the file cannot
+ * be mapped or was not baked by this build of the library, or if any entity
+ * has a class that is not registered with the entity factory or a layer out of
+ * range; every image is checked before any is brought to life.
+ */
+extern sage_level *sage_level_load(const char *path)
+{
+    sage_assert (path);
+
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    void *map = MAP_FAILED;
+
+    if (fd >= 0 && !fstat(fd, &st) && (size_t) st.st_size >= LEVEL_DATA)
+        map = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+                LEVEL_MAP_FLAGS, fd, 0);
+
+    if (fd >= 0)
+        close(fd);
+
+    if (map == MAP_FAILED) {
+        printf("%s: cannot map level\n", path);
+        return NULL;
+    }
+
+    const size_t size = (size_t) st.st_size;
+    const struct level_header *hdr = map;
+
+    if (memcmp(hdr->magic, LEVEL_MAGIC, sizeof hdr->magic)
+            || hdr->version != LEVEL_VERSION
+            || hdr->stride != sage_entity_image_size()
+            || hdr->count != (size - LEVEL_DATA) / hdr->stride
+            || (size - LEVEL_DATA) % hdr->stride) {
+        printf("%s: incompatible level\n", path);
+        munmap(map, size);
+        return NULL;
+    }
+
+    for (register size_t i = 0; i < hdr->count; i++) {
+        const void *img = (const uint8_t *) map + LEVEL_DATA
+            + i * hdr->stride;
+        const sage_id cls = sage_entity_image_class(img);
+
+        if (!cls || !sage_entity_factory_has(cls)
+                || sage_entity_image_layer(img) >= SAGE_ARENA_LAYERS) {
+            printf("%s: entity %zu has an unknown class or layer\n", path, i);
+            munmap(map, size);
+            return NULL;
+        }
+    }
+
+    sage_level *ctx = sage_heap_new(sizeof *ctx);
+    ctx->map = map;
+    ctx->size = size;
+    ctx->len = hdr->count;
+    ctx->stride = hdr->stride;
+
+    ctx->ncls = 0;
+    ctx->capcls = LEVEL_CLASSES_LEN;
+    ctx->cls = sage_heap_new(sizeof *ctx->cls * ctx->capcls);
+
+    void *img;
+    for (register size_t i = 0; i < ctx->len; i++) {
+        img = image(ctx, i);
+        sage_entity_image_fix(img, class_find(ctx,
+                sage_entity_image_class(img)));
+    }
+
+    return ctx;
+}
+
+
+/*
+ * The sage_level_free() interface function unmaps a level. Its entities must
+ * no longer be in use, nor any entity copied from them, as copies share the
+ * positions and sprites of the level until they are changed. If any still is,
+ * the level is left loaded and *ctx is left as it was, as unmapping it would
+ * pull the memory of those entities from under them.
+ */
+extern void sage_level_free(sage_level **ctx)
+{
+    sage_level *hnd;
+
+    if (sage_likely (ctx && (hnd = *ctx))) {
+        for (register size_t i = 0; i < hnd->len; i++) {
+            if (sage_unlikely (sage_entity_image_held(image(hnd, i)))) {
+                printf("level: entity %zu still in use, not freed\n", i);
+                return;
+            }
+        }
+
+        for (register size_t i = 0; i < hnd->ncls; i++)
+            sage_entity_free(&hnd->cls[i]);
+
+        munmap(hnd->map, hnd->size);
+        sage_heap_free((void **) &hnd->cls);
+        sage_heap_free((void **) ctx);
+    }
+}
+
+
+extern size_t sage_level_len(const sage_level *ctx)
+{
+    sage_assert (ctx);
+    return ctx->len;
+}
+
+
+/*
+ * The sage_level_populate() interface function adds every entity of a level to
+ * the scene scn. The entities are shared rather than copied, so this costs no
+ * more than growing the entity list of the scene.
+ */
+extern void sage_level_populate(const sage_level *ctx, sage_scene **scn)
+{
+    sage_assert (ctx && scn);
+    sage_entity_list **ents = sage_scene_entities_mutable(scn);
+
+    for (register size_t i = 0; i < ctx->len; i++)
+        sage_entity_list_push(ents, image(ctx, i));
+}
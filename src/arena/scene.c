@@ -27,8 +27,10 @@ static inline void update_default(sage_scene **ctx)
 
     sage_entity *ent;
     for (register size_t i = 1; i <= sage_entity_list_len(cd->ents); i++) {
-        ent = sage_entity_list_get(cd->ents, i);
+        ent = sage_entity_list_get_at(cd->ents, i);
         sage_entity_update(&ent);
+        sage_entity_list_set_at(&cd->ents, i, ent);
+        sage_entity_free(&ent);
     }
 }
 
@@ -38,8 +40,15 @@ static inline void draw_default(const sage_scene *ctx)
     sage_assert (ctx);
     const struct cdata *cd = sage_object_cdata(ctx);
 
-    for (register size_t i = 1; i <= sage_entity_list_len(cd->ents); i++)
-        sage_entity_draw(sage_entity_list_get(cd->ents, i));
+    sage_entity *ent;
+    for (register size_t i = 1; i <= sage_entity_list_len(cd->ents); i++) {
+        ent = sage_entity_list_get_at(cd->ents, i);
+
+        if (sage_entity_visible(ent))
+            sage_entity_draw(ent);
+
+        sage_entity_free(&ent);
+    }
 }
 
 
@@ -78,6 +87,7 @@ static void *cdata_copy(const void *ctx)
     const struct cdata *hnd = (const struct cdata *) ctx;
 
     struct cdata *cp = cdata_new(hnd->payload, &hnd->vt);
+    sage_entity_list_free(&cp->ents);
     cp->ents = sage_entity_list_copy(hnd->ents);
 
     return cp;
@@ -149,6 +159,7 @@ extern void sage_scene_entity_push(sage_scene **ctx, sage_id entid,
     sage_entity *ent = sage_entity_factory_clone(entid);
     sage_entity_id_set(&ent, guid);
     sage_entity_list_push(&cd->ents, ent);
+    sage_entity_free(&ent);
 }
 
 
@@ -164,7 +175,33 @@ extern sage_object *sage_scene_payload(const sage_scene *ctx)
 {
     sage_assert (ctx);
     const struct cdata *cd = sage_object_cdata(ctx);
-    return sage_object_copy(cd->payload);
+    return sage_likely (cd->payload) ? sage_object_copy(cd->payload) : NULL;
+}
+
+
+/*
+ * The sage_scene_entities() interface function gets the list of entities in a
+ * scene. The list is still owned by the scene, and is only valid for as long
+ * as the scene is not changed.
+ */
+extern const sage_entity_list *sage_scene_entities(const sage_scene *ctx)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = sage_object_cdata(ctx);
+    return cd->ents;
+}
+
+
+/*
+ * The sage_scene_entities_mutable() interface function gets the list of
+ * entities in a scene for writing, so that entities can be added to a scene
+ * without going through the entity factory.
+ */
+extern sage_entity_list **sage_scene_entities_mutable(sage_scene **ctx)
+{
+    sage_assert (ctx);
+    struct cdata *cd = sage_object_cdata_mutable(ctx);
+    return &cd->ents;
 }
 
 
@@ -0,0 +1,812 @@
+#include <stdio.h>
+#include <string.h>
+#include "arena.h"
+
+
+/*
+ * A snapshot holds the state of every scene on the stage, so that a game can be
+ * saved and restored. Each scene is stored as its ID and payload followed by
+ * its entities, and each entity as its ID, the state returned by
+ * sage_entity_state() and its payload. Entities are restored by cloning their
+ * class from the entity factory, and scenes by creating them afresh with the
+ * v-table registered for their ID, as neither kind of callback can be stored;
+ * the classes, scene v-tables and animation clips of a snapshot must therefore
+ * be set up before it is loaded.
+ *
+ * Payloads are stored through the hooks registered for their type, which is
+ * the object ID of the payload. A payload without a hook is not stored, and an
+ * entity whose payload was not stored gets the payload of its class back.
+ *
+ * The snapshot is built on the calling thread, which is the only one that may
+ * touch the scenes, but is compressed and written out by a writer thread, so
+ * the caller only pays for copying the state. The file begins with a header
+ * recording the version of the format, the sizes of the state and of its LZ4
+ * compressed form and a checksum of the latter. All fields are stored in host
+ * byte order, as a snapshot is only meant to be read back on the machine that
+ * wrote it.
+ *
+ * Like the frame capture state, the snapshot state is shared with the writer
+ * thread and so is not thread local; only the job queue is touched by both
+ * threads, and it is guarded by the lock.
+ */
+
+
+#define SNAPSHOT_MAGIC "SAGESNP"
+#define SNAPSHOT_VERSION ((uint32_t) 1)
+#define SNAPSHOT_BFR_LEN ((size_t) 65536)
+#define SNAPSHOT_HOOKS_LEN ((size_t) 8)
+#define SNAPSHOT_SIZE_MAX ((uint64_t) 1 << 30)
+#define SNAPSHOT_LZ4_RATIO ((uint64_t) 255)
+#define SNAPSHOT_SCENE_MIN ((uint64_t) 17)
+
+
+enum payload_t {
+    PAYLOAD_NONE = 0,
+    PAYLOAD_CLASS,
+    PAYLOAD_SAVED
+};
+
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t size;
+    uint64_t packed;
+    uint64_t sum;
+};
+
+
+struct payload_hook {
+    sage_id id;
+    struct sage_snapshot_vtable vt;
+};
+
+
+struct scene_hook {
+    sage_id id;
+    struct sage_scene_vtable vt;
+};
+
+
+struct job {
+    uint8_t *bfr;
+    size_t len;
+    uint32_t count;
+    char *path;
+    struct job *next;
+};
+
+
+struct snapshot {
+    mtx_t lock;
+    cnd_t work;
+    cnd_t idle;
+    struct job *todo;
+    struct job *todo_tail;
+    size_t busy;
+    thrd_t writer;
+    bool stop;
+    struct payload_hook *payloads;
+    size_t npayloads;
+    size_t cappayloads;
+    struct scene_hook *scenes;
+    size_t nscenes;
+    size_t capscenes;
+};
+
+
+struct writer {
+    uint8_t *bfr;
+    size_t len;
+    size_t cap;
+};
+
+
+struct reader {
+    const uint8_t *pos;
+    const uint8_t *end;
+    const char *path;
+    bool err;
+};
+
+
+static struct snapshot *snapshot = NULL;
+
+
+static uint64_t hash(const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint64_t h = 14695981039346656037u;
+
+    for (register size_t i = 0; i < len; i++)
+        h = (h ^ bytes[i]) * 1099511628211u;
+
+    return h;
+}
+
+
+static struct sage_snapshot_vtable *payload_hook(sage_id id)
+{
+    for (register size_t i = 0; i < snapshot->npayloads; i++) {
+        if (snapshot->payloads[i].id == id)
+            return &snapshot->payloads[i].vt;
+    }
+
+    return NULL;
+}
+
+
+static struct sage_scene_vtable *scene_hook(sage_id id)
+{
+    for (register size_t i = 0; i < snapshot->nscenes; i++) {
+        if (snapshot->scenes[i].id == id)
+            return &snapshot->scenes[i].vt;
+    }
+
+    return NULL;
+}
+
+
+static void reserve(struct writer *wr, size_t len)
+{
+    if (sage_unlikely (wr->len + len > wr->cap)) {
+        while (wr->len + len > wr->cap)
+            wr->cap *= 2;
+
+        wr->bfr = sage_heap_resize(wr->bfr, wr->cap);
+    }
+}
+
+
+static inline void put(struct writer *wr, const void *data, size_t len)
+{
+    reserve(wr, len);
+    memcpy(wr->bfr + wr->len, data, len);
+    wr->len += len;
+}
+
+
+static inline void put_u8(struct writer *wr, uint8_t val)
+{
+    put(wr, &val, sizeof val);
+}
+
+
+static inline void put_u16(struct writer *wr, uint16_t val)
+{
+    put(wr, &val, sizeof val);
+}
+
+
+static inline void put_u32(struct writer *wr, uint32_t val)
+{
+    put(wr, &val, sizeof val);
+}
+
+
+static inline void put_u64(struct writer *wr, uint64_t val)
+{
+    put(wr, &val, sizeof val);
+}
+
+
+static inline void put_float(struct writer *wr, float val)
+{
+    put(wr, &val, sizeof val);
+}
+
+
+/*
+ * The put_payload() helper function stores the payload obj, which may be NULL.
+ * The save hook of the payload is first given whatever room is left in the
+ * buffer, and is only called a second time if that was not enough.
+ */
+static void put_payload(struct writer *wr, const sage_object *obj)
+{
+    if (!obj) {
+        put_u8(wr, PAYLOAD_NONE);
+        return;
+    }
+
+    const struct sage_snapshot_vtable *vt = payload_hook(sage_object_id(obj));
+    if (!vt) {
+        put_u8(wr, PAYLOAD_CLASS);
+        return;
+    }
+
+    put_u8(wr, PAYLOAD_SAVED);
+    put_u64(wr, sage_object_id(obj));
+    put_u32(wr, 0);
+    const size_t at = wr->len - sizeof (uint32_t);
+
+    size_t len = vt->save(obj, wr->bfr + wr->len, wr->cap - wr->len);
+    if (len > wr->cap - wr->len) {
+        reserve(wr, len);
+        sage_require (vt->save(obj, wr->bfr + wr->len, wr->cap - wr->len)
+                == len);
+    }
+
+    sage_assert (len <= UINT32_MAX);
+    const uint32_t len32 = (uint32_t) len;
+    memcpy(wr->bfr + at, &len32, sizeof len32);
+    wr->len += len;
+}
+
+
+static void put_entity(struct writer *wr, const sage_entity *ent)
+{
+    struct sage_entity_state_t st;
+    sage_entity_state(ent, &st);
+
+    put_u64(wr, sage_entity_id(ent));
+    put_u64(wr, st.cls);
+    put_float(wr, st.x);
+    put_float(wr, st.y);
+    put_u16(wr, st.frm.r);
+    put_u16(wr, st.frm.c);
+    put_u16(wr, st.proj.h);
+    put_u16(wr, st.proj.w);
+    put_u8(wr, st.layer);
+
+    put_u64(wr, st.anim.clip);
+    if (st.anim.clip) {
+        put_u32(wr, st.anim.time);
+        put_u16(wr, st.anim.idx);
+        put_u8(wr, (uint8_t) st.anim.dir);
+        put_u8(wr, st.anim.done);
+    }
+
+    put_payload(wr, sage_entity_payload(ent));
+}
+
+
+static void put_scene(struct writer *wr, const sage_scene *scn)
+{
+    put_u64(wr, sage_scene_id(scn));
+
+    sage_object *payload = sage_scene_payload(scn);
+    put_payload(wr, payload);
+    sage_object_free(&payload);
+
+    const sage_entity_list *ents = sage_scene_entities(scn);
+    const size_t len = sage_entity_list_len(ents);
+    put_u64(wr, len);
+
+    sage_entity *ent;
+    for (register size_t i = 1; i <= len; i++) {
+        ent = sage_entity_list_get_at(ents, i);
+        put_entity(wr, ent);
+        sage_entity_free(&ent);
+    }
+}
+
+
+static void get(struct reader *rd, void *data, size_t len)
+{
+    if (sage_unlikely (rd->err || (size_t) (rd->end - rd->pos) < len)) {
+        memset(data, 0, len);
+        rd->err = true;
+        return;
+    }
+
+    memcpy(data, rd->pos, len);
+    rd->pos += len;
+}
+
+
+static inline uint8_t get_u8(struct reader *rd)
+{
+    uint8_t val;
+    get(rd, &val, sizeof val);
+    return val;
+}
+
+
+static inline uint16_t get_u16(struct reader *rd)
+{
+    uint16_t val;
+    get(rd, &val, sizeof val);
+    return val;
+}
+
+
+static inline uint32_t get_u32(struct reader *rd)
+{
+    uint32_t val;
+    get(rd, &val, sizeof val);
+    return val;
+}
+
+
+static inline uint64_t get_u64(struct reader *rd)
+{
+    uint64_t val;
+    get(rd, &val, sizeof val);
+    return val;
+}
+
+
+static inline float get_float(struct reader *rd)
+{
+    float val;
+    get(rd, &val, sizeof val);
+    return val;
+}
+
+
+/*
+ * The get_payload() helper function reads back a payload stored by
+ * put_payload(). The kind of payload that was stored is returned, and if it
+ * was saved through a hook, the payload is created by the load hook for its
+ * type and passed back through obj.
+ */
+static enum payload_t get_payload(struct reader *rd, sage_object **obj)
+{
+    *obj = NULL;
+
+    const enum payload_t kind = get_u8(rd);
+    if (kind != PAYLOAD_SAVED)
+        return kind;
+
+    const sage_id id = get_u64(rd);
+    const size_t len = get_u32(rd);
+    const uint8_t *data = rd->pos;
+
+    rd->err = rd->err || (size_t) (rd->end - rd->pos) < len;
+    if (sage_unlikely (rd->err))
+        return kind;
+
+    rd->pos += len;
+
+    const struct sage_snapshot_vtable *vt = payload_hook(id);
+    if (sage_unlikely (!vt)) {
+        printf("%s: no snapshot hook for payload %llu\n", rd->path,
+                (unsigned long long) id);
+        rd->err = true;
+    } else if (sage_unlikely (!(*obj = vt->load(id, data, len)))) {
+        printf("%s: cannot load payload %llu\n", rd->path,
+                (unsigned long long) id);
+        rd->err = true;
+    }
+
+    return kind;
+}
+
+
+static void get_entity(struct reader *rd, sage_entity_list **ents)
+{
+    struct sage_entity_state_t st;
+
+    const sage_id id = get_u64(rd);
+    st.cls = get_u64(rd);
+    st.x = get_float(rd);
+    st.y = get_float(rd);
+    st.frm.r = get_u16(rd);
+    st.frm.c = get_u16(rd);
+    st.proj.h = get_u16(rd);
+    st.proj.w = get_u16(rd);
+    st.layer = get_u8(rd);
+
+    st.anim = (struct sage_animation_state_t) { .clip = get_u64(rd) };
+    if (st.anim.clip) {
+        st.anim.time = get_u32(rd);
+        st.anim.idx = get_u16(rd);
+        st.anim.dir = (int8_t) get_u8(rd);
+        st.anim.done = get_u8(rd);
+    }
+
+    sage_object *payload;
+    const enum payload_t kind = get_payload(rd, &payload);
+
+    rd->err = rd->err || !id || !st.cls || st.layer >= SAGE_ARENA_LAYERS
+        || kind > PAYLOAD_SAVED;
+
+    if (sage_unlikely (!rd->err && !sage_entity_factory_has(st.cls))) {
+        printf("%s: no entity class %llu\n", rd->path,
+                (unsigned long long) st.cls);
+        rd->err = true;
+    } else if (sage_unlikely (!rd->err && st.anim.clip
+                && !sage_animation_resumable(&st.anim))) {
+        printf("%s: cannot resume animation clip %llu\n", rd->path,
+                (unsigned long long) st.anim.clip);
+        rd->err = true;
+    }
+
+    if (sage_unlikely (rd->err)) {
+        sage_object_free(&payload);
+        return;
+    }
+
+    sage_entity *ent = sage_entity_factory_clone(st.cls);
+    sage_entity_id_set(&ent, id);
+    sage_entity_state_set(&ent, &st);
+
+    if (kind == PAYLOAD_SAVED || (kind == PAYLOAD_NONE
+                && sage_entity_payload(ent)))
+        sage_entity_payload_set(&ent, payload);
+
+    sage_entity_list_push(ents, ent);
+    sage_entity_free(&ent);
+    sage_object_free(&payload);
+}
+
+
+static sage_scene *get_scene(struct reader *rd)
+{
+    const sage_id id = get_u64(rd);
+
+    sage_object *payload;
+    const enum payload_t kind = get_payload(rd, &payload);
+    const uint64_t len = get_u64(rd);
+
+    rd->err = rd->err || !id || kind > PAYLOAD_SAVED;
+    if (sage_unlikely (rd->err)) {
+        sage_object_free(&payload);
+        return NULL;
+    }
+
+    sage_scene *scn = sage_scene_new(id, payload, scene_hook(id));
+    sage_object_free(&payload);
+
+    sage_entity_list **ents = sage_scene_entities_mutable(&scn);
+    for (register uint64_t i = 0; i < len && !rd->err; i++)
+        get_entity(rd, ents);
+
+    if (sage_unlikely (rd->err))
+        sage_scene_free(&scn);
+
+    return scn;
+}
+
+
+/*
+ * The snapshot_write() helper function compresses the state built for job and
+ * writes it out. As with the bytecode cache, the snapshot is written to a
+ * temporary file that is then renamed over the old one, so that a snapshot
+ * that is only partly written is never read back.
+ */
+static void snapshot_write(const struct job *job)
+{
+    const size_t cap = sage_lz4_bound(job->len);
+    uint8_t *packed = sage_heap_new(cap);
+    const size_t len = job->len ? sage_lz4_compress(job->bfr, job->len,
+            packed, cap) : 0;
+
+    struct snapshot_header hdr = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .count = job->count,
+        .size = job->len,
+        .packed = len,
+        .sum = hash(packed, len)
+    };
+
+    const size_t plen = strlen(job->path);
+    char *tmp = sage_heap_new(plen + sizeof ".tmp");
+    memcpy(tmp, job->path, plen);
+    memcpy(tmp + plen, ".tmp", sizeof ".tmp");
+
+    FILE *file = fopen(tmp, "wb");
+    bool ok = file && fwrite(&hdr, sizeof hdr, 1, file) == 1
+        && fwrite(packed, 1, len, file) == len;
+
+    if (file)
+        ok = !fclose(file) && ok;
+
+    if (!ok || rename(tmp, job->path)) {
+        printf("%s: cannot write snapshot\n", job->path);
+        remove(tmp);
+    }
+
+    sage_heap_free((void **) &tmp);
+    sage_heap_free((void **) &packed);
+}
+
+
+static int writer(void *arg)
+{
+    struct snapshot *ctx = arg;
+    struct job *job;
+
+    while (true) {
+        mtx_lock(&ctx->lock);
+        while (!ctx->stop && !ctx->todo)
+            cnd_wait(&ctx->work, &ctx->lock);
+
+        if (!ctx->todo) {
+            mtx_unlock(&ctx->lock);
+            return 0;
+        }
+
+        job = ctx->todo;
+        if (!(ctx->todo = job->next))
+            ctx->todo_tail = NULL;
+        mtx_unlock(&ctx->lock);
+
+        snapshot_write(job);
+
+        sage_heap_free((void **) &job->bfr);
+        sage_heap_free((void **) &job->path);
+        sage_heap_free((void **) &job);
+
+        mtx_lock(&ctx->lock);
+        if (!--ctx->busy)
+            cnd_broadcast(&ctx->idle);
+        mtx_unlock(&ctx->lock);
+    }
+}
+
+
+/*
+ * The read_file() helper function reads the snapshot at path, checks its
+ * header and returns its decompressed state, or NULL if it cannot be used.
+ * Nothing is allocated on the word of the header alone: the packed state must
+ * fit in what is left of the file, and the state must be no larger than the
+ * packed state could expand to, LZ4 expanding no more than 255 times, nor
+ * than SNAPSHOT_SIZE_MAX. Nor may the state count more scenes than it has room
+ * for, a scene taking at least SNAPSHOT_SCENE_MIN bytes.
+ */
+static uint8_t *read_file(const char *path, struct snapshot_header *hdr)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("%s: cannot open snapshot\n", path);
+        return NULL;
+    }
+
+    long flen = -1;
+    if (!fseek(file, 0, SEEK_END)) {
+        flen = ftell(file);
+        rewind(file);
+    }
+
+    uint8_t *packed = NULL, *bfr = NULL;
+    bool ok = flen >= (long) sizeof *hdr
+        && fread(hdr, sizeof *hdr, 1, file) == 1
+        && !memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof hdr->magic)
+        && hdr->version == SNAPSHOT_VERSION
+        && hdr->packed == (uint64_t) flen - sizeof *hdr
+        && hdr->size <= SNAPSHOT_SIZE_MAX
+        && hdr->size <= hdr->packed * SNAPSHOT_LZ4_RATIO
+        && hdr->count <= hdr->size / SNAPSHOT_SCENE_MIN
+        && hdr->packed <= sage_lz4_bound(hdr->size);
+
+    if (ok) {
+        packed = sage_heap_new(hdr->packed + 1);
+        ok = fread(packed, 1, hdr->packed, file) == hdr->packed
+            && hash(packed, hdr->packed) == hdr->sum;
+    }
+
+    if (ok) {
+        bfr = sage_heap_new(hdr->size + 1);
+        ok = !hdr->size || sage_lz4_decompress(packed, hdr->packed, bfr,
+                hdr->size) == hdr->size;
+    }
+
+    fclose(file);
+    sage_heap_free((void **) &packed);
+
+    if (!ok) {
+        printf("%s: corrupt snapshot\n", path);
+        sage_heap_free((void **) &bfr);
+    }
+
+    return bfr;
+}
+
+
+/*
+ * The sage_snapshot_start() interface function starts the snapshot system and
+ * its writer thread. Hooks may only be registered once it has been started.
+ */
+extern void sage_snapshot_start(void)
+{
+    if (sage_unlikely (snapshot))
+        return;
+
+    snapshot = sage_heap_new(sizeof *snapshot);
+    sage_require (mtx_init(&snapshot->lock, mtx_plain) == thrd_success);
+    sage_require (cnd_init(&snapshot->work) == thrd_success);
+    sage_require (cnd_init(&snapshot->idle) == thrd_success);
+
+    snapshot->todo = snapshot->todo_tail = NULL;
+    snapshot->busy = 0;
+    snapshot->stop = false;
+
+    snapshot->npayloads = snapshot->nscenes = 0;
+    snapshot->cappayloads = snapshot->capscenes = SNAPSHOT_HOOKS_LEN;
+    snapshot->payloads = sage_heap_new(sizeof *snapshot->payloads
+            * snapshot->cappayloads);
+    snapshot->scenes = sage_heap_new(sizeof *snapshot->scenes
+            * snapshot->capscenes);
+
+    sage_require (thrd_create(&snapshot->writer, &writer, snapshot)
+            == thrd_success);
+}
+
+
+/*
+ * The sage_snapshot_stop() interface function stops the snapshot system, after
+ * every snapshot that has already been saved has been written out.
+ */
+extern void sage_snapshot_stop(void)
+{
+    if (sage_likely (snapshot)) {
+        mtx_lock(&snapshot->lock);
+        snapshot->stop = true;
+        cnd_broadcast(&snapshot->work);
+        mtx_unlock(&snapshot->lock);
+        thrd_join(snapshot->writer, NULL);
+
+        cnd_destroy(&snapshot->idle);
+        cnd_destroy(&snapshot->work);
+        mtx_destroy(&snapshot->lock);
+
+        sage_heap_free((void **) &snapshot->payloads);
+        sage_heap_free((void **) &snapshot->scenes);
+        sage_heap_free((void **) &snapshot);
+    }
+}
+
+
+/*
+ * The sage_snapshot_payload() interface function registers the hooks vt that
+ * save and load payloads of type id, replacing any registered before. The save
+ * hook writes the payload into the cap bytes at bfr and returns its size; if
+ * that is more than cap, the hook is called again with enough room. The load
+ * hook creates a payload from the len bytes at bfr, or returns NULL if it
+ * cannot.
+ */
+extern void sage_snapshot_payload(sage_id id,
+        const struct sage_snapshot_vtable *vt)
+{
+    sage_assert (snapshot && vt && vt->save && vt->load);
+    struct sage_snapshot_vtable *hook = payload_hook(id);
+
+    if (!hook) {
+        if (sage_unlikely (snapshot->npayloads == snapshot->cappayloads)) {
+            snapshot->cappayloads *= 2;
+            snapshot->payloads = sage_heap_resize(snapshot->payloads,
+                    sizeof *snapshot->payloads * snapshot->cappayloads);
+        }
+
+        snapshot->payloads[snapshot->npayloads].id = id;
+        hook = &snapshot->payloads[snapshot->npayloads++].vt;
+    }
+
+    *hook = *vt;
+}
+
+
+/*
+ * The sage_snapshot_scene() interface function registers the v-table vt with
+ * which the scene id is created when a snapshot is loaded; scenes without one
+ * are created with the default callbacks.
+ */
+extern void sage_snapshot_scene(sage_id id, const struct sage_scene_vtable *vt)
+{
+    sage_assert (snapshot && id && vt);
+    struct sage_scene_vtable *hook = scene_hook(id);
+
+    if (!hook) {
+        if (sage_unlikely (snapshot->nscenes == snapshot->capscenes)) {
+            snapshot->capscenes *= 2;
+            snapshot->scenes = sage_heap_resize(snapshot->scenes,
+                    sizeof *snapshot->scenes * snapshot->capscenes);
+        }
+
+        snapshot->scenes[snapshot->nscenes].id = id;
+        hook = &snapshot->scenes[snapshot->nscenes++].vt;
+    }
+
+    *hook = *vt;
+}
+
+
+/*
+ * The sage_snapshot_save() interface function takes a snapshot of every scene
+ * on the stage and queues it to be written to path by the writer thread. The
+ * stage may change as soon as this function returns.
+ */
+extern void sage_snapshot_save(const char *path)
+{
+    sage_assert (snapshot && path && *path);
+
+    struct writer wr = { .len = 0, .cap = SNAPSHOT_BFR_LEN };
+    wr.bfr = sage_heap_new(wr.cap);
+
+    const size_t count = sage_stage_len();
+    for (register size_t i = 1; i <= count; i++)
+        put_scene(&wr, sage_stage_scene(i));
+
+    struct job *job = sage_heap_new(sizeof *job);
+    job->bfr = wr.bfr;
+    job->len = wr.len;
+    job->count = (uint32_t) count;
+    job->next = NULL;
+
+    const size_t len = strlen(path) + 1;
+    job->path = sage_heap_new(len);
+    memcpy(job->path, path, len);
+
+    mtx_lock(&snapshot->lock);
+    if (snapshot->todo_tail)
+        snapshot->todo_tail->next = job;
+    else
+        snapshot->todo = job;
+    snapshot->todo_tail = job;
+    snapshot->busy++;
+    cnd_signal(&snapshot->work);
+    mtx_unlock(&snapshot->lock);
+}
+
+
+/*
+ * The sage_snapshot_wait() interface function blocks until every snapshot that
+ * has been saved has been written out.
+ */
+extern void sage_snapshot_wait(void)
+{
+    sage_assert (snapshot);
+
+    mtx_lock(&snapshot->lock);
+    while (snapshot->busy)
+        cnd_wait(&snapshot->idle, &snapshot->lock);
+    mtx_unlock(&snapshot->lock);
+}
+
+
+/*
+ * The sage_snapshot_load() interface function replaces the scenes on the stage
+ * with those in the snapshot at path, in the order they were first staged. The
+ * scenes on the stage are stopped, but those of the snapshot are not started
+ * again, as they were already started when they were saved; they carry on as
+ * they were. Snapshots still being written are waited for first. If the
+ * snapshot cannot be read in full, or names an entity class or animation clip
+ * that is not set up, false is returned and the stage is left as it was.
+ */
+extern bool sage_snapshot_load(const char *path)
+{
+    sage_assert (snapshot && path);
+    sage_snapshot_wait();
+
+    struct snapshot_header hdr;
+    uint8_t *bfr = read_file(path, &hdr);
+    if (!bfr)
+        return false;
+
+    struct reader rd = {
+        .pos = bfr,
+        .end = bfr + hdr.size,
+        .path = path,
+        .err = false
+    };
+
+    sage_scene **scns = sage_heap_new(sizeof *scns * (hdr.count + 1));
+    uint32_t len = 0;
+
+    while (len < hdr.count && !rd.err) {
+        if ((scns[len] = get_scene(&rd)))
+            len++;
+    }
+
+    const bool ok = !rd.err && rd.pos == rd.end;
+
+    if (ok) {
+        sage_stage_clear();
+
+        for (register uint32_t i = 0; i < len; i++)
+            sage_stage_push(scns[i]);
+    } else {
+        printf("%s: corrupt snapshot\n", path);
+
+        for (register uint32_t i = 0; i < len; i++)
+            sage_scene_free(&scns[i]);
+    }
+
+    sage_heap_free((void **) &scns);
+    sage_heap_free((void **) &bfr);
+
+    return ok;
+}
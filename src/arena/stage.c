@@ -111,6 +111,18 @@ extern void sage_stage_interval(sage_scene *scn)
 }
 
 
+/*
+ * The sage_stage_push() interface function puts the scene scn on the stage over
+ * the current one, if any, without starting it. It is meant for bringing back
+ * scenes that were already started before, such as those in a snapshot.
+ */
+extern void sage_stage_push(sage_scene *scn)
+{
+    sage_assert (list && scn);
+    list_push(scn);
+}
+
+
 extern void sage_stage_restore(void)
 {
     sage_assert (list && list->tail && list->tail != list->head);
@@ -119,6 +131,54 @@ extern void sage_stage_restore(void)
 }
 
 
+/*
+ * The sage_stage_clear() interface function stops and removes every scene on
+ * the stage, the most recent first, leaving the stage empty.
+ */
+extern void sage_stage_clear(void)
+{
+    sage_assert (list);
+    while (list->tail) {
+        sage_scene_stop(&list->tail->scn);
+        list_pop();
+    }
+}
+
+
+/*
+ * The sage_stage_len() interface function gets the number of scenes on the
+ * stage, counting the current scene and every scene it was staged over.
+ */
+extern size_t sage_stage_len(void)
+{
+    sage_assert (list);
+    size_t len = 0;
+
+    for (const struct node *itr = list->head; itr; itr = itr->nxt)
+        len++;
+
+    return len;
+}
+
+
+/*
+ * The sage_stage_scene() interface function gets the scene at position idx on
+ * the stage, counting from 1 at the first scene staged; the last scene is the
+ * current one. The scene is still owned by the stage.
+ */
+extern const sage_scene *sage_stage_scene(size_t idx)
+{
+    sage_assert (list && idx);
+    const struct node *itr = list->head;
+
+    while (itr && --idx)
+        itr = itr->nxt;
+
+    sage_assert (itr);
+    return itr->scn;
+}
+
+
 extern void sage_stage_update(void)
 {
     sage_assert (list && list->tail);
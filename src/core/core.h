@@ -313,6 +313,8 @@ extern size_t sage_string_refcount(const sage_string_t *ctx);
 
 extern const char *sage_string_cstr(const sage_string_t *ctx);
 
+extern uint64_t sage_string_hash(const sage_string_t *ctx);
+
 
 struct sage_object_vtable {
     void *(*copy)(const void *ctx);
@@ -337,6 +339,17 @@ extern const void *sage_object_cdata(const sage_object *ctx);
 
 extern void *sage_object_cdata_mutable(sage_object **ctx);
 
+extern uint64_t sage_object_revision(const sage_object *ctx);
+
+extern size_t sage_object_image_size(size_t sz);
+
+extern void *sage_object_image(void *img, sage_id id);
+
+extern void *sage_object_image_fix(void *img,
+        const struct sage_object_vtable *vt);
+
+extern bool sage_object_image_held(const void *img);
+
 
 typedef struct sage_object_map sage_object_map;
 
@@ -346,6 +359,8 @@ extern void sage_object_map_free(sage_object_map **ctx);
 
 extern size_t sage_object_map_hash(const sage_object_map *ctx, sage_id key);
 
+extern bool sage_object_map_has(const sage_object_map *ctx, sage_id key);
+
 extern sage_object *sage_object_map_value(const sage_object_map *ctx, 
         sage_id key);
 
@@ -482,6 +497,12 @@ extern void sage_vector_mul(sage_vector **ctx, float mul);
 
 extern void sage_vector_div(sage_vector **ctx, const float div);
 
+extern size_t sage_vector_image_size(void);
+
+extern void sage_vector_image(void *img, const sage_vector *ctx);
+
+extern sage_vector *sage_vector_image_fix(void *img);
+
 
 struct sage_id_map_vtable_t {
     void *(*copy) (const void *ctx);
@@ -520,6 +541,17 @@ extern void
 sage_id_map_value_set(sage_id_map_t *ctx, sage_id_t key, void *val);
 
 
+/** LZ4 **/
+
+extern size_t sage_lz4_bound(size_t len);
+
+extern size_t sage_lz4_compress(const void *src, size_t len, void *dst,
+        size_t cap);
+
+extern size_t sage_lz4_decompress(const void *src, size_t len, void *dst,
+        size_t cap);
+
+
 typedef struct sage_payload_t sage_payload_t;
 
 struct sage_payload_vtable_t {
@@ -0,0 +1,203 @@
+#include <string.h>
+#include "core.h"
+
+
+/*
+ * This is a minimal implementation of the LZ4 block format, which is described
+ * at https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md; it lets the
+ * SAGE Library produce and read LZ4 compressed data without depending on the
+ * reference library. The compressor is a simple greedy matcher over a hash of
+ * 4-byte sequences, and favours speed over ratio. Any conforming LZ4 block,
+ * including those produced by the reference compressor, can be decompressed.
+ */
+
+
+#define LZ4_MINMATCH 4
+#define LZ4_LASTLITERALS 5
+#define LZ4_MFLIMIT 12
+#define LZ4_DISTANCE_MAX 65535
+#define LZ4_HASH_BITS 12
+
+
+static inline uint32_t read32(const uint8_t *ptr)
+{
+    uint32_t val;
+    memcpy(&val, ptr, sizeof val);
+    return val;
+}
+
+
+static inline uint32_t hash(uint32_t seq)
+{
+    return (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+
+static inline uint8_t *length_put(uint8_t *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+
+    *op++ = (uint8_t) len;
+    return op;
+}
+
+
+static inline size_t sequence_size(size_t lit, size_t mlen)
+{
+    return 1 + lit + lit / 255 + 1 + 2 + mlen / 255 + 1;
+}
+
+
+extern size_t sage_lz4_bound(size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+
+/*
+ * The sage_lz4_compress() interface function compresses len bytes from src into
+ * an LZ4 block at dst, which has room for cap bytes. The size of the block is
+ * returned, or zero if it would not fit; a buffer of sage_lz4_bound() bytes is
+ * always large enough.
+ */
+extern size_t sage_lz4_compress(const void *src, size_t len, void *dst,
+        size_t cap)
+{
+    sage_assert (src && dst);
+
+    const uint8_t *ip = src, *anchor = src, *base = src;
+    const uint8_t *end = base + len;
+    uint8_t *op = dst, *oend = op + cap;
+
+    if (len > LZ4_MFLIMIT) {
+        const uint8_t *mflimit = end - LZ4_MFLIMIT;
+        const uint8_t *matchlimit = end - LZ4_LASTLITERALS;
+        uint32_t table[1 << LZ4_HASH_BITS] = { 0 };
+
+        while (ip < mflimit) {
+            uint32_t seq = read32(ip), h = hash(seq);
+            const uint8_t *ref = base + table[h];
+            table[h] = (uint32_t) (ip - base);
+
+            if (ref >= ip || ip - ref > LZ4_DISTANCE_MAX
+                    || read32(ref) != seq) {
+                ip++;
+                continue;
+            }
+
+            const uint8_t *mp = ip + LZ4_MINMATCH, *rp = ref + LZ4_MINMATCH;
+            while (mp < matchlimit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            size_t lit = (size_t) (ip - anchor);
+            size_t mlen = (size_t) (mp - ip) - LZ4_MINMATCH;
+            if (sage_unlikely (sequence_size(lit, mlen) > (size_t) (oend - op)))
+                return 0;
+
+            uint8_t *token = op++;
+            *token = (uint8_t) ((lit >= 15 ? 15 : lit) << 4);
+            if (lit >= 15)
+                op = length_put(op, lit - 15);
+
+            memcpy(op, anchor, lit);
+            op += lit;
+
+            uint16_t off = (uint16_t) (ip - ref);
+            *op++ = (uint8_t) (off & 0xFF);
+            *op++ = (uint8_t) (off >> 8);
+
+            *token |= (uint8_t) (mlen >= 15 ? 15 : mlen);
+            if (mlen >= 15)
+                op = length_put(op, mlen - 15);
+
+            ip = anchor = mp;
+        }
+    }
+
+    size_t lit = (size_t) (end - anchor);
+    if (sage_unlikely (1 + lit + lit / 255 + 1 > (size_t) (oend - op)))
+        return 0;
+
+    *op++ = (uint8_t) ((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15)
+        op = length_put(op, lit - 15);
+
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    return (size_t) (op - (uint8_t *) dst);
+}
+
+
+/*
+ * The sage_lz4_decompress() interface function decompresses the LZ4 block of
+ * len bytes at src into dst, which has room for cap bytes. The decompressed
+ * size is returned, or zero if the block is malformed or would overflow dst.
+ */
+extern size_t sage_lz4_decompress(const void *src, size_t len, void *dst,
+        size_t cap)
+{
+    sage_assert (src && dst);
+
+    const uint8_t *ip = src, *iend = ip + len;
+    uint8_t *op = dst, *oend = op + cap;
+
+    while (ip < iend) {
+        uint8_t token = *ip++, byte;
+
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            do {
+                if (sage_unlikely (ip >= iend))
+                    return 0;
+                lit += (byte = *ip++);
+            } while (byte == 255);
+        }
+
+        if (sage_unlikely (lit > (size_t) (iend - ip)
+                    || lit > (size_t) (oend - op)))
+            return 0;
+
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+
+        if (ip == iend)
+            break;
+
+        if (sage_unlikely (iend - ip < 2))
+            return 0;
+
+        size_t off = (size_t) ip[0] | ((size_t) ip[1] << 8);
+        ip += 2;
+
+        if (sage_unlikely (!off || off > (size_t) (op - (uint8_t *) dst)))
+            return 0;
+
+        size_t mlen = token & 15;
+        if (mlen == 15) {
+            do {
+                if (sage_unlikely (ip >= iend))
+                    return 0;
+                mlen += (byte = *ip++);
+            } while (byte == 255);
+        }
+
+        mlen += LZ4_MINMATCH;
+        if (sage_unlikely (mlen > (size_t) (oend - op)))
+            return 0;
+
+        const uint8_t *ref = op - off;
+        for (register size_t i = 0; i < mlen; i++)
+            op[i] = ref[i];
+        op += mlen;
+    }
+
+    return (size_t) (op - (uint8_t *) dst);
+}
+
@@ -36,7 +36,7 @@ static void *cdata_copy(const void *ctx)
             cp->lst = sage_heap_resize(cp->lst, sizeof *cp->lst * cp->cap);
         }
 
-        cp->lst[i] = sage_object_copy(hnd->lst[i]);
+        cp->lst[cp->len++] = sage_object_copy(hnd->lst[i]);
     }
 
     return cp;
@@ -47,11 +47,11 @@ static void cdata_free(void **ctx)
 {
     struct cdata *hnd = *((struct cdata **) ctx);
 
-    for (register size_t i = 0; i < hnd->cap; i++)
+    for (register size_t i = 0; i < hnd->len; i++)
         sage_object_free(&hnd->lst[i]);
 
     sage_heap_free((void **) &hnd->lst);
-    sage_heap_free((void **) &ctx);
+    sage_heap_free(ctx);
 }
 
 
@@ -131,7 +131,7 @@ extern void sage_object_list_set_at(sage_object_list **ctx, size_t idx,
     sage_assert (ctx);
     struct cdata *cd = sage_object_cdata_mutable(ctx);
 
-    sage_assert (idx <= cd->len);
+    sage_assert (idx && idx <= cd->len);
     size_t index = idx - 1;
     sage_object_free(&cd->lst[index]);
 
@@ -152,7 +152,7 @@ extern void sage_object_list_push(sage_object_list **ctx,
     }
 
     sage_assert (obj && sage_object_id(obj));
-    cd->lst[cd->len] = sage_object_copy(obj);
+    cd->lst[cd->len++] = sage_object_copy(obj);
 }
 
 
@@ -171,9 +171,9 @@ extern void sage_object_list_pop_at(sage_object_list **ctx, size_t idx)
     sage_assert (ctx);
     struct cdata *cd = sage_object_cdata_mutable(ctx);
 
-    sage_assert (idx);
+    sage_assert (idx && idx <= cd->len);
     sage_object_free(&cd->lst[--idx]);
-    cd->lst[idx] = cd->lst[cd->len];
-    cd->lst[cd->len--] = NULL;
+    cd->lst[idx] = cd->lst[--cd->len];
+    cd->lst[cd->len] = NULL;
 }
 
@@ -60,6 +60,22 @@ extern size_t sage_object_map_hash(const sage_object_map *ctx, sage_id key)
 }
 
 
+/*
+ * The sage_object_map_has() interface function checks whether the map ctx
+ * holds a value for key, which sage_object_map_value() requires.
+ */
+extern bool sage_object_map_has(const sage_object_map *ctx, sage_id key)
+{
+    sage_assert (ctx && key);
+    const struct node *itr = ctx->buck[sage_object_map_hash(ctx, key)];
+
+    while (itr && itr->key != key)
+        itr = itr->next;
+
+    return itr;
+}
+
+
 extern sage_object *sage_object_map_value(const sage_object_map *ctx, 
         sage_id key)
 {
@@ -91,6 +107,8 @@ extern void sage_object_map_value_set(sage_object_map *ctx, sage_id key,
             itr->val = sage_object_copy(val);
             return;
         }
+
+        itr = itr->next;
     }
 
     itr = sage_heap_new(sizeof *itr);
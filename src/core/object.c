@@ -1,14 +1,42 @@
+#include <stdatomic.h>
 #include "core.h"
 
 
+/*
+ * Object images are objects laid out in memory that the caller owns, such as a
+ * file mapped into memory, rather than on the heap. An image is the object
+ * followed by its cdata, each rounded up to IMAGE_ALIGN bytes, so that images
+ * can be laid out back to back. An image starts out with a reference count so
+ * high that it never drops to zero; it is therefore never freed, and is copied
+ * to the heap as soon as it is written to.
+ */
+#define IMAGE_ALIGN ((size_t) 16)
+#define IMAGE_NREF ((size_t) 1 << (sizeof (size_t) * 8 - 2))
+
+
 struct sage_object {
     struct sage_object_vtable vt;
     sage_id id;
     size_t nref;
+    uint64_t rev;
     void *cdata;
 };
 
 
+/*
+ * Revisions are drawn from a single counter shared by all objects, so that an
+ * object pointer together with its revision identifies one state of one object
+ * even if a freed object's memory is later reused for another.
+ */
+static atomic_uint_fast64_t revision = 1;
+
+
+static inline uint64_t revision_next(void)
+{
+    return atomic_fetch_add_explicit(&revision, 1, memory_order_relaxed);
+}
+
+
 static void copy_on_write(sage_object **ctx)
 {
     sage_assert (ctx);
@@ -36,6 +64,7 @@ extern sage_object *sage_object_new(sage_id id, void *cdata,
 
     ctx->id = id;
     ctx->nref = 1;
+    ctx->rev = revision_next();
     ctx->cdata = cdata;
 
     ctx->vt.copy = vt->copy;
@@ -81,6 +110,7 @@ extern void sage_object_id_set(sage_object **ctx, sage_id id)
     sage_assert (ctx && *ctx);
     copy_on_write(ctx);
     (*ctx)->id = id;
+    (*ctx)->rev = revision_next();
 }
 
 
@@ -97,6 +127,93 @@ extern void *sage_object_cdata_mutable(sage_object **ctx)
     sage_assert (*ctx);
 
     copy_on_write(ctx);
+    (*ctx)->rev = revision_next();
+
     return (*ctx)->cdata;
 }
 
+
+/*
+ * The sage_object_revision() interface function gets the revision of an
+ * object. The revision changes every time the object is given out for writing
+ * through sage_object_cdata_mutable() or has its ID changed, so callers can
+ * tell whether an object may have changed since they last looked at it without
+ * comparing its contents.
+ */
+extern uint64_t sage_object_revision(const sage_object *ctx)
+{
+    sage_assert (ctx);
+    return ctx->rev;
+}
+
+
+
+static inline size_t image_round(size_t sz)
+{
+    return (sz + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1);
+}
+
+
+/*
+ * The sage_object_image_size() interface function gets the size of the image
+ * of an object whose cdata is sz bytes.
+ */
+extern size_t sage_object_image_size(size_t sz)
+{
+    return image_round(sizeof (struct sage_object)) + image_round(sz);
+}
+
+
+/*
+ * The sage_object_image() interface function lays out the image of an object
+ * with ID id at img, leaving the pointers it holds unset, and returns where its
+ * cdata is to be laid out. The image can then be stored, and brought to life
+ * wherever it is loaded with sage_object_image_fix().
+ */
+extern void *sage_object_image(void *img, sage_id id)
+{
+    sage_assert (img && !((uintptr_t) img % IMAGE_ALIGN));
+    sage_object *ctx = img;
+
+    ctx->vt.copy = NULL;
+    ctx->vt.free = NULL;
+    ctx->id = id;
+    ctx->nref = 0;
+    ctx->rev = 0;
+    ctx->cdata = NULL;
+
+    return (uint8_t *) img + image_round(sizeof *ctx);
+}
+
+
+/*
+ * The sage_object_image_fix() interface function sets the pointers of the
+ * object image at img, which then becomes the object with the v-table vt. The
+ * cdata of the image is returned so that the caller can set its pointers too.
+ */
+extern void *sage_object_image_fix(void *img,
+        const struct sage_object_vtable *vt)
+{
+    sage_assert (img && !((uintptr_t) img % IMAGE_ALIGN));
+    sage_object *ctx = img;
+
+    sage_assert (vt && vt->copy && vt->free);
+    ctx->vt.copy = vt->copy;
+    ctx->vt.free = vt->free;
+    ctx->nref = IMAGE_NREF;
+    ctx->rev = revision_next();
+
+    return ctx->cdata = (uint8_t *) img + image_round(sizeof *ctx);
+}
+
+
+/*
+ * The sage_object_image_held() interface function checks whether references
+ * to the object image at img are still held, in which case the memory of the
+ * image must not yet be released.
+ */
+extern bool sage_object_image_held(const void *img)
+{
+    sage_assert (img);
+    return ((const sage_object *) img)->nref != IMAGE_NREF;
+}
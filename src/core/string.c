@@ -81,3 +81,20 @@ extern const char *sage_string_cstr(const sage_string_t *ctx)
     return ctx->bfr;
 }
 
+
+/*
+ * The sage_string_hash() interface function computes the 64-bit FNV-1a hash of
+ * the characters of a string, which is cheap enough to use for looking strings
+ * up in caches.
+ */
+extern uint64_t sage_string_hash(const sage_string_t *ctx)
+{
+    sage_assert (ctx);
+
+    uint64_t hash = 14695981039346656037u;
+
+    for (register size_t i = 0; i < ctx->len; i++)
+        hash = (hash ^ (uint8_t) ctx->bfr[i]) * 1099511628211u;
+
+    return hash;
+}
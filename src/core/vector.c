@@ -68,7 +68,7 @@ static inline void *cdata_copy(const void *ctx)
 
 static inline void cdata_free(void **ctx)
 {
-    (void) ctx;
+    sage_heap_free(ctx);
 }
 
 
@@ -379,6 +379,41 @@ extern void sage_vector_div(sage_vector **ctx, const float div)
 }
 
 
+/*
+ * The sage_vector_image_size() interface function gets the size of the image
+ * of a vector; see sage/src/core/object.c for what images are.
+ */
+extern size_t sage_vector_image_size(void)
+{
+    return sage_object_image_size(sizeof (struct cdata));
+}
+
+
+/*
+ * The sage_vector_image() interface function lays out the image of a vector at
+ * img.
+ */
+extern void sage_vector_image(void *img, const sage_vector *ctx)
+{
+    sage_assert (img && ctx);
+    struct cdata *cd = sage_object_image(img, 0);
+    *cd = *((const struct cdata *) sage_object_cdata(ctx));
+}
+
+
+/*
+ * The sage_vector_image_fix() interface function brings to life the vector
+ * image at img; a vector holds no pointers of its own, so only those of the
+ * object need to be set.
+ */
+extern sage_vector *sage_vector_image_fix(void *img)
+{
+    struct sage_object_vtable vt = { .copy = &cdata_copy, .free = &cdata_free };
+    sage_object_image_fix(img, &vt);
+    return img;
+}
+
+
 /******************************************************************************
  *                                   __.-._
  *                                   '-._"7'
@@ -0,0 +1,349 @@
+#include <string.h>
+#include "graphics.h"
+
+
+/*
+ * An animation clip is a sequence of sprite sheet frames, each shown for its
+ * own duration in milliseconds, along with what happens at the end of the
+ * sequence. Clips are defined once and shared by every instance playing them.
+ *
+ * The state of every playing instance is kept in one dense array of records,
+ * so that sage_animation_advance() moves all of them forward in a single pass
+ * over contiguous memory, and drawing only needs to read the resulting frame.
+ * Instances are referred to by handles, which stay valid while records are
+ * moved around; stopping an instance moves the last record into its place, so
+ * the array never has holes. Handles start from 1, so that 0 can mean no
+ * animation.
+ */
+
+
+#define ANIMATION_LEN ((size_t) 64)
+
+
+struct clip {
+    sage_id id;
+    struct sage_frame_t *frms;
+    uint32_t *durs;
+    uint16_t len;
+    enum sage_animation_loop_t loop;
+};
+
+
+struct record {
+    size_t clip;
+    uint32_t time;
+    uint16_t idx;
+    int8_t dir;
+    bool done;
+    size_t hnd;
+};
+
+
+static thread_local struct {
+    struct clip *clips;
+    size_t nclips;
+    size_t capclips;
+    struct record *recs;
+    size_t len;
+    size_t cap;
+    size_t *slots;
+    size_t nslots;
+    size_t *spare;
+    size_t nspare;
+} *anim = NULL;
+
+
+static size_t clip_find(sage_id id)
+{
+    for (register size_t i = 0; i < anim->nclips; i++) {
+        if (anim->clips[i].id == id)
+            return i + 1;
+    }
+
+    return 0;
+}
+
+
+static size_t handle_new(void)
+{
+    if (anim->nspare)
+        return anim->spare[--anim->nspare];
+
+    if (sage_unlikely (anim->nslots == anim->cap)) {
+        anim->cap *= 2;
+        anim->recs = sage_heap_resize(anim->recs, sizeof *anim->recs
+                * anim->cap);
+        anim->slots = sage_heap_resize(anim->slots, sizeof *anim->slots
+                * (anim->cap + 1));
+        anim->spare = sage_heap_resize(anim->spare, sizeof *anim->spare
+                * anim->cap);
+    }
+
+    return ++anim->nslots;
+}
+
+
+static inline struct record *record_get(size_t hnd)
+{
+    sage_assert (anim && hnd && hnd <= anim->nslots);
+    return &anim->recs[anim->slots[hnd]];
+}
+
+
+/*
+ * The record_step() helper function moves an instance on to the next frame of
+ * its clip, according to the clip's loop mode. A clip that plays once stays on
+ * its last frame, and a ping-pong clip turns around at either end without
+ * repeating the end frames.
+ */
+static inline void record_step(struct record *rec, const struct clip *clip)
+{
+    switch (clip->loop) {
+        case SAGE_ANIMATION_LOOP_ONCE:
+            if (rec->idx + 1 < clip->len)
+                rec->idx++;
+            else
+                rec->done = true;
+            break;
+
+        case SAGE_ANIMATION_LOOP_REPEAT:
+            rec->idx = rec->idx + 1 < clip->len ? rec->idx + 1 : 0;
+            break;
+
+        case SAGE_ANIMATION_LOOP_PINGPONG:
+            if (clip->len < 2)
+                break;
+
+            if ((rec->dir > 0 && rec->idx + 1 == clip->len)
+                    || (rec->dir < 0 && !rec->idx))
+                rec->dir = -rec->dir;
+
+            rec->idx = (uint16_t) (rec->idx + rec->dir);
+            break;
+    }
+}
+
+
+extern void sage_animation_start(void)
+{
+    if (sage_unlikely (anim))
+        return;
+
+    anim = sage_heap_new(sizeof *anim);
+
+    anim->nclips = 0;
+    anim->capclips = 8;
+    anim->clips = sage_heap_new(sizeof *anim->clips * anim->capclips);
+
+    anim->len = anim->nslots = anim->nspare = 0;
+    anim->cap = ANIMATION_LEN;
+    anim->recs = sage_heap_new(sizeof *anim->recs * anim->cap);
+    anim->slots = sage_heap_new(sizeof *anim->slots * (anim->cap + 1));
+    anim->spare = sage_heap_new(sizeof *anim->spare * anim->cap);
+}
+
+
+extern void sage_animation_stop(void)
+{
+    if (sage_likely (anim)) {
+        for (register size_t i = 0; i < anim->nclips; i++) {
+            sage_heap_free((void **) &anim->clips[i].frms);
+            sage_heap_free((void **) &anim->clips[i].durs);
+        }
+
+        sage_heap_free((void **) &anim->clips);
+        sage_heap_free((void **) &anim->recs);
+        sage_heap_free((void **) &anim->slots);
+        sage_heap_free((void **) &anim->spare);
+        sage_heap_free((void **) &anim);
+    }
+}
+
+
+/*
+ * The sage_animation_clip() interface function defines the animation clip id
+ * as the len frames in frms, with frame i shown for durs[i] milliseconds. If
+ * durs is NULL, every frame is shown for the same duration dur. The frames and
+ * durations are copied, so the arrays need not outlive the call.
+ */
+extern void sage_animation_clip(sage_id id, const struct sage_frame_t *frms,
+        const uint32_t *durs, uint32_t dur, uint16_t len,
+        enum sage_animation_loop_t loop)
+{
+    sage_assert (anim && id && frms && len);
+    sage_assert (!clip_find(id));
+
+    if (sage_unlikely (anim->nclips == anim->capclips)) {
+        anim->capclips *= 2;
+        anim->clips = sage_heap_resize(anim->clips, sizeof *anim->clips
+                * anim->capclips);
+    }
+
+    struct clip *clip = &anim->clips[anim->nclips++];
+    clip->id = id;
+    clip->len = len;
+    clip->loop = loop;
+
+    clip->frms = sage_heap_new(sizeof *clip->frms * len);
+    memcpy(clip->frms, frms, sizeof *clip->frms * len);
+
+    clip->durs = sage_heap_new(sizeof *clip->durs * len);
+    for (register size_t i = 0; i < len; i++) {
+        clip->durs[i] = durs ? durs[i] : dur;
+        sage_assert (clip->durs[i]);
+    }
+}
+
+
+/*
+ * The sage_animation_play() interface function starts a new instance of the
+ * clip id from its first frame, and returns its handle.
+ */
+extern size_t sage_animation_play(sage_id id)
+{
+    sage_assert (anim && id);
+
+    size_t clip;
+    sage_require (clip = clip_find(id));
+
+    size_t hnd = handle_new();
+    struct record *rec = &anim->recs[anim->len];
+
+    rec->clip = clip - 1;
+    rec->time = 0;
+    rec->idx = 0;
+    rec->dir = 1;
+    rec->done = false;
+    rec->hnd = hnd;
+
+    anim->slots[hnd] = anim->len++;
+    return hnd;
+}
+
+
+/*
+ * The sage_animation_clone() interface function starts a new instance that
+ * plays the same clip as an existing one, from the same point.
+ */
+extern size_t sage_animation_clone(size_t hnd)
+{
+    struct record src = *record_get(hnd);
+    size_t cp = handle_new();
+
+    src.hnd = cp;
+    anim->recs[anim->len] = src;
+    anim->slots[cp] = anim->len++;
+
+    return cp;
+}
+
+
+/*
+ * The sage_animation_state() interface function gets the point an instance has
+ * reached in its clip, so that it can be saved and later resumed with
+ * sage_animation_resume(), even after the animation system has been restarted.
+ */
+extern struct sage_animation_state_t sage_animation_state(size_t hnd)
+{
+    const struct record *rec = record_get(hnd);
+    struct sage_animation_state_t state = {
+        .clip = anim->clips[rec->clip].id,
+        .time = rec->time,
+        .idx = rec->idx,
+        .dir = rec->dir,
+        .done = rec->done
+    };
+
+    return state;
+}
+
+
+/*
+ * The sage_animation_resumable() interface function checks whether state can
+ * be passed to sage_animation_resume(): that its clip is defined, that it is at
+ * a frame of the clip and that it runs in one of the two directions. States
+ * got from sage_animation_state() always can be, but states read back from
+ * elsewhere may not.
+ */
+extern bool sage_animation_resumable(const struct sage_animation_state_t *state)
+{
+    sage_assert (anim && state);
+    const size_t clip = state->clip ? clip_find(state->clip) : 0;
+
+    return clip && state->idx < anim->clips[clip - 1].len
+        && (state->dir == 1 || state->dir == -1);
+}
+
+
+/*
+ * The sage_animation_resume() interface function starts a new instance of the
+ * clip recorded in state from the point recorded there, and returns its handle.
+ */
+extern size_t sage_animation_resume(const struct sage_animation_state_t *state)
+{
+    sage_assert (state);
+    size_t hnd = sage_animation_play(state->clip);
+    struct record *rec = record_get(hnd);
+
+    sage_assert (state->idx < anim->clips[rec->clip].len);
+    rec->time = state->time;
+    rec->idx = state->idx;
+    rec->dir = state->dir;
+    rec->done = state->done;
+
+    return hnd;
+}
+
+
+extern void sage_animation_halt(size_t hnd)
+{
+    struct record *rec = record_get(hnd);
+    size_t slot = anim->slots[hnd];
+
+    if (slot != --anim->len) {
+        *rec = anim->recs[anim->len];
+        anim->slots[rec->hnd] = slot;
+    }
+
+    anim->spare[anim->nspare++] = hnd;
+}
+
+
+extern bool sage_animation_done(size_t hnd)
+{
+    return record_get(hnd)->done;
+}
+
+
+extern SAGE_HOT struct sage_frame_t sage_animation_frame(size_t hnd)
+{
+    const struct record *rec = record_get(hnd);
+    return anim->clips[rec->clip].frms[rec->idx];
+}
+
+
+/*
+ * The sage_animation_advance() interface function moves every playing instance
+ * forward by dt milliseconds; it is called once per frame by the game loop. An
+ * instance skips as many frames as dt covers, so animations keep time even when
+ * the frame rate drops.
+ */
+extern SAGE_HOT void sage_animation_advance(uint32_t dt)
+{
+    sage_assert (anim);
+
+    for (register size_t i = 0; i < anim->len; i++) {
+        struct record *rec = &anim->recs[i];
+        const struct clip *clip = &anim->clips[rec->clip];
+
+        if (sage_unlikely (rec->done))
+            continue;
+
+        rec->time += dt;
+        while (rec->time >= clip->durs[rec->idx] && !rec->done) {
+            rec->time -= clip->durs[rec->idx];
+            record_step(rec, clip);
+        }
+    }
+}
+
@@ -0,0 +1,417 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <string.h>
+#include "graphics.h"
+
+
+#define ATLAS_MAGIC "sage-atlas"
+#define ATLAS_VERSION 1
+#define ATLAS_PATH_MAX ((size_t) 1024)
+
+
+/*
+ * A skyline node is a horizontal segment of the upper contour of the packed
+ * rectangles in a page; new rectangles are placed on top of the contour.
+ */
+struct node {
+    int x;
+    int y;
+    int w;
+};
+
+
+struct page {
+    SDL_Surface *surf;
+    sage_texture *tex;
+    struct node *sky;
+    size_t len;
+};
+
+
+struct entry {
+    sage_id id;
+    SDL_Surface *surf;
+    SDL_Rect rect;
+    size_t page;
+};
+
+
+static thread_local struct {
+    struct entry *ents;
+    size_t len;
+    size_t cap;
+    struct page *pages;
+    size_t npages;
+    struct sage_area_t size;
+    uint16_t pad;
+} *atlas = NULL;
+
+
+static size_t page_new(int w, int h)
+{
+    atlas->pages = atlas->npages
+        ? sage_heap_resize(atlas->pages, sizeof *atlas->pages
+                * (atlas->npages + 1))
+        : sage_heap_new(sizeof *atlas->pages);
+
+    struct page *pg = &atlas->pages[atlas->npages];
+    sage_require (pg->surf = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32,
+                SDL_PIXELFORMAT_RGBA32));
+    SDL_FillRect(pg->surf, NULL, 0);
+
+    pg->tex = NULL;
+    pg->sky = sage_heap_new(sizeof *pg->sky * (size_t) (w + 1));
+    pg->sky[0].x = pg->sky[0].y = 0;
+    pg->sky[0].w = w;
+    pg->len = 1;
+
+    return atlas->npages++;
+}
+
+
+static void page_free(struct page *ctx)
+{
+    SDL_FreeSurface(ctx->surf);
+    sage_heap_free((void **) &ctx->sky);
+
+    sage_texture_free(&ctx->tex);
+}
+
+
+/*
+ * Gets the lowest y at which a rectangle of width w can rest on the skyline of
+ * a page starting at node idx, or -1 if it would overflow the page.
+ */
+static int skyline_fit(const struct page *ctx, size_t idx, int w, int h)
+{
+    int x = ctx->sky[idx].x;
+    if (x + w > ctx->surf->w)
+        return -1;
+
+    int y = 0, rem = w;
+    for (register size_t i = idx; rem > 0; i++) {
+        sage_assert (i < ctx->len);
+        if (ctx->sky[i].y > y)
+            y = ctx->sky[i].y;
+
+        if (y + h > ctx->surf->h)
+            return -1;
+
+        rem -= ctx->sky[i].w;
+    }
+
+    return y;
+}
+
+
+static void skyline_insert(struct page *ctx, size_t idx, int x, int y, int w,
+        int h)
+{
+    memmove(&ctx->sky[idx + 1], &ctx->sky[idx],
+            sizeof *ctx->sky * (ctx->len - idx));
+    ctx->sky[idx].x = x;
+    ctx->sky[idx].y = y + h;
+    ctx->sky[idx].w = w;
+    ctx->len++;
+
+    for (register size_t i = idx + 1; i < ctx->len; i++) {
+        struct node *prv = &ctx->sky[i - 1];
+        struct node *cur = &ctx->sky[i];
+
+        if (cur->x >= prv->x + prv->w)
+            break;
+
+        int shrink = prv->x + prv->w - cur->x;
+        cur->x += shrink;
+        cur->w -= shrink;
+
+        if (cur->w > 0)
+            break;
+
+        memmove(cur, cur + 1, sizeof *ctx->sky * (ctx->len - i - 1));
+        ctx->len--;
+        i--;
+    }
+
+    for (register size_t i = 0; i + 1 < ctx->len; i++) {
+        if (ctx->sky[i].y == ctx->sky[i + 1].y) {
+            ctx->sky[i].w += ctx->sky[i + 1].w;
+            memmove(&ctx->sky[i + 1], &ctx->sky[i + 2],
+                    sizeof *ctx->sky * (ctx->len - i - 2));
+            ctx->len--;
+            i--;
+        }
+    }
+}
+
+
+/*
+ * Places a rectangle in a page using the bottom-left skyline heuristic, i.e.
+ * at the lowest position and then the leftmost one; returns false if the
+ * rectangle does not fit in the page.
+ */
+static bool skyline_place(struct page *ctx, int w, int h, SDL_Rect *rect)
+{
+    size_t best = ctx->len;
+    int besty = ctx->surf->h, bestw = ctx->surf->w;
+
+    for (register size_t i = 0; i < ctx->len; i++) {
+        int y = skyline_fit(ctx, i, w, h);
+
+        if (y >= 0 && (y < besty || (y == besty && ctx->sky[i].w < bestw))) {
+            best = i;
+            besty = y;
+            bestw = ctx->sky[i].w;
+        }
+    }
+
+    if (best == ctx->len)
+        return false;
+
+    rect->x = ctx->sky[best].x;
+    rect->y = besty;
+    rect->w = w;
+    rect->h = h;
+    skyline_insert(ctx, best, rect->x, rect->y, w, h);
+
+    return true;
+}
+
+
+static int entry_cmp(const void *lhs, const void *rhs)
+{
+    const struct entry *l = lhs, *r = rhs;
+
+    if (l->surf->h != r->surf->h)
+        return r->surf->h - l->surf->h;
+
+    return r->surf->w - l->surf->w;
+}
+
+
+static void entry_push(sage_id id, SDL_Surface *surf)
+{
+    if (sage_unlikely (atlas->len == atlas->cap)) {
+        atlas->cap *= 2;
+        atlas->ents = sage_heap_resize(atlas->ents,
+                sizeof *atlas->ents * atlas->cap);
+    }
+
+    struct entry *ent = &atlas->ents[atlas->len++];
+    ent->id = id;
+    ent->surf = surf;
+    ent->page = 0;
+    ent->rect.x = ent->rect.y = 0;
+    ent->rect.w = surf ? surf->w : 0;
+    ent->rect.h = surf ? surf->h : 0;
+}
+
+
+static void reset(void)
+{
+    for (register size_t i = 0; i < atlas->len; i++)
+        SDL_FreeSurface(atlas->ents[i].surf);
+
+    for (register size_t i = 0; i < atlas->npages; i++)
+        page_free(&atlas->pages[i]);
+
+    sage_heap_free((void **) &atlas->pages);
+    atlas->npages = 0;
+    atlas->len = 0;
+}
+
+
+extern void sage_atlas_start(struct sage_area_t page, uint16_t pad)
+{
+    if (sage_unlikely (atlas))
+        return;
+
+    sage_assert (page.w && page.h);
+    atlas = sage_heap_new(sizeof *atlas);
+
+    atlas->len = 0;
+    atlas->cap = 16;
+    atlas->ents = sage_heap_new(sizeof *atlas->ents * atlas->cap);
+
+    atlas->pages = NULL;
+    atlas->npages = 0;
+    atlas->size = page;
+    atlas->pad = pad;
+}
+
+
+extern void sage_atlas_stop(void)
+{
+    if (sage_likely (atlas)) {
+        reset();
+        sage_heap_free((void **) &atlas->ents);
+        sage_heap_free((void **) &atlas);
+    }
+}
+
+
+extern void sage_atlas_add(sage_id id, const char *path)
+{
+    sage_assert (atlas && !atlas->npages);
+    sage_assert (id && path && *path);
+
+    SDL_Surface *surf;
+    sage_require (surf = IMG_Load(path));
+    entry_push(id, surf);
+}
+
+
+/*
+ * The sage_atlas_pack() interface function packs the queued images into as few
+ * pages as possible, tallest first, and returns the number of pages used. Each
+ * image is surrounded by transparent padding so that filtering at the edges of
+ * a sub-rectangle never samples its neighbours. An image larger than the
+ * configured page size is given a page of its own.
+ */
+extern size_t sage_atlas_pack(void)
+{
+    sage_assert (atlas && !atlas->npages);
+    qsort(atlas->ents, atlas->len, sizeof *atlas->ents, &entry_cmp);
+
+    const int pad = atlas->pad;
+    for (register size_t i = 0; i < atlas->len; i++) {
+        struct entry *ent = &atlas->ents[i];
+        int w = ent->surf->w + 2 * pad, h = ent->surf->h + 2 * pad;
+        bool placed = false;
+
+        for (register size_t p = 0; !placed && p < atlas->npages; p++) {
+            if ((placed = skyline_place(&atlas->pages[p], w, h, &ent->rect)))
+                ent->page = p;
+        }
+
+        if (!placed) {
+            ent->page = page_new(w > atlas->size.w ? w : atlas->size.w,
+                    h > atlas->size.h ? h : atlas->size.h);
+            sage_require (skyline_place(&atlas->pages[ent->page], w, h,
+                        &ent->rect));
+        }
+
+        ent->rect.x += pad;
+        ent->rect.y += pad;
+        ent->rect.w -= 2 * pad;
+        ent->rect.h -= 2 * pad;
+
+        SDL_SetSurfaceBlendMode(ent->surf, SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(ent->surf, NULL, atlas->pages[ent->page].surf,
+                &ent->rect);
+        SDL_FreeSurface(ent->surf);
+        ent->surf = NULL;
+    }
+
+    return atlas->npages;
+}
+
+
+/*
+ * The sage_atlas_save() interface function bakes the packed pages to disk so
+ * that they can be loaded without repacking. Each page is written as the PNG
+ * file <stem>-<n>.png, and the sub-rectangles are written to the plain text
+ * metadata file <stem>.atlas, one texture per line as "<id> <page> <x> <y> <w>
+ * <h>".
+ */
+extern void sage_atlas_save(const char *stem)
+{
+    sage_assert (atlas && stem && *stem);
+    char path[ATLAS_PATH_MAX];
+
+    for (register size_t i = 0; i < atlas->npages; i++) {
+        snprintf(path, sizeof path, "%s-%zu.png", stem, i);
+        sage_require (!IMG_SavePNG(atlas->pages[i].surf, path));
+    }
+
+    FILE *meta;
+    snprintf(path, sizeof path, "%s.atlas", stem);
+    sage_require (meta = fopen(path, "w"));
+
+    fprintf(meta, "%s %d %zu %zu\n", ATLAS_MAGIC, ATLAS_VERSION,
+            atlas->npages, atlas->len);
+
+    for (register size_t i = 0; i < atlas->len; i++) {
+        const struct entry *ent = &atlas->ents[i];
+        fprintf(meta, "%" PRIu64 " %zu %d %d %d %d\n", ent->id, ent->page,
+                ent->rect.x, ent->rect.y, ent->rect.w, ent->rect.h);
+    }
+
+    sage_require (!fclose(meta));
+}
+
+
+extern void sage_atlas_load(const char *stem)
+{
+    sage_assert (atlas && !atlas->len && !atlas->npages);
+    sage_assert (stem && *stem);
+
+    char path[ATLAS_PATH_MAX], magic[16];
+    int ver;
+    size_t npages, len;
+
+    FILE *meta;
+    snprintf(path, sizeof path, "%s.atlas", stem);
+    sage_require (meta = fopen(path, "r"));
+
+    sage_require (fscanf(meta, "%15s %d %zu %zu", magic, &ver, &npages, &len)
+            == 4);
+    sage_require (!strcmp(magic, ATLAS_MAGIC) && ver == ATLAS_VERSION);
+
+    atlas->pages = sage_heap_new(sizeof *atlas->pages * (npages ? npages : 1));
+    for (register size_t i = 0; i < npages; i++) {
+        struct page *pg = &atlas->pages[i];
+        snprintf(path, sizeof path, "%s-%zu.png", stem, i);
+
+        sage_require (pg->surf = IMG_Load(path));
+        pg->tex = NULL;
+        pg->sky = NULL;
+        pg->len = 0;
+        atlas->npages++;
+    }
+
+    for (register size_t i = 0; i < len; i++) {
+        struct entry *ent;
+        entry_push(0, NULL);
+        ent = &atlas->ents[atlas->len - 1];
+
+        sage_require (fscanf(meta, "%" SCNu64 " %zu %d %d %d %d", &ent->id,
+                    &ent->page, &ent->rect.x, &ent->rect.y, &ent->rect.w,
+                    &ent->rect.h) == 6);
+        sage_require (ent->id && ent->page < npages);
+    }
+
+    fclose(meta);
+}
+
+
+/*
+ * The sage_atlas_register() interface function uploads each page as a single
+ * SDL texture and registers every packed image with the texture factory as a
+ * sub-rectangle of its page. Texture clipping and sprite frames are relative to
+ * the sub-rectangle, so client code is unaware of the atlas. The page textures
+ * are owned by the atlas, and must outlive the textures registered here.
+ */
+extern void sage_atlas_register(void)
+{
+    sage_assert (atlas);
+
+    for (register size_t i = 0; i < atlas->npages; i++) {
+        struct page *pg = &atlas->pages[i];
+
+        if (!pg->tex)
+            pg->tex = sage_texture_new_surface(0, pg->surf);
+    }
+
+    for (register size_t i = 0; i < atlas->len; i++) {
+        const struct entry *ent = &atlas->ents[i];
+        struct sage_point_t nw = { .x = ent->rect.x, .y = ent->rect.y };
+        struct sage_area_t area = { .w = ent->rect.w, .h = ent->rect.h };
+
+        sage_texture *tex = sage_texture_new_region(ent->id,
+                atlas->pages[ent->page].tex, nw, area);
+        sage_texture_factory_register_texture(tex);
+        sage_texture_free(&tex);
+    }
+}
+
@@ -0,0 +1,139 @@
+#include <SDL2/SDL.h>
+#include "graphics.h"
+
+
+#define BATCH_QUADS ((size_t) 256)
+
+
+static thread_local struct {
+    SDL_Texture *tex;
+    SDL_Vertex *vtx;
+    int *idx;
+    size_t len;
+    size_t cap;
+    bool open;
+} *batch = NULL;
+
+
+static void indices_fill(size_t from, size_t to)
+{
+    for (register size_t i = from; i < to; i++) {
+        int *itr = &batch->idx[i * 6];
+        int base = (int) (i * 4);
+
+        itr[0] = base;
+        itr[1] = base + 1;
+        itr[2] = base + 2;
+        itr[3] = base + 2;
+        itr[4] = base + 3;
+        itr[5] = base;
+    }
+}
+
+
+static void grow(void)
+{
+    size_t cap = batch->cap * 2;
+
+    batch->vtx = sage_heap_resize(batch->vtx, sizeof *batch->vtx * cap * 4);
+    batch->idx = sage_heap_resize(batch->idx, sizeof *batch->idx * cap * 6);
+    indices_fill(batch->cap, cap);
+
+    batch->cap = cap;
+}
+
+
+extern void sage_batch_start(void)
+{
+    if (sage_unlikely (batch))
+        return;
+
+    batch = sage_heap_new(sizeof *batch);
+    batch->cap = BATCH_QUADS;
+    batch->vtx = sage_heap_new(sizeof *batch->vtx * batch->cap * 4);
+    batch->idx = sage_heap_new(sizeof *batch->idx * batch->cap * 6);
+    indices_fill(0, batch->cap);
+}
+
+
+extern void sage_batch_stop(void)
+{
+    if (sage_likely (batch)) {
+        sage_heap_free((void **) &batch->vtx);
+        sage_heap_free((void **) &batch->idx);
+        sage_heap_free((void **) &batch);
+    }
+}
+
+
+extern void sage_batch_begin(void)
+{
+    sage_assert (batch && !batch->open);
+    batch->open = true;
+    batch->len = 0;
+    batch->tex = NULL;
+}
+
+
+extern void sage_batch_end(void)
+{
+    sage_assert (batch && batch->open);
+    sage_batch_flush();
+    batch->open = false;
+}
+
+
+extern SAGE_HOT bool sage_batch_active(void)
+{
+    return batch && batch->open;
+}
+
+
+extern SAGE_HOT void sage_batch_flush(void)
+{
+    sage_assert (batch);
+
+    if (sage_likely (batch->len)) {
+        if (!sage_raster_draw(batch->tex, batch->vtx, batch->len))
+            SDL_RenderGeometry(sage_screen_brush(), batch->tex, batch->vtx,
+                    (int) batch->len * 4, batch->idx, (int) batch->len * 6);
+
+        sage_stats_draw(batch->tex, 0.0);
+        batch->len = 0;
+    }
+}
+
+
+extern SAGE_HOT void sage_batch_push(void *tex, struct sage_area_t size,
+        struct sage_point_t nw, struct sage_area_t clip,
+        struct sage_point_t dst, struct sage_area_t proj)
+{
+    sage_assert (batch && batch->open && tex);
+
+    if (batch->tex != tex) {
+        sage_batch_flush();
+        batch->tex = tex;
+    }
+
+    if (sage_unlikely (batch->len == batch->cap))
+        grow();
+
+    const float u0 = nw.x / size.w;
+    const float v0 = nw.y / size.h;
+    const float u1 = (nw.x + clip.w) / size.w;
+    const float v1 = (nw.y + clip.h) / size.h;
+
+    const float x0 = dst.x;
+    const float y0 = dst.y;
+    const float x1 = dst.x + proj.w;
+    const float y1 = dst.y + proj.h;
+
+    const SDL_Color white = { .r = 0xFF, .g = 0xFF, .b = 0xFF, .a = 0xFF };
+    SDL_Vertex *vtx = &batch->vtx[batch->len++ * 4];
+
+    vtx[0] = (SDL_Vertex) { { x0, y0 }, white, { u0, v0 } };
+    vtx[1] = (SDL_Vertex) { { x1, y0 }, white, { u1, v0 } };
+    vtx[2] = (SDL_Vertex) { { x1, y1 }, white, { u1, v1 } };
+    vtx[3] = (SDL_Vertex) { { x0, y1 }, white, { u0, v1 } };
+}
+
@@ -0,0 +1,364 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <string.h>
+#include "graphics.h"
+
+
+/*
+ * Frame capture reads the frame back from the renderer into one of a pool of
+ * pixel buffers, and hands it to an encoder thread that writes it out, so that
+ * the game loop only ever pays for the read-back. A capture is requested with
+ * sage_capture_request() at any point during a frame, and is taken by
+ * sage_capture_run(), which the game loop calls once the frame has been drawn
+ * and before it is presented. If every buffer is still waiting to be encoded,
+ * the capture is dropped rather than stalling the frame.
+ *
+ * Like the texture loader, the capture state is shared with the encoder thread
+ * and so is not thread local; the job queue and the free list are guarded by
+ * the lock, while the pending request is only touched by the render thread.
+ */
+
+
+#define CAPTURE_PATH_MAX ((size_t) 256)
+
+
+struct job {
+    uint8_t *pixels;
+    size_t cap;
+    struct sage_area_t area;
+    enum sage_capture_format_t fmt;
+    char path[CAPTURE_PATH_MAX];
+    struct job *next;
+};
+
+
+struct capture {
+    mtx_t lock;
+    cnd_t work;
+    cnd_t idle;
+    struct job *jobs;
+    struct job *todo;
+    struct job *todo_tail;
+    struct job *spare;
+    size_t busy;
+    thrd_t encoder;
+    bool stop;
+    bool want;
+    enum sage_capture_format_t fmt;
+    char path[CAPTURE_PATH_MAX];
+};
+
+
+static struct capture *capture = NULL;
+
+
+static void file_write(FILE *file, const void *data, size_t len)
+{
+    sage_require (fwrite(data, 1, len, file) == len);
+}
+
+
+static void encode_raw(const struct job *job)
+{
+    FILE *file;
+    sage_require (file = fopen(job->path, "wb"));
+    file_write(file, job->pixels, (size_t) job->area.w * job->area.h * 4);
+    sage_require (!fclose(file));
+}
+
+
+static void encode_png(const struct job *job)
+{
+    SDL_Surface *surf;
+    sage_require (surf = SDL_CreateRGBSurfaceWithFormatFrom(job->pixels,
+                job->area.w, job->area.h, 32, job->area.w * 4,
+                SDL_PIXELFORMAT_ARGB8888));
+
+    sage_require (!IMG_SavePNG(surf, job->path));
+    SDL_FreeSurface(surf);
+}
+
+
+static inline void be32_put(uint8_t *bfr, uint32_t val)
+{
+    bfr[0] = (uint8_t) (val >> 24);
+    bfr[1] = (uint8_t) (val >> 16);
+    bfr[2] = (uint8_t) (val >> 8);
+    bfr[3] = (uint8_t) val;
+}
+
+
+/*
+ * The encode_qoi() helper function writes a frame in the Quite OK Image format
+ * described at https://qoiformat.org/qoi-specification.pdf, which compresses
+ * screenshots well at a small fraction of the cost of PNG.
+ */
+static void encode_qoi(const struct job *job)
+{
+    const size_t len = (size_t) job->area.w * job->area.h;
+    uint8_t *bfr = sage_heap_new(14 + len * 5 + 8);
+    uint8_t *op = bfr;
+
+    memcpy(op, "qoif", 4);
+    be32_put(op + 4, job->area.w);
+    be32_put(op + 8, job->area.h);
+    op[12] = 4;
+    op[13] = 0;
+    op += 14;
+
+    uint32_t index[64] = { 0 };
+    uint32_t prev = 0xFF000000;
+    size_t run = 0;
+
+    for (register size_t i = 0; i < len; i++) {
+        uint32_t px;
+        memcpy(&px, job->pixels + i * 4, sizeof px);
+
+        if (px == prev) {
+            if (++run == 62 || i + 1 == len) {
+                *op++ = (uint8_t) (0xC0 | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run) {
+            *op++ = (uint8_t) (0xC0 | (run - 1));
+            run = 0;
+        }
+
+        const uint8_t a = px >> 24, r = px >> 16, g = px >> 8, b = px;
+        const size_t hash = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+
+        if (index[hash] == px) {
+            *op++ = (uint8_t) hash;
+            prev = px;
+            continue;
+        }
+
+        index[hash] = px;
+
+        if (a == (uint8_t) (prev >> 24)) {
+            const int8_t vr = (int8_t) (r - (uint8_t) (prev >> 16));
+            const int8_t vg = (int8_t) (g - (uint8_t) (prev >> 8));
+            const int8_t vb = (int8_t) (b - (uint8_t) prev);
+            const int8_t vgr = (int8_t) (vr - vg), vgb = (int8_t) (vb - vg);
+
+            if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+                *op++ = (uint8_t) (0x40 | (vr + 2) << 4 | (vg + 2) << 2
+                        | (vb + 2));
+            else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9
+                    && vgb < 8) {
+                *op++ = (uint8_t) (0x80 | (vg + 32));
+                *op++ = (uint8_t) ((vgr + 8) << 4 | (vgb + 8));
+            } else {
+                *op++ = 0xFE;
+                *op++ = r;
+                *op++ = g;
+                *op++ = b;
+            }
+        } else {
+            *op++ = 0xFF;
+            *op++ = r;
+            *op++ = g;
+            *op++ = b;
+            *op++ = a;
+        }
+
+        prev = px;
+    }
+
+    const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    memcpy(op, end, sizeof end);
+    op += sizeof end;
+
+    FILE *file;
+    sage_require (file = fopen(job->path, "wb"));
+    file_write(file, bfr, (size_t) (op - bfr));
+    sage_require (!fclose(file));
+    sage_heap_free((void **) &bfr);
+}
+
+
+static int encoder(void *arg)
+{
+    struct capture *ctx = arg;
+    struct job *job;
+
+    while (true) {
+        mtx_lock(&ctx->lock);
+        while (!ctx->stop && !ctx->todo)
+            cnd_wait(&ctx->work, &ctx->lock);
+
+        if (!ctx->todo) {
+            mtx_unlock(&ctx->lock);
+            return 0;
+        }
+
+        job = ctx->todo;
+        if (!(ctx->todo = job->next))
+            ctx->todo_tail = NULL;
+        mtx_unlock(&ctx->lock);
+
+        switch (job->fmt) {
+            case SAGE_CAPTURE_FORMAT_QOI:
+                encode_qoi(job);
+                break;
+
+            case SAGE_CAPTURE_FORMAT_PNG:
+                encode_png(job);
+                break;
+
+            default:
+                encode_raw(job);
+                break;
+        }
+
+        mtx_lock(&ctx->lock);
+        job->next = ctx->spare;
+        ctx->spare = job;
+        if (!--ctx->busy)
+            cnd_broadcast(&ctx->idle);
+        mtx_unlock(&ctx->lock);
+    }
+}
+
+
+/*
+ * The sage_capture_start() interface function starts frame capture with a pool
+ * of len pixel buffers, which bounds how many captured frames can be waiting to
+ * be encoded at once. The buffers are sized on first use.
+ */
+extern void sage_capture_start(size_t len)
+{
+    if (sage_unlikely (capture))
+        return;
+
+    sage_assert (len);
+    capture = sage_heap_new(sizeof *capture);
+    sage_require (mtx_init(&capture->lock, mtx_plain) == thrd_success);
+    sage_require (cnd_init(&capture->work) == thrd_success);
+    sage_require (cnd_init(&capture->idle) == thrd_success);
+
+    capture->jobs = sage_heap_new(sizeof *capture->jobs * len);
+    capture->spare = NULL;
+    for (register size_t i = 0; i < len; i++) {
+        capture->jobs[i].next = capture->spare;
+        capture->spare = &capture->jobs[i];
+    }
+
+    capture->todo = capture->todo_tail = NULL;
+    capture->busy = 0;
+    capture->stop = capture->want = false;
+
+    sage_require (thrd_create(&capture->encoder, &encoder, capture)
+            == thrd_success);
+}
+
+
+/*
+ * The sage_capture_stop() interface function stops frame capture, after every
+ * frame that has already been captured has been written out.
+ */
+extern void sage_capture_stop(void)
+{
+    if (sage_likely (capture)) {
+        mtx_lock(&capture->lock);
+        capture->stop = true;
+        cnd_broadcast(&capture->work);
+        mtx_unlock(&capture->lock);
+        thrd_join(capture->encoder, NULL);
+
+        for (struct job *itr = capture->spare; itr; itr = itr->next)
+            sage_heap_free((void **) &itr->pixels);
+
+        cnd_destroy(&capture->idle);
+        cnd_destroy(&capture->work);
+        mtx_destroy(&capture->lock);
+
+        sage_heap_free((void **) &capture->jobs);
+        sage_heap_free((void **) &capture);
+    }
+}
+
+
+/*
+ * The sage_capture_request() interface function asks for the frame currently
+ * being drawn to be captured and written to path in the format fmt. Only one
+ * request is held per frame; a later request in the same frame replaces it.
+ */
+extern void sage_capture_request(const char *path,
+        enum sage_capture_format_t fmt)
+{
+    sage_assert (capture && path && *path);
+    sage_assert (strlen(path) < CAPTURE_PATH_MAX);
+
+    strcpy(capture->path, path);
+    capture->fmt = fmt;
+    capture->want = true;
+}
+
+
+/*
+ * The sage_capture_run() interface function takes the capture requested for
+ * the current frame, if any, and queues it for encoding. It returns false if a
+ * capture was requested but dropped because no buffer was free.
+ */
+extern bool sage_capture_run(void)
+{
+    if (sage_likely (!capture || !capture->want))
+        return true;
+
+    capture->want = false;
+
+    mtx_lock(&capture->lock);
+    struct job *job = capture->spare;
+    if (job)
+        capture->spare = job->next;
+    mtx_unlock(&capture->lock);
+
+    if (sage_unlikely (!job))
+        return false;
+
+    job->area = sage_screen_pixels();
+    size_t len = (size_t) job->area.w * job->area.h * 4;
+
+    if (!job->pixels)
+        job->pixels = sage_heap_new(job->cap = len);
+    else if (job->cap < len)
+        job->pixels = sage_heap_resize(job->pixels, job->cap = len);
+
+    sage_screen_read(job->pixels, (size_t) job->area.w * 4);
+    job->fmt = capture->fmt;
+    strcpy(job->path, capture->path);
+    job->next = NULL;
+
+    mtx_lock(&capture->lock);
+    if (capture->todo_tail)
+        capture->todo_tail->next = job;
+    else
+        capture->todo = job;
+    capture->todo_tail = job;
+    capture->busy++;
+    cnd_signal(&capture->work);
+    mtx_unlock(&capture->lock);
+
+    return true;
+}
+
+
+/*
+ * The sage_capture_wait() interface function blocks until every captured frame
+ * has been written out, so that tests can compare the files straight away.
+ */
+extern void sage_capture_wait(void)
+{
+    if (!capture)
+        return;
+
+    mtx_lock(&capture->lock);
+    while (capture->busy)
+        cnd_wait(&capture->idle, &capture->lock);
+    mtx_unlock(&capture->lock);
+}
+
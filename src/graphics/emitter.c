@@ -0,0 +1,292 @@
+#include <SDL2/SDL.h>
+#include <string.h>
+#include "graphics.h"
+
+
+/*
+ * A particle emitter spawns particles at a steady rate from its origin, moves
+ * them under a constant acceleration, and fades and scales them over their
+ * lifetimes. Particle state is held as a structure of arrays, one aligned array
+ * per field, so that the update loops run over contiguous floats with no
+ * branches and can be vectorised by the compiler. The arrays form a ring of cap
+ * slots; new particles take the slot after the last one spawned, so that when
+ * the emitter is full the oldest particle is the one replaced. Dead particles
+ * stay in their slots until then, and are skipped when drawing.
+ *
+ * All the live particles of an emitter are drawn in a single geometry call.
+ * The texture coordinates and indices of the quads never change, and so are
+ * filled in once up front; only positions and colours are written each frame.
+ */
+
+
+#define EMITTER_ALIGN ((size_t) 32)
+
+
+struct sage_emitter_t {
+    struct sage_emitter_opt_t opt;
+    sage_texture *tex;
+    struct sage_area_t size;
+    struct sage_point_t origin;
+    float *restrict x;
+    float *restrict y;
+    float *restrict vx;
+    float *restrict vy;
+    float *restrict age;
+    float *restrict life;
+    size_t len;
+    size_t head;
+    float debt;
+    uint32_t rng;
+    float *xy;
+    SDL_Color *col;
+    float *uv;
+    int *idx;
+    size_t nlive;
+};
+
+
+static float *floats_new(size_t len)
+{
+    size_t sz = (sizeof (float) * len + EMITTER_ALIGN - 1)
+        & ~(EMITTER_ALIGN - 1);
+
+    float *bfr;
+    sage_require (bfr = aligned_alloc(EMITTER_ALIGN, sz));
+    memset(bfr, 0, sz);
+
+    return bfr;
+}
+
+
+static inline float random_range(uint32_t *rng, float min, float max)
+{
+    uint32_t r = *rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    *rng = r;
+
+    return min + (max - min) * ((r >> 8) * (1.0f / 16777216.0f));
+}
+
+
+static inline uint8_t channel(uint32_t rgba, unsigned shift)
+{
+    return (uint8_t) (rgba >> shift);
+}
+
+
+static inline uint8_t channel_lerp(uint32_t from, uint32_t to, unsigned shift,
+        float t)
+{
+    float a = channel(from, shift), b = channel(to, shift);
+    return (uint8_t) (a + (b - a) * t);
+}
+
+
+static void spawn(sage_emitter_t *ctx, size_t n)
+{
+    const struct sage_emitter_opt_t *opt = &ctx->opt;
+
+    for (register size_t i = 0; i < n; i++) {
+        size_t s = ctx->head;
+        ctx->head = ctx->head + 1 < opt->cap ? ctx->head + 1 : 0;
+
+        if (ctx->len < opt->cap)
+            ctx->len++;
+
+        ctx->x[s] = ctx->origin.x;
+        ctx->y[s] = ctx->origin.y;
+        ctx->vx[s] = random_range(&ctx->rng, opt->vel[0].x, opt->vel[1].x);
+        ctx->vy[s] = random_range(&ctx->rng, opt->vel[0].y, opt->vel[1].y);
+        ctx->age[s] = 0.0f;
+        ctx->life[s] = random_range(&ctx->rng, opt->life[0], opt->life[1]);
+    }
+}
+
+
+/*
+ * The sage_emitter_new() interface function creates a new emitter with the
+ * options opt, which are copied. Particles are drawn with the texture that is
+ * registered under opt->texid, at its full size when their scale is 1.
+ */
+extern sage_emitter_t *sage_emitter_new(const struct sage_emitter_opt_t *opt)
+{
+    sage_assert (opt && opt->texid && opt->cap && opt->cap <= INT32_MAX / 6);
+    sage_assert (opt->life[0] > 0.0f && opt->life[0] <= opt->life[1]);
+
+    sage_emitter_t *ctx = sage_heap_new(sizeof *ctx);
+    ctx->opt = *opt;
+    ctx->tex = sage_texture_factory_clone(opt->texid);
+    ctx->size = sage_texture_area(ctx->tex);
+    ctx->origin.x = ctx->origin.y = 0.0f;
+
+    const size_t cap = opt->cap;
+    ctx->x = floats_new(cap);
+    ctx->y = floats_new(cap);
+    ctx->vx = floats_new(cap);
+    ctx->vy = floats_new(cap);
+    ctx->age = floats_new(cap);
+    ctx->life = floats_new(cap);
+
+    ctx->len = ctx->head = ctx->nlive = 0;
+    ctx->debt = 0.0f;
+    ctx->rng = opt->seed ? opt->seed : 0x9E3779B9u;
+
+    ctx->xy = sage_heap_new(sizeof *ctx->xy * cap * 8);
+    ctx->col = sage_heap_new(sizeof *ctx->col * cap * 4);
+    ctx->uv = sage_heap_new(sizeof *ctx->uv * cap * 8);
+    ctx->idx = sage_heap_new(sizeof *ctx->idx * cap * 6);
+
+    float uv[4];
+    sage_texture_uv(ctx->tex, uv);
+
+    for (register size_t i = 0; i < cap; i++) {
+        float *q = &ctx->uv[i * 8];
+        q[0] = uv[0], q[1] = uv[1];
+        q[2] = uv[2], q[3] = uv[1];
+        q[4] = uv[2], q[5] = uv[3];
+        q[6] = uv[0], q[7] = uv[3];
+
+        int *t = &ctx->idx[i * 6];
+        int base = (int) (i * 4);
+        t[0] = base, t[1] = base + 1, t[2] = base + 2;
+        t[3] = base + 2, t[4] = base + 3, t[5] = base;
+    }
+
+    return ctx;
+}
+
+
+extern void sage_emitter_free(sage_emitter_t **ctx)
+{
+    sage_emitter_t *hnd;
+
+    if (sage_likely (ctx && (hnd = *ctx))) {
+        free(hnd->x);
+        free(hnd->y);
+        free(hnd->vx);
+        free(hnd->vy);
+        free(hnd->age);
+        free(hnd->life);
+
+        sage_heap_free((void **) &hnd->xy);
+        sage_heap_free((void **) &hnd->col);
+        sage_heap_free((void **) &hnd->uv);
+        sage_heap_free((void **) &hnd->idx);
+
+        sage_texture_free(&hnd->tex);
+        sage_heap_free((void **) ctx);
+    }
+}
+
+
+extern void sage_emitter_move(sage_emitter_t *ctx, struct sage_point_t origin)
+{
+    sage_assert (ctx);
+    ctx->origin = origin;
+}
+
+
+extern size_t sage_emitter_len(const sage_emitter_t *ctx)
+{
+    sage_assert (ctx);
+    return ctx->nlive;
+}
+
+
+/*
+ * The quads() helper function fills in the positions and colours of the quads
+ * of the live particles of an emitter, packed at the front of its vertex
+ * arrays, and records how many there are.
+ */
+static void quads(sage_emitter_t *ctx)
+{
+    const struct sage_emitter_opt_t *opt = &ctx->opt;
+
+    const float hw = ctx->size.w * 0.5f, hh = ctx->size.h * 0.5f;
+    const float ds = opt->scale[1] - opt->scale[0];
+    size_t n = 0;
+
+    for (register size_t i = 0; i < ctx->len; i++) {
+        if (ctx->age[i] >= ctx->life[i])
+            continue;
+
+        const float t = ctx->age[i] / ctx->life[i];
+        const float s = opt->scale[0] + ds * t;
+        const float x0 = ctx->x[i] - hw * s, x1 = ctx->x[i] + hw * s;
+        const float y0 = ctx->y[i] - hh * s, y1 = ctx->y[i] + hh * s;
+
+        float *q = &ctx->xy[n * 8];
+        q[0] = x0, q[1] = y0;
+        q[2] = x1, q[3] = y0;
+        q[4] = x1, q[5] = y1;
+        q[6] = x0, q[7] = y1;
+
+        SDL_Color c = {
+            .r = channel_lerp(opt->colour[0], opt->colour[1], 24, t),
+            .g = channel_lerp(opt->colour[0], opt->colour[1], 16, t),
+            .b = channel_lerp(opt->colour[0], opt->colour[1], 8, t),
+            .a = channel_lerp(opt->colour[0], opt->colour[1], 0, t)
+        };
+
+        SDL_Color *v = &ctx->col[n * 4];
+        v[0] = v[1] = v[2] = v[3] = c;
+        n++;
+    }
+
+    ctx->nlive = n;
+}
+
+
+/*
+ * The sage_emitter_update() interface function advances an emitter by dt
+ * milliseconds: particles due in that time are spawned, and every particle is
+ * moved and aged. Fractions of a particle carry over between updates, so the
+ * spawn rate holds at any frame rate. The quads of the live particles are then
+ * built, so that drawing leaves the emitter untouched.
+ */
+extern SAGE_HOT void sage_emitter_update(sage_emitter_t *ctx, uint32_t dt)
+{
+    sage_assert (ctx);
+
+    const float sec = dt / 1000.0f;
+    const float ax = ctx->opt.acc.x * sec, ay = ctx->opt.acc.y * sec;
+
+    float *restrict x = ctx->x, *restrict y = ctx->y;
+    float *restrict vx = ctx->vx, *restrict vy = ctx->vy;
+    float *restrict age = ctx->age;
+    const size_t len = ctx->len;
+
+    for (register size_t i = 0; i < len; i++) {
+        vx[i] += ax;
+        vy[i] += ay;
+        x[i] += vx[i] * sec;
+        y[i] += vy[i] * sec;
+        age[i] += sec;
+    }
+
+    ctx->debt += ctx->opt.rate * sec;
+    if (ctx->debt >= 1.0f) {
+        size_t n = (size_t) ctx->debt;
+        ctx->debt -= (float) n;
+        spawn(ctx, n < ctx->opt.cap ? n : ctx->opt.cap);
+    }
+
+    quads(ctx);
+}
+
+
+/*
+ * The sage_emitter_draw() interface function draws the live particles of an
+ * emitter, each centred on its position, in a single geometry call. The quads
+ * are those built by the last update.
+ */
+extern SAGE_HOT void sage_emitter_draw(const sage_emitter_t *ctx)
+{
+    sage_assert (ctx);
+    const size_t n = ctx->nlive;
+
+    sage_texture_draw_geometry(ctx->tex, ctx->xy, ctx->col, ctx->uv, n * 4,
+            ctx->idx, n * 6);
+}
@@ -236,8 +236,39 @@ struct sage_viewport_t {
 };
 
 
+enum sage_screen_backend_t {
+    SAGE_SCREEN_BACKEND_ACCELERATED = 0,
+    SAGE_SCREEN_BACKEND_SOFTWARE
+};
+
+
+enum sage_screen_vsync_t {
+    SAGE_SCREEN_VSYNC_OFF = 0,
+    SAGE_SCREEN_VSYNC_ON,
+    SAGE_SCREEN_VSYNC_ADAPTIVE
+};
+
+
+/*
+ * Options for sage_screen_start(); a zero budget, in microseconds per frame,
+ * disables dynamic resolution, and zero scale bounds default to 0.5 and 1. A
+ * zero limit on frames in flight leaves it to the driver, and late presents
+ * only take effect with vertical sync.
+ */
+struct sage_screen_opt_t {
+    enum sage_screen_backend_t backend;
+    enum sage_screen_vsync_t vsync;
+    uint8_t frames;
+    bool late;
+    uint32_t budget;
+    float scale_min;
+    float scale_max;
+};
+
+
 extern void
-sage_screen_start(const char *title, struct sage_area_t res);
+sage_screen_start(const char *title, struct sage_area_t res,
+                  const struct sage_screen_opt_t *opt);
 
 extern void
 sage_screen_stop(void);
@@ -254,9 +285,190 @@ sage_screen_viewport(void);
 extern SAGE_HOT void
 sage_screen_viewport_set(const struct sage_viewport_t *vp);
 
+extern SAGE_HOT struct sage_area_t
+sage_screen_area(void);
+
+extern SAGE_HOT bool
+sage_screen_visible(struct sage_point_t nw, struct sage_area_t area);
+
+extern void
+sage_screen_target_push(void *tex, struct sage_area_t area);
+
+extern void
+sage_screen_target_pop(void);
+
+extern const void *
+sage_screen_framebuffer(size_t *pitch);
+
+extern SAGE_HOT void *
+sage_screen_direct(struct sage_viewport_t *vp);
+
+extern struct sage_area_t
+sage_screen_pixels(void);
+
+extern void
+sage_screen_read(void *pixels, size_t pitch);
+
+extern float
+sage_screen_scale(void);
+
+extern void
+sage_screen_wait(void);
+
 extern SAGE_HOT void sage_screen_render(void);
 
 
+/******************************************************************************
+ * BATCH
+ */
+
+
+/*
+ * sage_batch_start() - initialise the sprite batch.
+ * See sage/src/graphics/batch.c for details.
+ */
+extern void sage_batch_start(void);
+
+
+/*
+ * sage_batch_stop() - release the sprite batch.
+ * See sage/src/graphics/batch.c for details.
+ */
+extern void sage_batch_stop(void);
+
+
+/*
+ * sage_batch_begin() - start accumulating textured quads.
+ * See sage/src/graphics/batch.c for details.
+ */
+extern void sage_batch_begin(void);
+
+
+/*
+ * sage_batch_end() - flush pending quads and stop accumulating.
+ * See sage/src/graphics/batch.c for details.
+ */
+extern void sage_batch_end(void);
+
+
+/*
+ * sage_batch_active() - check whether quads are being accumulated.
+ * See sage/src/graphics/batch.c for details.
+ */
+extern SAGE_HOT bool sage_batch_active(void);
+
+
+/*
+ * sage_batch_flush() - submit pending quads as one geometry call.
+ * See sage/src/graphics/batch.c for details.
+ */
+extern SAGE_HOT void sage_batch_flush(void);
+
+
+/*
+ * sage_batch_push() - queue a clipped and projected texture quad.
+ * See sage/src/graphics/batch.c for details.
+ */
+extern SAGE_HOT void sage_batch_push(void *tex, struct sage_area_t size,
+        struct sage_point_t nw, struct sage_area_t clip,
+        struct sage_point_t dst, struct sage_area_t proj);
+
+
+
+
+/******************************************************************************
+ * RASTER
+ */
+
+
+/*
+ * sage_raster_start() - start the tile rasteriser of the software backend.
+ * See sage/src/graphics/raster.c for details.
+ */
+extern void sage_raster_start(void);
+
+
+/*
+ * sage_raster_stop() - stop the tile rasteriser and its workers.
+ * See sage/src/graphics/raster.c for details.
+ */
+extern void sage_raster_stop(void);
+
+
+/*
+ * sage_raster_draw() - draw batched quads straight into the framebuffer.
+ * See sage/src/graphics/raster.c for details.
+ */
+extern SAGE_HOT bool sage_raster_draw(void *tex, const void *vtx, size_t len);
+
+
+
+
+/******************************************************************************
+ * QUEUE
+ */
+
+
+/*
+ * sage_queue_start() - initialise the draw queue.
+ * See sage/src/graphics/queue.c for details.
+ */
+extern void sage_queue_start(void);
+
+
+/*
+ * sage_queue_stop() - release the draw queue.
+ * See sage/src/graphics/queue.c for details.
+ */
+extern void sage_queue_stop(void);
+
+
+/*
+ * sage_queue_begin() - start queueing quads for sorting.
+ * See sage/src/graphics/queue.c for details.
+ */
+extern void sage_queue_begin(void);
+
+
+/*
+ * sage_queue_end() - flush sorted quads and stop queueing.
+ * See sage/src/graphics/queue.c for details.
+ */
+extern void sage_queue_end(void);
+
+
+/*
+ * sage_queue_active() - check whether quads are being queued.
+ * See sage/src/graphics/queue.c for details.
+ */
+extern SAGE_HOT bool sage_queue_active(void);
+
+
+/*
+ * sage_queue_context() - set layer, depth and material of queued quads.
+ * See sage/src/graphics/queue.c for details.
+ */
+extern SAGE_HOT void sage_queue_context(uint8_t layer, float depth,
+        uint8_t material);
+
+
+/*
+ * sage_queue_push() - queue a textured quad for sorting.
+ * See sage/src/graphics/queue.c for details.
+ */
+extern SAGE_HOT void sage_queue_push(uint32_t tkey, void *tex,
+        struct sage_area_t size, struct sage_point_t nw,
+        struct sage_area_t clip, struct sage_point_t dst,
+        struct sage_area_t proj);
+
+
+/*
+ * sage_queue_flush() - sort queued quads and push them into the batch.
+ * See sage/src/graphics/queue.c for details.
+ */
+extern SAGE_HOT void sage_queue_flush(void);
+
+
 
 
 /******************************************************************************
@@ -274,6 +486,38 @@ typedef sage_object sage_texture;
 extern sage_texture *sage_texture_new(sage_id texid, const char *path);
 
 
+/*
+ * sage_texture_new_surface() - create new texture from an SDL surface.
+ * See sage/src/graphics/texture.c for details.
+ */
+extern sage_texture *sage_texture_new_surface(sage_id texid, void *surf);
+
+
+/*
+ * sage_texture_new_pixels() - create new texture from raw pixels.
+ * See sage/src/graphics/texture.c for details.
+ */
+extern sage_texture *sage_texture_new_pixels(sage_id texid, const void *pixels,
+        struct sage_area_t area, size_t pitch, uint32_t fmt);
+
+
+/*
+ * sage_texture_new_target() - create new blank texture that can be drawn into.
+ * See sage/src/graphics/texture.c for details.
+ */
+extern sage_texture *sage_texture_new_target(sage_id texid,
+        struct sage_area_t area);
+
+
+/*
+ * sage_texture_new_region() - create texture sharing part of another texture.
+ * See sage/src/graphics/texture.c for details.
+ */
+extern sage_texture *sage_texture_new_region(sage_id texid,
+        const sage_texture *src, struct sage_point_t nw,
+        struct sage_area_t area);
+
+
 /*
  * sage_texture_copy() - copy a texture.
  */
@@ -339,14 +583,250 @@ extern void sage_texture_reset(sage_texture **ctx);
 extern void sage_texture_draw(const sage_texture *ctx, struct sage_point_t dst);
 
 
+/*
+ * sage_texture_draw_clip() - draw clipped and projected texture to screen.
+ * See sage/src/graphics/texture.c for details.
+ */
+extern SAGE_HOT void sage_texture_draw_clip(const sage_texture *ctx,
+        struct sage_point_t nw, struct sage_area_t clip,
+        struct sage_area_t proj, struct sage_point_t dst);
+
+
+/*
+ * sage_texture_uv() - get normalised texture coordinates of a texture.
+ * See sage/src/graphics/texture.c for details.
+ */
+extern void sage_texture_uv(const sage_texture *ctx, float uv[4]);
+
+
+/*
+ * sage_texture_draw_geometry() - draw textured triangles in one call.
+ * See sage/src/graphics/texture.c for details.
+ */
+extern SAGE_HOT void sage_texture_draw_geometry(const sage_texture *ctx,
+        const float *xy, const void *col, const float *uv, size_t nvtx,
+        const int *idx, size_t nidx);
+
+
+/*
+ * sage_texture_target_begin() - start drawing into a target texture.
+ * See sage/src/graphics/texture.c for details.
+ */
+extern void sage_texture_target_begin(const sage_texture *ctx);
+
+
+/*
+ * sage_texture_target_end() - stop drawing into a target texture.
+ * See sage/src/graphics/texture.c for details.
+ */
+extern void sage_texture_target_end(void);
+
+
 extern void sage_texture_factory_init(void);
 
 extern void sage_texture_factory_exit(void);
 
 extern void sage_texture_factory_register(sage_id id, const char *path);
 
+extern void sage_texture_factory_register_texture(const sage_texture *tex);
+
 extern sage_texture *sage_texture_factory_clone(sage_id id);
 
+extern void sage_texture_factory_register_async(sage_id id, const char *path);
+
+extern bool sage_texture_factory_ready(sage_id id);
+
+extern void sage_texture_factory_wait(sage_id id);
+
+extern size_t sage_texture_factory_upload(uint32_t budget);
+
+extern void sage_texture_loader_start(void);
+
+extern void sage_texture_loader_stop(void);
+
+
+/******************************************************************************
+ * TEXTURE PACK
+ */
+
+
+typedef struct sage_texture_pack_t sage_texture_pack_t;
+
+
+/*
+ * sage_texture_pack_open() - map a baked texture pack into memory.
+ * See sage/src/graphics/texture-pack.c for details.
+ */
+extern sage_texture_pack_t *sage_texture_pack_open(const char *path);
+
+
+/*
+ * sage_texture_pack_close() - unmap a texture pack.
+ * See sage/src/graphics/texture-pack.c for details.
+ */
+extern void sage_texture_pack_close(sage_texture_pack_t **ctx);
+
+
+/*
+ * sage_texture_pack_len() - get number of textures in a texture pack.
+ * See sage/src/graphics/texture-pack.c for details.
+ */
+extern size_t sage_texture_pack_len(const sage_texture_pack_t *ctx);
+
+
+/*
+ * sage_texture_pack_texture() - create texture from a texture pack.
+ * See sage/src/graphics/texture-pack.c for details.
+ */
+extern sage_texture *sage_texture_pack_texture(const sage_texture_pack_t *ctx,
+        sage_id id);
+
+
+/*
+ * sage_texture_pack_register() - register all textures in a texture pack.
+ * See sage/src/graphics/texture-pack.c for details.
+ */
+extern void sage_texture_pack_register(const sage_texture_pack_t *ctx);
+
+
+/*
+ * sage_texture_pack_write() - bake images into a texture pack.
+ * See sage/src/graphics/texture-pack.c for details.
+ */
+extern void sage_texture_pack_write(const char *path, size_t len,
+        const sage_id *ids, const char *const *srcs, bool lz4);
+
+
+/******************************************************************************
+ * ATLAS
+ */
+
+
+/*
+ * sage_atlas_start() - initialise the texture atlas builder.
+ * See sage/src/graphics/atlas.c for details.
+ */
+extern void sage_atlas_start(struct sage_area_t page, uint16_t pad);
+
+
+/*
+ * sage_atlas_stop() - release the texture atlas and its pages.
+ * See sage/src/graphics/atlas.c for details.
+ */
+extern void sage_atlas_stop(void);
+
+
+/*
+ * sage_atlas_add() - queue an image for packing.
+ * See sage/src/graphics/atlas.c for details.
+ */
+extern void sage_atlas_add(sage_id id, const char *path);
+
+
+/*
+ * sage_atlas_pack() - pack queued images into atlas pages.
+ * See sage/src/graphics/atlas.c for details.
+ */
+extern size_t sage_atlas_pack(void);
+
+
+/*
+ * sage_atlas_save() - write baked atlas pages and metadata.
+ * See sage/src/graphics/atlas.c for details.
+ */
+extern void sage_atlas_save(const char *stem);
+
+
+/*
+ * sage_atlas_load() - read baked atlas pages and metadata.
+ * See sage/src/graphics/atlas.c for details.
+ */
+extern void sage_atlas_load(const char *stem);
+
+
+/*
+ * sage_atlas_register() - upload atlas pages and register their textures.
+ * See sage/src/graphics/atlas.c for details.
+ */
+extern void sage_atlas_register(void);
+
+
+/******************************************************************************
+ * TILEMAP
+ */
+
+
+typedef sage_object sage_tilemap;
+
+
+/*
+ * sage_tilemap_new() - create new tilemap of empty tiles.
+ * See sage/src/graphics/tilemap.c for details.
+ */
+extern sage_tilemap *sage_tilemap_new(sage_id id, sage_id texid,
+        struct sage_area_t tile, struct sage_area_t len);
+
+
+/*
+ * sage_tilemap_copy() - copy a tilemap.
+ */
+inline sage_tilemap *sage_tilemap_copy(const sage_tilemap *ctx)
+{
+    sage_assert (ctx);
+    return sage_object_copy(ctx);
+}
+
+
+/*
+ * sage_tilemap_free() - release tilemap from heap.
+ */
+inline void sage_tilemap_free(sage_tilemap **ctx)
+{
+    sage_object_free(ctx);
+}
+
+
+/*
+ * sage_tilemap_id() - get ID of tilemap.
+ */
+inline sage_id sage_tilemap_id(const sage_tilemap *ctx)
+{
+    sage_assert (ctx);
+    return sage_object_id(ctx);
+}
+
+
+/*
+ * sage_tilemap_len() - get number of tiles across and down a tilemap.
+ * See sage/src/graphics/tilemap.c for details.
+ */
+extern struct sage_area_t sage_tilemap_len(const sage_tilemap *ctx);
+
+
+/*
+ * sage_tilemap_tile() - get tile at a column and row of a tilemap.
+ * See sage/src/graphics/tilemap.c for details.
+ */
+extern uint16_t sage_tilemap_tile(const sage_tilemap *ctx, uint16_t col,
+        uint16_t row);
+
+
+/*
+ * sage_tilemap_tile_set() - set tile at a column and row of a tilemap.
+ * See sage/src/graphics/tilemap.c for details.
+ */
+extern void sage_tilemap_tile_set(sage_tilemap **ctx, uint16_t col,
+        uint16_t row, uint16_t tile);
+
+
+/*
+ * sage_tilemap_draw() - draw visible chunks of a tilemap to screen.
+ * See sage/src/graphics/tilemap.c for details.
+ */
+extern SAGE_HOT void sage_tilemap_draw(const sage_tilemap *ctx,
+        struct sage_point_t dst);
+
+
 struct sage_frame_t {
     uint16_t r;
     uint16_t c;
@@ -380,6 +860,16 @@ extern void sage_sprite_frame(sage_sprite **ctx, struct sage_frame_t frm);
 
 extern struct sage_frame_t sage_sprite_frames(const sage_sprite *ctx);
 
+extern struct sage_frame_t sage_sprite_frame_current(const sage_sprite *ctx);
+
+extern size_t sage_sprite_image_size(void);
+
+extern void sage_sprite_image(void *img, const sage_sprite *ctx);
+
+extern sage_sprite *sage_sprite_image_fix(void *img, const sage_sprite *cls);
+
+extern struct sage_area_t sage_sprite_projection(const sage_sprite *ctx);
+
 extern void sage_sprite_clip(sage_sprite **ctx, struct sage_point_t nw,
         struct sage_area_t clip);
 
@@ -389,6 +879,371 @@ extern void sage_sprite_reset(sage_sprite **ctx);
 
 extern void sage_sprite_draw(const sage_sprite *ctx, struct sage_point_t dst);
 
+extern SAGE_HOT void sage_sprite_draw_frame(const sage_sprite *ctx,
+        struct sage_frame_t frm, struct sage_point_t dst);
+
+
+/******************************************************************************
+ * ANIMATION
+ */
+
+
+enum sage_animation_loop_t {
+    SAGE_ANIMATION_LOOP_ONCE = 0,
+    SAGE_ANIMATION_LOOP_REPEAT,
+    SAGE_ANIMATION_LOOP_PINGPONG
+};
+
+
+/*
+ * The point a playing instance has reached in its clip, as saved by
+ * sage_animation_state() and resumed by sage_animation_resume().
+ */
+struct sage_animation_state_t {
+    sage_id clip;
+    uint32_t time;
+    uint16_t idx;
+    int8_t dir;
+    bool done;
+};
+
+
+/*
+ * sage_animation_start() - initialise the animation system.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern void sage_animation_start(void);
+
+
+/*
+ * sage_animation_stop() - release the animation system and its clips.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern void sage_animation_stop(void);
+
+
+/*
+ * sage_animation_clip() - define an animation clip.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern void sage_animation_clip(sage_id id, const struct sage_frame_t *frms,
+        const uint32_t *durs, uint32_t dur, uint16_t len,
+        enum sage_animation_loop_t loop);
+
+
+/*
+ * sage_animation_play() - start playing an instance of a clip.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern size_t sage_animation_play(sage_id id);
+
+
+/*
+ * sage_animation_clone() - start a copy of a playing instance.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern size_t sage_animation_clone(size_t hnd);
+
+
+/*
+ * sage_animation_state() - get the point an instance has reached.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern struct sage_animation_state_t sage_animation_state(size_t hnd);
+
+
+/*
+ * sage_animation_resumable() - check that a saved point can be resumed.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern bool sage_animation_resumable(const struct sage_animation_state_t *state);
+
+
+/*
+ * sage_animation_resume() - start an instance from a saved point.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern size_t sage_animation_resume(const struct sage_animation_state_t *state);
+
+
+/*
+ * sage_animation_halt() - stop a playing instance and release its handle.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern void sage_animation_halt(size_t hnd);
+
+
+/*
+ * sage_animation_done() - check whether a play-once instance has ended.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern bool sage_animation_done(size_t hnd);
+
+
+/*
+ * sage_animation_frame() - get the current frame of an instance.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern SAGE_HOT struct sage_frame_t sage_animation_frame(size_t hnd);
+
+
+/*
+ * sage_animation_advance() - move all playing instances forward in time.
+ * See sage/src/graphics/animation.c for details.
+ */
+extern SAGE_HOT void sage_animation_advance(uint32_t dt);
+
+
+/******************************************************************************
+ * EMITTER
+ */
+
+
+/*
+ * Options for sage_emitter_new(); the rate is in particles per second, the
+ * lifetime range in seconds, velocities in pixels per second and acceleration
+ * in pixels per second squared. Scales and colours, the latter packed as
+ * 0xRRGGBBAA, are interpolated from the first value at birth to the second at
+ * death. A zero seed picks a fixed default.
+ */
+struct sage_emitter_opt_t {
+    sage_id texid;
+    size_t cap;
+    float rate;
+    float life[2];
+    struct sage_point_t vel[2];
+    struct sage_point_t acc;
+    float scale[2];
+    uint32_t colour[2];
+    uint32_t seed;
+};
+
+
+typedef struct sage_emitter_t sage_emitter_t;
+
+
+/*
+ * sage_emitter_new() - create new particle emitter.
+ * See sage/src/graphics/emitter.c for details.
+ */
+extern sage_emitter_t *sage_emitter_new(const struct sage_emitter_opt_t *opt);
+
+
+/*
+ * sage_emitter_free() - release particle emitter from heap.
+ * See sage/src/graphics/emitter.c for details.
+ */
+extern void sage_emitter_free(sage_emitter_t **ctx);
+
+
+/*
+ * sage_emitter_move() - move the point particles are spawned from.
+ * See sage/src/graphics/emitter.c for details.
+ */
+extern void sage_emitter_move(sage_emitter_t *ctx, struct sage_point_t origin);
+
+
+/*
+ * sage_emitter_len() - get number of live particles as of the last update.
+ * See sage/src/graphics/emitter.c for details.
+ */
+extern size_t sage_emitter_len(const sage_emitter_t *ctx);
+
+
+/*
+ * sage_emitter_update() - spawn, move and age particles.
+ * See sage/src/graphics/emitter.c for details.
+ */
+extern SAGE_HOT void sage_emitter_update(sage_emitter_t *ctx, uint32_t dt);
+
+
+/*
+ * sage_emitter_draw() - draw live particles in one call.
+ * See sage/src/graphics/emitter.c for details.
+ */
+extern SAGE_HOT void sage_emitter_draw(const sage_emitter_t *ctx);
+
+
+/******************************************************************************
+ * TEXT
+ */
+
+
+typedef struct sage_font_t sage_font_t;
+
+
+/*
+ * sage_font_new() - create new bitmap font from a glyph sheet.
+ * See sage/src/graphics/text.c for details.
+ */
+extern sage_font_t *sage_font_new(sage_id texid, struct sage_area_t glyph,
+        uint8_t first, uint8_t count);
+
+
+/*
+ * sage_font_free() - release font and its atlases from heap.
+ * See sage/src/graphics/text.c for details.
+ */
+extern void sage_font_free(sage_font_t **ctx);
+
+
+/*
+ * sage_font_measure() - get area taken up by a string drawn with a font.
+ * See sage/src/graphics/text.c for details.
+ */
+extern struct sage_area_t sage_font_measure(const sage_font_t *ctx,
+        const sage_string_t *str, uint16_t size);
+
+
+/*
+ * sage_text_draw() - draw a string with a font.
+ * See sage/src/graphics/text.c for details.
+ */
+extern SAGE_HOT void sage_text_draw(sage_font_t *ctx, const sage_string_t *str,
+        uint16_t size, struct sage_point_t dst);
+
+
+/******************************************************************************
+ * CAPTURE
+ */
+
+
+enum sage_capture_format_t {
+    SAGE_CAPTURE_FORMAT_RAW = 0,
+    SAGE_CAPTURE_FORMAT_QOI,
+    SAGE_CAPTURE_FORMAT_PNG
+};
+
+
+/*
+ * sage_capture_start() - start frame capture with a pool of buffers.
+ * See sage/src/graphics/capture.c for details.
+ */
+extern void sage_capture_start(size_t len);
+
+
+/*
+ * sage_capture_stop() - stop frame capture once pending frames are written.
+ * See sage/src/graphics/capture.c for details.
+ */
+extern void sage_capture_stop(void);
+
+
+/*
+ * sage_capture_request() - request capture of the current frame.
+ * See sage/src/graphics/capture.c for details.
+ */
+extern void sage_capture_request(const char *path,
+        enum sage_capture_format_t fmt);
+
+
+/*
+ * sage_capture_run() - take the requested capture of the current frame.
+ * See sage/src/graphics/capture.c for details.
+ */
+extern bool sage_capture_run(void);
+
+
+/*
+ * sage_capture_wait() - wait until captured frames have been written.
+ * See sage/src/graphics/capture.c for details.
+ */
+extern void sage_capture_wait(void);
+
+
+/******************************************************************************
+ * STATS
+ */
+
+
+struct sage_stats_t {
+    double draws;
+    double switches;
+    double sprites;
+    double culled;
+    double pixels;
+    double overdraw;
+    double targets;
+};
+
+
+/*
+ * sage_stats_start() - start counting render statistics.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern void sage_stats_start(void);
+
+
+/*
+ * sage_stats_stop() - stop counting render statistics.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern void sage_stats_stop(void);
+
+
+/*
+ * sage_stats_draw() - record a call to the renderer.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern SAGE_HOT void sage_stats_draw(const void *tex, double pixels);
+
+
+/*
+ * sage_stats_geometry() - record a geometry call to the renderer.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern SAGE_HOT void sage_stats_geometry(const void *tex, const float *xy,
+        const int *idx, size_t nidx);
+
+
+/*
+ * sage_stats_sprite() - record a submitted or culled sprite.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern SAGE_HOT void sage_stats_sprite(struct sage_area_t proj, bool visible);
+
+
+/*
+ * sage_stats_cull() - record sprites culled before being drawn.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern SAGE_HOT void sage_stats_cull(size_t len);
+
+
+/*
+ * sage_stats_target() - record a render target switch.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern void sage_stats_target(void);
+
+
+/*
+ * sage_stats_frame() - close the counts of the current frame.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern void sage_stats_frame(struct sage_area_t area);
+
+
+/*
+ * sage_stats_last() - get the counts of the last frame.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern struct sage_stats_t sage_stats_last(void);
+
+
+/*
+ * sage_stats_average() - get the counts averaged over recent frames.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern struct sage_stats_t sage_stats_average(void);
+
+
+/*
+ * sage_stats_reset() - discard all counts.
+ * See sage/src/graphics/stats.c for details.
+ */
+extern void sage_stats_reset(void);
+
 
 #endif /* SCHEME_ASSISTED_GAME_ENGINE_GRAPHICS_HEADER */
 
@@ -0,0 +1,235 @@
+#include <string.h>
+#include "graphics.h"
+
+
+/*
+ * The draw queue collects textured quads along with a 64-bit sort key, and
+ * sorts them before handing them over to the sprite batch. The key is made up
+ * of, from the most significant bits down, the layer, the depth, the texture
+ * and the material of the quad, so that quads are drawn in painter's order by
+ * layer and depth, and quads that tie on those are grouped by texture so that
+ * the batch can submit them together. The layer, depth and material come from
+ * the context set with sage_queue_context() by whoever is drawing, usually an
+ * entity, and the texture is filled in by the texture being drawn.
+ *
+ * The keys are sorted with a stable LSD radix sort, one byte at a time, so
+ * quads with equal keys stay in the order in which they were queued. Passes
+ * over bytes that are the same for every key are skipped, so that sorting a
+ * frame in which most keys share their high bits is cheap.
+ */
+
+
+#define QUEUE_LEN ((size_t) 1024)
+#define QUEUE_DEPTH_BIAS 8388608.0f
+#define QUEUE_DEPTH_MAX 16777215.0f
+
+
+struct item {
+    void *tex;
+    struct sage_area_t size;
+    struct sage_point_t nw;
+    struct sage_area_t clip;
+    struct sage_point_t dst;
+    struct sage_area_t proj;
+};
+
+
+struct entry {
+    uint64_t key;
+    size_t idx;
+};
+
+
+static thread_local struct {
+    struct item *items;
+    struct entry *ents;
+    struct entry *tmp;
+    size_t len;
+    size_t cap;
+    uint64_t ctx;
+    bool open;
+} *queue = NULL;
+
+
+static void grow(void)
+{
+    queue->cap *= 2;
+
+    queue->items = sage_heap_resize(queue->items,
+            sizeof *queue->items * queue->cap);
+    queue->ents = sage_heap_resize(queue->ents,
+            sizeof *queue->ents * queue->cap);
+    queue->tmp = sage_heap_resize(queue->tmp, sizeof *queue->tmp * queue->cap);
+}
+
+
+static void sort(void)
+{
+    size_t hist[8][256];
+    memset(hist, 0, sizeof hist);
+
+    for (register size_t i = 0; i < queue->len; i++) {
+        uint64_t key = queue->ents[i].key;
+
+        for (register size_t b = 0; b < 8; b++)
+            hist[b][(key >> (b * 8)) & 0xFF]++;
+    }
+
+    for (register size_t b = 0; b < 8; b++) {
+        uint64_t byte = (queue->ents[0].key >> (b * 8)) & 0xFF;
+
+        if (hist[b][byte] == queue->len)
+            continue;
+
+        size_t off = 0;
+        for (register size_t i = 0; i < 256; i++) {
+            size_t n = hist[b][i];
+            hist[b][i] = off;
+            off += n;
+        }
+
+        for (register size_t i = 0; i < queue->len; i++) {
+            const struct entry *ent = &queue->ents[i];
+            queue->tmp[hist[b][(ent->key >> (b * 8)) & 0xFF]++] = *ent;
+        }
+
+        struct entry *swap = queue->ents;
+        queue->ents = queue->tmp;
+        queue->tmp = swap;
+    }
+}
+
+
+extern void sage_queue_start(void)
+{
+    if (sage_unlikely (queue))
+        return;
+
+    queue = sage_heap_new(sizeof *queue);
+    queue->cap = QUEUE_LEN;
+    queue->items = sage_heap_new(sizeof *queue->items * queue->cap);
+    queue->ents = sage_heap_new(sizeof *queue->ents * queue->cap);
+    queue->tmp = sage_heap_new(sizeof *queue->tmp * queue->cap);
+    queue->len = 0;
+    queue->ctx = 0;
+    queue->open = false;
+}
+
+
+extern void sage_queue_stop(void)
+{
+    if (sage_likely (queue)) {
+        sage_heap_free((void **) &queue->items);
+        sage_heap_free((void **) &queue->ents);
+        sage_heap_free((void **) &queue->tmp);
+        sage_heap_free((void **) &queue);
+    }
+}
+
+
+/*
+ * The sage_queue_begin() interface function starts queueing quads for sorting
+ * instead of drawing them as they come. It can only be called while the sprite
+ * batch is accumulating quads, since the sorted quads are pushed into it.
+ */
+extern void sage_queue_begin(void)
+{
+    sage_assert (queue && !queue->open && sage_batch_active());
+    queue->open = true;
+    queue->len = 0;
+    queue->ctx = 0;
+}
+
+
+extern void sage_queue_end(void)
+{
+    sage_assert (queue && queue->open);
+    sage_queue_flush();
+    queue->open = false;
+}
+
+
+extern SAGE_HOT bool sage_queue_active(void)
+{
+    return queue && queue->open;
+}
+
+
+/*
+ * The sage_queue_context() interface function sets the layer, depth and
+ * material of the quads queued from here on. The depth is usually the vertical
+ * position of what is being drawn, so that things lower down the screen are
+ * drawn over those above them; it is biased and clamped to 24 bits, which is
+ * exact for any whole pixel position within about eight million pixels of the
+ * origin.
+ */
+extern SAGE_HOT void sage_queue_context(uint8_t layer, float depth,
+        uint8_t material)
+{
+    sage_assert (queue);
+
+    float d = depth + QUEUE_DEPTH_BIAS;
+    if (sage_unlikely (d < 0.0f))
+        d = 0.0f;
+    else if (sage_unlikely (d > QUEUE_DEPTH_MAX))
+        d = QUEUE_DEPTH_MAX;
+
+    queue->ctx = (uint64_t) layer << 56 | (uint64_t) d << 32
+        | (uint64_t) material;
+}
+
+
+/*
+ * The sage_queue_push() interface function queues a quad that would otherwise
+ * have been pushed straight into the sprite batch; the arguments after tex are
+ * those of sage_batch_push(). The texture key tkey is a number that is the same
+ * for all quads drawn from the same texture, and that fits in 24 bits. The quad
+ * is recorded by value, but the texture must stay alive until the queue has
+ * been flushed.
+ */
+extern SAGE_HOT void sage_queue_push(uint32_t tkey, void *tex,
+        struct sage_area_t size, struct sage_point_t nw,
+        struct sage_area_t clip, struct sage_point_t dst,
+        struct sage_area_t proj)
+{
+    sage_assert (queue && queue->open && tex);
+
+    if (sage_unlikely (queue->len == queue->cap))
+        grow();
+
+    struct item *item = &queue->items[queue->len];
+    item->tex = tex;
+    item->size = size;
+    item->nw = nw;
+    item->clip = clip;
+    item->dst = dst;
+    item->proj = proj;
+
+    struct entry *ent = &queue->ents[queue->len];
+    ent->key = queue->ctx | (uint64_t) (tkey & 0xFFFFFF) << 8;
+    ent->idx = queue->len++;
+}
+
+
+/*
+ * The sage_queue_flush() interface function sorts the queued quads and pushes
+ * them into the sprite batch in order, leaving the queue empty.
+ */
+extern SAGE_HOT void sage_queue_flush(void)
+{
+    sage_assert (queue);
+
+    if (sage_unlikely (!queue->len))
+        return;
+
+    sort();
+
+    for (register size_t i = 0; i < queue->len; i++) {
+        const struct item *item = &queue->items[queue->ents[i].idx];
+        sage_batch_push(item->tex, item->size, item->nw, item->clip,
+                item->dst, item->proj);
+    }
+
+    queue->len = 0;
+}
+
@@ -0,0 +1,393 @@
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <unistd.h>
+#include "graphics.h"
+
+
+/*
+ * The software backend draws the quads of the sprite batch straight into its
+ * framebuffer rather than through SDL's software renderer, which draws on one
+ * thread only. The rows of the framebuffer are split into tiles, and the tiles
+ * are shared out between the render thread and a pool of workers. Every tile
+ * goes through all the quads of a batch in the order they were pushed, but only
+ * writes to its own rows, so quads still land over one another in order and no
+ * two threads ever touch the same pixel.
+ *
+ * Only what the batch produces is drawn this way: axis aligned quads, untinted,
+ * from textures whose pixels are kept in an ARGB8888 surface attached to them
+ * as user data, and with either no blending or ordinary alpha blending. A pixel
+ * is covered when its centre lies inside the quad, and takes the texel under
+ * that centre, as with SDL's own software renderer. Anything else, including
+ * every draw into a render target or into the frame texture of dynamic
+ * resolution, goes through SDL as before.
+ *
+ * The rasteriser is shared by the render thread and the workers, and so like
+ * the texture loader it is not thread local. The render thread posts a batch
+ * under the lock, takes tiles along with the workers, and waits until every
+ * tile has been drawn before it returns; the batch is only read while that is
+ * going on. Batches that cover too few pixels to be worth waking the workers
+ * for are drawn on the render thread alone.
+ */
+
+
+#define RASTER_WORKERS_MAX ((size_t) 8)
+#define RASTER_TILE_ROWS 16
+#define RASTER_PARALLEL_MIN ((uint64_t) 16384)
+#define RASTER_QUADS_LEN ((size_t) 256)
+
+
+/*
+ * A quad as it is drawn: the rows and columns of the framebuffer it covers,
+ * already clipped, the texel coordinates under the centre of its first pixel
+ * and their step from one pixel to the next, both in 16.16 fixed point, and the
+ * bounds of the texels it may sample.
+ */
+struct quad {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+    int64_t u;
+    int64_t v;
+    int64_t du;
+    int64_t dv;
+    int sx0;
+    int sy0;
+    int sx1;
+    int sy1;
+};
+
+
+struct raster {
+    mtx_t lock;
+    cnd_t work;
+    cnd_t done;
+    thrd_t workers[RASTER_WORKERS_MAX];
+    size_t nworkers;
+    bool stop;
+    size_t next;
+    size_t ntiles;
+    size_t left;
+    SDL_Surface *dst;
+    const SDL_Surface *src;
+    bool blend;
+    int top;
+    struct quad *quads;
+    size_t len;
+    size_t cap;
+};
+
+
+static struct raster *raster = NULL;
+
+
+/*
+ * The div255() helper function divides each of the 16-bit lanes of x by 255,
+ * rounding to nearest; a lane must not exceed 255 * 255.
+ */
+static inline uint32_t div255(uint32_t x)
+{
+    x += 0x00800080;
+    return ((x + ((x >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+}
+
+
+/*
+ * The pixel_blend() helper function blends the ARGB8888 pixel src over dst,
+ * working on two channels at a time: red and blue, then alpha and green.
+ */
+static inline uint32_t pixel_blend(uint32_t src, uint32_t dst)
+{
+    const uint32_t a = src >> 24;
+
+    if (sage_likely (a == 0xFF))
+        return src;
+
+    if (!a)
+        return dst;
+
+    const uint32_t na = 0xFF - a;
+    const uint32_t rb = div255((src & 0x00FF00FF) * a
+            + (dst & 0x00FF00FF) * na);
+    const uint32_t ag = div255((0x00FF0000 | ((src >> 8) & 0xFF)) * a
+            + ((dst >> 8) & 0x00FF00FF) * na);
+
+    return ag << 8 | rb;
+}
+
+
+/*
+ * The tile_draw() helper function draws the rows of the tile tile of the batch
+ * posted to ctx.
+ */
+static void tile_draw(const struct raster *ctx, size_t tile)
+{
+    const int top = ctx->top + (int) tile * RASTER_TILE_ROWS;
+    const int bottom = top + RASTER_TILE_ROWS;
+    const SDL_Surface *src = ctx->src;
+    SDL_Surface *dst = ctx->dst;
+
+    for (register size_t i = 0; i < ctx->len; i++) {
+        const struct quad *q = &ctx->quads[i];
+        const int y0 = q->y0 > top ? q->y0 : top;
+        const int y1 = q->y1 < bottom ? q->y1 : bottom;
+
+        for (register int y = y0; y < y1; y++) {
+            int sy = (int) ((q->v + (y - q->y0) * q->dv) >> 16);
+            sy = sy < q->sy0 ? q->sy0 : sy > q->sy1 ? q->sy1 : sy;
+
+            const uint32_t *in = (const uint32_t *) ((const uint8_t *)
+                    src->pixels + (size_t) sy * src->pitch);
+            uint32_t *out = (uint32_t *) ((uint8_t *) dst->pixels
+                    + (size_t) y * dst->pitch);
+            int64_t u = q->u;
+
+            for (register int x = q->x0; x < q->x1; x++, u += q->du) {
+                int sx = (int) (u >> 16);
+                sx = sx < q->sx0 ? q->sx0 : sx > q->sx1 ? q->sx1 : sx;
+                out[x] = ctx->blend ? pixel_blend(in[sx], out[x]) : in[sx];
+            }
+        }
+    }
+}
+
+
+/*
+ * The tiles_take() helper function draws tiles of the posted batch until there
+ * are none left to take. It is called with the lock held, and releases it
+ * while drawing.
+ */
+static void tiles_take(struct raster *ctx)
+{
+    while (ctx->next < ctx->ntiles) {
+        const size_t tile = ctx->next++;
+        mtx_unlock(&ctx->lock);
+
+        tile_draw(ctx, tile);
+
+        mtx_lock(&ctx->lock);
+        if (!--ctx->left)
+            cnd_signal(&ctx->done);
+    }
+}
+
+
+static int worker(void *arg)
+{
+    struct raster *ctx = arg;
+
+    mtx_lock(&ctx->lock);
+
+    while (true) {
+        while (!ctx->stop && ctx->next == ctx->ntiles)
+            cnd_wait(&ctx->work, &ctx->lock);
+
+        if (ctx->stop)
+            break;
+
+        tiles_take(ctx);
+    }
+
+    mtx_unlock(&ctx->lock);
+    return 0;
+}
+
+
+/*
+ * The quad_clip() helper function works out how the quad with its corners at
+ * the vertices nw and se is drawn through the viewport vp of the framebuffer
+ * dst from the texture pixels src, and returns the number of pixels it covers,
+ * which is zero if it falls outside the viewport.
+ */
+static uint64_t quad_clip(struct quad *q, const SDL_Vertex *nw,
+        const SDL_Vertex *se, const struct sage_viewport_t *vp,
+        const SDL_Surface *dst, const SDL_Surface *src)
+{
+    const float fx0 = nw->position.x + vp->point.x;
+    const float fy0 = nw->position.y + vp->point.y;
+    const float fx1 = se->position.x + vp->point.x;
+    const float fy1 = se->position.y + vp->point.y;
+
+    if (!(fx1 > fx0 && fy1 > fy0))
+        return 0;
+
+    int left = (int) vp->point.x, top = (int) vp->point.y;
+    int right = left + vp->area.w, bottom = top + vp->area.h;
+
+    left = left > 0 ? left : 0;
+    top = top > 0 ? top : 0;
+    right = right < dst->w ? right : dst->w;
+    bottom = bottom < dst->h ? bottom : dst->h;
+
+    int x0 = (int) ceilf(fx0 - 0.5f), y0 = (int) ceilf(fy0 - 0.5f);
+    int x1 = (int) ceilf(fx1 - 0.5f), y1 = (int) ceilf(fy1 - 0.5f);
+
+    q->x0 = x0 > left ? x0 : left;
+    q->y0 = y0 > top ? y0 : top;
+    q->x1 = x1 < right ? x1 : right;
+    q->y1 = y1 < bottom ? y1 : bottom;
+
+    if (q->x0 >= q->x1 || q->y0 >= q->y1)
+        return 0;
+
+    const float su0 = nw->tex_coord.x * src->w, sv0 = nw->tex_coord.y * src->h;
+    const float su1 = se->tex_coord.x * src->w, sv1 = se->tex_coord.y * src->h;
+    const float du = (su1 - su0) / (fx1 - fx0);
+    const float dv = (sv1 - sv0) / (fy1 - fy0);
+
+    q->du = (int64_t) (du * 65536.0f);
+    q->dv = (int64_t) (dv * 65536.0f);
+    q->u = (int64_t) ((su0 + (q->x0 + 0.5f - fx0) * du) * 65536.0f);
+    q->v = (int64_t) ((sv0 + (q->y0 + 0.5f - fy0) * dv) * 65536.0f);
+
+    q->sx0 = (int) floorf(su0 + 0.5f);
+    q->sy0 = (int) floorf(sv0 + 0.5f);
+    q->sx1 = (int) floorf(su1 + 0.5f) - 1;
+    q->sy1 = (int) floorf(sv1 + 0.5f) - 1;
+
+    q->sx0 = q->sx0 > 0 ? q->sx0 : 0;
+    q->sy0 = q->sy0 > 0 ? q->sy0 : 0;
+    q->sx1 = q->sx1 < src->w - 1 ? q->sx1 : src->w - 1;
+    q->sy1 = q->sy1 < src->h - 1 ? q->sy1 : src->h - 1;
+    q->sx1 = q->sx1 > q->sx0 ? q->sx1 : q->sx0;
+    q->sy1 = q->sy1 > q->sy0 ? q->sy1 : q->sy0;
+
+    return (uint64_t) (q->x1 - q->x0) * (uint64_t) (q->y1 - q->y0);
+}
+
+
+/*
+ * The sage_raster_start() interface function starts the rasteriser of the
+ * software backend, with a worker for each core but the one of the render
+ * thread, up to RASTER_WORKERS_MAX.
+ */
+extern void sage_raster_start(void)
+{
+    if (sage_unlikely (raster))
+        return;
+
+    raster = sage_heap_new(sizeof *raster);
+    sage_require (mtx_init(&raster->lock, mtx_plain) == thrd_success);
+    sage_require (cnd_init(&raster->work) == thrd_success);
+    sage_require (cnd_init(&raster->done) == thrd_success);
+
+    raster->stop = false;
+    raster->next = raster->ntiles = raster->left = 0;
+    raster->len = 0;
+    raster->cap = RASTER_QUADS_LEN;
+    raster->quads = sage_heap_new(sizeof *raster->quads * raster->cap);
+
+    const long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    raster->nworkers = ncpu > 1 ? (size_t) ncpu - 1 : 0;
+
+    if (raster->nworkers > RASTER_WORKERS_MAX)
+        raster->nworkers = RASTER_WORKERS_MAX;
+
+    for (register size_t i = 0; i < raster->nworkers; i++) {
+        sage_require (thrd_create(&raster->workers[i], &worker, raster)
+                == thrd_success);
+    }
+}
+
+
+/*
+ * The sage_raster_stop() interface function stops the rasteriser and its
+ * workers. It does nothing if the rasteriser was never started.
+ */
+extern void sage_raster_stop(void)
+{
+    if (sage_likely (raster)) {
+        mtx_lock(&raster->lock);
+        raster->stop = true;
+        cnd_broadcast(&raster->work);
+        mtx_unlock(&raster->lock);
+
+        for (register size_t i = 0; i < raster->nworkers; i++)
+            thrd_join(raster->workers[i], NULL);
+
+        cnd_destroy(&raster->done);
+        cnd_destroy(&raster->work);
+        mtx_destroy(&raster->lock);
+
+        sage_heap_free((void **) &raster->quads);
+        sage_heap_free((void **) &raster);
+    }
+}
+
+
+/*
+ * The sage_raster_draw() interface function draws the len quads of the sprite
+ * batch at vtx, four vertices to a quad, textured with tex, straight into the
+ * framebuffer. It returns false, having drawn nothing, if the rasteriser is
+ * not running, if drawing does not go to the framebuffer, or if the quads are
+ * not of a kind it draws, in which case they are left to SDL.
+ */
+extern SAGE_HOT bool sage_raster_draw(void *tex, const void *vtx, size_t len)
+{
+    const SDL_Surface *src;
+    SDL_BlendMode mode;
+    uint8_t r, g, b, a;
+
+    if (!raster || !(src = SDL_GetTextureUserData(tex))
+            || SDL_GetTextureBlendMode(tex, &mode)
+            || (mode != SDL_BLENDMODE_BLEND && mode != SDL_BLENDMODE_NONE)
+            || SDL_GetTextureAlphaMod(tex, &a) || a != 0xFF
+            || SDL_GetTextureColorMod(tex, &r, &g, &b)
+            || (r & g & b) != 0xFF)
+        return false;
+
+    struct sage_viewport_t vp;
+    SDL_Surface *dst = sage_screen_direct(&vp);
+
+    if (!dst)
+        return false;
+
+    if (sage_unlikely (len > raster->cap)) {
+        while (raster->cap < len)
+            raster->cap *= 2;
+
+        raster->quads = sage_heap_resize(raster->quads,
+                sizeof *raster->quads * raster->cap);
+    }
+
+    const SDL_Vertex *itr = vtx;
+    uint64_t area = 0;
+    int top = dst->h, bottom = 0;
+
+    raster->len = 0;
+    for (register size_t i = 0; i < len; i++, itr += 4) {
+        struct quad *q = &raster->quads[raster->len];
+        const uint64_t px = quad_clip(q, &itr[0], &itr[2], &vp, dst, src);
+
+        if (px) {
+            area += px;
+            top = q->y0 < top ? q->y0 : top;
+            bottom = q->y1 > bottom ? q->y1 : bottom;
+            raster->len++;
+        }
+    }
+
+    if (!raster->len)
+        return true;
+
+    mtx_lock(&raster->lock);
+    raster->dst = dst;
+    raster->src = src;
+    raster->blend = mode == SDL_BLENDMODE_BLEND;
+    raster->top = top;
+    raster->ntiles = (size_t) (bottom - top + RASTER_TILE_ROWS - 1)
+        / RASTER_TILE_ROWS;
+    raster->left = raster->ntiles;
+    raster->next = 0;
+
+    if (area >= RASTER_PARALLEL_MIN && raster->ntiles > 1)
+        cnd_broadcast(&raster->work);
+
+    tiles_take(raster);
+
+    while (raster->left)
+        cnd_wait(&raster->done, &raster->lock);
+
+    mtx_unlock(&raster->lock);
+    return true;
+}
@@ -1,42 +1,299 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
+#include <string.h>
 #include "graphics.h"
 
 
+#define SCREEN_TARGETS_MAX ((size_t) 8)
+
+
+struct target {
+    SDL_Texture *tex;
+    struct sage_area_t area;
+};
+
+
 static thread_local struct {
     SDL_Window *wnd;
     SDL_Renderer *brush;
+    SDL_Surface *fb;
     struct sage_viewport_t *vp;
+    struct target tgt[SCREEN_TARGETS_MAX];
+    size_t ntgt;
+    SDL_Texture *frame;
+    struct sage_area_t res;
+    float scale;
+    float smin;
+    float smax;
+    uint64_t budget;
+    uint64_t mark;
+    uint64_t begin;
+    double cost;
+    uint64_t period;
+    uint8_t frames;
+    uint32_t nframe;
+    bool late;
 } *screen = NULL;
 
 
-extern void
-sage_screen_start(const char *title, struct sage_area_t res)
+/*
+ * The target_apply() helper function points the renderer at the render target
+ * on top of the target stack. With an empty stack, drawing goes to the frame
+ * texture if dynamic resolution is enabled, with the current scale applied, and
+ * to the screen otherwise; the viewport is restored in either case, since SDL
+ * resets it whenever the target changes.
+ */
+static void
+target_apply(void)
 {
-    if (sage_unlikely (screen))
+    if (screen->ntgt) {
+        sage_require (!SDL_SetRenderTarget (screen->brush,
+            screen->tgt[screen->ntgt - 1].tex));
         return;
+    }
 
-    sage_require (SDL_Init (SDL_INIT_VIDEO) >= 0);
-    sage_require (IMG_Init (IMG_INIT_PNG) & IMG_INIT_PNG);
+    SDL_Rect rvp = {.x = screen->vp->point.x,
+                    .y = screen->vp->point.y,
+                    .w = screen->vp->area.w,
+                    .h = screen->vp->area.h};
 
-    sage_require (screen = malloc (sizeof *screen));
+    sage_require (!SDL_SetRenderTarget (screen->brush, screen->frame));
+
+    if (screen->frame)
+        SDL_RenderSetScale (screen->brush, screen->scale, screen->scale);
+
+    SDL_RenderSetViewport (screen->brush, &rvp);
+}
+
+
+/*
+ * The start_accelerated() helper function starts the accelerated backend in a
+ * window. Adaptive vertical sync, which skips the wait when a frame is already
+ * late, is only offered through OpenGL swap intervals; where it is not
+ * available, ordinary vertical sync is used instead.
+ */
+static void
+start_accelerated(const char *title, struct sage_area_t res,
+                  enum sage_screen_vsync_t vsync)
+{
+    sage_require (SDL_Init (SDL_INIT_VIDEO) >= 0);
 
     sage_require (screen->wnd = SDL_CreateWindow (title, 
         SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, res.w, res.h,
         SDL_WINDOW_SHOWN));
 
+    uint32_t flags = SDL_RENDERER_ACCELERATED;
+    if (vsync != SAGE_SCREEN_VSYNC_OFF)
+        flags |= SDL_RENDERER_PRESENTVSYNC;
+
     sage_require (screen->brush = SDL_CreateRenderer (screen->wnd, -1, 
-        SDL_RENDERER_ACCELERATED));
+        flags));
+    screen->fb = NULL;
+
+    if (vsync == SAGE_SCREEN_VSYNC_ADAPTIVE && SDL_GL_SetSwapInterval (-1))
+        SDL_GL_SetSwapInterval (1);
+}
+
+
+/*
+ * The latency_start() helper function sets up frame latency control. The
+ * refresh period of the display is only needed for late presents, and falls
+ * back to 60 Hz when the display does not report it.
+ */
+static void
+latency_start(const struct sage_screen_opt_t *opt)
+{
+    screen->frames = opt ? opt->frames : 0;
+    screen->nframe = 0;
+    screen->late = opt && opt->late && opt->vsync != SAGE_SCREEN_VSYNC_OFF
+        && screen->wnd;
+
+    SDL_DisplayMode mode;
+    int hz = 60;
+
+    if (screen->wnd && !SDL_GetCurrentDisplayMode (
+        SDL_GetWindowDisplayIndex (screen->wnd), &mode) && mode.refresh_rate)
+        hz = mode.refresh_rate;
+
+    screen->period = SDL_GetPerformanceFrequency () / (uint64_t) hz;
+    screen->mark = 0;
+    screen->begin = 0;
+    screen->cost = 0.0;
+}
+
+
+/*
+ * The start_software() helper function starts the software backend. There is
+ * no window; instead SDL's software renderer draws into an in-memory ARGB8888
+ * framebuffer, so only the events subsystem is needed and nothing depends on a
+ * GPU or a display. Batched sprites are drawn into the framebuffer by the tile
+ * rasteriser, which splits the rows of the framebuffer across cores; see
+ * sage/src/graphics/raster.c. Everything else goes through SDL's blitters, and
+ * both honour texture clipping and projection exactly as the accelerated
+ * backend does.
+ */
+static void
+start_software(struct sage_area_t res)
+{
+    sage_require (SDL_Init (SDL_INIT_EVENTS) >= 0);
+
+    screen->wnd = NULL;
+    sage_require (screen->fb = SDL_CreateRGBSurfaceWithFormat (0, res.w, res.h,
+        32, SDL_PIXELFORMAT_ARGB8888));
+    sage_require (screen->brush = SDL_CreateSoftwareRenderer (screen->fb));
+    sage_raster_start ();
+}
+
+
+/*
+ * The frame_start() helper function enables dynamic resolution if the screen
+ * options ask for it by setting a frame time budget. Drawing then goes to a
+ * frame texture large enough for the maximum scale, with the renderer scaled
+ * so that callers keep drawing in screen coordinates; only the top-left part of
+ * the frame texture that the current scale covers is drawn to, and it is
+ * stretched over the screen when the frame is rendered.
+ */
+static void
+frame_start(const struct sage_screen_opt_t *opt, struct sage_area_t res)
+{
+    screen->frame = NULL;
+    screen->res = res;
+    screen->scale = 1.0f;
+
+    if (!opt || !opt->budget)
+        return;
+
+    screen->smax = opt->scale_max > 0.0f ? opt->scale_max : 1.0f;
+    screen->smin = opt->scale_min > 0.0f ? opt->scale_min : 0.5f;
+    sage_assert (screen->smin <= screen->smax);
+
+    screen->scale = screen->smax;
+    screen->budget = SDL_GetPerformanceFrequency () * opt->budget / 1000000;
+
+    sage_require (screen->frame = SDL_CreateTexture (screen->brush,
+        SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+        (int) (res.w * screen->smax + 0.5f),
+        (int) (res.h * screen->smax + 0.5f)));
+    SDL_SetTextureScaleMode (screen->frame, SDL_ScaleModeLinear);
+}
+
+
+/*
+ * The cost_update() helper function records the cost of the frame that is about
+ * to be presented. The cost of a frame is the time from when work on it began,
+ * which is the end of the last present or of any late present sleep after it,
+ * to the start of the next present, so that time spent waiting for vertical
+ * sync or sleeping does not count towards it; it is smoothed over recent frames
+ * so that a single slow frame does not throw off dynamic resolution or late
+ * presents.
+ */
+static void
+cost_update(uint64_t start)
+{
+    if (screen->begin) {
+        double cost = (double) (start - screen->begin);
+        screen->cost = screen->cost > 0.0 ? screen->cost * 0.9 + cost * 0.1
+            : cost;
+    }
+}
+
+
+/*
+ * The frame_adjust() helper function moves the dynamic resolution scale towards
+ * the frame time budget. The scale drops quickly when the budget is exceeded,
+ * and recovers slowly once there is headroom.
+ */
+static void
+frame_adjust(void)
+{
+    if (screen->cost <= 0.0)
+        return;
+
+    if (screen->cost > (double) screen->budget)
+        screen->scale *= 0.95f;
+    else if (screen->cost < (double) screen->budget * 0.8)
+        screen->scale *= 1.02f;
+
+    if (screen->scale < screen->smin)
+        screen->scale = screen->smin;
+    else if (screen->scale > screen->smax)
+        screen->scale = screen->smax;
+}
+
+
+/*
+ * The latency_limit() helper function bounds the number of frames that can be
+ * queued up ahead of the GPU. Reading back a pixel makes the renderer wait for
+ * all the work queued so far to finish; doing so after every frames presents
+ * means that no more than that many frames are ever in flight.
+ */
+static void
+latency_limit(void)
+{
+    if (sage_likely (!screen->frames) || ++screen->nframe < screen->frames)
+        return;
+
+    SDL_Rect px = {.x = 0, .y = 0, .w = 1, .h = 1};
+    uint32_t bfr;
+
+    SDL_RenderReadPixels (screen->brush, &px, SDL_PIXELFORMAT_ARGB8888, &bfr,
+        sizeof bfr);
+    screen->nframe = 0;
+}
+
+
+extern void
+sage_screen_start(const char *title, struct sage_area_t res,
+                  const struct sage_screen_opt_t *opt)
+{
+    if (sage_unlikely (screen))
+        return;
+
+    sage_require (screen = malloc (sizeof *screen));
+
+    if (opt && opt->backend == SAGE_SCREEN_BACKEND_SOFTWARE)
+        start_software(res);
+    else
+        start_accelerated(title, res,
+            opt ? opt->vsync : SAGE_SCREEN_VSYNC_OFF);
+
+    sage_require (IMG_Init (IMG_INIT_PNG) & IMG_INIT_PNG);
     SDL_SetRenderDrawColor (screen->brush, 0xFF, 0xFF, 0xFF, 0xFF);
+
+    sage_require (screen->vp = malloc (sizeof *screen->vp));
+    screen->vp->point.x = screen->vp->point.y = 0;
+    screen->vp->area = res;
+    screen->ntgt = 0;
+
+    latency_start (opt);
+    frame_start (opt, res);
+    target_apply ();
+
+    sage_batch_start();
+    sage_queue_start();
 }
 
 
 extern void
 sage_screen_stop(void)
 {
+    sage_queue_stop();
+    sage_batch_stop();
+    sage_raster_stop();
+
     if (sage_likely (screen)) {
+        if (screen->frame)
+            SDL_DestroyTexture (screen->frame);
+
         SDL_DestroyRenderer (screen->brush);
-        SDL_DestroyWindow (screen->wnd);
+
+        if (screen->wnd)
+            SDL_DestroyWindow (screen->wnd);
+
+        if (screen->fb)
+            SDL_FreeSurface (screen->fb);
+
+        free (screen->vp);
         free (screen);
     }
 
@@ -59,6 +316,9 @@ sage_screen_clear(const sage_colour_t *col)
         sage_colour_green (col), sage_colour_blue (col), 
         sage_colour_alpha (col));
     SDL_RenderClear (screen->brush);
+
+    struct sage_area_t area = sage_screen_area ();
+    sage_stats_draw (NULL, (double) area.w * area.h);
 }
 
 
@@ -92,8 +352,263 @@ sage_screen_viewport_set(const struct sage_viewport_t *vp)
 }
 
 
+/*
+ * The sage_screen_area() interface function gets the area that is currently
+ * being drawn to. This is the area of the active viewport, unless a render
+ * target has been pushed with sage_screen_target_push(), in which case it is
+ * the area of that target.
+ */
+extern SAGE_HOT struct sage_area_t
+sage_screen_area(void)
+{
+    if (sage_unlikely (screen->ntgt))
+        return screen->tgt[screen->ntgt - 1].area;
+
+    return screen->vp->area;
+}
+
+
+/*
+ * The sage_screen_visible() interface function checks whether a rectangle with
+ * its north-west corner at nw and of the given area overlaps the area that is
+ * currently being drawn to. Since drawing coordinates are relative to the
+ * viewport or render target, only its area matters here. This is the test used
+ * to cull sprites before they are submitted for drawing.
+ */
+extern SAGE_HOT bool
+sage_screen_visible(struct sage_point_t nw, struct sage_area_t area)
+{
+    struct sage_area_t cur = sage_screen_area();
+
+    return nw.x < cur.w && nw.y < cur.h && nw.x + area.w > 0
+        && nw.y + area.h > 0;
+}
+
+
+/*
+ * The sage_screen_target_push() interface function redirects drawing into the
+ * render target texture tex, which covers area, until a matching call to
+ * sage_screen_target_pop(). Targets nest, so that content can be pre-rendered
+ * while another target is being drawn to. Any quads that are pending in the
+ * draw queue or the sprite batch are flushed first so that they land in the
+ * target they were meant for.
+ */
+extern void
+sage_screen_target_push(void *tex, struct sage_area_t area)
+{
+    sage_assert (tex && screen->ntgt < SCREEN_TARGETS_MAX);
+
+    if (sage_queue_active ())
+        sage_queue_flush ();
+
+    if (sage_batch_active ())
+        sage_batch_flush ();
+
+    screen->tgt[screen->ntgt].tex = tex;
+    screen->tgt[screen->ntgt++].area = area;
+    sage_stats_target ();
+    target_apply ();
+}
+
+
+extern void
+sage_screen_target_pop(void)
+{
+    sage_assert (screen->ntgt);
+
+    if (sage_queue_active ())
+        sage_queue_flush ();
+
+    if (sage_batch_active ())
+        sage_batch_flush ();
+
+    screen->ntgt--;
+    sage_stats_target ();
+    target_apply ();
+}
+
+
+/*
+ * The sage_screen_framebuffer() interface function gets the pixels that the
+ * software backend renders into, in ARGB8888 format, along with the number of
+ * bytes per row through pitch. The accelerated backend has no framebuffer in
+ * memory, so NULL is returned for it.
+ */
+extern const void *
+sage_screen_framebuffer(size_t *pitch)
+{
+    if (!screen->fb)
+        return NULL;
+
+    if (pitch)
+        *pitch = (size_t) screen->fb->pitch;
+
+    return screen->fb->pixels;
+}
+
+
+/*
+ * The sage_screen_direct() interface function gets the framebuffer of the
+ * software backend, and through vp the viewport, if what is drawn next goes
+ * straight into the framebuffer rather than into a render target or the frame
+ * texture of dynamic resolution; otherwise NULL is returned. Draws that SDL has
+ * yet to carry out are flushed first, so that pixels written to the framebuffer
+ * land over them.
+ */
+extern SAGE_HOT void *
+sage_screen_direct(struct sage_viewport_t *vp)
+{
+    if (!screen->fb || screen->frame || screen->ntgt)
+        return NULL;
+
+    SDL_RenderFlush (screen->brush);
+    *vp = *screen->vp;
+
+    return screen->fb;
+}
+
+
+/*
+ * The sage_screen_pixels() interface function gets the size in pixels of the
+ * frame being drawn, which is what sage_screen_read() reads back. This is the
+ * size of the screen, except under dynamic resolution, when it is the part of
+ * the frame texture covered by the current scale.
+ */
+extern struct sage_area_t
+sage_screen_pixels(void)
+{
+    struct sage_area_t area;
+
+    if (screen->frame) {
+        area.w = (uint16_t) (screen->res.w * screen->scale + 0.5f);
+        area.h = (uint16_t) (screen->res.h * screen->scale + 0.5f);
+    } else if (screen->fb) {
+        area.w = (uint16_t) screen->fb->w;
+        area.h = (uint16_t) screen->fb->h;
+    } else {
+        int w, h;
+        SDL_GetRendererOutputSize (screen->brush, &w, &h);
+        area.w = (uint16_t) w;
+        area.h = (uint16_t) h;
+    }
+
+    return area;
+}
+
+
+/*
+ * The sage_screen_read() interface function copies the frame drawn so far into
+ * pixels, in ARGB8888 format with pitch bytes per row; the buffer must be large
+ * enough for sage_screen_pixels(). It has to be called after drawing and before
+ * sage_screen_render(), with no render target pushed. The software backend is
+ * read straight from its framebuffer; otherwise the renderer is made to read
+ * back the whole frame, which waits for the GPU to finish drawing it.
+ */
+extern void
+sage_screen_read(void *pixels, size_t pitch)
+{
+    sage_assert (pixels && !screen->ntgt);
+    struct sage_area_t area = sage_screen_pixels ();
+
+    if (sage_batch_active ())
+        sage_batch_flush ();
+
+    if (screen->fb && !screen->frame) {
+        SDL_RenderFlush (screen->brush);
+
+        for (register size_t i = 0; i < area.h; i++)
+            memcpy ((uint8_t *) pixels + i * pitch,
+                (const uint8_t *) screen->fb->pixels + i * screen->fb->pitch,
+                (size_t) area.w * 4);
+        return;
+    }
+
+    SDL_Rect rect = {.x = 0, .y = 0, .w = area.w, .h = area.h};
+
+    SDL_RenderSetScale (screen->brush, 1.0f, 1.0f);
+    SDL_RenderSetViewport (screen->brush, NULL);
+    sage_require (!SDL_RenderReadPixels (screen->brush, &rect,
+        SDL_PIXELFORMAT_ARGB8888, pixels, (int) pitch));
+    target_apply ();
+}
+
+
+/*
+ * The sage_screen_scale() interface function gets the current dynamic
+ * resolution scale, which is the ratio of the resolution that is being drawn at
+ * to the resolution of the screen. It is always 1 unless dynamic resolution has
+ * been enabled in the options passed to sage_screen_start().
+ */
+extern float
+sage_screen_scale(void)
+{
+    return screen->scale;
+}
+
+
+/*
+ * The sage_screen_render() interface function presents the frame that has been
+ * drawn. With dynamic resolution, the part of the frame texture that was drawn
+ * to is first stretched over the screen, and the scale for the next frame is
+ * worked out from the cost of this one. If a limit on frames in flight has been
+ * set, the present may wait for the GPU to catch up.
+ */
 extern SAGE_HOT void sage_screen_render(void)
 {
+    sage_assert (!screen->ntgt);
+    sage_stats_frame (screen->vp->area);
+    uint64_t start = SDL_GetPerformanceCounter ();
+    cost_update (start);
+
+    if (sage_likely (!screen->frame)) {
+        SDL_RenderPresent (screen->brush);
+        latency_limit ();
+        screen->mark = screen->begin = SDL_GetPerformanceCounter ();
+        return;
+    }
+
+    SDL_Rect src = {.x = 0,
+                    .y = 0,
+                    .w = (int) (screen->res.w * screen->scale + 0.5f),
+                    .h = (int) (screen->res.h * screen->scale + 0.5f)};
+
+    sage_require (!SDL_SetRenderTarget (screen->brush, NULL));
+    SDL_RenderCopy (screen->brush, screen->frame, &src, NULL);
     SDL_RenderPresent (screen->brush);
+    latency_limit ();
+
+    frame_adjust ();
+    screen->mark = screen->begin = SDL_GetPerformanceCounter ();
+    target_apply ();
+}
+
+
+/*
+ * The sage_screen_wait() interface function is called at the start of each
+ * frame, before input is read. If late presents are enabled, it sleeps until
+ * just long enough before the next vertical sync to build the frame, judging by
+ * the cost of recent frames, so that input is sampled as late as possible and
+ * reaches the screen sooner. Otherwise, it returns immediately.
+ */
+extern void
+sage_screen_wait(void)
+{
+    if (sage_likely (!screen->late || !screen->mark))
+        return;
+
+    const uint64_t freq = SDL_GetPerformanceFrequency ();
+    const uint64_t margin = freq / 1000;
+    const uint64_t need = (uint64_t) screen->cost + margin;
+
+    if (need >= screen->period)
+        return;
+
+    uint64_t wake = screen->mark + screen->period - need;
+    uint64_t now = SDL_GetPerformanceCounter ();
+
+    if (now < wake) {
+        SDL_Delay ((uint32_t) ((wake - now) * 1000 / freq));
+        screen->begin = SDL_GetPerformanceCounter ();
+    }
 }
 
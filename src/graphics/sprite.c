@@ -50,6 +50,7 @@ static inline void cdata_free(void **ctx)
 {
     struct cdata *hnd = *((struct cdata **) ctx);
     sage_texture_free(&hnd->tex);
+    sage_heap_free(ctx);
 }
 
 
@@ -109,6 +110,63 @@ extern struct sage_frame_t sage_sprite_frames(const sage_sprite *ctx)
 }
 
 
+extern struct sage_frame_t sage_sprite_frame_current(const sage_sprite *ctx)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = sage_object_cdata(ctx);
+    return cd->cur;
+}
+
+
+/*
+ * The sage_sprite_image_size() interface function gets the size of the image
+ * of a sprite; see sage/src/core/object.c for what images are.
+ */
+extern size_t sage_sprite_image_size(void)
+{
+    return sage_object_image_size(sizeof (struct cdata));
+}
+
+
+/*
+ * The sage_sprite_image() interface function lays out the image of a sprite at
+ * img, keeping its frame, clip and scale but not its texture.
+ */
+extern void sage_sprite_image(void *img, const sage_sprite *ctx)
+{
+    sage_assert (img && ctx);
+    struct cdata *cd = sage_object_image(img, sage_sprite_id(ctx));
+
+    *cd = *((const struct cdata *) sage_object_cdata(ctx));
+    cd->tex = NULL;
+}
+
+
+/*
+ * The sage_sprite_image_fix() interface function brings to life the sprite
+ * image at img, sharing the texture of the sprite cls. As the image is never
+ * released, it takes no reference to the texture, and so cls must outlive it.
+ */
+extern sage_sprite *sage_sprite_image_fix(void *img, const sage_sprite *cls)
+{
+    struct sage_object_vtable vt = { .copy = &cdata_copy, .free = &cdata_free };
+    struct cdata *cd = sage_object_image_fix(img, &vt);
+
+    sage_assert (cls && sage_sprite_id(img) == sage_sprite_id(cls));
+    cd->tex = ((const struct cdata *) sage_object_cdata(cls))->tex;
+
+    return img;
+}
+
+
+extern struct sage_area_t sage_sprite_projection(const sage_sprite *ctx)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = sage_object_cdata(ctx);
+    return cd->proj;
+}
+
+
 extern void sage_sprite_clip(sage_sprite **ctx, struct sage_point_t nw,
         struct sage_area_t clip)
 {
@@ -149,19 +207,29 @@ extern void sage_sprite_draw(const sage_sprite *ctx, struct sage_point_t dst)
 {
     sage_assert (ctx);
     const struct cdata *cd = sage_object_cdata(ctx);
+    sage_sprite_draw_frame(ctx, cd->cur, dst);
+}
+
 
-    struct sage_area_t frm = sage_sprite_area_frame(ctx);
+/*
+ * The sage_sprite_draw_frame() interface function draws a given frame of a
+ * sprite instead of its current frame, with the sprite's clip and projection.
+ * The sprite is not modified, so frames chosen elsewhere, such as by the
+ * animation system, can be drawn without taking the sprite for writing.
+ */
+extern SAGE_HOT void sage_sprite_draw_frame(const sage_sprite *ctx,
+        struct sage_frame_t frm, struct sage_point_t dst)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = sage_object_cdata(ctx);
+    sage_assert (frm.r && frm.c && frm.r <= cd->tot.r && frm.c <= cd->tot.c);
+
+    struct sage_area_t area = sage_sprite_area_frame(ctx);
     struct sage_point_t nw = {
-        .x = (float) (frm.w * (cd->cur.c - 1) + cd->clip.x),
-        .y = (float) (frm.h * (cd->cur.r - 1) + cd->clip.y)
+        .x = (float) (area.w * (frm.c - 1) + cd->clip.x),
+        .y = (float) (area.h * (frm.r - 1) + cd->clip.y)
     };
     struct sage_area_t clip = { .w = cd->clip.w, .h = cd->clip.h };
 
-    sage_sprite *hnd = (sage_sprite *) ctx;
-    struct cdata *cdm = sage_object_cdata_mutable(&hnd);
-
-    sage_texture_clip(&cdm->tex, nw, clip);
-    sage_texture_scale(&cdm->tex, cdm->proj);
-    sage_texture_draw(cdm->tex, dst);
+    sage_texture_draw_clip(cd->tex, nw, clip, cd->proj, dst);
 }
-
@@ -0,0 +1,214 @@
+#include <math.h>
+#include <string.h>
+#include "graphics.h"
+
+
+/*
+ * Render statistics count what the renderer is asked to do in each frame: how
+ * many calls are made to the renderer, how often the texture being drawn from
+ * changes between calls, how many sprites are submitted and how many are culled
+ * before they get that far, how many pixels are covered, and how often drawing
+ * is redirected to another render target. The pixels covered are an estimate
+ * of overdraw: they count every pixel written, so a frame that covers each
+ * pixel of the screen exactly once has an overdraw of 1.
+ *
+ * Statistics are off until sage_stats_start() is called. The hooks are called
+ * from the texture, batch, screen and arena code as they draw, and cost a
+ * single check while statistics are off. The counts of the last STATS_FRAMES
+ * frames are kept in a ring, with a running sum so that averages are available
+ * at any time without walking the ring.
+ */
+
+
+#define STATS_FRAMES ((size_t) 64)
+
+
+static thread_local struct {
+    struct sage_stats_t cur;
+    struct sage_stats_t ring[STATS_FRAMES];
+    struct sage_stats_t sum;
+    size_t head;
+    size_t len;
+    const void *tex;
+} *stats = NULL;
+
+
+static void tally(struct sage_stats_t *dst, const struct sage_stats_t *src,
+        double sign)
+{
+    dst->draws += sign * src->draws;
+    dst->switches += sign * src->switches;
+    dst->sprites += sign * src->sprites;
+    dst->culled += sign * src->culled;
+    dst->pixels += sign * src->pixels;
+    dst->overdraw += sign * src->overdraw;
+    dst->targets += sign * src->targets;
+}
+
+
+extern void sage_stats_start(void)
+{
+    if (sage_unlikely (stats))
+        return;
+
+    stats = sage_heap_new(sizeof *stats);
+    stats->head = stats->len = 0;
+    stats->tex = NULL;
+}
+
+
+extern void sage_stats_stop(void)
+{
+    if (sage_likely (stats))
+        sage_heap_free((void **) &stats);
+}
+
+
+/*
+ * The sage_stats_draw() interface function records a call to the renderer that
+ * draws from the texture tex, covering pixels pixels that have not already been
+ * counted as sprites. A call that draws from a different texture than the one
+ * before it counts as a texture switch; tex is NULL for calls that do not draw
+ * from a texture, such as clearing the screen, which leave it unchanged.
+ */
+extern SAGE_HOT void sage_stats_draw(const void *tex, double pixels)
+{
+    if (sage_likely (!stats))
+        return;
+
+    stats->cur.draws++;
+    stats->cur.pixels += pixels;
+
+    if (tex && tex != stats->tex) {
+        if (stats->tex)
+            stats->cur.switches++;
+
+        stats->tex = tex;
+    }
+}
+
+
+/*
+ * The sage_stats_geometry() interface function records a geometry call drawing
+ * from the texture tex, working out the pixels it covers from the areas of its
+ * nidx / 3 triangles, whose vertex positions are pairs of floats in xy.
+ */
+extern SAGE_HOT void sage_stats_geometry(const void *tex, const float *xy,
+        const int *idx, size_t nidx)
+{
+    if (sage_likely (!stats))
+        return;
+
+    double pixels = 0.0;
+
+    for (register size_t i = 0; i + 2 < nidx; i += 3) {
+        const float *a = &xy[idx[i] * 2];
+        const float *b = &xy[idx[i + 1] * 2];
+        const float *c = &xy[idx[i + 2] * 2];
+
+        pixels += fabs((double) (b[0] - a[0]) * (c[1] - a[1])
+                - (double) (c[0] - a[0]) * (b[1] - a[1])) * 0.5;
+    }
+
+    sage_stats_draw(tex, pixels);
+}
+
+
+/*
+ * The sage_stats_sprite() interface function records a sprite projected onto
+ * the area proj, which was either submitted for drawing or culled because it
+ * was not visible.
+ */
+extern SAGE_HOT void sage_stats_sprite(struct sage_area_t proj, bool visible)
+{
+    if (sage_likely (!stats))
+        return;
+
+    if (visible) {
+        stats->cur.sprites++;
+        stats->cur.pixels += (double) proj.w * proj.h;
+    } else
+        stats->cur.culled++;
+}
+
+
+extern SAGE_HOT void sage_stats_cull(size_t len)
+{
+    if (sage_likely (stats))
+        stats->cur.culled += (double) len;
+}
+
+
+extern void sage_stats_target(void)
+{
+    if (sage_likely (stats))
+        stats->cur.targets++;
+}
+
+
+/*
+ * The sage_stats_frame() interface function closes the counts of the current
+ * frame, which covered the area area, and starts the next one. It is called by
+ * sage_screen_render().
+ */
+extern void sage_stats_frame(struct sage_area_t area)
+{
+    if (sage_likely (!stats))
+        return;
+
+    if (area.w && area.h)
+        stats->cur.overdraw = stats->cur.pixels / ((double) area.w * area.h);
+
+    if (stats->len == STATS_FRAMES)
+        tally(&stats->sum, &stats->ring[stats->head], -1.0);
+    else
+        stats->len++;
+
+    stats->ring[stats->head] = stats->cur;
+    tally(&stats->sum, &stats->cur, 1.0);
+    stats->head = (stats->head + 1) % STATS_FRAMES;
+
+    memset(&stats->cur, 0, sizeof stats->cur);
+    stats->tex = NULL;
+}
+
+
+/*
+ * The sage_stats_last() interface function gets the counts of the last frame
+ * that was rendered, or all zeros if no frame has been rendered yet.
+ */
+extern struct sage_stats_t sage_stats_last(void)
+{
+    sage_assert (stats);
+    struct sage_stats_t last = { 0 };
+
+    if (stats->len)
+        last = stats->ring[(stats->head + STATS_FRAMES - 1) % STATS_FRAMES];
+
+    return last;
+}
+
+
+/*
+ * The sage_stats_average() interface function gets the counts averaged over the
+ * last STATS_FRAMES frames, or over as many frames as have been rendered if
+ * there have been fewer.
+ */
+extern struct sage_stats_t sage_stats_average(void)
+{
+    sage_assert (stats);
+    struct sage_stats_t avg = { 0 };
+
+    if (stats->len)
+        tally(&avg, &stats->sum, 1.0 / stats->len);
+
+    return avg;
+}
+
+
+extern void sage_stats_reset(void)
+{
+    sage_assert (stats);
+    memset(stats, 0, sizeof *stats);
+}
+
@@ -0,0 +1,375 @@
+#include <SDL2/SDL.h>
+#include <string.h>
+#include "graphics.h"
+
+
+/*
+ * A font is a bitmap glyph sheet: a texture cut into a grid of equally sized
+ * glyphs, holding count consecutive characters starting from first, row by row
+ * from the top left. Text is laid out on a fixed grid, one glyph cell per
+ * character, with newlines starting a new line.
+ *
+ * For each size that text is drawn at, the glyph sheet is rendered once into
+ * an atlas in which every glyph has already been scaled to that size, so that
+ * glyphs are never scaled again while drawing. Laying out a string produces a
+ * run of quads, which is cached by the string's hash and the size; drawing the
+ * same string again at the same size only offsets the cached quads to where
+ * the text is drawn, and submits them in a single geometry call. At most
+ * FONT_RUNS runs are cached, and the one that has gone longest without being
+ * drawn makes way for a new one.
+ */
+
+
+#define FONT_ATLASES ((size_t) 4)
+#define FONT_RUNS ((size_t) 128)
+#define FONT_QUADS ((size_t) 64)
+
+
+struct atlas {
+    uint16_t size;
+    struct sage_area_t glyph;
+    sage_texture *tex;
+    float uv[4];
+};
+
+
+struct run {
+    uint64_t hash;
+    uint16_t size;
+    sage_string_t *str;
+    float *xy;
+    float *uv;
+    size_t len;
+    struct sage_area_t area;
+    uint64_t used;
+};
+
+
+struct sage_font_t {
+    sage_texture *sheet;
+    struct sage_area_t glyph;
+    uint8_t first;
+    uint8_t count;
+    uint16_t cols;
+    struct atlas atlases[FONT_ATLASES];
+    size_t natlases;
+    struct run runs[FONT_RUNS];
+    size_t nruns;
+    uint64_t tick;
+    float *xy;
+    SDL_Color *col;
+    int *idx;
+    size_t cap;
+};
+
+
+/*
+ * The atlas_get() helper function gets the atlas of a font for a given size,
+ * rendering it if it does not exist yet. Glyphs keep their aspect ratio, with
+ * the size being the height of a glyph in pixels. If all atlas slots are taken,
+ * the oldest atlas is replaced; cached runs stay valid, since an atlas for a
+ * given size always has the same layout.
+ */
+static struct atlas *atlas_get(sage_font_t *ctx, uint16_t size)
+{
+    for (register size_t i = 0; i < ctx->natlases; i++) {
+        if (ctx->atlases[i].size == size)
+            return &ctx->atlases[i];
+    }
+
+    struct atlas *atl;
+
+    if (ctx->natlases < FONT_ATLASES)
+        atl = &ctx->atlases[ctx->natlases++];
+    else {
+        sage_texture_free(&ctx->atlases[0].tex);
+        memmove(ctx->atlases, ctx->atlases + 1,
+                sizeof *ctx->atlases * (FONT_ATLASES - 1));
+        atl = &ctx->atlases[FONT_ATLASES - 1];
+    }
+
+    atl->size = size;
+    atl->glyph.h = size;
+    atl->glyph.w = (uint16_t) ((uint32_t) ctx->glyph.w * size / ctx->glyph.h);
+    sage_assert (atl->glyph.w);
+
+    const uint16_t rows = (ctx->count + ctx->cols - 1) / ctx->cols;
+    struct sage_area_t area = {
+        .w = atl->glyph.w * ctx->cols,
+        .h = atl->glyph.h * rows
+    };
+
+    atl->tex = sage_texture_new_target(0, area);
+    sage_texture_uv(atl->tex, atl->uv);
+    sage_texture_target_begin(atl->tex);
+
+    for (register uint16_t i = 0; i < ctx->count; i++) {
+        struct sage_point_t nw = {
+            .x = (float) ((i % ctx->cols) * ctx->glyph.w),
+            .y = (float) ((i / ctx->cols) * ctx->glyph.h)
+        };
+
+        struct sage_point_t at = {
+            .x = (float) ((i % ctx->cols) * atl->glyph.w),
+            .y = (float) ((i / ctx->cols) * atl->glyph.h)
+        };
+
+        sage_texture_draw_clip(ctx->sheet, nw, ctx->glyph, atl->glyph, at);
+    }
+
+    sage_texture_target_end();
+    return atl;
+}
+
+
+static void run_clear(struct run *run)
+{
+    sage_string_free(&run->str);
+    sage_heap_free((void **) &run->xy);
+    sage_heap_free((void **) &run->uv);
+}
+
+
+/*
+ * The run_layout() helper function lays out a string into a run of quads for
+ * the glyphs of an atlas, relative to the north-west corner of the text. Blank
+ * and unknown characters advance the pen without producing a quad.
+ */
+static void run_layout(sage_font_t *ctx, struct run *run,
+        const struct atlas *atl, const sage_string_t *str)
+{
+    const char *cstr = sage_string_cstr(str);
+    const size_t len = sage_string_len(str);
+
+    run->str = sage_string_copy(str);
+    run->xy = sage_heap_new(sizeof *run->xy * (len ? len : 1) * 8);
+    run->uv = sage_heap_new(sizeof *run->uv * (len ? len : 1) * 8);
+    run->len = 0;
+
+    const uint16_t rows = (ctx->count + ctx->cols - 1) / ctx->cols;
+    const float du = (atl->uv[2] - atl->uv[0]) / ctx->cols;
+    const float dv = (atl->uv[3] - atl->uv[1]) / rows;
+    float x = 0.0f, y = 0.0f;
+
+    run->area.w = 0;
+    run->area.h = atl->glyph.h;
+
+    for (register size_t i = 0; i < len; i++) {
+        const uint8_t ch = (uint8_t) cstr[i];
+
+        if (ch == '\n') {
+            x = 0.0f;
+            y += atl->glyph.h;
+            run->area.h += atl->glyph.h;
+            continue;
+        }
+
+        if (ch >= ctx->first && ch - ctx->first < ctx->count && ch != ' ') {
+            const uint16_t g = ch - ctx->first;
+            const float u0 = atl->uv[0] + du * (g % ctx->cols);
+            const float v0 = atl->uv[1] + dv * (g / ctx->cols);
+            const float x1 = x + atl->glyph.w, y1 = y + atl->glyph.h;
+
+            float *q = &run->xy[run->len * 8];
+            q[0] = x, q[1] = y;
+            q[2] = x1, q[3] = y;
+            q[4] = x1, q[5] = y1;
+            q[6] = x, q[7] = y1;
+
+            float *t = &run->uv[run->len * 8];
+            t[0] = u0, t[1] = v0;
+            t[2] = u0 + du, t[3] = v0;
+            t[4] = u0 + du, t[5] = v0 + dv;
+            t[6] = u0, t[7] = v0 + dv;
+
+            run->len++;
+        }
+
+        x += atl->glyph.w;
+        if (x > run->area.w)
+            run->area.w = (uint16_t) x;
+    }
+}
+
+
+static struct run *run_get(sage_font_t *ctx, const sage_string_t *str,
+        uint16_t size)
+{
+    const uint64_t hash = sage_string_hash(str);
+
+    for (register size_t i = 0; i < ctx->nruns; i++) {
+        struct run *run = &ctx->runs[i];
+
+        if (run->hash == hash && run->size == size && (run->str == str
+                    || !strcmp(sage_string_cstr(run->str),
+                        sage_string_cstr(str))))
+            return run;
+    }
+
+    struct run *run;
+
+    if (ctx->nruns < FONT_RUNS)
+        run = &ctx->runs[ctx->nruns++];
+    else {
+        run = &ctx->runs[0];
+        for (register size_t i = 1; i < FONT_RUNS; i++) {
+            if (ctx->runs[i].used < run->used)
+                run = &ctx->runs[i];
+        }
+
+        run_clear(run);
+    }
+
+    run->hash = hash;
+    run->size = size;
+    run_layout(ctx, run, atlas_get(ctx, size), str);
+
+    return run;
+}
+
+
+static void scratch_fill(sage_font_t *ctx, size_t from, size_t to)
+{
+    const SDL_Color white = { .r = 0xFF, .g = 0xFF, .b = 0xFF, .a = 0xFF };
+
+    for (register size_t i = from; i < to; i++) {
+        SDL_Color *c = &ctx->col[i * 4];
+        c[0] = c[1] = c[2] = c[3] = white;
+
+        int *t = &ctx->idx[i * 6];
+        int base = (int) (i * 4);
+        t[0] = base, t[1] = base + 1, t[2] = base + 2;
+        t[3] = base + 2, t[4] = base + 3, t[5] = base;
+    }
+}
+
+
+static void scratch_reserve(sage_font_t *ctx, size_t len)
+{
+    if (sage_likely (len <= ctx->cap))
+        return;
+
+    size_t cap = ctx->cap;
+    while (cap < len)
+        cap *= 2;
+
+    ctx->xy = sage_heap_resize(ctx->xy, sizeof *ctx->xy * cap * 8);
+    ctx->col = sage_heap_resize(ctx->col, sizeof *ctx->col * cap * 4);
+    ctx->idx = sage_heap_resize(ctx->idx, sizeof *ctx->idx * cap * 6);
+
+    scratch_fill(ctx, ctx->cap, cap);
+    ctx->cap = cap;
+}
+
+
+/*
+ * The sage_font_new() interface function creates a new font from the glyph
+ * sheet registered under texid, which is cut into glyphs of the area glyph
+ * holding count characters from first onwards.
+ */
+extern sage_font_t *sage_font_new(sage_id texid, struct sage_area_t glyph,
+        uint8_t first, uint8_t count)
+{
+    sage_assert (texid && glyph.w && glyph.h && count);
+
+    sage_font_t *ctx = sage_heap_new(sizeof *ctx);
+    ctx->sheet = sage_texture_factory_clone(texid);
+    ctx->glyph = glyph;
+    ctx->first = first;
+    ctx->count = count;
+    ctx->cols = sage_texture_area(ctx->sheet).w / glyph.w;
+    sage_assert (ctx->cols);
+
+    ctx->natlases = ctx->nruns = 0;
+    ctx->tick = 0;
+
+    ctx->cap = FONT_QUADS;
+    ctx->xy = sage_heap_new(sizeof *ctx->xy * ctx->cap * 8);
+    ctx->col = sage_heap_new(sizeof *ctx->col * ctx->cap * 4);
+    ctx->idx = sage_heap_new(sizeof *ctx->idx * ctx->cap * 6);
+    scratch_fill(ctx, 0, ctx->cap);
+
+    return ctx;
+}
+
+
+extern void sage_font_free(sage_font_t **ctx)
+{
+    sage_font_t *hnd;
+
+    if (sage_likely (ctx && (hnd = *ctx))) {
+        for (register size_t i = 0; i < hnd->nruns; i++)
+            run_clear(&hnd->runs[i]);
+
+        for (register size_t i = 0; i < hnd->natlases; i++)
+            sage_texture_free(&hnd->atlases[i].tex);
+
+        sage_heap_free((void **) &hnd->xy);
+        sage_heap_free((void **) &hnd->col);
+        sage_heap_free((void **) &hnd->idx);
+        sage_texture_free(&hnd->sheet);
+        sage_heap_free((void **) ctx);
+    }
+}
+
+
+/*
+ * The sage_font_measure() interface function gets the area that a string takes
+ * up when drawn with a font at a given size, without laying it out.
+ */
+extern struct sage_area_t sage_font_measure(const sage_font_t *ctx,
+        const sage_string_t *str, uint16_t size)
+{
+    sage_assert (ctx && str && size);
+
+    const char *cstr = sage_string_cstr(str);
+    const uint16_t gw = (uint16_t) ((uint32_t) ctx->glyph.w * size
+            / ctx->glyph.h);
+    size_t cols = 0, rows = 1, cur = 0;
+
+    for (register size_t i = 0; i < sage_string_len(str); i++) {
+        if (cstr[i] == '\n') {
+            rows++;
+            cur = 0;
+        } else if (++cur > cols)
+            cols = cur;
+    }
+
+    struct sage_area_t area = {
+        .w = (uint16_t) (cols * gw),
+        .h = (uint16_t) (rows * size)
+    };
+
+    return area;
+}
+
+
+/*
+ * The sage_text_draw() interface function draws a string with a font, with the
+ * glyphs size pixels high and the north-west corner of the text at dst. Text
+ * that has been drawn before at the same size reuses its cached layout, and
+ * text that is wholly outside the area being drawn to is skipped.
+ */
+extern SAGE_HOT void sage_text_draw(sage_font_t *ctx, const sage_string_t *str,
+        uint16_t size, struct sage_point_t dst)
+{
+    sage_assert (ctx && str && size);
+
+    struct run *run = run_get(ctx, str, size);
+    run->used = ++ctx->tick;
+
+    if (sage_unlikely (!sage_screen_visible(dst, run->area)))
+        return;
+
+    const struct atlas *atl = atlas_get(ctx, size);
+    scratch_reserve(ctx, run->len);
+
+    for (register size_t i = 0; i < run->len * 8; i += 2) {
+        ctx->xy[i] = run->xy[i] + dst.x;
+        ctx->xy[i + 1] = run->xy[i + 1] + dst.y;
+    }
+
+    sage_texture_draw_geometry(atl->tex, ctx->xy, ctx->col, run->uv,
+            run->len * 4, ctx->idx, run->len * 6);
+}
+
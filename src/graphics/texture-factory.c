@@ -15,6 +15,7 @@ extern void sage_texture_factory_init(void)
 
 extern void sage_texture_factory_exit(void)
 {
+    sage_texture_loader_stop();
     sage_object_map_free(&map);
 }
 
@@ -22,7 +23,17 @@ extern void sage_texture_factory_exit(void)
 extern void sage_texture_factory_register(sage_id id, const char *path)
 {
     sage_assert (id && path && *path);
-    sage_object_map_value_set(map, id, sage_texture_new(id, path));
+
+    sage_texture *tex = sage_texture_new(id, path);
+    sage_object_map_value_set(map, id, tex);
+    sage_texture_free(&tex);
+}
+
+
+extern void sage_texture_factory_register_texture(const sage_texture *tex)
+{
+    sage_assert (tex);
+    sage_object_map_value_set(map, sage_texture_id(tex), tex);
 }
 
 
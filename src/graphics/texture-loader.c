@@ -0,0 +1,301 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <string.h>
+#include <unistd.h>
+#include "graphics.h"
+
+
+#define LOADER_WORKERS_MAX ((size_t) 8)
+
+
+enum job_state {
+    JOB_QUEUED = 0,
+    JOB_DECODED
+};
+
+
+struct job {
+    sage_id id;
+    char *path;
+    SDL_Surface *surf;
+    enum job_state state;
+    struct job *next;
+};
+
+
+/*
+ * The loader is shared between the thread that owns the renderer and the pool
+ * of decoding workers, and so unlike the other singletons in the library it is
+ * not thread local; every field other than the pending list is guarded by the
+ * lock. Queued jobs wait in the todo queue until a worker decodes them into an
+ * SDL surface and moves them to the done queue; the render thread then uploads
+ * them as textures. The pending list tracks every job that has not yet been
+ * uploaded, and is only ever touched by the render thread.
+ */
+struct loader {
+    mtx_t lock;
+    cnd_t work;
+    cnd_t done;
+    struct job *todo;
+    struct job *todo_tail;
+    struct job *decoded;
+    thrd_t workers[LOADER_WORKERS_MAX];
+    size_t nworkers;
+    bool stop;
+    struct job **pending;
+    size_t len;
+    size_t cap;
+};
+
+
+static struct loader *loader = NULL;
+
+
+static void job_free(struct job **ctx)
+{
+    struct job *hnd;
+
+    if (sage_likely (ctx && (hnd = *ctx))) {
+        if (hnd->surf)
+            SDL_FreeSurface(hnd->surf);
+
+        sage_heap_free((void **) &hnd->path);
+        sage_heap_free((void **) ctx);
+    }
+}
+
+
+static int worker(void *arg)
+{
+    struct loader *ctx = arg;
+    struct job *job;
+
+    while (true) {
+        mtx_lock(&ctx->lock);
+        while (!ctx->stop && !ctx->todo)
+            cnd_wait(&ctx->work, &ctx->lock);
+
+        if (ctx->stop) {
+            mtx_unlock(&ctx->lock);
+            return 0;
+        }
+
+        job = ctx->todo;
+        if (!(ctx->todo = job->next))
+            ctx->todo_tail = NULL;
+        mtx_unlock(&ctx->lock);
+
+        SDL_Surface *surf;
+        sage_require (surf = IMG_Load(job->path));
+
+        mtx_lock(&ctx->lock);
+        job->surf = surf;
+        job->state = JOB_DECODED;
+        job->next = ctx->decoded;
+        ctx->decoded = job;
+        cnd_broadcast(&ctx->done);
+        mtx_unlock(&ctx->lock);
+    }
+}
+
+
+static size_t workers_count(void)
+{
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (ncpu <= 1)
+        return 1;
+
+    return (size_t) ncpu - 1 < LOADER_WORKERS_MAX ? (size_t) ncpu - 1
+        : LOADER_WORKERS_MAX;
+}
+
+
+static size_t pending_find(sage_id id)
+{
+    for (register size_t i = 0; i < loader->len; i++) {
+        if (loader->pending[i]->id == id)
+            return i + 1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Unlinks a decoded job from the done queue, and uploads it to the renderer.
+ * The surface is no longer needed once the texture has been created.
+ */
+static void job_upload(struct job *job)
+{
+    mtx_lock(&loader->lock);
+    struct job **itr = &loader->decoded;
+    while (*itr != job)
+        itr = &(*itr)->next;
+    *itr = job->next;
+    mtx_unlock(&loader->lock);
+
+    sage_texture *tex = sage_texture_new_surface(job->id, job->surf);
+    sage_texture_factory_register_texture(tex);
+    sage_texture_free(&tex);
+
+    size_t idx = pending_find(job->id);
+    loader->pending[idx - 1] = loader->pending[--loader->len];
+    job_free(&job);
+}
+
+
+extern void sage_texture_loader_start(void)
+{
+    if (sage_likely (loader))
+        return;
+
+    loader = sage_heap_new(sizeof *loader);
+    sage_require (mtx_init(&loader->lock, mtx_plain) == thrd_success);
+    sage_require (cnd_init(&loader->work) == thrd_success);
+    sage_require (cnd_init(&loader->done) == thrd_success);
+
+    loader->todo = loader->todo_tail = loader->decoded = NULL;
+    loader->stop = false;
+
+    loader->len = 0;
+    loader->cap = 16;
+    loader->pending = sage_heap_new(sizeof *loader->pending * loader->cap);
+
+    loader->nworkers = workers_count();
+    for (register size_t i = 0; i < loader->nworkers; i++) {
+        sage_require (thrd_create(&loader->workers[i], &worker, loader)
+                == thrd_success);
+    }
+}
+
+
+extern void sage_texture_loader_stop(void)
+{
+    if (sage_likely (loader)) {
+        mtx_lock(&loader->lock);
+        loader->stop = true;
+        cnd_broadcast(&loader->work);
+        mtx_unlock(&loader->lock);
+
+        for (register size_t i = 0; i < loader->nworkers; i++)
+            thrd_join(loader->workers[i], NULL);
+
+        for (register size_t i = 0; i < loader->len; i++)
+            job_free(&loader->pending[i]);
+
+        cnd_destroy(&loader->done);
+        cnd_destroy(&loader->work);
+        mtx_destroy(&loader->lock);
+
+        sage_heap_free((void **) &loader->pending);
+        sage_heap_free((void **) &loader);
+    }
+}
+
+
+/*
+ * The sage_texture_factory_register_async() interface function queues an image
+ * to be decoded on the pool of loader threads, and returns immediately. The
+ * texture is registered once it has been uploaded by a later call to either
+ * sage_texture_factory_upload() or sage_texture_factory_wait(); until then
+ * sage_texture_factory_ready() reports false for its ID.
+ */
+extern void sage_texture_factory_register_async(sage_id id, const char *path)
+{
+    sage_assert (id && path && *path);
+    sage_texture_loader_start();
+    sage_assert (!pending_find(id));
+
+    struct job *job = sage_heap_new(sizeof *job);
+    size_t len = strlen(path);
+
+    job->id = id;
+    job->path = sage_heap_new(len + 1);
+    memcpy(job->path, path, len);
+    job->surf = NULL;
+    job->state = JOB_QUEUED;
+    job->next = NULL;
+
+    if (sage_unlikely (loader->len == loader->cap)) {
+        loader->cap *= 2;
+        loader->pending = sage_heap_resize(loader->pending,
+                sizeof *loader->pending * loader->cap);
+    }
+    loader->pending[loader->len++] = job;
+
+    mtx_lock(&loader->lock);
+    if (loader->todo_tail)
+        loader->todo_tail->next = job;
+    else
+        loader->todo = job;
+    loader->todo_tail = job;
+    cnd_signal(&loader->work);
+    mtx_unlock(&loader->lock);
+}
+
+
+extern bool sage_texture_factory_ready(sage_id id)
+{
+    sage_assert (id);
+    return !loader || !pending_find(id);
+}
+
+
+/*
+ * The sage_texture_factory_wait() interface function blocks until a texture
+ * queued by sage_texture_factory_register_async() has been decoded, and then
+ * uploads it immediately regardless of the upload budget, so that a scene only
+ * waits for the textures it actually needs.
+ */
+extern void sage_texture_factory_wait(sage_id id)
+{
+    sage_assert (id);
+    size_t idx;
+
+    if (!loader || !(idx = pending_find(id)))
+        return;
+
+    struct job *job = loader->pending[idx - 1];
+
+    mtx_lock(&loader->lock);
+    while (job->state != JOB_DECODED)
+        cnd_wait(&loader->done, &loader->lock);
+    mtx_unlock(&loader->lock);
+
+    job_upload(job);
+}
+
+
+/*
+ * The sage_texture_factory_upload() interface function uploads decoded images
+ * as textures until the time budget, in milliseconds, has been spent; it is
+ * called once per frame by the game loop. At least one image is uploaded on
+ * each call so that loading always makes progress. The number of textures
+ * uploaded is returned.
+ */
+extern size_t sage_texture_factory_upload(uint32_t budget)
+{
+    if (sage_likely (!loader || !loader->len))
+        return 0;
+
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    const uint64_t end = SDL_GetPerformanceCounter() + freq * budget / 1000;
+    size_t count = 0;
+    struct job *job;
+
+    do {
+        mtx_lock(&loader->lock);
+        job = loader->decoded;
+        mtx_unlock(&loader->lock);
+
+        if (!job)
+            break;
+
+        job_upload(job);
+        count++;
+    } while (SDL_GetPerformanceCounter() < end);
+
+    return count;
+}
+
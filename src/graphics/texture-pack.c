@@ -0,0 +1,290 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "graphics.h"
+
+
+/*
+ * A texture pack is a single file holding any number of textures as pixel data
+ * in the renderer's native pixel format, so that loading a texture is a page-in
+ * and a copy to the GPU rather than a PNG decode. The file begins with a header
+ * followed by an index of entries, and then the pixel blobs, each aligned to
+ * PACK_ALIGN bytes. Each blob is either raw pixel rows of pitch bytes, or an
+ * LZ4 block that decompresses to such rows. All fields are stored in host byte
+ * order.
+ */
+
+
+#define PACK_MAGIC "SAGETPK"
+#define PACK_VERSION ((uint32_t) 1)
+#define PACK_FORMAT SDL_PIXELFORMAT_ARGB8888
+#define PACK_ALIGN ((uint64_t) 16)
+
+
+enum pack_codec {
+    PACK_CODEC_RAW = 0,
+    PACK_CODEC_LZ4
+};
+
+
+struct pack_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+
+struct pack_entry {
+    uint64_t id;
+    uint32_t w;
+    uint32_t h;
+    uint32_t pitch;
+    uint32_t codec;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t rawsize;
+};
+
+
+struct sage_texture_pack_t {
+    const uint8_t *map;
+    size_t len;
+    const struct pack_header *hdr;
+    const struct pack_entry *ents;
+};
+
+
+static const struct pack_entry *entry_find(const sage_texture_pack_t *ctx,
+        sage_id id)
+{
+    for (register size_t i = 0; i < ctx->hdr->count; i++) {
+        if (ctx->ents[i].id == id)
+            return &ctx->ents[i];
+    }
+
+    return NULL;
+}
+
+
+static sage_texture *entry_texture(const sage_texture_pack_t *ctx,
+        const struct pack_entry *ent)
+{
+    struct sage_area_t area = { .w = ent->w, .h = ent->h };
+    const void *pixels = ctx->map + ent->offset;
+
+    if (ent->codec == PACK_CODEC_RAW)
+        return sage_texture_new_pixels(ent->id, pixels, area, ent->pitch,
+                ctx->hdr->format);
+
+    void *bfr = sage_heap_new(ent->rawsize);
+    sage_require (sage_lz4_decompress(pixels, ent->size, bfr, ent->rawsize)
+            == ent->rawsize);
+
+    sage_texture *tex = sage_texture_new_pixels(ent->id, bfr, area,
+            ent->pitch, ctx->hdr->format);
+    sage_heap_free(&bfr);
+
+    return tex;
+}
+
+
+/*
+ * The sage_texture_pack_open() interface function maps a texture pack into
+ * memory and validates its header and index. No pixel data is read at this
+ * point; the kernel is only advised that the mapping will be needed soon, so
+ * that it can start paging it in.
+ */
+extern sage_texture_pack_t *sage_texture_pack_open(const char *path)
+{
+    sage_assert (path && *path);
+    sage_texture_pack_t *ctx = sage_heap_new(sizeof *ctx);
+
+    int fd;
+    struct stat st;
+    sage_require ((fd = open(path, O_RDONLY)) >= 0);
+    sage_require (!fstat(fd, &st));
+    sage_require ((size_t) st.st_size >= sizeof *ctx->hdr);
+
+    ctx->len = (size_t) st.st_size;
+    ctx->map = mmap(NULL, ctx->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    sage_require (ctx->map != MAP_FAILED);
+    close(fd);
+    madvise((void *) ctx->map, ctx->len, MADV_WILLNEED);
+
+    ctx->hdr = (const struct pack_header *) ctx->map;
+    ctx->ents = (const struct pack_entry *) (ctx->hdr + 1);
+
+    sage_require (!memcmp(ctx->hdr->magic, PACK_MAGIC, sizeof PACK_MAGIC));
+    sage_require (ctx->hdr->version == PACK_VERSION);
+    sage_require (sizeof *ctx->hdr + sizeof *ctx->ents * ctx->hdr->count
+            <= ctx->len);
+
+    /*
+     * The index is untrusted, so each blob is bounds checked without summing
+     * its offset and size, which could wrap around. The pitch and height are
+     * 32-bit, so their product cannot overflow; an LZ4 blob must decompress to
+     * exactly that many bytes, or it would overrun or underfill its buffer.
+     */
+    for (register size_t i = 0; i < ctx->hdr->count; i++) {
+        const struct pack_entry *ent = &ctx->ents[i];
+        const uint64_t rows = (uint64_t) ent->pitch * ent->h;
+
+        sage_require (ent->offset <= ctx->len
+                && ent->size <= ctx->len - ent->offset);
+        sage_require (ent->pitch >= (uint64_t) ent->w
+                * SDL_BYTESPERPIXEL(ctx->hdr->format));
+        sage_require (ent->codec == PACK_CODEC_RAW
+                || ent->codec == PACK_CODEC_LZ4);
+        sage_require (ent->codec == PACK_CODEC_LZ4 ? ent->rawsize == rows
+                : ent->size >= rows);
+    }
+
+    return ctx;
+}
+
+
+extern void sage_texture_pack_close(sage_texture_pack_t **ctx)
+{
+    sage_texture_pack_t *hnd;
+
+    if (sage_likely (ctx && (hnd = *ctx))) {
+        munmap((void *) hnd->map, hnd->len);
+        sage_heap_free((void **) ctx);
+    }
+}
+
+
+extern size_t sage_texture_pack_len(const sage_texture_pack_t *ctx)
+{
+    sage_assert (ctx);
+    return ctx->hdr->count;
+}
+
+
+extern sage_texture *sage_texture_pack_texture(const sage_texture_pack_t *ctx,
+        sage_id id)
+{
+    sage_assert (ctx && id);
+
+    const struct pack_entry *ent;
+    sage_require (ent = entry_find(ctx, id));
+
+    return entry_texture(ctx, ent);
+}
+
+
+extern void sage_texture_pack_register(const sage_texture_pack_t *ctx)
+{
+    sage_assert (ctx);
+
+    for (register size_t i = 0; i < ctx->hdr->count; i++) {
+        sage_texture *tex = entry_texture(ctx, &ctx->ents[i]);
+        sage_texture_factory_register_texture(tex);
+        sage_texture_free(&tex);
+    }
+}
+
+
+static void file_write(FILE *file, const void *data, size_t len)
+{
+    sage_require (fwrite(data, 1, len, file) == len);
+}
+
+
+/*
+ * The sage_texture_pack_write() interface function bakes len images into a
+ * texture pack at path. Each image at srcs[i] is decoded, converted to the pack
+ * pixel format, and stored under ids[i]. If lz4 is true, each image is stored
+ * LZ4 compressed unless compression does not make it smaller. This function
+ * does not need a renderer, and is meant to be run by offline tools.
+ */
+extern void sage_texture_pack_write(const char *path, size_t len,
+        const sage_id *ids, const char *const *srcs, bool lz4)
+{
+    sage_assert (path && *path && ids && srcs);
+
+    struct pack_header hdr = {
+        .magic = PACK_MAGIC,
+        .version = PACK_VERSION,
+        .format = PACK_FORMAT,
+        .count = (uint32_t) len,
+        .reserved = 0
+    };
+
+    struct pack_entry *ents = sage_heap_new(sizeof *ents * (len ? len : 1));
+    void **blobs = sage_heap_new(sizeof *blobs * (len ? len : 1));
+    uint64_t offset = sizeof hdr + sizeof *ents * len;
+
+    for (register size_t i = 0; i < len; i++) {
+        SDL_Surface *img, *surf;
+        sage_require (img = IMG_Load(srcs[i]));
+        sage_require (surf = SDL_ConvertSurfaceFormat(img, PACK_FORMAT, 0));
+        SDL_FreeSurface(img);
+
+        struct pack_entry *ent = &ents[i];
+        sage_assert (ids[i]);
+        ent->id = ids[i];
+        ent->w = (uint32_t) surf->w;
+        ent->h = (uint32_t) surf->h;
+        ent->pitch = ent->w * SDL_BYTESPERPIXEL(PACK_FORMAT);
+        ent->rawsize = (uint64_t) ent->pitch * ent->h;
+
+        uint8_t *raw = sage_heap_new(ent->rawsize);
+        SDL_LockSurface(surf);
+        for (register size_t row = 0; row < ent->h; row++) {
+            memcpy(raw + row * ent->pitch,
+                    (uint8_t *) surf->pixels + row * (size_t) surf->pitch,
+                    ent->pitch);
+        }
+        SDL_UnlockSurface(surf);
+        SDL_FreeSurface(surf);
+
+        ent->codec = PACK_CODEC_RAW;
+        ent->size = ent->rawsize;
+        blobs[i] = raw;
+
+        if (lz4) {
+            size_t cap = sage_lz4_bound(ent->rawsize);
+            void *z = sage_heap_new(cap);
+            size_t zlen = sage_lz4_compress(raw, ent->rawsize, z, cap);
+
+            if (zlen && zlen < ent->rawsize) {
+                ent->codec = PACK_CODEC_LZ4;
+                ent->size = zlen;
+                blobs[i] = z;
+                sage_heap_free((void **) &raw);
+            } else
+                sage_heap_free(&z);
+        }
+
+        offset = (offset + PACK_ALIGN - 1) & ~(PACK_ALIGN - 1);
+        ent->offset = offset;
+        offset += ent->size;
+    }
+
+    FILE *file;
+    sage_require (file = fopen(path, "wb"));
+    file_write(file, &hdr, sizeof hdr);
+    file_write(file, ents, sizeof *ents * len);
+
+    const uint8_t zero[PACK_ALIGN] = { 0 };
+    uint64_t pos = sizeof hdr + sizeof *ents * len;
+
+    for (register size_t i = 0; i < len; i++) {
+        file_write(file, zero, ents[i].offset - pos);
+        file_write(file, blobs[i], ents[i].size);
+        pos = ents[i].offset + ents[i].size;
+        sage_heap_free(&blobs[i]);
+    }
+
+    sage_require (!fclose(file));
+    sage_heap_free((void **) &blobs);
+    sage_heap_free((void **) &ents);
+}
+
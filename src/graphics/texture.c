@@ -1,32 +1,124 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
-#include <string.h>
 #include "graphics.h"
 
 
-struct cdata {
-    char *path;
+/*
+ * The decoded SDL texture is held in a reference counted resource that is
+ * shared by every copy of a texture, and by every region of it. The resource is
+ * never modified after creation, so copies never touch the disk or the GPU;
+ * only the clip and projection are per-instance state.
+ */
+struct resource {
     SDL_Texture *tex;
+    struct sage_area_t size;
+    uint32_t serial;
+    size_t nref;
+};
+
+
+/*
+ * Each resource is given a serial number when it is created, which the draw
+ * queue uses to group quads drawn from the same texture, however many regions
+ * of it they come from.
+ */
+static thread_local uint32_t serial = 0;
+
+
+struct cdata {
+    struct resource *res;
+    SDL_Rect region;
     SDL_Rect clip;
     struct sage_area_t proj;
 };
 
 
-static inline struct cdata *cdata_new(const char *path)
+static struct resource *resource_new(SDL_Texture *tex)
 {
-    struct cdata *ctx = sage_heap_new(sizeof *ctx);
+    struct resource *ctx = sage_heap_new(sizeof *ctx);
+
+    int w, h;
+    sage_assert (tex);
+    SDL_QueryTexture(tex, NULL, NULL, &w, &h);
+
+    ctx->tex = tex;
+    ctx->size.w = w;
+    ctx->size.h = h;
+    ctx->serial = ++serial;
+    ctx->nref = 1;
+
+    return ctx;
+}
+
 
-    size_t len = strlen(path);
-    ctx->path = sage_heap_new(len + 1);
-    strncpy(ctx->path, path, len);
+/*
+ * The resource_pixels() helper function keeps a copy of the pixels of the
+ * texture tex, which were uploaded from the surface surf, when rendering in
+ * software. The copy is an ARGB8888 surface attached to the texture as its user
+ * data, from which the tile rasteriser draws the texture straight into the
+ * framebuffer; textures without one, such as render targets, are drawn by SDL.
+ */
+static void resource_pixels(SDL_Texture *tex, SDL_Surface *surf)
+{
+    if (sage_screen_framebuffer(NULL)) {
+        SDL_Surface *cp = SDL_ConvertSurfaceFormat(surf,
+                SDL_PIXELFORMAT_ARGB8888, 0);
+
+        if (cp)
+            SDL_SetTextureUserData(tex, cp);
+    }
+}
+
+
+static inline struct resource *resource_copy(struct resource *ctx)
+{
+    ctx->nref++;
+    return ctx;
+}
+
+
+static inline void resource_free(struct resource **ctx)
+{
+    struct resource *hnd;
+
+    if (sage_likely (ctx && (hnd = *ctx))) {
+        if (!--hnd->nref) {
+            SDL_Surface *surf = SDL_GetTextureUserData(hnd->tex);
+
+            if (surf)
+                SDL_FreeSurface(surf);
+
+            SDL_DestroyTexture(hnd->tex);
+            sage_heap_free((void **) ctx);
+        }
+    }
+}
 
-    sage_require (ctx->tex = IMG_LoadTexture(sage_screen_brush(), path));
+
+static inline void cdata_reset(struct cdata *ctx)
+{
     ctx->clip.x = ctx->clip.y = 0;
-    SDL_QueryTexture(ctx->tex, NULL, NULL, &ctx->clip.w, &ctx->clip.h);
+    ctx->clip.w = ctx->proj.w = ctx->region.w;
+    ctx->clip.h = ctx->proj.h = ctx->region.h;
+}
+
+
+static inline struct cdata *cdata_new(struct resource *res,
+        const SDL_Rect *region)
+{
+    struct cdata *ctx = sage_heap_new(sizeof *ctx);
+
+    ctx->res = res;
 
-    ctx->proj.w = ctx->clip.w;
-    ctx->proj.h = ctx->clip.h;
+    if (region)
+        ctx->region = *region;
+    else {
+        ctx->region.x = ctx->region.y = 0;
+        ctx->region.w = res->size.w;
+        ctx->region.h = res->size.h;
+    }
 
+    cdata_reset(ctx);
     return ctx;
 }
 
@@ -35,7 +127,7 @@ static inline void *cdata_copy(const void *ctx)
 {
     const struct cdata *hnd = (const struct cdata *) ctx;
 
-    struct cdata *cp = cdata_new(hnd->path);
+    struct cdata *cp = cdata_new(resource_copy(hnd->res), &hnd->region);
     cp->clip = hnd->clip;
     cp->proj = hnd->proj;
 
@@ -46,8 +138,8 @@ static inline void *cdata_copy(const void *ctx)
 static inline void cdata_free(void **ctx)
 {
     struct cdata *hnd = *((struct cdata **) ctx);
-    sage_heap_free((void **) &hnd->path);
-    SDL_DestroyTexture(hnd->tex);
+    resource_free(&hnd->res);
+    sage_heap_free(ctx);
 }
 
 
@@ -55,7 +147,128 @@ extern sage_texture *sage_texture_new(sage_id texid, const char *path)
 {
     sage_assert (texid && path && *path);
     struct sage_object_vtable vt = { .copy = &cdata_copy, .free = &cdata_free };
-    return sage_object_new(texid, cdata_new(path), &vt);
+
+    SDL_Texture *tex;
+    SDL_Surface *surf;
+
+    if (sage_screen_framebuffer(NULL)) {
+        sage_require (surf = IMG_Load(path));
+        sage_require (tex = SDL_CreateTextureFromSurface(sage_screen_brush(),
+                    surf));
+        resource_pixels(tex, surf);
+        SDL_FreeSurface(surf);
+    } else
+        sage_require (tex = IMG_LoadTexture(sage_screen_brush(), path));
+
+    return sage_object_new(texid, cdata_new(resource_new(tex), NULL), &vt);
+}
+
+
+extern sage_texture *sage_texture_new_surface(sage_id texid, void *surf)
+{
+    sage_assert (surf);
+    struct sage_object_vtable vt = { .copy = &cdata_copy, .free = &cdata_free };
+
+    SDL_Texture *tex;
+    sage_require (tex = SDL_CreateTextureFromSurface(sage_screen_brush(),
+                surf));
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+    resource_pixels(tex, surf);
+
+    return sage_object_new(texid, cdata_new(resource_new(tex), NULL), &vt);
+}
+
+
+/*
+ * The sage_texture_new_pixels() interface function creates a new texture from
+ * raw pixel data that is already in the pixel format fmt, copying the pixels
+ * straight to the renderer without any intermediate decoding or conversion;
+ * only the software backend keeps a converted copy, for the tile rasteriser.
+ */
+extern sage_texture *sage_texture_new_pixels(sage_id texid, const void *pixels,
+        struct sage_area_t area, size_t pitch, uint32_t fmt)
+{
+    sage_assert (pixels && area.w && area.h && pitch);
+    struct sage_object_vtable vt = { .copy = &cdata_copy, .free = &cdata_free };
+
+    SDL_Texture *tex;
+    sage_require (tex = SDL_CreateTexture(sage_screen_brush(), fmt,
+                SDL_TEXTUREACCESS_STATIC, area.w, area.h));
+    sage_require (!SDL_UpdateTexture(tex, NULL, pixels, (int) pitch));
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+
+    SDL_Surface *surf;
+    if (sage_screen_framebuffer(NULL) && (surf =
+            SDL_CreateRGBSurfaceWithFormatFrom((void *) pixels, area.w, area.h,
+                SDL_BITSPERPIXEL(fmt), (int) pitch, fmt))) {
+        resource_pixels(tex, surf);
+        SDL_FreeSurface(surf);
+    }
+
+    return sage_object_new(texid, cdata_new(resource_new(tex), NULL), &vt);
+}
+
+
+/*
+ * The sage_texture_new_target() interface function creates a new blank texture
+ * of a given area that can be drawn into, so that content which rarely changes
+ * can be rendered once and then drawn as a single texture. The texture starts
+ * out fully transparent.
+ *
+ * Blending a translucent pixel into a transparent target leaves its colour
+ * already multiplied by its alpha, so the target is drawn with a blend mode
+ * that takes the colour as it is; blending it again would apply the alpha a
+ * second time and darken it. Renderers without custom blend modes keep the
+ * ordinary blend mode.
+ */
+extern sage_texture *sage_texture_new_target(sage_id texid,
+        struct sage_area_t area)
+{
+    sage_assert (area.w && area.h);
+    struct sage_object_vtable vt = { .copy = &cdata_copy, .free = &cdata_free };
+
+    SDL_Texture *tex;
+    sage_require (tex = SDL_CreateTexture(sage_screen_brush(),
+                SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, area.w,
+                area.h));
+
+    SDL_BlendMode pma = SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE,
+            SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+            SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+            SDL_BLENDOPERATION_ADD);
+
+    if (SDL_SetTextureBlendMode(tex, pma))
+        SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+
+    sage_texture *ctx = sage_object_new(texid,
+            cdata_new(resource_new(tex), NULL), &vt);
+    sage_texture_target_begin(ctx);
+    sage_texture_target_end();
+
+    return ctx;
+}
+
+
+extern sage_texture *sage_texture_new_region(sage_id texid,
+        const sage_texture *src, struct sage_point_t nw,
+        struct sage_area_t area)
+{
+    sage_assert (src);
+    const struct cdata *cd = sage_object_cdata(src);
+    struct sage_object_vtable vt = { .copy = &cdata_copy, .free = &cdata_free };
+
+    SDL_Rect region = {
+        .x = cd->region.x + (int) nw.x,
+        .y = cd->region.y + (int) nw.y,
+        .w = area.w,
+        .h = area.h
+    };
+
+    sage_assert (region.x + region.w <= cd->region.x + cd->region.w);
+    sage_assert (region.y + region.h <= cd->region.y + cd->region.h);
+
+    return sage_object_new(texid, cdata_new(resource_copy(cd->res), &region),
+            &vt);
 }
 
 
@@ -73,12 +286,7 @@ extern struct sage_area_t sage_texture_area(const sage_texture *ctx)
     sage_assert (ctx);
 
     const struct cdata *cd = sage_object_cdata(ctx);
-    sage_assert (cd->tex);
-
-    int w, h;
-    SDL_QueryTexture(cd->tex, NULL, NULL, &w, &h);
-
-    struct sage_area_t area = { .w = w, .h = h };
+    struct sage_area_t area = { .w = cd->region.w, .h = cd->region.h };
     return area;
 }
 
@@ -88,7 +296,7 @@ extern void sage_texture_clip(sage_texture **ctx, struct sage_point_t nw,
 {
     sage_assert (ctx);
     struct cdata *cd = sage_object_cdata_mutable(ctx);
-    
+
     cd->clip.x = (int) nw.x;
     cd->clip.y = (int) nw.y;
     cd->clip.w = clip.w;
@@ -109,12 +317,7 @@ extern void sage_texture_reset(sage_texture **ctx)
     sage_assert (ctx);
     struct cdata *cd = (struct cdata *) sage_object_cdata_mutable(ctx);
 
-    cd->clip.x = cd->clip.y = 0;
-    sage_assert (cd->tex);
-    SDL_QueryTexture(cd->tex, NULL, NULL, &cd->clip.w, &cd->clip.h);
-
-    cd->proj.w = cd->clip.w;
-    cd->proj.h = cd->clip.h;
+    cdata_reset(cd);
 }
 
 
@@ -123,15 +326,139 @@ extern void sage_texture_draw(const sage_texture *ctx, struct sage_point_t dst)
     sage_assert (ctx);
     const struct cdata *cd = (const struct cdata *) sage_object_cdata(ctx);
 
+    struct sage_point_t nw = { .x = cd->clip.x, .y = cd->clip.y };
+    struct sage_area_t clip = { .w = cd->clip.w, .h = cd->clip.h };
+    sage_texture_draw_clip(ctx, nw, clip, cd->proj, dst);
+}
+
+
+/*
+ * The sage_texture_draw_clip() interface function draws the area clip at the
+ * offset nw of a texture, scaled to the projection proj, at the point dst of
+ * the screen. The source and destination rectangles are computed on the stack
+ * and handed straight to the renderer, so unlike sage_texture_clip() and
+ * sage_texture_scale() the texture itself is never modified, and drawing a
+ * shared texture never triggers a copy.
+ */
+extern SAGE_HOT void sage_texture_draw_clip(const sage_texture *ctx,
+        struct sage_point_t nw, struct sage_area_t clip,
+        struct sage_area_t proj, struct sage_point_t dst)
+{
+    if (sage_unlikely (!sage_screen_visible(dst, proj))) {
+        sage_stats_sprite(proj, false);
+        return;
+    }
+
+    sage_assert (ctx);
+    sage_stats_sprite(proj, true);
+    const struct cdata *cd = (const struct cdata *) sage_object_cdata(ctx);
+
+    SDL_Rect from = {
+        .x = cd->region.x + (int) nw.x,
+        .y = cd->region.y + (int) nw.y,
+        .w = clip.w,
+        .h = clip.h
+    };
+
     SDL_Rect to = {
         .x = (int) dst.x,
         .y = (int) dst.y,
-        .w = cd->proj.w,
-        .h = cd->proj.h
+        .w = proj.w,
+        .h = proj.h
     };
 
-    sage_assert (cd->tex);
-    SDL_RenderCopy(sage_screen_brush(), cd->tex, &cd->clip, &to);
+    if (sage_likely (sage_batch_active())) {
+        struct sage_point_t src = { .x = from.x, .y = from.y };
+        struct sage_point_t at = { .x = to.x, .y = to.y };
+
+        if (sage_queue_active())
+            sage_queue_push(cd->res->serial, cd->res->tex, cd->res->size, src,
+                    clip, at, proj);
+        else
+            sage_batch_push(cd->res->tex, cd->res->size, src, clip, at, proj);
+    } else {
+        SDL_RenderCopy(sage_screen_brush(), cd->res->tex, &from, &to);
+        sage_stats_draw(cd->res->tex, 0.0);
+    }
 }
 
 
+
+/*
+ * The sage_texture_uv() interface function gets the corners of a texture, or
+ * of the region of a texture that it refers to, as normalised coordinates into
+ * the underlying pixels; the north-west corner is written to uv[0] and uv[1],
+ * and the south-east corner to uv[2] and uv[3]. These are the coordinates that
+ * sage_texture_draw_geometry() expects.
+ */
+extern void sage_texture_uv(const sage_texture *ctx, float uv[4])
+{
+    sage_assert (ctx && uv);
+    const struct cdata *cd = (const struct cdata *) sage_object_cdata(ctx);
+
+    uv[0] = (float) cd->region.x / cd->res->size.w;
+    uv[1] = (float) cd->region.y / cd->res->size.h;
+    uv[2] = (float) (cd->region.x + cd->region.w) / cd->res->size.w;
+    uv[3] = (float) (cd->region.y + cd->region.h) / cd->res->size.h;
+}
+
+
+/*
+ * The sage_texture_draw_geometry() interface function draws indexed triangles
+ * textured with a texture in a single call to the renderer. The nvtx vertices
+ * are given as separate arrays of positions, SDL_Color colours and texture
+ * coordinates, two floats per vertex for positions and coordinates. Any quads
+ * pending in the draw queue or the sprite batch are flushed first, so that the
+ * geometry is drawn over them.
+ */
+extern SAGE_HOT void sage_texture_draw_geometry(const sage_texture *ctx,
+        const float *xy, const void *col, const float *uv, size_t nvtx,
+        const int *idx, size_t nidx)
+{
+    sage_assert (ctx && xy && col && uv && idx);
+    const struct cdata *cd = (const struct cdata *) sage_object_cdata(ctx);
+
+    if (sage_unlikely (!nidx))
+        return;
+
+    if (sage_queue_active())
+        sage_queue_flush();
+
+    if (sage_batch_active())
+        sage_batch_flush();
+
+    SDL_RenderGeometryRaw(sage_screen_brush(), cd->res->tex, xy,
+            2 * sizeof *xy, col, sizeof (SDL_Color), uv, 2 * sizeof *uv,
+            (int) nvtx, idx, (int) nidx, sizeof *idx);
+    sage_stats_geometry(cd->res->tex, xy, idx, nidx);
+}
+
+
+/*
+ * The sage_texture_target_begin() interface function redirects drawing into a
+ * texture created by sage_texture_new_target(), and clears it to transparent;
+ * drawing goes back to where it was on the matching call to
+ * sage_texture_target_end(). Since the pixels of the texture are shared by all
+ * of its copies, they all see what is drawn.
+ */
+extern void sage_texture_target_begin(const sage_texture *ctx)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = (const struct cdata *) sage_object_cdata(ctx);
+    SDL_Renderer *brush = sage_screen_brush();
+
+    sage_screen_target_push(cd->res->tex, cd->res->size);
+
+    uint8_t r, g, b, a;
+    SDL_GetRenderDrawColor(brush, &r, &g, &b, &a);
+    SDL_SetRenderDrawColor(brush, 0, 0, 0, 0);
+    SDL_RenderClear(brush);
+    SDL_SetRenderDrawColor(brush, r, g, b, a);
+    sage_stats_draw(NULL, (double) cd->res->size.w * cd->res->size.h);
+}
+
+
+extern void sage_texture_target_end(void)
+{
+    sage_screen_target_pop();
+}
@@ -0,0 +1,360 @@
+#include <math.h>
+#include <string.h>
+#include "graphics.h"
+
+
+/*
+ * A tilemap is a grid of tile indices into a tileset texture. Index 0 leaves a
+ * cell empty, and index n draws the nth tile of the tileset, counting row by
+ * row from the top left. The grid is split into square chunks of CHUNK_TILES
+ * tiles a side, with the tiles of each chunk stored together, so that a chunk
+ * can be pre-rendered into a cached target texture and then drawn as a single
+ * quad. A chunk is only rendered again after one of its tiles has changed.
+ *
+ * At most CHUNK_CACHE_MAX chunks hold a cache at any one time; when another is
+ * needed, the cache of the chunk that has gone longest without being drawn is
+ * released. Caches of chunks drawn in the current frame are never released, so
+ * the limit is exceeded rather than thrashed if more chunks than that are on
+ * screen at once.
+ *
+ * The caches are not part of the value of a tilemap, and drawing must not
+ * change the tilemap it is given. They are kept in a table of slots, one for
+ * each chunk, that the tilemap points to rather than holds, so that drawing
+ * updates the table and leaves the tilemap itself, and its revision, alone.
+ * Each copy of the data of a tilemap gets a table of its own, which starts out
+ * empty.
+ */
+
+
+#define CHUNK_TILES ((size_t) 32)
+#define CHUNK_CACHE_MAX ((size_t) 32)
+
+
+struct chunk {
+    uint16_t tiles[CHUNK_TILES * CHUNK_TILES];
+    size_t nset;
+};
+
+
+struct slot {
+    sage_texture *tex;
+    uint64_t used;
+    bool dirty;
+};
+
+
+struct cache {
+    struct slot *slots;
+    size_t len;
+    size_t ncache;
+    uint64_t tick;
+};
+
+
+struct cdata {
+    sage_texture *set;
+    uint16_t cols;
+    uint16_t ntiles;
+    struct sage_area_t tile;
+    struct sage_area_t len;
+    size_t ncx;
+    size_t ncy;
+    struct chunk *chunks;
+    struct cache *cache;
+};
+
+
+static struct cache *cache_new(size_t len)
+{
+    struct cache *ctx = sage_heap_new(sizeof *ctx);
+
+    ctx->slots = sage_heap_new(sizeof *ctx->slots * len);
+    ctx->len = len;
+    ctx->ncache = 0;
+    ctx->tick = 0;
+
+    for (register size_t i = 0; i < len; i++) {
+        ctx->slots[i].tex = NULL;
+        ctx->slots[i].used = 0;
+        ctx->slots[i].dirty = true;
+    }
+
+    return ctx;
+}
+
+
+static void cache_free(struct cache **ctx)
+{
+    struct cache *hnd = *ctx;
+
+    for (register size_t i = 0; i < hnd->len; i++)
+        sage_texture_free(&hnd->slots[i].tex);
+
+    sage_heap_free((void **) &hnd->slots);
+    sage_heap_free((void **) ctx);
+}
+
+
+static inline struct cdata *cdata_new(sage_id texid, struct sage_area_t tile,
+        struct sage_area_t len)
+{
+    struct cdata *ctx = sage_heap_new(sizeof *ctx);
+
+    ctx->set = sage_texture_factory_clone(texid);
+    ctx->tile = tile;
+    ctx->len = len;
+
+    struct sage_area_t area = sage_texture_area(ctx->set);
+    ctx->cols = area.w / tile.w;
+    ctx->ntiles = ctx->cols * (area.h / tile.h);
+    sage_assert (ctx->ntiles);
+
+    ctx->ncx = (len.w + CHUNK_TILES - 1) / CHUNK_TILES;
+    ctx->ncy = (len.h + CHUNK_TILES - 1) / CHUNK_TILES;
+    ctx->chunks = sage_heap_new(sizeof *ctx->chunks * ctx->ncx * ctx->ncy);
+    memset(ctx->chunks, 0, sizeof *ctx->chunks * ctx->ncx * ctx->ncy);
+
+    ctx->cache = cache_new(ctx->ncx * ctx->ncy);
+
+    return ctx;
+}
+
+
+static inline void *cdata_copy(const void *ctx)
+{
+    const struct cdata *hnd = (const struct cdata *) ctx;
+    struct cdata *cp = cdata_new(sage_texture_id(hnd->set), hnd->tile,
+            hnd->len);
+
+    for (register size_t i = 0; i < hnd->ncx * hnd->ncy; i++) {
+        memcpy(cp->chunks[i].tiles, hnd->chunks[i].tiles,
+                sizeof cp->chunks[i].tiles);
+        cp->chunks[i].nset = hnd->chunks[i].nset;
+    }
+
+    return cp;
+}
+
+
+static inline void cdata_free(void **ctx)
+{
+    struct cdata *hnd = *((struct cdata **) ctx);
+
+    cache_free(&hnd->cache);
+    sage_heap_free((void **) &hnd->chunks);
+    sage_texture_free(&hnd->set);
+    sage_heap_free(ctx);
+}
+
+
+static inline struct chunk *chunk_at(const struct cdata *ctx, uint16_t col,
+        uint16_t row, size_t *idx)
+{
+    sage_assert (col < ctx->len.w && row < ctx->len.h);
+
+    *idx = (row % CHUNK_TILES) * CHUNK_TILES + col % CHUNK_TILES;
+    return &ctx->chunks[(row / CHUNK_TILES) * ctx->ncx + col / CHUNK_TILES];
+}
+
+
+static inline struct sage_area_t chunk_area(const struct cdata *ctx, size_t cx,
+        size_t cy)
+{
+    size_t w = ctx->len.w - cx * CHUNK_TILES;
+    size_t h = ctx->len.h - cy * CHUNK_TILES;
+
+    struct sage_area_t area = {
+        .w = (w < CHUNK_TILES ? w : CHUNK_TILES) * ctx->tile.w,
+        .h = (h < CHUNK_TILES ? h : CHUNK_TILES) * ctx->tile.h
+    };
+
+    return area;
+}
+
+
+static void cache_evict(struct cache *ctx)
+{
+    struct slot *lru = NULL;
+
+    for (register size_t i = 0; i < ctx->len; i++) {
+        struct slot *itr = &ctx->slots[i];
+
+        if (itr->tex && itr->used < ctx->tick && (!lru
+                    || itr->used < lru->used))
+            lru = itr;
+    }
+
+    if (lru) {
+        sage_texture_free(&lru->tex);
+        ctx->ncache--;
+    }
+}
+
+
+static void chunk_render(const struct cdata *ctx, const struct chunk *chk,
+        struct slot *slot, struct sage_area_t area)
+{
+    if (!slot->tex) {
+        if (ctx->cache->ncache >= CHUNK_CACHE_MAX)
+            cache_evict(ctx->cache);
+
+        slot->tex = sage_texture_new_target(0, area);
+        ctx->cache->ncache++;
+    }
+
+    sage_texture_target_begin(slot->tex);
+
+    for (register size_t i = 0; i < CHUNK_TILES * CHUNK_TILES; i++) {
+        uint16_t tile = chk->tiles[i];
+
+        if (!tile)
+            continue;
+
+        struct sage_point_t nw = {
+            .x = ((tile - 1) % ctx->cols) * ctx->tile.w,
+            .y = ((tile - 1) / ctx->cols) * ctx->tile.h
+        };
+
+        struct sage_point_t at = {
+            .x = (i % CHUNK_TILES) * ctx->tile.w,
+            .y = (i / CHUNK_TILES) * ctx->tile.h
+        };
+
+        sage_texture_draw_clip(ctx->set, nw, ctx->tile, ctx->tile, at);
+    }
+
+    sage_texture_target_end();
+    slot->dirty = false;
+}
+
+
+/*
+ * The sage_tilemap_new() interface function creates a new tilemap of len tiles
+ * across and down, with every cell empty. The tiles are drawn from the texture
+ * registered under texid, which is cut into tiles of the area tile.
+ */
+extern sage_tilemap *sage_tilemap_new(sage_id id, sage_id texid,
+        struct sage_area_t tile, struct sage_area_t len)
+{
+    sage_assert (texid && tile.w && tile.h && len.w && len.h);
+    struct sage_object_vtable vt = { .copy = &cdata_copy, .free = &cdata_free };
+
+    return sage_object_new(id, cdata_new(texid, tile, len), &vt);
+}
+
+
+extern inline sage_tilemap *sage_tilemap_copy(const sage_tilemap *ctx);
+
+
+extern inline void sage_tilemap_free(sage_tilemap **ctx);
+
+
+extern inline sage_id sage_tilemap_id(const sage_tilemap *ctx);
+
+
+extern struct sage_area_t sage_tilemap_len(const sage_tilemap *ctx)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = sage_object_cdata(ctx);
+    return cd->len;
+}
+
+
+extern uint16_t sage_tilemap_tile(const sage_tilemap *ctx, uint16_t col,
+        uint16_t row)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = sage_object_cdata(ctx);
+
+    size_t idx;
+    const struct chunk *chk = chunk_at(cd, col, row, &idx);
+    return chk->tiles[idx];
+}
+
+
+/*
+ * The sage_tilemap_tile_set() interface function sets the tile at a given
+ * column and row of a tilemap. Only the chunk holding the tile is marked to be
+ * rendered again, and only if the tile has actually changed.
+ */
+extern void sage_tilemap_tile_set(sage_tilemap **ctx, uint16_t col,
+        uint16_t row, uint16_t tile)
+{
+    sage_assert (ctx);
+    struct cdata *cd = sage_object_cdata_mutable(ctx);
+    sage_assert (tile <= cd->ntiles);
+
+    size_t idx;
+    struct chunk *chk = chunk_at(cd, col, row, &idx);
+
+    if (chk->tiles[idx] == tile)
+        return;
+
+    chk->nset += !chk->tiles[idx];
+    chk->nset -= !tile;
+    chk->tiles[idx] = tile;
+    cd->cache->slots[chk - cd->chunks].dirty = true;
+}
+
+
+/*
+ * The sage_tilemap_draw() interface function draws a tilemap with its north-
+ * west corner at the point dst. Only the chunks that overlap the area being
+ * drawn to are considered; of those, empty chunks are skipped, and the rest
+ * are drawn from their caches, which are first rendered if they are missing or
+ * out of date. Only the table of caches is written to, never the tilemap.
+ */
+extern SAGE_HOT void sage_tilemap_draw(const sage_tilemap *ctx,
+        struct sage_point_t dst)
+{
+    sage_assert (ctx);
+    const struct cdata *cd = sage_object_cdata(ctx);
+    struct cache *cache = cd->cache;
+    struct sage_area_t view = sage_screen_area();
+
+    const float cw = (float) (CHUNK_TILES * cd->tile.w);
+    const float ch = (float) (CHUNK_TILES * cd->tile.h);
+
+    float fx0 = floorf(-dst.x / cw), fx1 = ceilf((view.w - dst.x) / cw);
+    float fy0 = floorf(-dst.y / ch), fy1 = ceilf((view.h - dst.y) / ch);
+
+    size_t cx0 = fx0 > 0 ? (size_t) fx0 : 0;
+    size_t cy0 = fy0 > 0 ? (size_t) fy0 : 0;
+    size_t cx1 = fx1 > 0 ? (size_t) fx1 : 0;
+    size_t cy1 = fy1 > 0 ? (size_t) fy1 : 0;
+
+    if (cx1 > cd->ncx)
+        cx1 = cd->ncx;
+    if (cy1 > cd->ncy)
+        cy1 = cd->ncy;
+
+    cache->tick++;
+
+    for (register size_t cy = cy0; cy < cy1; cy++) {
+        for (register size_t cx = cx0; cx < cx1; cx++) {
+            const struct chunk *chk = &cd->chunks[cy * cd->ncx + cx];
+            struct slot *slot = &cache->slots[cy * cd->ncx + cx];
+
+            if (!chk->nset)
+                continue;
+
+            struct sage_area_t area = chunk_area(cd, cx, cy);
+            struct sage_point_t at = {
+                .x = dst.x + cx * cw,
+                .y = dst.y + cy * ch
+            };
+
+            if (sage_unlikely (!sage_screen_visible(at, area)))
+                continue;
+
+            slot->used = cache->tick;
+
+            if (sage_unlikely (!slot->tex || slot->dirty))
+                chunk_render(cd, chk, slot, area);
+
+            struct sage_point_t nw = { .x = 0, .y = 0 };
+            sage_texture_draw_clip(slot->tex, nw, area, area, at);
+        }
+    }
+}
+
@@ -0,0 +1,757 @@
+#include "../hid/hid.h"
+#include "script.h"
+
+
+/*
+ * Binding an entity class or a scene to script procedures gets a vtable whose
+ * callbacks call the procedures named by globals, so that the callbacks pick
+ * up any later redefinition of those globals. The globals are looked up once,
+ * when binding, and each call goes through their cells; callbacks that are not
+ * bound are left NULL so that the engine defaults apply.
+ *
+ * The entity or scene that a callback is running for is passed to the script
+ * procedure as a handle. Handles are reused rather than allocated on each call,
+ * with one handle of each kind for each level of nesting, and are cleared once
+ * the callback returns so that a script that keeps hold of one cannot reach a
+ * stale entity. The handle passed to an entity draw callback is read-only, as
+ * the engine does not allow entities to change while being drawn.
+ *
+ * An entity class can instead be bound in batches, so that its update procedure
+ * is called once per frame for all the entities of the class rather than once
+ * for each. The procedure is passed columns rather than handles: vectors of the
+ * x and y positions of the entities and of their payloads, in the same order,
+ * which it can loop over without leaving the VM. Positions that the procedure
+ * changes in the columns are written back to the entities when it returns. The
+ * column vectors are reused from frame to frame, and so are only valid for the
+ * duration of the call.
+ *
+ * The primitives that read the keyboard and mouse are kept apart from the rest,
+ * as the input state they read is held by the thread that polls events. They
+ * are only defined by sage_script_bind_input(), which the game calls on that
+ * thread; the VMs of workers never define them.
+ */
+
+
+#define BINDS_LEN ((size_t) 16)
+#define HANDLES_DEPTH ((size_t) 8)
+#define POINTS_LEN ((size_t) 64)
+
+
+enum handle_t {
+    HANDLE_ENTITY = 0,
+    HANDLE_SCENE,
+
+    HANDLE_COUNT
+};
+
+
+enum hook_t {
+    HOOK_ENTITY_UPDATE = 0,
+    HOOK_ENTITY_DRAW,
+    HOOK_ENTITY_BATCH,
+
+    HOOK_SCENE_START = 0,
+    HOOK_SCENE_STOP,
+    HOOK_SCENE_UPDATE,
+
+    HOOK_COUNT
+};
+
+
+enum column_t {
+    COLUMN_X = 0,
+    COLUMN_Y,
+    COLUMN_PAYLOAD,
+
+    COLUMN_COUNT
+};
+
+
+struct binding {
+    sage_id id;
+    struct sage_script_global_t *hooks[HOOK_COUNT];
+    struct sage_script_global_t *cols[COLUMN_COUNT];
+};
+
+
+struct bindings {
+    struct binding *items;
+    size_t len;
+    size_t cap;
+};
+
+
+static thread_local struct {
+    struct bindings ents;
+    struct bindings scns;
+    sage_value_t handles[HANDLES_DEPTH][HANDLE_COUNT];
+    size_t depth;
+    struct sage_point_t *pts;
+    size_t cappts;
+} *bind = NULL;
+
+
+static struct binding *binding_find(const struct bindings *set, sage_id id)
+{
+    for (register size_t i = 0; i < set->len; i++) {
+        if (set->items[i].id == id)
+            return &set->items[i];
+    }
+
+    return NULL;
+}
+
+
+static struct binding *binding_add(struct bindings *set, sage_id id)
+{
+    struct binding *b = binding_find(set, id);
+    if (b)
+        return b;
+
+    if (sage_unlikely (set->len == set->cap)) {
+        set->cap *= 2;
+        set->items = sage_heap_resize(set->items, sizeof *set->items
+                * set->cap);
+    }
+
+    b = &set->items[set->len++];
+    b->id = id;
+
+    for (register size_t i = 0; i < HOOK_COUNT; i++)
+        b->hooks[i] = NULL;
+
+    for (register size_t i = 0; i < COLUMN_COUNT; i++)
+        b->cols[i] = NULL;
+
+    return b;
+}
+
+
+static struct sage_script_global_t *hook(const char *name)
+{
+    return name ? sage_script_global_cell(sage_value_symbol(name,
+                strlen(name))) : NULL;
+}
+
+
+static sage_value_t handle_enter(enum handle_t kind, void *ptr, bool mutable)
+{
+    sage_value_t val = bind->depth < HANDLES_DEPTH
+        ? bind->handles[bind->depth][kind] : sage_value_handle((uint8_t) kind);
+
+    struct sage_value_handle_t *hnd = sage_value_object(val);
+    hnd->ptr = ptr;
+    hnd->mutable = mutable;
+
+    bind->depth++;
+    return val;
+}
+
+
+static void handle_leave(sage_value_t val)
+{
+    ((struct sage_value_handle_t *) sage_value_object(val))->ptr = NULL;
+    bind->depth--;
+}
+
+
+static void run(const struct sage_script_global_t *g, enum handle_t kind,
+        void *ptr, bool mutable)
+{
+    sage_value_t hnd = handle_enter(kind, ptr, mutable);
+
+    sage_script_call(g->val, &hnd, 1, NULL);
+    handle_leave(hnd);
+}
+
+
+/*
+ * The entity_update() helper function runs the update procedure of the class
+ * of an entity. Entities made before their class was bound again in batches
+ * still have this callback, and are left to the batch.
+ */
+static void entity_update(sage_entity **ctx)
+{
+    const struct binding *b = binding_find(&bind->ents, sage_entity_class(
+                *ctx));
+
+    sage_assert (b);
+    if (b->hooks[HOOK_ENTITY_UPDATE])
+        run(b->hooks[HOOK_ENTITY_UPDATE], HANDLE_ENTITY, ctx, true);
+}
+
+
+static void entity_draw(const sage_entity *ctx)
+{
+    const struct binding *b = binding_find(&bind->ents, sage_entity_class(ctx));
+
+    sage_assert (b && b->hooks[HOOK_ENTITY_DRAW]);
+    run(b->hooks[HOOK_ENTITY_DRAW], HANDLE_ENTITY, (void *) ctx, false);
+}
+
+
+static void scene_hook(sage_scene **ctx, enum hook_t idx)
+{
+    const struct binding *b = binding_find(&bind->scns, sage_scene_id(*ctx));
+
+    sage_assert (b && b->hooks[idx]);
+    run(b->hooks[idx], HANDLE_SCENE, ctx, true);
+}
+
+
+static void scene_start(sage_scene **ctx)
+{
+    scene_hook(ctx, HOOK_SCENE_START);
+}
+
+
+static void scene_stop(sage_scene **ctx)
+{
+    scene_hook(ctx, HOOK_SCENE_STOP);
+}
+
+
+static void scene_update(sage_scene **ctx)
+{
+    scene_hook(ctx, HOOK_SCENE_UPDATE);
+}
+
+
+static struct sage_value_handle_t *handle(sage_value_t val,
+        enum handle_t kind, const char *who)
+{
+    if (sage_unlikely (!sage_value_is(val, SAGE_VALUE_TYPE_HANDLE)))
+        sage_script_error("%s: expected a handle", who);
+
+    struct sage_value_handle_t *hnd = sage_value_object(val);
+
+    if (sage_unlikely (hnd->kind != kind))
+        sage_script_error("%s: wrong kind of handle", who);
+
+    if (sage_unlikely (!hnd->ptr))
+        sage_script_error("%s: handle is no longer valid", who);
+
+    return hnd;
+}
+
+
+static const sage_entity *entity(sage_value_t val, const char *who)
+{
+    const struct sage_value_handle_t *hnd = handle(val, HANDLE_ENTITY, who);
+
+    return hnd->mutable ? *(sage_entity **) hnd->ptr : hnd->ptr;
+}
+
+
+static sage_entity **entity_mutable(sage_value_t val, const char *who)
+{
+    const struct sage_value_handle_t *hnd = handle(val, HANDLE_ENTITY, who);
+
+    if (sage_unlikely (!hnd->mutable))
+        sage_script_error("%s: entity cannot be changed here", who);
+
+    return hnd->ptr;
+}
+
+
+static inline sage_scene **scene(sage_value_t val, const char *who)
+{
+    return handle(val, HANDLE_SCENE, who)->ptr;
+}
+
+
+static inline double num(sage_value_t val, const char *who)
+{
+    if (sage_unlikely (!sage_value_is_number(val)))
+        sage_script_error("%s: expected a number", who);
+
+    return sage_value_to_number(val);
+}
+
+
+static inline uint64_t whole(sage_value_t val, const char *who)
+{
+    const double n = num(val, who);
+
+    if (sage_unlikely (n < 0.0 || n != (double) (uint64_t) n))
+        sage_script_error("%s: expected a non-negative integer", who);
+
+    return (uint64_t) n;
+}
+
+
+static struct sage_point_t point(const sage_entity *ent)
+{
+    sage_vector *pos = sage_entity_position(ent);
+    struct sage_point_t pt = sage_vector_point(pos);
+
+    sage_vector_free(&pos);
+    return pt;
+}
+
+
+/*
+ * The column() helper function gets the vector that holds column col of the
+ * batch of entities bound by b, making it anew if the batch has changed size.
+ * Each column is kept in a global of its own that cannot be named by scripts,
+ * so that the collector treats it as a root and keeps the vector up to date as
+ * it moves.
+ */
+static struct sage_value_vector_t *column(struct binding *b,
+        enum column_t col, size_t len)
+{
+    if (sage_unlikely (!b->cols[col]))
+        b->cols[col] = sage_script_global_cell(sage_value_symbol_unique(
+                    "column"));
+
+    struct sage_script_global_t *g = b->cols[col];
+
+    if (!sage_value_is(g->val, SAGE_VALUE_TYPE_VECTOR) || ((struct
+                    sage_value_vector_t *) sage_value_object(g->val))->len
+            != len)
+        g->val = sage_value_vector(len, SAGE_VALUE_FALSE);
+
+    return sage_value_object(g->val);
+}
+
+
+/*
+ * The payload_set() helper function puts a handle to the payload obj in slot
+ * idx of the payload column vec. A handle left in the slot from an earlier
+ * frame is kept if it still refers to the same payload, so that a payload that
+ * does not change does not need a new handle each frame.
+ */
+static void payload_set(struct sage_value_vector_t *vec, size_t idx,
+        const sage_object *obj)
+{
+    if (!obj) {
+        vec->items[idx] = SAGE_VALUE_FALSE;
+        return;
+    }
+
+    if (sage_value_bridged(vec->items[idx]) == obj)
+        return;
+
+    const sage_value_t val = sage_value_bridge(obj);
+
+    sage_value_barrier(vec, val);
+    vec->items[idx] = val;
+}
+
+
+static void entity_batch(sage_id cls, const size_t *idx, size_t len)
+{
+    struct binding *b = binding_find(&bind->ents, cls);
+    sage_assert (b && b->hooks[HOOK_ENTITY_BATCH]);
+
+    if (sage_unlikely (len > bind->cappts)) {
+        bind->cappts = len * 2;
+        bind->pts = sage_heap_resize(bind->pts, sizeof *bind->pts
+                * bind->cappts);
+    }
+
+    sage_value_t argv[COLUMN_COUNT];
+    struct sage_value_vector_t *cols[COLUMN_COUNT];
+
+    for (register size_t i = 0; i < COLUMN_COUNT; i++) {
+        cols[i] = column(b, (enum column_t) i, len);
+        argv[i] = sage_value_from_object(cols[i]);
+    }
+
+    for (register size_t i = 0; i < len; i++) {
+        const sage_entity *ent = *sage_arena_entity_mutable(idx[i]);
+
+        bind->pts[i] = point(ent);
+        cols[COLUMN_X]->items[i] = sage_value_number(bind->pts[i].x);
+        cols[COLUMN_Y]->items[i] = sage_value_number(bind->pts[i].y);
+        payload_set(cols[COLUMN_PAYLOAD], i, sage_entity_payload(ent));
+    }
+
+    if (!sage_script_call(b->hooks[HOOK_ENTITY_BATCH]->val, argv,
+                COLUMN_COUNT, NULL))
+        return;
+
+    for (register size_t i = 0; i < len; i++) {
+        const sage_value_t x = cols[COLUMN_X]->items[i];
+        const sage_value_t y = cols[COLUMN_Y]->items[i];
+
+        if (sage_unlikely (!sage_value_is_number(x)
+                    || !sage_value_is_number(y)))
+            continue;
+
+        const float fx = (float) sage_value_to_number(x);
+        const float fy = (float) sage_value_to_number(y);
+
+        if (fx != bind->pts[i].x || fy != bind->pts[i].y) {
+            sage_vector *pos = sage_vector_new(fx, fy);
+
+            sage_entity_position_set(sage_arena_entity_mutable(idx[i]), pos);
+            sage_vector_free(&pos);
+        }
+    }
+}
+
+
+static sage_value_t entity_class(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number((double) sage_entity_class(entity(argv[0],
+                    "entity-class")));
+}
+
+
+static sage_value_t entity_x(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number(point(entity(argv[0], "entity-x")).x);
+}
+
+
+static sage_value_t entity_y(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number(point(entity(argv[0], "entity-y")).y);
+}
+
+
+static sage_value_t entity_position_set(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_entity **ent = entity_mutable(argv[0], "entity-position-set!");
+    sage_vector *pos = sage_vector_new((float) num(argv[1],
+                "entity-position-set!"), (float) num(argv[2],
+                "entity-position-set!"));
+
+    sage_entity_position_set(ent, pos);
+    sage_vector_free(&pos);
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t entity_move(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_entity **ent = entity_mutable(argv[0], "entity-move!");
+    sage_vector *vel = sage_vector_new((float) num(argv[1], "entity-move!"),
+            (float) num(argv[2], "entity-move!"));
+
+    sage_entity_move(ent, vel);
+    sage_vector_free(&vel);
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t entity_layer(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number(sage_entity_layer(entity(argv[0],
+                    "entity-layer")));
+}
+
+
+static sage_value_t entity_layer_set(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    const uint64_t layer = whole(argv[1], "entity-layer-set!");
+
+    if (sage_unlikely (layer >= SAGE_ARENA_LAYERS))
+        sage_script_error("entity-layer-set!: no such layer");
+
+    sage_entity_layer_set(entity_mutable(argv[0], "entity-layer-set!"),
+            (uint8_t) layer);
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t entity_frame_set(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    struct sage_frame_t frm = {
+        .r = (uint16_t) whole(argv[1], "entity-frame-set!"),
+        .c = (uint16_t) whole(argv[2], "entity-frame-set!")
+    };
+
+    sage_entity_frame(entity_mutable(argv[0], "entity-frame-set!"), frm);
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t entity_animate(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_entity_animate(entity_mutable(argv[0], "entity-animate!"),
+            whole(argv[1], "entity-animate!"));
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t entity_visible(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_bool(sage_entity_visible(entity(argv[0],
+                    "entity-visible?")));
+}
+
+
+static sage_value_t entity_focused(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_bool(sage_entity_focused(entity(argv[0],
+                    "entity-focused?")));
+}
+
+
+static sage_value_t entity_payload(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    const sage_object *obj = sage_entity_payload(entity(argv[0],
+                "entity-payload"));
+
+    return obj ? sage_value_bridge(obj) : SAGE_VALUE_FALSE;
+}
+
+
+static sage_value_t key_down(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_bool(sage_keyboard_state((enum sage_keyboard_key)
+                whole(argv[0], "key-down?")) == SAGE_KEYBOARD_STATE_DOWN);
+}
+
+
+static sage_value_t mouse_x(sage_value_t *argv, size_t argc)
+{
+    (void) argv;
+    (void) argc;
+
+    sage_vector *pos = sage_mouse_vector();
+    const float x = sage_vector_x(pos);
+
+    sage_vector_free(&pos);
+    return sage_value_number(x);
+}
+
+
+static sage_value_t mouse_y(sage_value_t *argv, size_t argc)
+{
+    (void) argv;
+    (void) argc;
+
+    sage_vector *pos = sage_mouse_vector();
+    const float y = sage_vector_y(pos);
+
+    sage_vector_free(&pos);
+    return sage_value_number(y);
+}
+
+
+static sage_value_t mouse_down(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    const uint64_t btn = whole(argv[0], "mouse-down?");
+
+    if (sage_unlikely (btn >= SAGE_MOUSE_BUTTON_COUNT))
+        sage_script_error("mouse-down?: no such button");
+
+    return sage_value_bool(sage_mouse_state((enum sage_mouse_button) btn)
+            == SAGE_MOUSE_STATE_DOWN);
+}
+
+
+static sage_value_t scene_id(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number((double) sage_scene_id(*scene(argv[0],
+                    "scene-id")));
+}
+
+
+static sage_value_t scene_entity_push(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_scene_entity_push(scene(argv[0], "scene-entity-push!"),
+            whole(argv[1], "scene-entity-push!"), whole(argv[2],
+                "scene-entity-push!"));
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t scene_entity_pop(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_scene_entity_pop(scene(argv[0], "scene-entity-pop!"), whole(argv[1],
+                "scene-entity-pop!"));
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static const struct {
+    const char *name;
+    sage_value_primitive_f *fn;
+    uint8_t min;
+    uint8_t max;
+} PRIMITIVES[] = {
+    { "entity-class", entity_class, 1, 1 },
+    { "entity-x", entity_x, 1, 1 },
+    { "entity-y", entity_y, 1, 1 },
+    { "entity-position-set!", entity_position_set, 3, 3 },
+    { "entity-move!", entity_move, 3, 3 },
+    { "entity-layer", entity_layer, 1, 1 },
+    { "entity-layer-set!", entity_layer_set, 2, 2 },
+    { "entity-frame-set!", entity_frame_set, 3, 3 },
+    { "entity-animate!", entity_animate, 2, 2 },
+    { "entity-visible?", entity_visible, 1, 1 },
+    { "entity-focused?", entity_focused, 1, 1 },
+    { "entity-payload", entity_payload, 1, 1 },
+    { "scene-id", scene_id, 1, 1 },
+    { "scene-entity-push!", scene_entity_push, 3, 3 },
+    { "scene-entity-pop!", scene_entity_pop, 2, 2 }
+}, INPUTS[] = {
+    { "key-down?", key_down, 1, 1 },
+    { "mouse-x", mouse_x, 0, 0 },
+    { "mouse-y", mouse_y, 0, 0 },
+    { "mouse-down?", mouse_down, 1, 1 }
+};
+
+
+extern void sage_script_bind_start(void)
+{
+    if (sage_unlikely (bind))
+        return;
+
+    bind = sage_heap_new(sizeof *bind);
+    bind->ents.cap = bind->scns.cap = BINDS_LEN;
+    bind->ents.len = bind->scns.len = 0;
+    bind->ents.items = sage_heap_new(sizeof *bind->ents.items * BINDS_LEN);
+    bind->scns.items = sage_heap_new(sizeof *bind->scns.items * BINDS_LEN);
+    bind->depth = 0;
+    bind->cappts = POINTS_LEN;
+    bind->pts = sage_heap_new(sizeof *bind->pts * POINTS_LEN);
+
+    for (register size_t i = 0; i < HANDLES_DEPTH; i++) {
+        for (register size_t j = 0; j < HANDLE_COUNT; j++) {
+            bind->handles[i][j] = sage_value_handle((uint8_t) j);
+            sage_script_pin(bind->handles[i][j]);
+        }
+    }
+
+    for (register size_t i = 0; i < sizeof PRIMITIVES / sizeof *PRIMITIVES;
+            i++)
+        sage_script_primitive(PRIMITIVES[i].name, PRIMITIVES[i].fn,
+                PRIMITIVES[i].min, PRIMITIVES[i].max);
+}
+
+
+/*
+ * The sage_script_bind_input() interface function defines the primitives that
+ * read the keyboard and mouse in the VM of the calling thread, which must be
+ * the thread that polls input events.
+ */
+extern void sage_script_bind_input(void)
+{
+    for (register size_t i = 0; i < sizeof INPUTS / sizeof *INPUTS; i++)
+        sage_script_primitive(INPUTS[i].name, INPUTS[i].fn, INPUTS[i].min,
+                INPUTS[i].max);
+}
+
+
+extern void sage_script_bind_stop(void)
+{
+    if (sage_likely (bind)) {
+        sage_heap_free((void **) &bind->ents.items);
+        sage_heap_free((void **) &bind->scns.items);
+        sage_heap_free((void **) &bind->pts);
+        sage_heap_free((void **) &bind);
+    }
+}
+
+
+/*
+ * The sage_script_entity_bind() interface function binds the entity class cls
+ * to the script procedures held by the globals named update and draw, either
+ * of which may be NULL to keep the engine default. The vtable it returns is
+ * meant to be passed to sage_entity_new() for entities of that class. A class
+ * that has been bound in batches cannot be given an update procedure this way,
+ * as the entities already made for it have no update callback to run it.
+ */
+extern struct sage_entity_vtable sage_script_entity_bind(sage_id cls,
+        const char *update, const char *draw)
+{
+    sage_assert (bind);
+    struct binding *b = binding_add(&bind->ents, cls);
+    sage_require (!update || !b->hooks[HOOK_ENTITY_BATCH]);
+
+    b->hooks[HOOK_ENTITY_UPDATE] = hook(update);
+    b->hooks[HOOK_ENTITY_DRAW] = hook(draw);
+
+    struct sage_entity_vtable vt = {
+        .update = update ? entity_update : NULL,
+        .draw = draw ? entity_draw : NULL
+    };
+
+    return vt;
+}
+
+
+/*
+ * The sage_script_scene_bind() interface function binds the scene id to the
+ * script procedures held by the globals named start, stop and update, any of
+ * which may be NULL to keep the engine default. The vtable it returns is meant
+ * to be passed to sage_scene_new() for the scene.
+ */
+extern struct sage_scene_vtable sage_script_scene_bind(sage_id id,
+        const char *start, const char *stop, const char *update)
+{
+    sage_assert (bind);
+    struct binding *b = binding_add(&bind->scns, id);
+
+    b->hooks[HOOK_SCENE_START] = hook(start);
+    b->hooks[HOOK_SCENE_STOP] = hook(stop);
+    b->hooks[HOOK_SCENE_UPDATE] = hook(update);
+
+    struct sage_scene_vtable vt = {
+        .start = start ? scene_start : NULL,
+        .stop = stop ? scene_stop : NULL,
+        .update = update ? scene_update : NULL,
+        .draw = NULL
+    };
+
+    return vt;
+}
+
+
+/*
+ * The sage_script_entity_batch_bind() interface function binds the entity class
+ * cls in batches, so that the script procedure held by the global named update
+ * is called once per frame with the columns of all the entities of that class,
+ * and the procedure held by the global named draw is called for each entity as
+ * with sage_script_entity_bind(). Either name may be NULL to keep the engine
+ * default. The arena must have been started. A class that was bound before with
+ * sage_script_entity_bind() may be bound again this way; the entities already
+ * made for it are then updated by the batch alone.
+ */
+extern struct sage_entity_vtable sage_script_entity_batch_bind(sage_id cls,
+        const char *update, const char *draw)
+{
+    sage_assert (bind);
+    struct binding *b = binding_add(&bind->ents, cls);
+
+    b->hooks[HOOK_ENTITY_UPDATE] = NULL;
+    b->hooks[HOOK_ENTITY_BATCH] = hook(update);
+    b->hooks[HOOK_ENTITY_DRAW] = hook(draw);
+
+    sage_arena_batch(cls, update ? entity_batch : NULL);
+
+    struct sage_entity_vtable vt = {
+        .update = NULL,
+        .draw = draw ? entity_draw : NULL
+    };
+
+    return vt;
+}
@@ -0,0 +1,711 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "script.h"
+
+
+/*
+ * A bytecode cache holds the compiled code of every top-level form of a script,
+ * so that loading an unchanged script runs its code without reading or
+ * compiling the source again. The cache begins with a header recording the
+ * version of the format, the hash of the source it was compiled from and a
+ * checksum of the rest of the file, and is only used if all three match; any
+ * other cache is ignored and rewritten.
+ *
+ * Each form is stored as the line it ends on followed by its prototype, with
+ * the constants of the prototype stored as tagged values. Interned symbols are
+ * stored by name and interned again on loading, and the globals a prototype
+ * uses are linked to their cells afresh, so that the cache holds no pointers.
+ * All fields are stored in host byte order, as the cache is only meant to be
+ * read back on the machine that wrote it.
+ *
+ * The same encoding of values is used to pass values between the heaps of
+ * different threads, which cannot share objects.
+ */
+
+
+#define CACHE_MAGIC "SAGESBC"
+#define CACHE_VERSION ((uint32_t) 1)
+#define CACHE_BFR_LEN ((size_t) 4096)
+#define CACHE_GENSYMS_LEN ((size_t) 64)
+
+
+enum tag_t {
+    TAG_IMMEDIATE = 0,
+    TAG_LIST,
+    TAG_STRING,
+    TAG_SYMBOL,
+    TAG_GENSYM,
+    TAG_VECTOR,
+    TAG_PROTO
+};
+
+
+struct cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t hash;
+    uint64_t size;
+    uint64_t sum;
+};
+
+
+struct writer {
+    uint8_t *bfr;
+    size_t len;
+    size_t cap;
+    const void *gensyms[CACHE_GENSYMS_LEN];
+    size_t ngensyms;
+};
+
+
+struct reader {
+    const uint8_t *pos;
+    const uint8_t *end;
+    sage_value_t gensyms[CACHE_GENSYMS_LEN];
+    size_t ngensyms;
+    bool err;
+};
+
+
+static uint64_t hash(const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint64_t h = 14695981039346656037u;
+
+    for (register size_t i = 0; i < len; i++)
+        h = (h ^ bytes[i]) * 1099511628211u;
+
+    return h;
+}
+
+
+static void put(struct writer *wr, const void *data, size_t len)
+{
+    if (sage_unlikely (wr->len + len > wr->cap)) {
+        while (wr->len + len > wr->cap)
+            wr->cap *= 2;
+
+        wr->bfr = sage_heap_resize(wr->bfr, wr->cap);
+    }
+
+    memcpy(wr->bfr + wr->len, data, len);
+    wr->len += len;
+}
+
+
+static inline void put_u8(struct writer *wr, uint8_t val)
+{
+    put(wr, &val, sizeof val);
+}
+
+
+static inline void put_u32(struct writer *wr, uint32_t val)
+{
+    put(wr, &val, sizeof val);
+}
+
+
+static bool put_value(struct writer *wr, sage_value_t val);
+
+
+static bool put_proto(struct writer *wr, const struct sage_value_proto_t *p)
+{
+    put_u32(wr, (uint32_t) p->ncode);
+    put(wr, p->code, sizeof *p->code * p->ncode);
+
+    put_u32(wr, (uint32_t) p->nconsts);
+    for (register size_t i = 0; i < p->nconsts; i++) {
+        if (!put_value(wr, p->consts[i]))
+            return false;
+    }
+
+    put_u32(wr, (uint32_t) p->nics);
+    for (register size_t i = 0; i < p->nics; i++) {
+        if (!put_value(wr, p->icsyms[i]))
+            return false;
+    }
+
+    put_u8(wr, p->nups);
+    put(wr, p->ups, sizeof *p->ups * p->nups);
+    put_u8(wr, p->nparams);
+    put_u8(wr, p->nregs);
+    put_u8(wr, p->rest);
+
+    return put_value(wr, p->name);
+}
+
+
+/*
+ * The put_value() helper function stores the value val, and returns false if
+ * it cannot be stored, as is the case for procedures and handles. Lists are
+ * stored as runs of elements rather than pair by pair, so that long quoted
+ * lists do not recurse deeply when they are stored or loaded.
+ */
+static bool put_value(struct writer *wr, sage_value_t val)
+{
+    if (!sage_value_is_object(val)) {
+        put_u8(wr, TAG_IMMEDIATE);
+        put(wr, &val, sizeof val);
+        return true;
+    }
+
+    const void *obj = sage_value_object(val);
+
+    switch (((const struct sage_value_obj_t *) obj)->type) {
+        case SAGE_VALUE_TYPE_PAIR: {
+            uint32_t len = 0;
+            sage_value_t itr = val;
+
+            for (; sage_value_is(itr, SAGE_VALUE_TYPE_PAIR);
+                    itr = sage_value_cdr(itr))
+                len++;
+
+            put_u8(wr, TAG_LIST);
+            put_u32(wr, len);
+
+            for (itr = val; len--; itr = sage_value_cdr(itr)) {
+                if (!put_value(wr, sage_value_car(itr)))
+                    return false;
+            }
+
+            return put_value(wr, itr);
+        }
+
+        case SAGE_VALUE_TYPE_STRING: {
+            const struct sage_value_string_t *s = obj;
+
+            put_u8(wr, TAG_STRING);
+            put_u32(wr, (uint32_t) s->len);
+            put(wr, s->str, s->len);
+            return true;
+        }
+
+        case SAGE_VALUE_TYPE_SYMBOL: {
+            const struct sage_value_symbol_t *sym = obj;
+
+            if (sage_value_symbol_interned(val))
+                put_u8(wr, TAG_SYMBOL);
+            else {
+                size_t id = 0;
+                while (id < wr->ngensyms && wr->gensyms[id] != obj)
+                    id++;
+
+                if (id == wr->ngensyms) {
+                    if (sage_unlikely (id == CACHE_GENSYMS_LEN))
+                        return false;
+
+                    wr->gensyms[wr->ngensyms++] = obj;
+                }
+
+                put_u8(wr, TAG_GENSYM);
+                put_u32(wr, (uint32_t) id);
+            }
+
+            put_u32(wr, (uint32_t) sym->len);
+            put(wr, sym->name, sym->len);
+            return true;
+        }
+
+        case SAGE_VALUE_TYPE_VECTOR: {
+            const struct sage_value_vector_t *vec = obj;
+
+            put_u8(wr, TAG_VECTOR);
+            put_u32(wr, (uint32_t) vec->len);
+
+            for (register size_t i = 0; i < vec->len; i++) {
+                if (!put_value(wr, vec->items[i]))
+                    return false;
+            }
+
+            return true;
+        }
+
+        case SAGE_VALUE_TYPE_PROTO:
+            put_u8(wr, TAG_PROTO);
+            return put_proto(wr, obj);
+
+        default:
+            return false;
+    }
+}
+
+
+static const void *get(struct reader *rd, size_t len)
+{
+    if (sage_unlikely (rd->err || (size_t) (rd->end - rd->pos) < len)) {
+        rd->err = true;
+        return NULL;
+    }
+
+    const void *data = rd->pos;
+    rd->pos += len;
+
+    return data;
+}
+
+
+static inline uint8_t get_u8(struct reader *rd)
+{
+    const uint8_t *data = get(rd, sizeof (uint8_t));
+    return data ? *data : 0;
+}
+
+
+static inline uint32_t get_u32(struct reader *rd)
+{
+    uint32_t val = 0;
+    const void *data = get(rd, sizeof val);
+
+    if (data)
+        memcpy(&val, data, sizeof val);
+
+    return val;
+}
+
+
+/*
+ * The get_count() helper function loads the number of items that follow. Each
+ * item takes at least a byte, so a count larger than what is left of the cache
+ * can only come from a corrupt cache, and is treated as an error rather than
+ * trusted with an allocation.
+ */
+static size_t get_count(struct reader *rd)
+{
+    const size_t len = get_u32(rd);
+
+    if (sage_unlikely (len > (size_t) (rd->end - rd->pos))) {
+        rd->err = true;
+        return 0;
+    }
+
+    return len;
+}
+
+
+static sage_value_t get_value(struct reader *rd);
+
+
+/*
+ * The get_proto() helper function loads a prototype, and links its globals to
+ * their cells as the compiler does. The counts of the prototype only cover what
+ * has been loaded, so that a prototype left half loaded by a corrupt cache can
+ * still be collected safely.
+ */
+static struct sage_value_proto_t *get_proto(struct reader *rd)
+{
+    struct sage_value_proto_t *p = sage_value_proto();
+
+    const size_t ncode = get_count(rd);
+    const void *code = get(rd, sizeof *p->code * ncode);
+    if (!code)
+        return p;
+
+    p->code = sage_heap_new(sizeof *p->code * (ncode ? ncode : 1));
+    memcpy(p->code, code, sizeof *p->code * ncode);
+    p->ncode = ncode;
+
+    const size_t nconsts = get_count(rd);
+    p->consts = sage_heap_new(sizeof *p->consts * (nconsts ? nconsts : 1));
+
+    while (p->nconsts < nconsts && !rd->err)
+        p->consts[p->nconsts++] = get_value(rd);
+
+    const size_t nics = get_count(rd);
+    p->icsyms = sage_heap_new(sizeof *p->icsyms * (nics ? nics : 1));
+    p->ics = sage_heap_new(sizeof *p->ics * (nics ? nics : 1));
+
+    while (p->nics < nics && !rd->err) {
+        const sage_value_t sym = get_value(rd);
+
+        if (sage_unlikely (!sage_value_is(sym, SAGE_VALUE_TYPE_SYMBOL))) {
+            rd->err = true;
+            return p;
+        }
+
+        p->icsyms[p->nics] = sym;
+        p->ics[p->nics++] = sage_script_global_cell(sym);
+    }
+
+    const uint8_t nups = get_u8(rd);
+    const void *ups = get(rd, sizeof *p->ups * nups);
+    if (!ups)
+        return p;
+
+    p->ups = sage_heap_new(sizeof *p->ups * (nups ? nups : 1));
+    memcpy(p->ups, ups, sizeof *p->ups * nups);
+    p->nups = nups;
+
+    p->nparams = get_u8(rd);
+    p->nregs = get_u8(rd);
+    p->rest = get_u8(rd);
+    p->name = get_value(rd);
+
+    return p;
+}
+
+
+static sage_value_t get_value(struct reader *rd)
+{
+    switch (get_u8(rd)) {
+        case TAG_IMMEDIATE: {
+            sage_value_t val = SAGE_VALUE_FALSE;
+            const void *data = get(rd, sizeof val);
+
+            if (data)
+                memcpy(&val, data, sizeof val);
+
+            return sage_value_is_object(val) ? SAGE_VALUE_FALSE : val;
+        }
+
+        case TAG_LIST: {
+            const size_t len = get_count(rd);
+            sage_value_t *items = sage_heap_new(sizeof *items * (len + 1));
+            for (register size_t i = 0; i <= len && !rd->err; i++)
+                items[i] = get_value(rd);
+
+            sage_value_t lst = items[len];
+            for (register size_t i = len; i-- > 0;)
+                lst = sage_value_cons(items[i], lst);
+
+            sage_heap_free((void **) &items);
+            return lst;
+        }
+
+        case TAG_STRING: {
+            const size_t len = get_u32(rd);
+            const char *str = get(rd, len);
+
+            return str ? sage_value_string(str, len) : SAGE_VALUE_FALSE;
+        }
+
+        case TAG_SYMBOL: {
+            const size_t len = get_u32(rd);
+            const char *name = get(rd, len);
+
+            return name ? sage_value_symbol(name, len) : SAGE_VALUE_FALSE;
+        }
+
+        case TAG_GENSYM: {
+            const size_t id = get_u32(rd);
+            const size_t len = get_u32(rd);
+
+            if (!get(rd, len) || id > rd->ngensyms
+                    || id == CACHE_GENSYMS_LEN) {
+                rd->err = true;
+                return SAGE_VALUE_FALSE;
+            }
+
+            if (id == rd->ngensyms)
+                rd->gensyms[rd->ngensyms++] = sage_value_symbol_unique("g");
+
+            return rd->gensyms[id];
+        }
+
+        case TAG_VECTOR: {
+            const size_t len = get_count(rd);
+            sage_value_t val = sage_value_vector(len, SAGE_VALUE_FALSE);
+            struct sage_value_vector_t *vec = sage_value_object(val);
+
+            for (register size_t i = 0; i < len && !rd->err; i++) {
+                const sage_value_t item = get_value(rd);
+
+                sage_value_barrier(vec, item);
+                vec->items[i] = item;
+            }
+
+            return val;
+        }
+
+        case TAG_PROTO:
+            return sage_value_from_object(get_proto(rd));
+
+        default:
+            rd->err = true;
+            return SAGE_VALUE_FALSE;
+    }
+}
+
+
+/*
+ * The sage_script_encode() interface function appends the encoding of the value
+ * val to the buffer ctx, which starts out zeroed, and returns false if val
+ * holds a value that cannot be encoded, such as a procedure or a handle. The
+ * buffer is released with sage_heap_free() on its bfr field.
+ */
+extern bool sage_script_encode(struct sage_script_bytes_t *ctx,
+        sage_value_t val)
+{
+    sage_assert (ctx);
+
+    struct writer wr = {
+        .bfr = ctx->bfr,
+        .len = ctx->len,
+        .cap = ctx->cap,
+        .ngensyms = 0
+    };
+
+    if (!wr.bfr) {
+        wr.cap = CACHE_BFR_LEN;
+        wr.bfr = sage_heap_new(wr.cap);
+    }
+
+    const bool ok = put_value(&wr, val);
+
+    ctx->bfr = wr.bfr;
+    ctx->len = ok ? wr.len : ctx->len;
+    ctx->cap = wr.cap;
+
+    return ok;
+}
+
+
+/*
+ * The sage_script_decode() interface function creates the value encoded in the
+ * len bytes at data on the heap of the calling thread, and returns false if the
+ * bytes do not hold exactly one encoded value.
+ */
+extern bool sage_script_decode(const void *data, size_t len,
+        sage_value_t *val)
+{
+    sage_assert (data && val);
+
+    struct reader rd = {
+        .pos = data,
+        .end = (const uint8_t *) data + len,
+        .ngensyms = 0,
+        .err = false
+    };
+
+    *val = get_value(&rd);
+    return !rd.err && rd.pos == rd.end;
+}
+
+
+static char *source_read(const char *path, size_t *len)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long sz = ftell(file);
+    rewind(file);
+
+    char *src = sage_heap_new((size_t) (sz > 0 ? sz : 0) + 1);
+    *len = fread(src, 1, (size_t) (sz > 0 ? sz : 0), file);
+    src[*len] = '\0';
+    fclose(file);
+
+    return src;
+}
+
+
+static bool run(struct sage_value_proto_t *p, const char *name, size_t line)
+{
+    sage_value_t proc = sage_value_from_object(sage_value_closure(p));
+
+    if (!sage_script_call(proc, NULL, 0, NULL)) {
+        printf("%s:%zu: error in form\n", name, line);
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * The cache_run() helper function runs the forms stored in the cache mapped at
+ * map, if the cache is valid for source text with hash src. It returns true
+ * if the cache was used, whether or not the forms ran without error, and sets
+ * ok accordingly.
+ *
+ * The checksum only shows that the cache is as it was written, not that its
+ * code is sound, so every form is loaded and verified before any of them is
+ * run, and the cache is not used if any fails. The loaded forms are not held
+ * by any root, so nothing is collected until they have all been run; garbage
+ * is only ever collected at safe points, and the forms are run back to back.
+ */
+static bool cache_run(const uint8_t *map, size_t len, uint64_t src,
+        const char *name, bool *ok)
+{
+    const struct cache_header *hdr = (const struct cache_header *) map;
+
+    if (len < sizeof *hdr || memcmp(hdr->magic, CACHE_MAGIC,
+                sizeof CACHE_MAGIC) || hdr->version != CACHE_VERSION
+            || hdr->hash != src || hdr->size != len - sizeof *hdr
+            || hdr->sum != hash(hdr + 1, hdr->size)
+            || hdr->count > hdr->size / sizeof (uint32_t))
+        return false;
+
+    struct reader rd = {
+        .pos = (const uint8_t *) (hdr + 1),
+        .end = map + len,
+        .ngensyms = 0,
+        .err = false
+    };
+
+    struct sage_value_proto_t **forms = sage_heap_new(sizeof *forms
+            * (hdr->count ? hdr->count : 1));
+    size_t *lines = sage_heap_new(sizeof *lines * (hdr->count ? hdr->count
+                : 1));
+    bool valid = true;
+
+    for (register uint32_t i = 0; i < hdr->count && valid; i++) {
+        lines[i] = get_u32(&rd);
+        forms[i] = get_proto(&rd);
+        valid = !rd.err && sage_script_verify(forms[i]);
+        rd.ngensyms = 0;
+    }
+
+    if (sage_unlikely (!valid))
+        printf("%s: invalid bytecode cache\n", name);
+
+    *ok = true;
+
+    for (register uint32_t i = 0; valid && i < hdr->count && *ok; i++)
+        *ok = run(forms[i], name, lines[i]);
+
+    if (valid && sage_value_collect_due())
+        sage_script_collect(SAGE_SCRIPT_LOAD_BUDGET);
+
+    sage_heap_free((void **) &lines);
+    sage_heap_free((void **) &forms);
+
+    return valid;
+}
+
+
+/*
+ * The cache_write() helper function writes the forms stored by wr to a cache
+ * for source text with hash src. The cache is written to a temporary file that
+ * is then renamed over the old cache, so that a cache that is only partly
+ * written is never read back.
+ */
+static void cache_write(const char *cache, const struct writer *wr,
+        uint32_t count, uint64_t src)
+{
+    struct cache_header hdr = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .count = count,
+        .hash = src,
+        .size = wr->len,
+        .sum = hash(wr->bfr, wr->len)
+    };
+
+    const size_t len = strlen(cache);
+    char *tmp = sage_heap_new(len + sizeof ".tmp");
+    memcpy(tmp, cache, len);
+    memcpy(tmp + len, ".tmp", sizeof ".tmp");
+
+    FILE *file = fopen(tmp, "wb");
+    bool ok = file && fwrite(&hdr, sizeof hdr, 1, file) == 1
+        && fwrite(wr->bfr, 1, wr->len, file) == wr->len;
+
+    if (file)
+        ok = !fclose(file) && ok;
+
+    if (!ok || rename(tmp, cache)) {
+        printf("%s: cannot write bytecode cache\n", cache);
+        remove(tmp);
+    }
+
+    sage_heap_free((void **) &tmp);
+}
+
+
+/*
+ * The sage_script_load_cached() interface function evaluates every form in the
+ * source file at path as sage_script_load_file() does, going through the
+ * bytecode cache at cache. If the cache was compiled from the same source text
+ * by the same version of the format, its forms are run without reading or
+ * compiling the source; otherwise the source is compiled as usual, and if all
+ * of it runs without error the cache is written anew. Forms whose constants
+ * cannot be stored, which can only happen if they are too unusual for the
+ * cache, are run but leave the cache unwritten.
+ */
+extern bool sage_script_load_cached(const char *path, const char *cache)
+{
+    sage_assert (path && cache);
+
+    size_t len;
+    char *src = source_read(path, &len);
+    if (!src) {
+        printf("%s: cannot open script\n", path);
+        return false;
+    }
+
+    const uint64_t key = hash(src, len);
+    bool ok = false;
+
+    int fd = open(cache, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        void *map = MAP_FAILED;
+
+        if (!fstat(fd, &st) && st.st_size > 0)
+            map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd,
+                    0);
+        close(fd);
+
+        if (map != MAP_FAILED) {
+            bool hit = cache_run(map, (size_t) st.st_size, key, path, &ok);
+            munmap(map, (size_t) st.st_size);
+
+            if (hit) {
+                sage_heap_free((void **) &src);
+                return ok;
+            }
+        }
+    }
+
+    struct writer wr = { .len = 0, .cap = CACHE_BFR_LEN, .ngensyms = 0 };
+    wr.bfr = sage_heap_new(wr.cap);
+
+    struct sage_script_reader_t rdr;
+    sage_value_t form;
+    const char *err;
+    uint32_t count = 0;
+    bool store = true;
+
+    sage_script_reader_start(&rdr, src);
+    ok = true;
+
+    while (ok && sage_script_read(&rdr, &form)) {
+        struct sage_value_proto_t *p = sage_script_compile(form, &err);
+
+        if (!p) {
+            printf("%s:%zu: %s\n", path, rdr.line, err);
+            ok = false;
+            break;
+        }
+
+        if (store) {
+            put_u32(&wr, (uint32_t) rdr.line);
+            store = put_proto(&wr, p);
+            wr.ngensyms = 0;
+            count++;
+        }
+
+        ok = run(p, path, rdr.line);
+
+        if (sage_value_collect_due())
+            sage_script_collect(SAGE_SCRIPT_LOAD_BUDGET);
+    }
+
+    if (ok && rdr.err) {
+        printf("%s:%zu: %s\n", path, rdr.line, rdr.err);
+        ok = false;
+    }
+
+    if (ok && store)
+        cache_write(cache, &wr, count, key);
+
+    sage_heap_free((void **) &wr.bfr);
+    sage_heap_free((void **) &src);
+
+    return ok;
+}
@@ -0,0 +1,1266 @@
+#include <setjmp.h>
+#include "script.h"
+
+
+/*
+ * The compiler turns each top-level form into a procedure prototype of no
+ * arguments for the VM to run. It makes a single pass over the form, emitting
+ * register code as it goes: every procedure gets a frame of up to REGS_MAX
+ * registers, with its parameters and local variables in fixed registers and
+ * temporaries allocated above them in stack order.
+ *
+ * Closures capture the values of the variables they refer to when they are
+ * created. A variable that is both assigned with set! and captured by a
+ * closure is kept in a box instead, so that every closure sees the same
+ * storage; the same goes for the variables bound by letrec and by internal
+ * definitions, which may be captured before they are initialised. The test
+ * for whether a variable needs a box looks at the variable's name only, and
+ * so errs on the side of boxing.
+ *
+ * Calls to a handful of primitives through the globals that name them, such
+ * as (+ a b) or (car x), are compiled into inline operations rather than
+ * calls. Each one carries the global it stands for, and falls back to calling
+ * whatever that global holds if it has been redefined.
+ */
+
+
+#define LOCALS_MAX ((size_t) 200)
+#define UPVALS_MAX ((size_t) 255)
+#define REGS_MAX ((unsigned) 250)
+#define CLAUSES_MAX ((size_t) 256)
+
+
+enum form_t {
+    FORM_QUOTE = 0,
+    FORM_IF,
+    FORM_DEFINE,
+    FORM_SET,
+    FORM_LAMBDA,
+    FORM_BEGIN,
+    FORM_LET,
+    FORM_LETSTAR,
+    FORM_LETREC,
+    FORM_LETRECSTAR,
+    FORM_COND,
+    FORM_CASE,
+    FORM_AND,
+    FORM_OR,
+    FORM_WHEN,
+    FORM_UNLESS,
+    FORM_DO,
+
+    FORM_COUNT
+};
+
+
+static const char *FORMS[] = {
+    "quote", "if", "define", "set!", "lambda", "begin", "let", "let*",
+    "letrec", "letrec*", "cond", "case", "and", "or", "when", "unless", "do"
+};
+
+
+struct local {
+    sage_value_t sym;
+    uint8_t reg;
+    bool boxed;
+};
+
+
+struct upval {
+    sage_value_t sym;
+    uint8_t idx;
+    bool local;
+    bool boxed;
+};
+
+
+struct fstate {
+    struct fstate *parent;
+    uint32_t *code;
+    size_t ncode;
+    size_t capcode;
+    sage_value_t *consts;
+    size_t nconsts;
+    size_t capconsts;
+    sage_value_t *icsyms;
+    size_t nics;
+    size_t capics;
+    struct local locals[LOCALS_MAX];
+    size_t nlocals;
+    struct upval ups[UPVALS_MAX];
+    size_t nups;
+    unsigned top;
+    unsigned nregs;
+    uint8_t nparams;
+    bool rest;
+};
+
+
+enum scope_t {
+    SCOPE_LOCAL,
+    SCOPE_UPVAL,
+    SCOPE_GLOBAL
+};
+
+
+static thread_local struct {
+    sage_value_t forms[FORM_COUNT];
+    sage_value_t sym_else;
+    sage_value_t sym_arrow;
+    sage_value_t sym_memv;
+    struct fstate *fs;
+    jmp_buf *jmp;
+    const char *err;
+} *comp = NULL;
+
+
+static SAGE_COLD _Noreturn void fail(const char *err)
+{
+    comp->err = err;
+    longjmp(*comp->jmp, 1);
+}
+
+
+static inline bool is_pair(sage_value_t val)
+{
+    return sage_value_is(val, SAGE_VALUE_TYPE_PAIR);
+}
+
+
+static inline bool is_symbol(sage_value_t val)
+{
+    return sage_value_is(val, SAGE_VALUE_TYPE_SYMBOL);
+}
+
+
+static inline sage_value_t cadr(sage_value_t val)
+{
+    return sage_value_car(sage_value_cdr(val));
+}
+
+
+static inline sage_value_t cddr(sage_value_t val)
+{
+    return sage_value_cdr(sage_value_cdr(val));
+}
+
+
+static inline sage_value_t list2(sage_value_t a, sage_value_t b)
+{
+    return sage_value_cons(a, sage_value_cons(b, SAGE_VALUE_NIL));
+}
+
+
+static size_t list_len(sage_value_t lst)
+{
+    size_t len = 0;
+
+    for (; is_pair(lst); lst = sage_value_cdr(lst))
+        len++;
+
+    if (lst != SAGE_VALUE_NIL)
+        fail("improper list in form");
+
+    return len;
+}
+
+
+static void fstate_start(struct fstate *fs, struct fstate *parent)
+{
+    fs->parent = parent;
+    fs->capcode = 64;
+    fs->code = sage_heap_new(sizeof *fs->code * fs->capcode);
+    fs->capconsts = fs->capics = 16;
+    fs->consts = sage_heap_new(sizeof *fs->consts * fs->capconsts);
+    fs->icsyms = sage_heap_new(sizeof *fs->icsyms * fs->capics);
+    fs->ncode = fs->nconsts = fs->nics = fs->nlocals = fs->nups = 0;
+    fs->top = fs->nregs = 0;
+    fs->nparams = 0;
+    fs->rest = false;
+
+    comp->fs = fs;
+}
+
+
+static void fstate_clear(struct fstate *fs)
+{
+    sage_heap_free((void **) &fs->code);
+    sage_heap_free((void **) &fs->consts);
+    sage_heap_free((void **) &fs->icsyms);
+}
+
+
+/*
+ * The fstate_finish() helper function moves the code and constants of a
+ * finished procedure into a new prototype, and links its globals.
+ */
+static struct sage_value_proto_t *fstate_finish(struct fstate *fs,
+        sage_value_t name)
+{
+    struct sage_value_proto_t *p = sage_value_proto();
+
+    p->code = fs->code;
+    p->ncode = fs->ncode;
+    p->consts = fs->consts;
+    p->nconsts = fs->nconsts;
+    p->icsyms = fs->icsyms;
+    p->nics = fs->nics;
+    p->nparams = fs->nparams;
+    p->rest = fs->rest;
+    p->nregs = (uint8_t) fs->nregs;
+    p->name = name;
+
+    p->nups = (uint8_t) fs->nups;
+    p->ups = sage_heap_new(sizeof *p->ups * (fs->nups ? fs->nups : 1));
+    for (register size_t i = 0; i < fs->nups; i++)
+        p->ups[i] = (uint16_t) ((fs->ups[i].local ? 0x100 : 0)
+                | fs->ups[i].idx);
+
+    p->ics = sage_heap_new(sizeof *p->ics * (fs->nics ? fs->nics : 1));
+    for (register size_t i = 0; i < fs->nics; i++)
+        p->ics[i] = sage_script_global_cell(fs->icsyms[i]);
+
+    fs->code = NULL;
+    fs->consts = fs->icsyms = NULL;
+    comp->fs = fs->parent;
+
+    return p;
+}
+
+
+static inline uint32_t iabc(enum sage_script_op_t op, unsigned a, unsigned b,
+        unsigned c)
+{
+    return (uint32_t) op | (uint32_t) a << 8 | (uint32_t) b << 16
+        | (uint32_t) c << 24;
+}
+
+
+static inline uint32_t iabx(enum sage_script_op_t op, unsigned a, unsigned bx)
+{
+    return (uint32_t) op | (uint32_t) a << 8 | (uint32_t) bx << 16;
+}
+
+
+static size_t emit(struct fstate *fs, uint32_t ins)
+{
+    if (sage_unlikely (fs->ncode == fs->capcode)) {
+        fs->capcode *= 2;
+        fs->code = sage_heap_resize(fs->code, sizeof *fs->code * fs->capcode);
+    }
+
+    fs->code[fs->ncode] = ins;
+    return fs->ncode++;
+}
+
+
+static inline size_t jump(struct fstate *fs, enum sage_script_op_t op,
+        unsigned a)
+{
+    return emit(fs, iabx(op, a, 0));
+}
+
+
+static void patch(struct fstate *fs, size_t at)
+{
+    int32_t off = (int32_t) fs->ncode - (int32_t) at - 1;
+
+    if (sage_unlikely (off + SAGE_SCRIPT_SBX_BIAS > 0xFFFF))
+        fail("procedure too long");
+
+    fs->code[at] = (fs->code[at] & 0xFFFF)
+        | (uint32_t) (off + SAGE_SCRIPT_SBX_BIAS) << 16;
+}
+
+
+static unsigned const_add(struct fstate *fs, sage_value_t val)
+{
+    for (register size_t i = 0; i < fs->nconsts; i++) {
+        if (fs->consts[i] == val)
+            return (unsigned) i;
+    }
+
+    if (sage_unlikely (fs->nconsts > 0xFFFF))
+        fail("too many constants");
+
+    if (sage_unlikely (fs->nconsts == fs->capconsts)) {
+        fs->capconsts *= 2;
+        fs->consts = sage_heap_resize(fs->consts, sizeof *fs->consts
+                * fs->capconsts);
+    }
+
+    fs->consts[fs->nconsts] = val;
+    return (unsigned) fs->nconsts++;
+}
+
+
+static unsigned ic_add(struct fstate *fs, sage_value_t sym)
+{
+    for (register size_t i = 0; i < fs->nics; i++) {
+        if (fs->icsyms[i] == sym)
+            return (unsigned) i;
+    }
+
+    if (sage_unlikely (fs->nics > 0xFFFF))
+        fail("too many globals");
+
+    if (sage_unlikely (fs->nics == fs->capics)) {
+        fs->capics *= 2;
+        fs->icsyms = sage_heap_resize(fs->icsyms, sizeof *fs->icsyms
+                * fs->capics);
+    }
+
+    fs->icsyms[fs->nics] = sym;
+    return (unsigned) fs->nics++;
+}
+
+
+static inline void load_const(struct fstate *fs, unsigned dst,
+        sage_value_t val)
+{
+    emit(fs, iabx(SAGE_SCRIPT_OP_CONST, dst, const_add(fs, val)));
+}
+
+
+static unsigned reg_alloc(struct fstate *fs)
+{
+    if (sage_unlikely (fs->top >= REGS_MAX))
+        fail("procedure needs too many registers");
+
+    if (++fs->top > fs->nregs)
+        fs->nregs = fs->top;
+
+    return fs->top - 1;
+}
+
+
+static void local_add(struct fstate *fs, sage_value_t sym, unsigned reg,
+        bool boxed)
+{
+    if (sage_unlikely (!is_symbol(sym)))
+        fail("variable name is not a symbol");
+
+    if (sage_unlikely (fs->nlocals == LOCALS_MAX))
+        fail("too many local variables");
+
+    fs->locals[fs->nlocals].sym = sym;
+    fs->locals[fs->nlocals].reg = (uint8_t) reg;
+    fs->locals[fs->nlocals++].boxed = boxed;
+}
+
+
+static struct local *local_find(struct fstate *fs, sage_value_t sym)
+{
+    for (register size_t i = fs->nlocals; i-- > 0;) {
+        if (fs->locals[i].sym == sym)
+            return &fs->locals[i];
+    }
+
+    return NULL;
+}
+
+
+static bool bound(struct fstate *fs, sage_value_t sym)
+{
+    for (; fs; fs = fs->parent) {
+        if (local_find(fs, sym))
+            return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * The resolve() helper function finds out where a variable lives as seen from
+ * a procedure: in one of its own registers, in one of its upvalues, or in a
+ * global. A variable that lives in an enclosing procedure is added to the
+ * upvalues of every procedure in between.
+ */
+static enum scope_t resolve(struct fstate *fs, sage_value_t sym,
+        unsigned *idx, bool *boxed)
+{
+    struct local *loc = local_find(fs, sym);
+
+    if (loc) {
+        *idx = loc->reg;
+        *boxed = loc->boxed;
+        return SCOPE_LOCAL;
+    }
+
+    for (register size_t i = 0; i < fs->nups; i++) {
+        if (fs->ups[i].sym == sym) {
+            *idx = (unsigned) i;
+            *boxed = fs->ups[i].boxed;
+            return SCOPE_UPVAL;
+        }
+    }
+
+    if (!fs->parent)
+        return SCOPE_GLOBAL;
+
+    enum scope_t scope = resolve(fs->parent, sym, idx, boxed);
+    if (scope == SCOPE_GLOBAL)
+        return SCOPE_GLOBAL;
+
+    if (sage_unlikely (fs->nups == UPVALS_MAX))
+        fail("too many captured variables");
+
+    struct upval *up = &fs->ups[fs->nups];
+    up->sym = sym;
+    up->idx = (uint8_t) *idx;
+    up->local = scope == SCOPE_LOCAL;
+    up->boxed = *boxed;
+
+    *idx = (unsigned) fs->nups++;
+    return SCOPE_UPVAL;
+}
+
+
+static bool assigned(sage_value_t sym, sage_value_t x)
+{
+    if (!is_pair(x) || sage_value_car(x) == comp->forms[FORM_QUOTE])
+        return false;
+
+    if (sage_value_car(x) == comp->forms[FORM_SET] && is_pair(sage_value_cdr(x))
+            && cadr(x) == sym)
+        return true;
+
+    for (; is_pair(x); x = sage_value_cdr(x)) {
+        if (assigned(sym, sage_value_car(x)))
+            return true;
+    }
+
+    return false;
+}
+
+
+static bool captured(sage_value_t sym, sage_value_t x, bool inside)
+{
+    if (x == sym)
+        return inside;
+
+    if (!is_pair(x) || sage_value_car(x) == comp->forms[FORM_QUOTE])
+        return false;
+
+    sage_value_t head = sage_value_car(x);
+    bool in = inside || head == comp->forms[FORM_LAMBDA]
+        || head == comp->forms[FORM_DO]
+        || (head == comp->forms[FORM_LET] && is_pair(sage_value_cdr(x))
+                && is_symbol(cadr(x)))
+        || (head == comp->forms[FORM_DEFINE] && is_pair(sage_value_cdr(x))
+                && is_pair(cadr(x)));
+
+    for (; is_pair(x); x = sage_value_cdr(x)) {
+        if (captured(sym, sage_value_car(x), in))
+            return true;
+    }
+
+    return x == sym && in;
+}
+
+
+static inline bool needs_box(sage_value_t sym, sage_value_t body)
+{
+    return assigned(sym, body) && captured(sym, body, false);
+}
+
+
+static void expr(struct fstate *fs, sage_value_t x, unsigned dst, bool tail);
+
+static void body(struct fstate *fs, sage_value_t lst, unsigned dst, bool tail);
+
+
+static void var_load(struct fstate *fs, sage_value_t sym, unsigned dst)
+{
+    unsigned idx;
+    bool boxed;
+
+    switch (resolve(fs, sym, &idx, &boxed)) {
+        case SCOPE_LOCAL:
+            if (boxed)
+                emit(fs, iabc(SAGE_SCRIPT_OP_UNBOX, dst, idx, 0));
+            else if (idx != dst)
+                emit(fs, iabc(SAGE_SCRIPT_OP_MOVE, dst, idx, 0));
+            break;
+
+        case SCOPE_UPVAL:
+            emit(fs, iabc(SAGE_SCRIPT_OP_UPVAL, dst, idx, 0));
+            if (boxed)
+                emit(fs, iabc(SAGE_SCRIPT_OP_UNBOX, dst, dst, 0));
+            break;
+
+        default:
+            emit(fs, iabx(SAGE_SCRIPT_OP_GLOBAL, dst, ic_add(fs, sym)));
+            break;
+    }
+}
+
+
+/*
+ * The operand() helper function gets a register holding the value of an
+ * expression. An unboxed local variable is used in place, and anything else
+ * is evaluated into a new temporary, which the caller releases by resetting
+ * the top of the register stack.
+ */
+static unsigned operand(struct fstate *fs, sage_value_t x)
+{
+    if (is_symbol(x)) {
+        struct local *loc = local_find(fs, x);
+
+        if (loc && !loc->boxed)
+            return loc->reg;
+    }
+
+    unsigned reg = reg_alloc(fs);
+    expr(fs, x, reg, false);
+
+    return reg;
+}
+
+
+static void seq(struct fstate *fs, sage_value_t lst, unsigned dst, bool tail)
+{
+    if (lst == SAGE_VALUE_NIL) {
+        load_const(fs, dst, SAGE_VALUE_VOID);
+        return;
+    }
+
+    for (; is_pair(lst); lst = sage_value_cdr(lst)) {
+        const bool last = sage_value_cdr(lst) == SAGE_VALUE_NIL;
+        expr(fs, sage_value_car(lst), dst, tail && last);
+    }
+}
+
+
+static void call(struct fstate *fs, sage_value_t x, unsigned dst, bool tail)
+{
+    const unsigned save = fs->top;
+    const unsigned base = reg_alloc(fs);
+    size_t argc = 0;
+
+    expr(fs, sage_value_car(x), base, false);
+
+    for (sage_value_t itr = sage_value_cdr(x); is_pair(itr);
+            itr = sage_value_cdr(itr), argc++)
+        expr(fs, sage_value_car(itr), reg_alloc(fs), false);
+
+    if (sage_unlikely (argc > 0xFF))
+        fail("too many arguments");
+
+    emit(fs, iabc(tail ? SAGE_SCRIPT_OP_TAILCALL : SAGE_SCRIPT_OP_CALL, base,
+                (unsigned) argc, 0));
+
+    fs->top = save;
+    if (!tail && base != dst)
+        emit(fs, iabc(SAGE_SCRIPT_OP_MOVE, dst, base, 0));
+}
+
+
+static void inline_op(struct fstate *fs, enum sage_script_op_t op,
+        sage_value_t x, unsigned dst)
+{
+    const unsigned save = fs->top;
+    const unsigned ic = ic_add(fs, sage_value_car(x));
+    sage_value_t args = sage_value_cdr(x);
+
+    if (op >= SAGE_SCRIPT_OP_CAR) {
+        unsigned b = operand(fs, sage_value_car(args));
+        emit(fs, iabc(op, dst, b, 0));
+        emit(fs, ic);
+        fs->top = save;
+        return;
+    }
+
+    unsigned acc;
+    if (sage_value_cdr(args) == SAGE_VALUE_NIL) {
+        acc = reg_alloc(fs);
+        load_const(fs, acc, sage_value_number(0.0));
+    } else {
+        acc = operand(fs, sage_value_car(args));
+        args = sage_value_cdr(args);
+    }
+
+    for (; is_pair(args); args = sage_value_cdr(args)) {
+        unsigned c = operand(fs, sage_value_car(args));
+        emit(fs, iabc(op, dst, acc, c));
+        emit(fs, ic);
+        acc = dst;
+    }
+
+    fs->top = save;
+}
+
+
+static void lambda(struct fstate *fs, sage_value_t params, sage_value_t lst,
+        sage_value_t name, unsigned dst)
+{
+    struct fstate child;
+    fstate_start(&child, fs);
+
+    sage_value_t itr = params;
+    for (; is_pair(itr); itr = sage_value_cdr(itr)) {
+        sage_value_t sym = sage_value_car(itr);
+        local_add(&child, sym, reg_alloc(&child), needs_box(sym, lst));
+        child.nparams++;
+    }
+
+    if (itr != SAGE_VALUE_NIL) {
+        local_add(&child, itr, reg_alloc(&child), needs_box(itr, lst));
+        child.rest = true;
+    }
+
+    for (register size_t i = 0; i < child.nlocals; i++) {
+        if (child.locals[i].boxed)
+            emit(&child, iabc(SAGE_SCRIPT_OP_BOX, child.locals[i].reg,
+                        child.locals[i].reg, 0));
+    }
+
+    unsigned reg = reg_alloc(&child);
+    body(&child, lst, reg, true);
+    emit(&child, iabc(SAGE_SCRIPT_OP_RETURN, reg, 0, 0));
+
+    struct sage_value_proto_t *p = fstate_finish(&child, name);
+    emit(fs, iabx(SAGE_SCRIPT_OP_CLOSURE, dst,
+                const_add(fs, sage_value_from_object(p))));
+}
+
+
+/*
+ * The value() helper function compiles the value of a binding, passing the
+ * name along if it is a lambda expression so that the procedure knows its
+ * name for error messages.
+ */
+static void value(struct fstate *fs, sage_value_t name, sage_value_t x,
+        unsigned dst)
+{
+    if (is_pair(x) && sage_value_car(x) == comp->forms[FORM_LAMBDA]
+            && !bound(fs, comp->forms[FORM_LAMBDA]) && is_pair(
+                sage_value_cdr(x)))
+        lambda(fs, cadr(x), cddr(x), name, dst);
+    else
+        expr(fs, x, dst, false);
+}
+
+
+/*
+ * The definition() helper function splits a define form into the name being
+ * defined and the expression giving its value, turning the procedure shorthand
+ * (define (f . params) body...) into a lambda expression.
+ */
+static sage_value_t definition(sage_value_t x, sage_value_t *val)
+{
+    if (!is_pair(sage_value_cdr(x)))
+        fail("bad define");
+
+    sage_value_t target = cadr(x);
+
+    if (is_pair(target)) {
+        *val = sage_value_cons(comp->forms[FORM_LAMBDA], sage_value_cons(
+                    sage_value_cdr(target), cddr(x)));
+        return sage_value_car(target);
+    }
+
+    *val = is_pair(cddr(x)) ? sage_value_car(cddr(x)) : SAGE_VALUE_VOID;
+    return target;
+}
+
+
+static void body(struct fstate *fs, sage_value_t lst, unsigned dst, bool tail)
+{
+    const unsigned save = fs->top;
+    const size_t nlocals = fs->nlocals;
+    sage_value_t itr, val;
+
+    for (itr = lst; is_pair(itr) && is_pair(sage_value_car(itr))
+            && sage_value_car(sage_value_car(itr)) == comp->forms[FORM_DEFINE]
+            && !bound(fs, comp->forms[FORM_DEFINE]); itr = sage_value_cdr(itr)) {
+        unsigned reg = reg_alloc(fs);
+        load_const(fs, reg, SAGE_VALUE_UNDEF);
+        emit(fs, iabc(SAGE_SCRIPT_OP_BOX, reg, reg, 0));
+        local_add(fs, definition(sage_value_car(itr), &val), reg, true);
+    }
+
+    size_t idx = nlocals;
+    for (sage_value_t def = lst; def != itr; def = sage_value_cdr(def)) {
+        sage_value_t name = definition(sage_value_car(def), &val);
+        unsigned tmp = reg_alloc(fs);
+
+        value(fs, name, val, tmp);
+        emit(fs, iabc(SAGE_SCRIPT_OP_SETBOX, fs->locals[idx++].reg, tmp, 0));
+        fs->top = tmp;
+    }
+
+    seq(fs, itr, dst, tail);
+
+    fs->nlocals = nlocals;
+    fs->top = save;
+}
+
+
+static void form_if(struct fstate *fs, sage_value_t x, unsigned dst,
+        bool tail)
+{
+    const size_t len = list_len(x);
+    if (len != 3 && len != 4)
+        fail("bad if");
+
+    const unsigned save = fs->top;
+    unsigned test = operand(fs, cadr(x));
+    fs->top = save;
+
+    size_t jf = jump(fs, SAGE_SCRIPT_OP_JUMPF, test);
+    expr(fs, sage_value_car(cddr(x)), dst, tail);
+
+    size_t end = jump(fs, SAGE_SCRIPT_OP_JUMP, 0);
+    patch(fs, jf);
+
+    if (len == 4)
+        expr(fs, cadr(cddr(x)), dst, tail);
+    else
+        load_const(fs, dst, SAGE_VALUE_VOID);
+
+    patch(fs, end);
+}
+
+
+static void form_define(struct fstate *fs, sage_value_t x, unsigned dst)
+{
+    if (fs->parent || fs->nlocals)
+        fail("define is only allowed at top level or at the start of a body");
+
+    sage_value_t val, name = definition(x, &val);
+    if (!is_symbol(name))
+        fail("bad define");
+
+    const unsigned save = fs->top;
+    unsigned reg = reg_alloc(fs);
+
+    value(fs, name, val, reg);
+    emit(fs, iabx(SAGE_SCRIPT_OP_DEFINE, reg, ic_add(fs, name)));
+    fs->top = save;
+
+    load_const(fs, dst, SAGE_VALUE_VOID);
+}
+
+
+static void form_set(struct fstate *fs, sage_value_t x, unsigned dst)
+{
+    if (list_len(x) != 3 || !is_symbol(cadr(x)))
+        fail("bad set!");
+
+    const unsigned save = fs->top;
+    unsigned tmp = reg_alloc(fs), idx;
+    bool boxed;
+
+    expr(fs, sage_value_car(cddr(x)), tmp, false);
+
+    switch (resolve(fs, cadr(x), &idx, &boxed)) {
+        case SCOPE_LOCAL:
+            emit(fs, iabc(boxed ? SAGE_SCRIPT_OP_SETBOX : SAGE_SCRIPT_OP_MOVE,
+                        idx, tmp, 0));
+            break;
+
+        case SCOPE_UPVAL: {
+            sage_assert (boxed);
+            unsigned box = reg_alloc(fs);
+
+            emit(fs, iabc(SAGE_SCRIPT_OP_UPVAL, box, idx, 0));
+            emit(fs, iabc(SAGE_SCRIPT_OP_SETBOX, box, tmp, 0));
+            break;
+        }
+
+        default:
+            emit(fs, iabx(SAGE_SCRIPT_OP_SETGLOBAL, tmp, ic_add(fs, cadr(x))));
+            break;
+    }
+
+    fs->top = save;
+    load_const(fs, dst, SAGE_VALUE_VOID);
+}
+
+
+static void form_let(struct fstate *fs, sage_value_t x, unsigned dst,
+        bool tail, enum form_t form)
+{
+    if (!is_pair(sage_value_cdr(x)))
+        fail("bad let");
+
+    sage_value_t binds = cadr(x), lst = cddr(x);
+
+    if (form == FORM_LET && is_symbol(binds)) {
+        /* (let name ((v i) ...) body ...) is
+         * ((letrec ((name (lambda (v ...) body ...))) name) i ...) */
+        sage_value_t name = binds, vars = SAGE_VALUE_NIL;
+        sage_value_t inits = SAGE_VALUE_NIL, *vtail = &vars, *itail = &inits;
+
+        if (!is_pair(lst))
+            fail("bad named let");
+
+        for (binds = sage_value_car(lst); is_pair(binds);
+                binds = sage_value_cdr(binds)) {
+            sage_value_t b = sage_value_car(binds);
+            if (list_len(b) != 2)
+                fail("bad named let binding");
+
+            *vtail = sage_value_cons(sage_value_car(b), SAGE_VALUE_NIL);
+            vtail = &((struct sage_value_pair_t *) sage_value_object(
+                        *vtail))->cdr;
+            *itail = sage_value_cons(cadr(b), SAGE_VALUE_NIL);
+            itail = &((struct sage_value_pair_t *) sage_value_object(
+                        *itail))->cdr;
+        }
+
+        sage_value_t fn = sage_value_cons(comp->forms[FORM_LAMBDA],
+                sage_value_cons(vars, sage_value_cdr(lst)));
+        sage_value_t rec = sage_value_cons(comp->forms[FORM_LETREC],
+                list2(sage_value_cons(list2(name, fn), SAGE_VALUE_NIL), name));
+
+        expr(fs, sage_value_cons(rec, inits), dst, tail);
+        return;
+    }
+
+    const unsigned save = fs->top;
+    const size_t nlocals = fs->nlocals;
+    const size_t len = list_len(binds);
+    unsigned regs[LOCALS_MAX];
+
+    if (len > LOCALS_MAX)
+        fail("too many bindings");
+
+    sage_value_t itr = binds;
+    for (size_t i = 0; i < len; i++, itr = sage_value_cdr(itr)) {
+        sage_value_t b = sage_value_car(itr);
+        if (list_len(b) != 2)
+            fail("bad let binding");
+
+        regs[i] = reg_alloc(fs);
+
+        if (form >= FORM_LETREC) {
+            load_const(fs, regs[i], SAGE_VALUE_UNDEF);
+            emit(fs, iabc(SAGE_SCRIPT_OP_BOX, regs[i], regs[i], 0));
+            local_add(fs, sage_value_car(b), regs[i], true);
+            continue;
+        }
+
+        value(fs, sage_value_car(b), cadr(b), regs[i]);
+
+        if (form == FORM_LETSTAR) {
+            bool boxed = needs_box(sage_value_car(b), sage_value_cdr(x));
+            if (boxed)
+                emit(fs, iabc(SAGE_SCRIPT_OP_BOX, regs[i], regs[i], 0));
+            local_add(fs, sage_value_car(b), regs[i], boxed);
+        }
+    }
+
+    itr = binds;
+    for (size_t i = 0; i < len; i++, itr = sage_value_cdr(itr)) {
+        sage_value_t b = sage_value_car(itr);
+
+        if (form == FORM_LET) {
+            bool boxed = needs_box(sage_value_car(b), lst);
+            if (boxed)
+                emit(fs, iabc(SAGE_SCRIPT_OP_BOX, regs[i], regs[i], 0));
+            local_add(fs, sage_value_car(b), regs[i], boxed);
+        } else if (form >= FORM_LETREC) {
+            unsigned tmp = reg_alloc(fs);
+            value(fs, sage_value_car(b), cadr(b), tmp);
+            emit(fs, iabc(SAGE_SCRIPT_OP_SETBOX, regs[i], tmp, 0));
+            fs->top = tmp;
+        }
+    }
+
+    body(fs, lst, dst, tail);
+
+    fs->nlocals = nlocals;
+    fs->top = save;
+}
+
+
+static void form_cond(struct fstate *fs, sage_value_t x, unsigned dst,
+        bool tail)
+{
+    size_t ends[CLAUSES_MAX], nends = 0;
+    bool otherwise = false;
+
+    for (sage_value_t itr = sage_value_cdr(x); is_pair(itr);
+            itr = sage_value_cdr(itr)) {
+        sage_value_t clause = sage_value_car(itr);
+        if (!is_pair(clause))
+            fail("bad cond clause");
+
+        if (nends == CLAUSES_MAX)
+            fail("too many cond clauses");
+
+        sage_value_t test = sage_value_car(clause);
+        sage_value_t lst = sage_value_cdr(clause);
+
+        if (test == comp->sym_else && !bound(fs, test)) {
+            seq(fs, lst, dst, tail);
+            otherwise = true;
+            break;
+        }
+
+        if (lst == SAGE_VALUE_NIL) {
+            expr(fs, test, dst, false);
+            ends[nends++] = jump(fs, SAGE_SCRIPT_OP_JUMPT, dst);
+            continue;
+        }
+
+        if (sage_value_car(lst) == comp->sym_arrow && is_pair(
+                    sage_value_cdr(lst))) {
+            expr(fs, test, dst, false);
+            size_t jf = jump(fs, SAGE_SCRIPT_OP_JUMPF, dst);
+
+            const unsigned save = fs->top;
+            unsigned base = reg_alloc(fs);
+            expr(fs, cadr(lst), base, false);
+            emit(fs, iabc(SAGE_SCRIPT_OP_MOVE, reg_alloc(fs), dst, 0));
+            emit(fs, iabc(tail ? SAGE_SCRIPT_OP_TAILCALL : SAGE_SCRIPT_OP_CALL,
+                        base, 1, 0));
+            emit(fs, iabc(SAGE_SCRIPT_OP_MOVE, dst, base, 0));
+            fs->top = save;
+
+            ends[nends++] = jump(fs, SAGE_SCRIPT_OP_JUMP, 0);
+            patch(fs, jf);
+            continue;
+        }
+
+        const unsigned save = fs->top;
+        unsigned reg = operand(fs, test);
+        fs->top = save;
+
+        size_t jf = jump(fs, SAGE_SCRIPT_OP_JUMPF, reg);
+        seq(fs, lst, dst, tail);
+        ends[nends++] = jump(fs, SAGE_SCRIPT_OP_JUMP, 0);
+        patch(fs, jf);
+    }
+
+    if (!otherwise)
+        load_const(fs, dst, SAGE_VALUE_VOID);
+
+    for (register size_t i = 0; i < nends; i++)
+        patch(fs, ends[i]);
+}
+
+
+/*
+ * The form_case() helper function compiles (case key clause ...) as
+ * (let ((k key)) (cond ((memv k '(datum ...)) body ...) ...)).
+ */
+static void form_case(struct fstate *fs, sage_value_t x, unsigned dst,
+        bool tail)
+{
+    if (!is_pair(sage_value_cdr(x)))
+        fail("bad case");
+
+    sage_value_t key = sage_value_symbol_unique(" key");
+    sage_value_t clauses = SAGE_VALUE_NIL, *ctail = &clauses;
+
+    for (sage_value_t itr = cddr(x); is_pair(itr); itr = sage_value_cdr(itr)) {
+        sage_value_t clause = sage_value_car(itr), test;
+        if (!is_pair(clause))
+            fail("bad case clause");
+
+        if (sage_value_car(clause) == comp->sym_else)
+            test = comp->sym_else;
+        else
+            test = sage_value_cons(comp->sym_memv, list2(key, list2(
+                            comp->forms[FORM_QUOTE], sage_value_car(clause))));
+
+        *ctail = sage_value_cons(sage_value_cons(test, sage_value_cdr(clause)),
+                SAGE_VALUE_NIL);
+        ctail = &((struct sage_value_pair_t *) sage_value_object(
+                    *ctail))->cdr;
+    }
+
+    sage_value_t cond = sage_value_cons(comp->forms[FORM_COND], clauses);
+    sage_value_t let = sage_value_cons(comp->forms[FORM_LET], list2(
+                sage_value_cons(list2(key, cadr(x)), SAGE_VALUE_NIL), cond));
+
+    expr(fs, let, dst, tail);
+}
+
+
+static void form_logic(struct fstate *fs, sage_value_t x, unsigned dst,
+        bool tail, bool all)
+{
+    size_t ends[CLAUSES_MAX], nends = 0;
+    sage_value_t itr = sage_value_cdr(x);
+
+    if (itr == SAGE_VALUE_NIL) {
+        load_const(fs, dst, sage_value_bool(all));
+        return;
+    }
+
+    for (; is_pair(itr); itr = sage_value_cdr(itr)) {
+        if (sage_value_cdr(itr) == SAGE_VALUE_NIL) {
+            expr(fs, sage_value_car(itr), dst, tail);
+            break;
+        }
+
+        if (nends == CLAUSES_MAX)
+            fail("too many operands");
+
+        expr(fs, sage_value_car(itr), dst, false);
+        ends[nends++] = jump(fs, all ? SAGE_SCRIPT_OP_JUMPF
+                : SAGE_SCRIPT_OP_JUMPT, dst);
+    }
+
+    for (register size_t i = 0; i < nends; i++)
+        patch(fs, ends[i]);
+}
+
+
+static void form_when(struct fstate *fs, sage_value_t x, unsigned dst,
+        bool tail, bool when)
+{
+    if (!is_pair(sage_value_cdr(x)))
+        fail("bad when or unless");
+
+    const unsigned save = fs->top;
+    unsigned test = operand(fs, cadr(x));
+    fs->top = save;
+
+    size_t skip = jump(fs, when ? SAGE_SCRIPT_OP_JUMPF : SAGE_SCRIPT_OP_JUMPT,
+            test);
+    seq(fs, cddr(x), dst, tail);
+
+    size_t end = jump(fs, SAGE_SCRIPT_OP_JUMP, 0);
+    patch(fs, skip);
+    load_const(fs, dst, SAGE_VALUE_VOID);
+    patch(fs, end);
+}
+
+
+/*
+ * The form_do() helper function compiles
+ * (do ((var init step) ...) (test res ...) body ...) as
+ * (let loop ((var init) ...)
+ *   (if test (begin res ...) (begin body ... (loop step ...)))).
+ */
+static void form_do(struct fstate *fs, sage_value_t x, unsigned dst,
+        bool tail)
+{
+    if (list_len(x) < 3 || !is_pair(sage_value_car(cddr(x))))
+        fail("bad do");
+
+    sage_value_t loop = sage_value_symbol_unique(" loop");
+    sage_value_t binds = SAGE_VALUE_NIL, steps = SAGE_VALUE_NIL;
+    sage_value_t *btail = &binds, *stail = &steps;
+
+    for (sage_value_t itr = cadr(x); is_pair(itr); itr = sage_value_cdr(itr)) {
+        sage_value_t spec = sage_value_car(itr);
+        size_t len = list_len(spec);
+
+        if (len != 2 && len != 3)
+            fail("bad do binding");
+
+        *btail = sage_value_cons(list2(sage_value_car(spec), cadr(spec)),
+                SAGE_VALUE_NIL);
+        btail = &((struct sage_value_pair_t *) sage_value_object(
+                    *btail))->cdr;
+
+        *stail = sage_value_cons(len == 3 ? sage_value_car(cddr(spec))
+                : sage_value_car(spec), SAGE_VALUE_NIL);
+        stail = &((struct sage_value_pair_t *) sage_value_object(
+                    *stail))->cdr;
+    }
+
+    sage_value_t exit = sage_value_car(cddr(x));
+    sage_value_t again = sage_value_cons(loop, steps);
+    sage_value_t lst = cddr(sage_value_cdr(x));
+    sage_value_t step = sage_value_cons(again, SAGE_VALUE_NIL);
+    sage_value_t run = SAGE_VALUE_NIL, *rtail = &run;
+
+    for (sage_value_t itr = lst; is_pair(itr); itr = sage_value_cdr(itr)) {
+        *rtail = sage_value_cons(sage_value_car(itr), SAGE_VALUE_NIL);
+        rtail = &((struct sage_value_pair_t *) sage_value_object(
+                    *rtail))->cdr;
+    }
+    *rtail = step;
+
+    sage_value_t test = sage_value_cons(comp->forms[FORM_IF], sage_value_cons(
+                sage_value_car(exit), list2(sage_value_cons(
+                        comp->forms[FORM_BEGIN], sage_value_cdr(exit)),
+                    sage_value_cons(comp->forms[FORM_BEGIN], run))));
+
+    sage_value_t let = sage_value_cons(comp->forms[FORM_LET], sage_value_cons(
+                loop, list2(binds, test)));
+
+    expr(fs, let, dst, tail);
+}
+
+
+static void special(struct fstate *fs, enum form_t form, sage_value_t x,
+        unsigned dst, bool tail)
+{
+    switch (form) {
+        case FORM_QUOTE:
+            if (list_len(x) != 2)
+                fail("bad quote");
+            load_const(fs, dst, cadr(x));
+            break;
+
+        case FORM_IF:
+            form_if(fs, x, dst, tail);
+            break;
+
+        case FORM_DEFINE:
+            form_define(fs, x, dst);
+            break;
+
+        case FORM_SET:
+            form_set(fs, x, dst);
+            break;
+
+        case FORM_LAMBDA:
+            if (!is_pair(sage_value_cdr(x)))
+                fail("bad lambda");
+            lambda(fs, cadr(x), cddr(x), SAGE_VALUE_FALSE, dst);
+            break;
+
+        case FORM_BEGIN:
+            seq(fs, sage_value_cdr(x), dst, tail);
+            break;
+
+        case FORM_LET:
+        case FORM_LETSTAR:
+        case FORM_LETREC:
+        case FORM_LETRECSTAR:
+            form_let(fs, x, dst, tail, form);
+            break;
+
+        case FORM_COND:
+            form_cond(fs, x, dst, tail);
+            break;
+
+        case FORM_CASE:
+            form_case(fs, x, dst, tail);
+            break;
+
+        case FORM_AND:
+        case FORM_OR:
+            form_logic(fs, x, dst, tail, form == FORM_AND);
+            break;
+
+        case FORM_WHEN:
+        case FORM_UNLESS:
+            form_when(fs, x, dst, tail, form == FORM_WHEN);
+            break;
+
+        case FORM_DO:
+            form_do(fs, x, dst, tail);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+static void expr(struct fstate *fs, sage_value_t x, unsigned dst, bool tail)
+{
+    if (is_symbol(x)) {
+        var_load(fs, x, dst);
+        return;
+    }
+
+    if (!is_pair(x)) {
+        load_const(fs, dst, x);
+        return;
+    }
+
+    sage_value_t head = sage_value_car(x);
+
+    if (is_symbol(head) && !bound(fs, head)) {
+        for (register size_t i = 0; i < FORM_COUNT; i++) {
+            if (comp->forms[i] == head) {
+                special(fs, (enum form_t) i, x, dst, tail);
+                return;
+            }
+        }
+
+        enum sage_script_op_t op = sage_script_inline_op(head,
+                list_len(sage_value_cdr(x)));
+
+        if (op != SAGE_SCRIPT_OP_COUNT) {
+            inline_op(fs, op, x, dst);
+            return;
+        }
+    }
+
+    list_len(x);
+    call(fs, x, dst, tail);
+}
+
+
+extern void sage_script_compiler_start(void)
+{
+    if (sage_unlikely (comp))
+        return;
+
+    comp = sage_heap_new(sizeof *comp);
+
+    for (register size_t i = 0; i < FORM_COUNT; i++)
+        comp->forms[i] = sage_value_symbol(FORMS[i], strlen(FORMS[i]));
+
+    comp->sym_else = sage_value_symbol("else", 4);
+    comp->sym_arrow = sage_value_symbol("=>", 2);
+    comp->sym_memv = sage_value_symbol("memv", 4);
+    comp->fs = NULL;
+    comp->jmp = NULL;
+}
+
+
+extern void sage_script_compiler_stop(void)
+{
+    if (sage_likely (comp))
+        sage_heap_free((void **) &comp);
+}
+
+
+/*
+ * The sage_script_compile() interface function compiles a top-level form into
+ * a procedure prototype that takes no arguments and evaluates the form when
+ * called. If the form is malformed, it returns NULL and points err to a
+ * description of what is wrong. No garbage must be collected while compiling,
+ * since the form and the prototypes being built are not reachable from the
+ * roots of the VM.
+ */
+extern struct sage_value_proto_t *sage_script_compile(sage_value_t form,
+        const char **err)
+{
+    sage_assert (comp && err);
+
+    jmp_buf jmp;
+    jmp_buf *prev = comp->jmp;
+    struct fstate *outer = comp->fs;
+    struct fstate top;
+
+    comp->jmp = &jmp;
+
+    if (setjmp(jmp)) {
+        for (struct fstate *fs = comp->fs; fs != outer; fs = fs->parent)
+            fstate_clear(fs);
+
+        comp->fs = outer;
+        comp->jmp = prev;
+        *err = comp->err;
+
+        return NULL;
+    }
+
+    fstate_start(&top, NULL);
+
+    unsigned reg = reg_alloc(&top);
+    expr(&top, form, reg, true);
+    emit(&top, iabc(SAGE_SCRIPT_OP_RETURN, reg, 0, 0));
+
+    struct sage_value_proto_t *p = fstate_finish(&top, SAGE_VALUE_FALSE);
+    comp->fs = outer;
+    comp->jmp = prev;
+
+    return p;
+}
+
@@ -0,0 +1,798 @@
+#include <math.h>
+#include "script.h"
+
+
+/*
+ * The standard primitives are the procedures that every script can rely on:
+ * arithmetic over doubles, the predicates, list, vector, string and symbol
+ * operations, and output. Each takes its arguments as an array of values that
+ * it must not keep a pointer to, and raises a script error if they are of the
+ * wrong type. The VM checks the number of arguments before calling them.
+ */
+
+
+#define APPLY_MAX ((size_t) 256)
+
+
+static thread_local uint64_t seed = 0x2545F4914F6CDD1Du;
+
+
+static inline double num(sage_value_t val, const char *who)
+{
+    if (sage_unlikely (!sage_value_is_number(val)))
+        sage_script_error("%s: expected a number", who);
+
+    return sage_value_to_number(val);
+}
+
+
+static inline sage_value_t pair(sage_value_t val, const char *who)
+{
+    if (sage_unlikely (!sage_value_is(val, SAGE_VALUE_TYPE_PAIR)))
+        sage_script_error("%s: expected a pair", who);
+
+    return val;
+}
+
+
+static inline struct sage_value_vector_t *vector(sage_value_t val,
+        const char *who)
+{
+    if (sage_unlikely (!sage_value_is(val, SAGE_VALUE_TYPE_VECTOR)))
+        sage_script_error("%s: expected a vector", who);
+
+    return sage_value_object(val);
+}
+
+
+static inline struct sage_value_string_t *string(sage_value_t val,
+        const char *who)
+{
+    if (sage_unlikely (!sage_value_is(val, SAGE_VALUE_TYPE_STRING)))
+        sage_script_error("%s: expected a string", who);
+
+    return sage_value_object(val);
+}
+
+
+static inline size_t position(sage_value_t val, size_t len, const char *who)
+{
+    const double idx = num(val, who);
+
+    if (sage_unlikely (idx < 0 || idx >= (double) len || idx != floor(idx)))
+        sage_script_error("%s: index out of range", who);
+
+    return (size_t) idx;
+}
+
+
+static size_t list_len(sage_value_t lst, const char *who)
+{
+    size_t len = 0;
+
+    for (; sage_value_is(lst, SAGE_VALUE_TYPE_PAIR); lst = sage_value_cdr(lst))
+        len++;
+
+    if (sage_unlikely (lst != SAGE_VALUE_NIL))
+        sage_script_error("%s: expected a list", who);
+
+    return len;
+}
+
+
+static sage_value_t add(sage_value_t *argv, size_t argc)
+{
+    double acc = 0.0;
+
+    for (register size_t i = 0; i < argc; i++)
+        acc += num(argv[i], "+");
+
+    return sage_value_number(acc);
+}
+
+
+static sage_value_t sub(sage_value_t *argv, size_t argc)
+{
+    double acc = num(argv[0], "-");
+
+    if (argc == 1)
+        return sage_value_number(-acc);
+
+    for (register size_t i = 1; i < argc; i++)
+        acc -= num(argv[i], "-");
+
+    return sage_value_number(acc);
+}
+
+
+static sage_value_t mul(sage_value_t *argv, size_t argc)
+{
+    double acc = 1.0;
+
+    for (register size_t i = 0; i < argc; i++)
+        acc *= num(argv[i], "*");
+
+    return sage_value_number(acc);
+}
+
+
+static sage_value_t divide(sage_value_t *argv, size_t argc)
+{
+    double acc = num(argv[0], "/");
+
+    if (argc == 1)
+        return sage_value_number(1.0 / acc);
+
+    for (register size_t i = 1; i < argc; i++)
+        acc /= num(argv[i], "/");
+
+    return sage_value_number(acc);
+}
+
+
+#define COMPARE(fn, name, op)                                               \
+    static sage_value_t fn(sage_value_t *argv, size_t argc)                 \
+    {                                                                       \
+        for (register size_t i = 0; i + 1 < argc; i++) {                    \
+            if (!(num(argv[i], name) op num(argv[i + 1], name)))            \
+                return SAGE_VALUE_FALSE;                                    \
+        }                                                                   \
+        return SAGE_VALUE_TRUE;                                             \
+    }
+
+COMPARE(numeq, "=", ==)
+COMPARE(lt, "<", <)
+COMPARE(gt, ">", >)
+COMPARE(le, "<=", <=)
+COMPARE(ge, ">=", >=)
+
+
+static sage_value_t quotient(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number(trunc(num(argv[0], "quotient")
+                / num(argv[1], "quotient")));
+}
+
+
+static sage_value_t remainder_(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number(fmod(num(argv[0], "remainder"),
+                num(argv[1], "remainder")));
+}
+
+
+static sage_value_t modulo(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    const double y = num(argv[1], "modulo");
+    const double r = fmod(num(argv[0], "modulo"), y);
+
+    return sage_value_number(r != 0.0 && (r < 0.0) != (y < 0.0) ? r + y : r);
+}
+
+
+static sage_value_t min(sage_value_t *argv, size_t argc)
+{
+    double acc = num(argv[0], "min");
+
+    for (register size_t i = 1; i < argc; i++)
+        acc = fmin(acc, num(argv[i], "min"));
+
+    return sage_value_number(acc);
+}
+
+
+static sage_value_t max(sage_value_t *argv, size_t argc)
+{
+    double acc = num(argv[0], "max");
+
+    for (register size_t i = 1; i < argc; i++)
+        acc = fmax(acc, num(argv[i], "max"));
+
+    return sage_value_number(acc);
+}
+
+
+#define MATH(fn, name, expr)                                                \
+    static sage_value_t fn(sage_value_t *argv, size_t argc)                 \
+    {                                                                       \
+        (void) argc;                                                        \
+        const double x = num(argv[0], name);                                \
+        return sage_value_number(expr);                                     \
+    }
+
+MATH(abs_, "abs", fabs(x))
+MATH(floor_, "floor", floor(x))
+MATH(ceiling, "ceiling", ceil(x))
+MATH(round_, "round", nearbyint(x))
+MATH(truncate_, "truncate", trunc(x))
+MATH(sqrt_, "sqrt", sqrt(x))
+MATH(sin_, "sin", sin(x))
+MATH(cos_, "cos", cos(x))
+MATH(exp_, "exp", exp(x))
+MATH(log_, "log", log(x))
+
+
+static sage_value_t expt(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number(pow(num(argv[0], "expt"), num(argv[1], "expt")));
+}
+
+
+static sage_value_t atan_(sage_value_t *argv, size_t argc)
+{
+    if (argc == 2)
+        return sage_value_number(atan2(num(argv[0], "atan"),
+                    num(argv[1], "atan")));
+
+    return sage_value_number(atan(num(argv[0], "atan")));
+}
+
+
+/*
+ * The random primitive gets a random integer in [0, n) if n is an integer, and
+ * a random real in [0, n) otherwise, from a xorshift generator.
+ */
+static sage_value_t random_(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    const double n = num(argv[0], "random");
+
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+
+    const double r = (double) ((seed * 0x2545F4914F6CDD1Du) >> 11)
+        * (1.0 / 9007199254740992.0) * n;
+
+    return sage_value_number(n == floor(n) ? floor(r) : r);
+}
+
+
+#define PREDICATE(fn, expr)                                                 \
+    static sage_value_t fn(sage_value_t *argv, size_t argc)                 \
+    {                                                                       \
+        (void) argc;                                                        \
+        const sage_value_t x = argv[0];                                     \
+        return sage_value_bool(expr);                                       \
+    }
+
+PREDICATE(numberp, sage_value_is_number(x))
+PREDICATE(integerp, sage_value_is_number(x) && sage_value_to_number(x)
+        == floor(sage_value_to_number(x)))
+PREDICATE(zerop, num(x, "zero?") == 0.0)
+PREDICATE(positivep, num(x, "positive?") > 0.0)
+PREDICATE(negativep, num(x, "negative?") < 0.0)
+PREDICATE(not, x == SAGE_VALUE_FALSE)
+PREDICATE(nullp, x == SAGE_VALUE_NIL)
+PREDICATE(pairp, sage_value_is(x, SAGE_VALUE_TYPE_PAIR))
+PREDICATE(symbolp, sage_value_is(x, SAGE_VALUE_TYPE_SYMBOL))
+PREDICATE(stringp, sage_value_is(x, SAGE_VALUE_TYPE_STRING))
+PREDICATE(vectorp, sage_value_is(x, SAGE_VALUE_TYPE_VECTOR))
+PREDICATE(booleanp, x == SAGE_VALUE_TRUE || x == SAGE_VALUE_FALSE)
+PREDICATE(procedurep, sage_value_is(x, SAGE_VALUE_TYPE_CLOSURE)
+        || sage_value_is(x, SAGE_VALUE_TYPE_PRIMITIVE))
+
+
+static sage_value_t eqp(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_bool(argv[0] == argv[1]);
+}
+
+
+static sage_value_t eqvp(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+
+    if (sage_value_is_number(argv[0]) && sage_value_is_number(argv[1]))
+        return sage_value_bool(sage_value_to_number(argv[0])
+                == sage_value_to_number(argv[1]));
+
+    return sage_value_bool(argv[0] == argv[1]);
+}
+
+
+static sage_value_t equalp(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_bool(sage_value_equal(argv[0], argv[1]));
+}
+
+
+static sage_value_t cons(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_cons(argv[0], argv[1]);
+}
+
+
+#define ACCESS(fn, name, expr)                                              \
+    static sage_value_t fn(sage_value_t *argv, size_t argc)                 \
+    {                                                                       \
+        (void) argc;                                                        \
+        sage_value_t x = argv[0];                                           \
+        return (expr);                                                      \
+    }
+
+ACCESS(car, "car", sage_value_car(pair(x, "car")))
+ACCESS(cdr, "cdr", sage_value_cdr(pair(x, "cdr")))
+ACCESS(caar, "caar", sage_value_car(pair(sage_value_car(pair(x, "caar")),
+                "caar")))
+ACCESS(cadr, "cadr", sage_value_car(pair(sage_value_cdr(pair(x, "cadr")),
+                "cadr")))
+ACCESS(cdar, "cdar", sage_value_cdr(pair(sage_value_car(pair(x, "cdar")),
+                "cdar")))
+ACCESS(cddr, "cddr", sage_value_cdr(pair(sage_value_cdr(pair(x, "cddr")),
+                "cddr")))
+ACCESS(caddr, "caddr", sage_value_car(pair(sage_value_cdr(pair(
+                        sage_value_cdr(pair(x, "caddr")), "caddr")), "caddr")))
+
+
+static sage_value_t set_car(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    struct sage_value_pair_t *p = sage_value_object(pair(argv[0], "set-car!"));
+
+    sage_value_barrier(p, argv[1]);
+    p->car = argv[1];
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t set_cdr(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    struct sage_value_pair_t *p = sage_value_object(pair(argv[0], "set-cdr!"));
+
+    sage_value_barrier(p, argv[1]);
+    p->cdr = argv[1];
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t list(sage_value_t *argv, size_t argc)
+{
+    sage_value_t lst = SAGE_VALUE_NIL;
+
+    for (register size_t i = argc; i-- > 0;)
+        lst = sage_value_cons(argv[i], lst);
+
+    return lst;
+}
+
+
+static sage_value_t length(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number((double) list_len(argv[0], "length"));
+}
+
+
+static sage_value_t append(sage_value_t *argv, size_t argc)
+{
+    if (!argc)
+        return SAGE_VALUE_NIL;
+
+    sage_value_t head = argv[argc - 1];
+
+    for (register size_t i = argc - 1; i-- > 0;) {
+        const size_t len = list_len(argv[i], "append");
+        sage_value_t itr = argv[i], tail = head, *at = &head;
+
+        for (register size_t j = 0; j < len; j++, itr = sage_value_cdr(itr)) {
+            *at = sage_value_cons(sage_value_car(itr), tail);
+            at = &((struct sage_value_pair_t *) sage_value_object(*at))->cdr;
+        }
+    }
+
+    return head;
+}
+
+
+static sage_value_t reverse(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_value_t lst = SAGE_VALUE_NIL, itr = argv[0];
+
+    list_len(itr, "reverse");
+    for (; itr != SAGE_VALUE_NIL; itr = sage_value_cdr(itr))
+        lst = sage_value_cons(sage_value_car(itr), lst);
+
+    return lst;
+}
+
+
+static sage_value_t list_ref(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_value_t itr = argv[0];
+
+    for (size_t i = position(argv[1], list_len(itr, "list-ref"), "list-ref"); i;
+            i--)
+        itr = sage_value_cdr(itr);
+
+    return sage_value_car(itr);
+}
+
+
+static sage_value_t memq(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_value_t itr = argv[1];
+
+    for (; sage_value_is(itr, SAGE_VALUE_TYPE_PAIR); itr = sage_value_cdr(itr)) {
+        if (sage_value_car(itr) == argv[0])
+            return itr;
+    }
+
+    return SAGE_VALUE_FALSE;
+}
+
+
+static sage_value_t memv(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_value_t itr = argv[1];
+
+    for (; sage_value_is(itr, SAGE_VALUE_TYPE_PAIR); itr = sage_value_cdr(itr)) {
+        sage_value_t pair[2] = { sage_value_car(itr), argv[0] };
+
+        if (eqvp(pair, 2) == SAGE_VALUE_TRUE)
+            return itr;
+    }
+
+    return SAGE_VALUE_FALSE;
+}
+
+
+static sage_value_t assq(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_value_t itr = argv[1];
+
+    for (; sage_value_is(itr, SAGE_VALUE_TYPE_PAIR); itr = sage_value_cdr(itr)) {
+        sage_value_t entry = sage_value_car(itr);
+
+        if (sage_value_is(entry, SAGE_VALUE_TYPE_PAIR)
+                && sage_value_car(entry) == argv[0])
+            return entry;
+    }
+
+    return SAGE_VALUE_FALSE;
+}
+
+
+static sage_value_t vector_(sage_value_t *argv, size_t argc)
+{
+    sage_value_t vec = sage_value_vector(argc, SAGE_VALUE_FALSE);
+
+    if (argc)
+        memcpy(((struct sage_value_vector_t *) sage_value_object(vec))->items,
+                argv, sizeof *argv * argc);
+
+    return vec;
+}
+
+
+static sage_value_t make_vector(sage_value_t *argv, size_t argc)
+{
+    const double len = num(argv[0], "make-vector");
+
+    if (len < 0 || len != floor(len))
+        sage_script_error("make-vector: bad length");
+
+    return sage_value_vector((size_t) len, argc > 1 ? argv[1]
+            : SAGE_VALUE_FALSE);
+}
+
+
+static sage_value_t vector_ref(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    struct sage_value_vector_t *vec = vector(argv[0], "vector-ref");
+
+    return vec->items[position(argv[1], vec->len, "vector-ref")];
+}
+
+
+static sage_value_t vector_set(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    struct sage_value_vector_t *vec = vector(argv[0], "vector-set!");
+
+    const size_t idx = position(argv[1], vec->len, "vector-set!");
+
+    sage_value_barrier(vec, argv[2]);
+    vec->items[idx] = argv[2];
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t vector_length(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number((double) vector(argv[0], "vector-length")->len);
+}
+
+
+static sage_value_t display(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_value_print(stdout, argv[0], false);
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t write_(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    sage_value_print(stdout, argv[0], true);
+
+    return SAGE_VALUE_VOID;
+}
+
+
+static sage_value_t newline(sage_value_t *argv, size_t argc)
+{
+    (void) argv;
+    (void) argc;
+    putchar('\n');
+
+    return SAGE_VALUE_VOID;
+}
+
+
+/*
+ * The error primitive raises a script error with a message made up of its
+ * first argument displayed and the rest written after it.
+ */
+static sage_value_t error_(sage_value_t *argv, size_t argc)
+{
+    char msg[256], *bfr = NULL;
+    size_t len = 0;
+    FILE *file = open_memstream(&bfr, &len);
+
+    if (!file)
+        sage_script_error("error raised by script");
+
+    sage_value_print(file, argv[0], false);
+    for (register size_t i = 1; i < argc; i++) {
+        fputc(' ', file);
+        sage_value_print(file, argv[i], true);
+    }
+
+    fclose(file);
+    snprintf(msg, sizeof msg, "%s", bfr);
+    free(bfr);
+
+    sage_script_error("%s", msg);
+}
+
+
+static sage_value_t apply(sage_value_t *argv, size_t argc)
+{
+    sage_value_t args[APPLY_MAX];
+    size_t len = 0;
+
+    for (register size_t i = 1; i + 1 < argc; i++) {
+        if (len == APPLY_MAX)
+            sage_script_error("apply: too many arguments");
+        args[len++] = argv[i];
+    }
+
+    sage_value_t itr = argv[argc - 1];
+    list_len(itr, "apply");
+
+    for (; itr != SAGE_VALUE_NIL; itr = sage_value_cdr(itr)) {
+        if (len == APPLY_MAX)
+            sage_script_error("apply: too many arguments");
+        args[len++] = sage_value_car(itr);
+    }
+
+    return sage_script_apply(argv[0], args, len);
+}
+
+
+static sage_value_t string_append(sage_value_t *argv, size_t argc)
+{
+    size_t len = 0;
+
+    for (register size_t i = 0; i < argc; i++)
+        len += string(argv[i], "string-append")->len;
+
+    char *bfr = sage_heap_new(len + 1), *at = bfr;
+    for (register size_t i = 0; i < argc; i++) {
+        const struct sage_value_string_t *str = sage_value_object(argv[i]);
+
+        memcpy(at, str->str, str->len);
+        at += str->len;
+    }
+
+    sage_value_t val = sage_value_string(bfr, len);
+    sage_heap_free((void **) &bfr);
+
+    return val;
+}
+
+
+static sage_value_t number_string(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    char *bfr = NULL;
+    size_t len = 0;
+    FILE *file = open_memstream(&bfr, &len);
+
+    if (!file)
+        sage_script_error("number->string: out of memory");
+
+    sage_value_print(file, sage_value_number(num(argv[0], "number->string")),
+            false);
+    fclose(file);
+
+    sage_value_t val = sage_value_string(bfr, len);
+    free(bfr);
+
+    return val;
+}
+
+
+static sage_value_t symbol_string(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+
+    if (!sage_value_is(argv[0], SAGE_VALUE_TYPE_SYMBOL))
+        sage_script_error("symbol->string: expected a symbol");
+
+    const struct sage_value_symbol_t *sym = sage_value_object(argv[0]);
+    return sage_value_string(sym->name, sym->len);
+}
+
+
+static sage_value_t string_symbol(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    const struct sage_value_string_t *str = string(argv[0], "string->symbol");
+
+    return sage_value_symbol(str->str, str->len);
+}
+
+
+static sage_value_t string_length(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    return sage_value_number((double) string(argv[0], "string-length")->len);
+}
+
+
+static sage_value_t string_eq(sage_value_t *argv, size_t argc)
+{
+    (void) argc;
+    const struct sage_value_string_t *lhs = string(argv[0], "string=?");
+    const struct sage_value_string_t *rhs = string(argv[1], "string=?");
+
+    return sage_value_bool(lhs->len == rhs->len && !memcmp(lhs->str, rhs->str,
+                lhs->len));
+}
+
+
+static const struct {
+    const char *name;
+    sage_value_primitive_f *fn;
+    uint8_t min;
+    uint8_t max;
+} PRIMITIVES[] = {
+    { "+", add, 0, SAGE_VALUE_VARIADIC },
+    { "-", sub, 1, SAGE_VALUE_VARIADIC },
+    { "*", mul, 0, SAGE_VALUE_VARIADIC },
+    { "/", divide, 1, SAGE_VALUE_VARIADIC },
+    { "=", numeq, 1, SAGE_VALUE_VARIADIC },
+    { "<", lt, 1, SAGE_VALUE_VARIADIC },
+    { ">", gt, 1, SAGE_VALUE_VARIADIC },
+    { "<=", le, 1, SAGE_VALUE_VARIADIC },
+    { ">=", ge, 1, SAGE_VALUE_VARIADIC },
+    { "quotient", quotient, 2, 2 },
+    { "remainder", remainder_, 2, 2 },
+    { "modulo", modulo, 2, 2 },
+    { "abs", abs_, 1, 1 },
+    { "min", min, 1, SAGE_VALUE_VARIADIC },
+    { "max", max, 1, SAGE_VALUE_VARIADIC },
+    { "floor", floor_, 1, 1 },
+    { "ceiling", ceiling, 1, 1 },
+    { "round", round_, 1, 1 },
+    { "truncate", truncate_, 1, 1 },
+    { "sqrt", sqrt_, 1, 1 },
+    { "expt", expt, 2, 2 },
+    { "sin", sin_, 1, 1 },
+    { "cos", cos_, 1, 1 },
+    { "atan", atan_, 1, 2 },
+    { "exp", exp_, 1, 1 },
+    { "log", log_, 1, 1 },
+    { "random", random_, 1, 1 },
+    { "number?", numberp, 1, 1 },
+    { "integer?", integerp, 1, 1 },
+    { "zero?", zerop, 1, 1 },
+    { "positive?", positivep, 1, 1 },
+    { "negative?", negativep, 1, 1 },
+    { "not", not, 1, 1 },
+    { "eq?", eqp, 2, 2 },
+    { "eqv?", eqvp, 2, 2 },
+    { "equal?", equalp, 2, 2 },
+    { "null?", nullp, 1, 1 },
+    { "pair?", pairp, 1, 1 },
+    { "symbol?", symbolp, 1, 1 },
+    { "string?", stringp, 1, 1 },
+    { "vector?", vectorp, 1, 1 },
+    { "boolean?", booleanp, 1, 1 },
+    { "procedure?", procedurep, 1, 1 },
+    { "cons", cons, 2, 2 },
+    { "car", car, 1, 1 },
+    { "cdr", cdr, 1, 1 },
+    { "caar", caar, 1, 1 },
+    { "cadr", cadr, 1, 1 },
+    { "cdar", cdar, 1, 1 },
+    { "cddr", cddr, 1, 1 },
+    { "caddr", caddr, 1, 1 },
+    { "set-car!", set_car, 2, 2 },
+    { "set-cdr!", set_cdr, 2, 2 },
+    { "list", list, 0, SAGE_VALUE_VARIADIC },
+    { "length", length, 1, 1 },
+    { "append", append, 0, SAGE_VALUE_VARIADIC },
+    { "reverse", reverse, 1, 1 },
+    { "list-ref", list_ref, 2, 2 },
+    { "memq", memq, 2, 2 },
+    { "memv", memv, 2, 2 },
+    { "assq", assq, 2, 2 },
+    { "vector", vector_, 0, SAGE_VALUE_VARIADIC },
+    { "make-vector", make_vector, 1, 2 },
+    { "vector-ref", vector_ref, 2, 2 },
+    { "vector-set!", vector_set, 3, 3 },
+    { "vector-length", vector_length, 1, 1 },
+    { "display", display, 1, 1 },
+    { "write", write_, 1, 1 },
+    { "newline", newline, 0, 0 },
+    { "error", error_, 1, SAGE_VALUE_VARIADIC },
+    { "apply", apply, 2, SAGE_VALUE_VARIADIC },
+    { "string-append", string_append, 0, SAGE_VALUE_VARIADIC },
+    { "number->string", number_string, 1, 1 },
+    { "symbol->string", symbol_string, 1, 1 },
+    { "string->symbol", string_symbol, 1, 1 },
+    { "string-length", string_length, 1, 1 },
+    { "string=?", string_eq, 2, 2 }
+};
+
+
+extern void sage_script_primitives_register(void)
+{
+    for (register size_t i = 0; i < sizeof PRIMITIVES / sizeof *PRIMITIVES;
+            i++)
+        sage_script_primitive(PRIMITIVES[i].name, PRIMITIVES[i].fn,
+                PRIMITIVES[i].min, PRIMITIVES[i].max);
+}
+
+
+/*
+ * The sage_script_primitives_seed() interface function seeds the generator of
+ * the random primitive in the VM of the calling thread. Every VM starts from
+ * the same seed, so threads that run scripts side by side are seeded apart to
+ * keep them from drawing the same numbers. The seed is mixed before use, so
+ * that nearby seeds such as worker indices give unrelated streams, and a zero
+ * state, from which xorshift never leaves, cannot come of it.
+ */
+extern void sage_script_primitives_seed(uint64_t val)
+{
+    val += 0x9E3779B97F4A7C15u;
+    val = (val ^ (val >> 30)) * 0xBF58476D1CE4E5B9u;
+    val = (val ^ (val >> 27)) * 0x94D049BB133111EBu;
+    val ^= val >> 31;
+
+    seed = val ? val : 0x2545F4914F6CDD1Du;
+}
+
@@ -0,0 +1,303 @@
+#include <ctype.h>
+#include "script.h"
+
+
+/*
+ * The reader turns source text into data: numbers, strings, symbols, booleans,
+ * lists, including dotted lists, and vectors, along with quote abbreviations.
+ * Line comments start with a semicolon, and block comments are enclosed within
+ * #| and |#. A datum is read at a time, so that a file is compiled and run form
+ * by form; the line number is kept for error messages.
+ */
+
+
+#define READ_DEPTH ((size_t) 512)
+
+
+static const char *DELIMITERS = "()\";'";
+
+
+static bool fail(struct sage_script_reader_t *ctx, const char *err)
+{
+    ctx->err = err;
+    return false;
+}
+
+
+static void skip(struct sage_script_reader_t *ctx)
+{
+    while (*ctx->pos) {
+        if (*ctx->pos == '\n') {
+            ctx->line++;
+            ctx->pos++;
+        } else if (isspace((unsigned char) *ctx->pos))
+            ctx->pos++;
+        else if (*ctx->pos == ';') {
+            while (*ctx->pos && *ctx->pos != '\n')
+                ctx->pos++;
+        } else if (ctx->pos[0] == '#' && ctx->pos[1] == '|') {
+            ctx->pos += 2;
+            while (*ctx->pos && !(ctx->pos[0] == '|' && ctx->pos[1] == '#')) {
+                if (*ctx->pos++ == '\n')
+                    ctx->line++;
+            }
+
+            if (*ctx->pos)
+                ctx->pos += 2;
+        } else
+            break;
+    }
+}
+
+
+static inline bool delimiter(char ch)
+{
+    return !ch || isspace((unsigned char) ch) || strchr(DELIMITERS, ch);
+}
+
+
+static bool string_read(struct sage_script_reader_t *ctx, sage_value_t *datum)
+{
+    size_t cap = 64, len = 0;
+    char *bfr = sage_heap_new(cap);
+
+    for (ctx->pos++; *ctx->pos != '"'; ctx->pos++) {
+        char ch = *ctx->pos;
+
+        if (!ch) {
+            sage_heap_free((void **) &bfr);
+            return fail(ctx, "unterminated string");
+        }
+
+        if (ch == '\n')
+            ctx->line++;
+
+        if (ch == '\\') {
+            switch (*++ctx->pos) {
+                case 'n':
+                    ch = '\n';
+                    break;
+
+                case 't':
+                    ch = '\t';
+                    break;
+
+                case '\0':
+                    sage_heap_free((void **) &bfr);
+                    return fail(ctx, "unterminated string");
+
+                default:
+                    ch = *ctx->pos;
+                    break;
+            }
+        }
+
+        if (len + 1 == cap)
+            bfr = sage_heap_resize(bfr, cap *= 2);
+
+        bfr[len++] = ch;
+    }
+
+    ctx->pos++;
+    *datum = sage_value_string(bfr, len);
+    sage_heap_free((void **) &bfr);
+
+    return true;
+}
+
+
+static bool atom_read(struct sage_script_reader_t *ctx, sage_value_t *datum)
+{
+    const char *start = ctx->pos;
+    while (!delimiter(*ctx->pos))
+        ctx->pos++;
+
+    const size_t len = (size_t) (ctx->pos - start);
+
+    if (*start == '#') {
+        if ((len == 2 && start[1] == 't') || (len == 5
+                    && !strncmp(start, "#true", 5))) {
+            *datum = SAGE_VALUE_TRUE;
+            return true;
+        }
+
+        if ((len == 2 && start[1] == 'f') || (len == 6
+                    && !strncmp(start, "#false", 6))) {
+            *datum = SAGE_VALUE_FALSE;
+            return true;
+        }
+
+        return fail(ctx, "unknown # syntax");
+    }
+
+    char *end;
+    double num = strtod(start, &end);
+
+    if (end == ctx->pos && (isdigit((unsigned char) start[0])
+                || (len > 1 && (isdigit((unsigned char) start[1])
+                        || start[1] == '.')))) {
+        *datum = sage_value_number(num);
+        return true;
+    }
+
+    *datum = sage_value_symbol(start, len);
+    return true;
+}
+
+
+static bool datum_read(struct sage_script_reader_t *ctx, sage_value_t *datum,
+        size_t depth);
+
+
+static bool list_read(struct sage_script_reader_t *ctx, sage_value_t *datum,
+        char close, size_t depth)
+{
+    sage_value_t head = SAGE_VALUE_NIL, tail = SAGE_VALUE_NIL;
+    sage_value_t item;
+
+    ctx->pos++;
+
+    while (true) {
+        skip(ctx);
+
+        if (!*ctx->pos)
+            return fail(ctx, "unterminated list");
+
+        if (*ctx->pos == close) {
+            ctx->pos++;
+            break;
+        }
+
+        if (*ctx->pos == '.' && delimiter(ctx->pos[1]) && close == ')') {
+            if (head == SAGE_VALUE_NIL)
+                return fail(ctx, "bad dotted list");
+
+            ctx->pos++;
+            if (!datum_read(ctx, &item, depth + 1))
+                return ctx->err ? false : fail(ctx, "bad dotted list");
+
+            ((struct sage_value_pair_t *) sage_value_object(tail))->cdr = item;
+
+            skip(ctx);
+            if (*ctx->pos != ')')
+                return fail(ctx, "bad dotted list");
+
+            ctx->pos++;
+            break;
+        }
+
+        if (!datum_read(ctx, &item, depth + 1))
+            return ctx->err ? false : fail(ctx, "unterminated list");
+
+        sage_value_t cell = sage_value_cons(item, SAGE_VALUE_NIL);
+
+        if (head == SAGE_VALUE_NIL)
+            head = cell;
+        else
+            ((struct sage_value_pair_t *) sage_value_object(tail))->cdr = cell;
+
+        tail = cell;
+    }
+
+    *datum = head;
+    return true;
+}
+
+
+static bool vector_read(struct sage_script_reader_t *ctx, sage_value_t *datum,
+        size_t depth)
+{
+    sage_value_t lst;
+
+    if (!list_read(ctx, &lst, ')', depth))
+        return false;
+
+    size_t len = 0;
+    for (sage_value_t itr = lst; itr != SAGE_VALUE_NIL;
+            itr = sage_value_cdr(itr))
+        len++;
+
+    *datum = sage_value_vector(len, SAGE_VALUE_FALSE);
+    struct sage_value_vector_t *vec = sage_value_object(*datum);
+
+    for (register size_t i = 0; i < len; i++, lst = sage_value_cdr(lst))
+        vec->items[i] = sage_value_car(lst);
+
+    return true;
+}
+
+
+static bool datum_read(struct sage_script_reader_t *ctx, sage_value_t *datum,
+        size_t depth)
+{
+    if (sage_unlikely (depth > READ_DEPTH))
+        return fail(ctx, "nesting too deep");
+
+    skip(ctx);
+
+    switch (*ctx->pos) {
+        case '\0':
+            return false;
+
+        case '(':
+            return list_read(ctx, datum, ')', depth);
+
+        case ')':
+            ctx->pos++;
+            return fail(ctx, "unexpected )");
+
+        case '"':
+            return string_read(ctx, datum);
+
+        case '\'': {
+            sage_value_t quoted;
+            ctx->pos++;
+
+            if (!datum_read(ctx, &quoted, depth + 1))
+                return ctx->err ? false : fail(ctx, "nothing to quote");
+
+            *datum = sage_value_cons(sage_value_symbol("quote", 5),
+                    sage_value_cons(quoted, SAGE_VALUE_NIL));
+            return true;
+        }
+
+        case '#':
+            if (ctx->pos[1] == '(') {
+                ctx->pos++;
+                return vector_read(ctx, datum, depth);
+            }
+            return atom_read(ctx, datum);
+
+        default:
+            return atom_read(ctx, datum);
+    }
+}
+
+
+extern void sage_script_reader_start(struct sage_script_reader_t *ctx,
+        const char *src)
+{
+    sage_assert (ctx && src);
+    ctx->pos = src;
+    ctx->line = 1;
+    ctx->err = NULL;
+}
+
+
+/*
+ * The sage_script_read() interface function reads the next datum from the
+ * source text of a reader. It returns false once there is nothing left to
+ * read, or if the text is malformed, in which case the err field of the reader
+ * describes what went wrong, and its line field says where.
+ */
+extern bool sage_script_read(struct sage_script_reader_t *ctx,
+        sage_value_t *datum)
+{
+    sage_assert (ctx && datum);
+
+    if (ctx->err)
+        return false;
+
+    return datum_read(ctx, datum, 0);
+}
+
@@ -0,0 +1,781 @@
+/******************************************************************************
+ *                           ____   __    ___  ____
+ *                          / ___) / _\  / __)(  __)
+ *                          \___ \/    \( (_ \ ) _)
+ *                          (____/\_/\_/ \___/(____)
+ *
+ * Schemable? Game Engine (SAGE) Library
+ * Copyright (c) 2020 Abhishek Chakravarti <abhishek@taranjali.org>.
+ *
+ * This code is released under the MIT License. See the accompanying
+ * sage/LICENSE.md file or <http://opensource.org/licenses/MIT> for complete
+ * licensing details.
+ *
+ * BY CONTINUING TO USE AND/OR DISTRIBUTE THIS FILE, YOU ACKNOWLEDGE THAT YOU
+ * HAVE UNDERSTOOD THESE LICENSE TERMS AND ACCEPT THEM.
+ *
+ * This is the sage/src/script/script.h header file; it declares the interface
+ * of the SAGE Library Scheme scripting engine.
+ ******************************************************************************/
+
+
+#ifndef SCHEME_ASSISTED_GAME_ENGINE_SCRIPT_HEADER
+#define SCHEME_ASSISTED_GAME_ENGINE_SCRIPT_HEADER
+
+
+#include <string.h>
+#include "../arena/arena.h"
+
+
+/******************************************************************************
+ * VALUE
+ */
+
+
+/*
+ * Script values are NaN-boxed into 64 bits. Any bit pattern whose top sixteen
+ * bits are below 0xFFF9 is a double, which is the only numeric type; the rest
+ * of the quiet NaN space encodes the immediate constants and pointers to heap
+ * objects, so numbers are never allocated.
+ */
+typedef uint64_t sage_value_t;
+
+
+#define SAGE_VALUE_NIL ((sage_value_t) 0xFFF9000000000000u)
+#define SAGE_VALUE_FALSE ((sage_value_t) 0xFFFA000000000000u)
+#define SAGE_VALUE_TRUE ((sage_value_t) 0xFFFB000000000000u)
+#define SAGE_VALUE_VOID ((sage_value_t) 0xFFFC000000000000u)
+#define SAGE_VALUE_UNDEF ((sage_value_t) 0xFFFD000000000000u)
+#define SAGE_VALUE_OBJECT ((sage_value_t) 0xFFFF000000000000u)
+
+
+enum sage_value_type_t {
+    SAGE_VALUE_TYPE_PAIR = 1,
+    SAGE_VALUE_TYPE_STRING,
+    SAGE_VALUE_TYPE_SYMBOL,
+    SAGE_VALUE_TYPE_BOX,
+    SAGE_VALUE_TYPE_VECTOR,
+    SAGE_VALUE_TYPE_PROTO,
+    SAGE_VALUE_TYPE_CLOSURE,
+    SAGE_VALUE_TYPE_PRIMITIVE,
+    SAGE_VALUE_TYPE_HANDLE
+};
+
+
+struct sage_value_obj_t {
+    struct sage_value_obj_t *next;
+    uint8_t type;
+    uint8_t mark;
+    uint8_t flags;
+};
+
+
+struct sage_value_pair_t {
+    struct sage_value_obj_t hdr;
+    sage_value_t car;
+    sage_value_t cdr;
+};
+
+
+struct sage_value_string_t {
+    struct sage_value_obj_t hdr;
+    size_t len;
+    char str[];
+};
+
+
+struct sage_value_symbol_t {
+    struct sage_value_obj_t hdr;
+    uint64_t hash;
+    struct sage_value_symbol_t *chain;
+    size_t len;
+    char name[];
+};
+
+
+struct sage_value_box_t {
+    struct sage_value_obj_t hdr;
+    sage_value_t val;
+};
+
+
+struct sage_value_vector_t {
+    struct sage_value_obj_t hdr;
+    size_t len;
+    sage_value_t items[];
+};
+
+
+/*
+ * A global variable lives in a cell that never moves once created, so that
+ * code can cache a pointer to it at each site that refers to it.
+ */
+struct sage_script_global_t {
+    sage_value_t sym;
+    sage_value_t val;
+};
+
+
+struct sage_value_proto_t {
+    struct sage_value_obj_t hdr;
+    uint32_t *code;
+    size_t ncode;
+    sage_value_t *consts;
+    size_t nconsts;
+    sage_value_t *icsyms;
+    struct sage_script_global_t **ics;
+    size_t nics;
+    uint16_t *ups;
+    uint8_t nups;
+    uint8_t nparams;
+    uint8_t nregs;
+    bool rest;
+    sage_value_t name;
+};
+
+
+struct sage_value_closure_t {
+    struct sage_value_obj_t hdr;
+    struct sage_value_proto_t *proto;
+    uint8_t nups;
+    sage_value_t ups[];
+};
+
+
+typedef sage_value_t (sage_value_primitive_f)(sage_value_t *argv, size_t argc);
+
+
+#define SAGE_VALUE_VARIADIC ((uint8_t) 0xFF)
+
+
+struct sage_value_primitive_t {
+    struct sage_value_obj_t hdr;
+    sage_value_primitive_f *fn;
+    const char *name;
+    uint8_t min;
+    uint8_t max;
+};
+
+
+/*
+ * A handle refers to something owned by C code, such as the entity that a
+ * callback is running for. Handles of a given kind are only valid while C code
+ * says so, and are cleared when it is done with them. Handles of the kind
+ * SAGE_VALUE_HANDLE_OBJECT are different: they hold a reference to a
+ * sage_object of their own, which is released when they are collected.
+ */
+struct sage_value_handle_t {
+    struct sage_value_obj_t hdr;
+    uint8_t kind;
+    bool mutable;
+    void *ptr;
+};
+
+
+#define SAGE_VALUE_HANDLE_OBJECT ((uint8_t) 0xFF)
+
+
+typedef void (sage_value_visit_f)(sage_value_t *slot);
+
+
+inline bool sage_value_is_number(sage_value_t val)
+{
+    return (val >> 48) < 0xFFF9;
+}
+
+
+inline sage_value_t sage_value_number(double num)
+{
+    sage_value_t val;
+    memcpy(&val, &num, sizeof val);
+    return val;
+}
+
+
+inline double sage_value_to_number(sage_value_t val)
+{
+    double num;
+    memcpy(&num, &val, sizeof num);
+    return num;
+}
+
+
+inline sage_value_t sage_value_bool(bool pred)
+{
+    return pred ? SAGE_VALUE_TRUE : SAGE_VALUE_FALSE;
+}
+
+
+inline bool sage_value_is_object(sage_value_t val)
+{
+    return (val & SAGE_VALUE_OBJECT) == SAGE_VALUE_OBJECT;
+}
+
+
+inline void *sage_value_object(sage_value_t val)
+{
+    return (void *) (uintptr_t) (val & ~SAGE_VALUE_OBJECT);
+}
+
+
+inline sage_value_t sage_value_from_object(const void *obj)
+{
+    return (sage_value_t) (uintptr_t) obj | SAGE_VALUE_OBJECT;
+}
+
+
+inline bool sage_value_is(sage_value_t val, enum sage_value_type_t type)
+{
+    return sage_value_is_object(val)
+        && ((struct sage_value_obj_t *) sage_value_object(val))->type == type;
+}
+
+
+inline sage_value_t sage_value_car(sage_value_t val)
+{
+    return ((struct sage_value_pair_t *) sage_value_object(val))->car;
+}
+
+
+inline sage_value_t sage_value_cdr(sage_value_t val)
+{
+    return ((struct sage_value_pair_t *) sage_value_object(val))->cdr;
+}
+
+
+/*
+ * sage_value_barrier_slow() - record a store into a heap object.
+ * See sage/src/script/value.c for details.
+ */
+extern void sage_value_barrier_slow(void *obj, sage_value_t val);
+
+
+/*
+ * sage_value_barrier() must be called whenever a value is stored into an
+ * object that may have survived a collection, such as by set-car! or
+ * vector-set!; storing into an object that was just created needs no barrier.
+ */
+inline void sage_value_barrier(void *obj, sage_value_t val)
+{
+    if (sage_value_is_object(val))
+        sage_value_barrier_slow(obj, val);
+}
+
+
+/*
+ * sage_value_heap_start() - initialise the script heap.
+ * See sage/src/script/value.c for details.
+ */
+extern void sage_value_heap_start(void);
+
+
+/*
+ * sage_value_heap_stop() - release the script heap and all its objects.
+ * See sage/src/script/value.c for details.
+ */
+extern void sage_value_heap_stop(void);
+
+
+/*
+ * sage_value_cons() - create new pair.
+ * See sage/src/script/value.c for details.
+ */
+extern sage_value_t sage_value_cons(sage_value_t car, sage_value_t cdr);
+
+
+/*
+ * sage_value_string() - create new string.
+ * See sage/src/script/value.c for details.
+ */
+extern sage_value_t sage_value_string(const char *str, size_t len);
+
+
+/*
+ * sage_value_symbol() - get interned symbol.
+ * See sage/src/script/value.c for details.
+ */
+extern sage_value_t sage_value_symbol(const char *name, size_t len);
+
+
+/*
+ * sage_value_symbol_unique() - create new uninterned symbol.
+ * See sage/src/script/value.c for details.
+ */
+extern sage_value_t sage_value_symbol_unique(const char *prefix);
+
+
+/*
+ * sage_value_symbol_interned() - check whether a symbol is interned.
+ * See sage/src/script/value.c for details.
+ */
+extern bool sage_value_symbol_interned(sage_value_t sym);
+
+
+/*
+ * sage_value_box() - create new box holding a value.
+ * See sage/src/script/value.c for details.
+ */
+extern sage_value_t sage_value_box(sage_value_t val);
+
+
+/*
+ * sage_value_vector() - create new vector.
+ * See sage/src/script/value.c for details.
+ */
+extern sage_value_t sage_value_vector(size_t len, sage_value_t fill);
+
+
+/*
+ * sage_value_proto() - create new empty procedure prototype.
+ * See sage/src/script/value.c for details.
+ */
+extern struct sage_value_proto_t *sage_value_proto(void);
+
+
+/*
+ * sage_value_closure() - create new closure over a prototype.
+ * See sage/src/script/value.c for details.
+ */
+extern struct sage_value_closure_t *sage_value_closure(
+        struct sage_value_proto_t *proto);
+
+
+/*
+ * sage_value_primitive() - create new primitive procedure.
+ * See sage/src/script/value.c for details.
+ */
+extern sage_value_t sage_value_primitive(const char *name,
+        sage_value_primitive_f *fn, uint8_t min, uint8_t max);
+
+
+/*
+ * sage_value_handle() - create new handle to C-owned data.
+ * See sage/src/script/value.c for details.
+ */
+extern sage_value_t sage_value_handle(uint8_t kind);
+
+
+/*
+ * sage_value_bridge() - create new handle holding a reference to an object.
+ * See sage/src/script/value.c for details.
+ */
+extern sage_value_t sage_value_bridge(const sage_object *obj);
+
+
+/*
+ * sage_value_bridged() - get the object referred to by a bridge handle.
+ * See sage/src/script/value.c for details.
+ */
+extern const sage_object *sage_value_bridged(sage_value_t val);
+
+
+/*
+ * sage_value_collect() - collect all unreachable script objects.
+ * See sage/src/script/value.c for details.
+ */
+extern void sage_value_collect(void);
+
+
+/*
+ * sage_value_collect_due() - check whether a collection is worthwhile.
+ * See sage/src/script/value.c for details.
+ */
+extern bool sage_value_collect_due(void);
+
+
+/*
+ * sage_value_collect_step() - empty the nursery and collect incrementally.
+ * See sage/src/script/value.c for details.
+ */
+extern void sage_value_collect_step(uint32_t budget);
+
+
+/*
+ * sage_value_equal() - check whether two values are structurally equal.
+ * See sage/src/script/value.c for details.
+ */
+extern bool sage_value_equal(sage_value_t lhs, sage_value_t rhs);
+
+
+/*
+ * sage_value_print() - print a value.
+ * See sage/src/script/value.c for details.
+ */
+extern void sage_value_print(FILE *file, sage_value_t val, bool write);
+
+
+/******************************************************************************
+ * READER
+ */
+
+
+struct sage_script_reader_t {
+    const char *pos;
+    size_t line;
+    const char *err;
+};
+
+
+/*
+ * sage_script_reader_start() - start reading data from source text.
+ * See sage/src/script/reader.c for details.
+ */
+extern void sage_script_reader_start(struct sage_script_reader_t *ctx,
+        const char *src);
+
+
+/*
+ * sage_script_read() - read the next datum from source text.
+ * See sage/src/script/reader.c for details.
+ */
+extern bool sage_script_read(struct sage_script_reader_t *ctx,
+        sage_value_t *datum);
+
+
+/******************************************************************************
+ * COMPILER
+ */
+
+
+/*
+ * Instructions are 32 bits wide, with the opcode in the low byte followed by
+ * the operands A, B and C, one byte each; Bx is B and C taken together as an
+ * unsigned 16-bit operand, and sBx is Bx less SAGE_SCRIPT_SBX_BIAS. The inline
+ * operations from SAGE_SCRIPT_OP_ADD onwards are followed by a second word
+ * holding the index of the global they stand for.
+ */
+enum sage_script_op_t {
+    SAGE_SCRIPT_OP_MOVE = 0,
+    SAGE_SCRIPT_OP_CONST,
+    SAGE_SCRIPT_OP_GLOBAL,
+    SAGE_SCRIPT_OP_DEFINE,
+    SAGE_SCRIPT_OP_SETGLOBAL,
+    SAGE_SCRIPT_OP_UPVAL,
+    SAGE_SCRIPT_OP_BOX,
+    SAGE_SCRIPT_OP_UNBOX,
+    SAGE_SCRIPT_OP_SETBOX,
+    SAGE_SCRIPT_OP_CLOSURE,
+    SAGE_SCRIPT_OP_JUMP,
+    SAGE_SCRIPT_OP_JUMPF,
+    SAGE_SCRIPT_OP_JUMPT,
+    SAGE_SCRIPT_OP_CALL,
+    SAGE_SCRIPT_OP_TAILCALL,
+    SAGE_SCRIPT_OP_RETURN,
+    SAGE_SCRIPT_OP_ADD,
+    SAGE_SCRIPT_OP_SUB,
+    SAGE_SCRIPT_OP_MUL,
+    SAGE_SCRIPT_OP_DIV,
+    SAGE_SCRIPT_OP_LT,
+    SAGE_SCRIPT_OP_LE,
+    SAGE_SCRIPT_OP_GT,
+    SAGE_SCRIPT_OP_GE,
+    SAGE_SCRIPT_OP_NUMEQ,
+    SAGE_SCRIPT_OP_EQ,
+    SAGE_SCRIPT_OP_CONS,
+    SAGE_SCRIPT_OP_VREF,
+    SAGE_SCRIPT_OP_CAR,
+    SAGE_SCRIPT_OP_CDR,
+    SAGE_SCRIPT_OP_NOT,
+    SAGE_SCRIPT_OP_NULLP,
+    SAGE_SCRIPT_OP_PAIRP,
+
+    SAGE_SCRIPT_OP_COUNT
+};
+
+
+#define SAGE_SCRIPT_SBX_BIAS ((int32_t) 32767)
+
+
+/*
+ * sage_script_compiler_start() - start the compiler of the calling thread.
+ * See sage/src/script/compiler.c for details.
+ */
+extern void sage_script_compiler_start(void);
+
+
+/*
+ * sage_script_compiler_stop() - stop the compiler of the calling thread.
+ * See sage/src/script/compiler.c for details.
+ */
+extern void sage_script_compiler_stop(void);
+
+
+/*
+ * sage_script_compile() - compile a top-level form into a procedure.
+ * See sage/src/script/compiler.c for details.
+ */
+extern struct sage_value_proto_t *sage_script_compile(sage_value_t form,
+        const char **err);
+
+
+/******************************************************************************
+ * VM
+ */
+
+
+/*
+ * sage_script_start() - start the script VM of the calling thread.
+ * See sage/src/script/vm.c for details.
+ */
+extern void sage_script_start(void);
+
+
+/*
+ * sage_script_stop() - stop the script VM of the calling thread.
+ * See sage/src/script/vm.c for details.
+ */
+extern void sage_script_stop(void);
+
+
+/*
+ * The time budget in microseconds that the loaders give the collector after
+ * running a form, if a collection is due.
+ */
+#define SAGE_SCRIPT_LOAD_BUDGET ((uint32_t) 1000)
+
+
+/*
+ * sage_script_load() - evaluate every form in a string of source text.
+ * See sage/src/script/vm.c for details.
+ */
+extern bool sage_script_load(const char *src, const char *name);
+
+
+/*
+ * sage_script_load_file() - evaluate every form in a source file.
+ * See sage/src/script/vm.c for details.
+ */
+extern bool sage_script_load_file(const char *path);
+
+
+/*
+ * sage_script_load_cached() - evaluate a source file through a bytecode cache.
+ * See sage/src/script/cache.c for details.
+ */
+extern bool sage_script_load_cached(const char *path, const char *cache);
+
+
+/*
+ * A buffer of encoded values, as filled in by sage_script_encode().
+ */
+struct sage_script_bytes_t {
+    uint8_t *bfr;
+    size_t len;
+    size_t cap;
+};
+
+
+/*
+ * sage_script_encode() - encode a value so it can be moved between heaps.
+ * See sage/src/script/cache.c for details.
+ */
+extern bool sage_script_encode(struct sage_script_bytes_t *ctx,
+        sage_value_t val);
+
+
+/*
+ * sage_script_decode() - create a value from its encoding.
+ * See sage/src/script/cache.c for details.
+ */
+extern bool sage_script_decode(const void *data, size_t len,
+        sage_value_t *val);
+
+
+/*
+ * sage_script_call() - call a script procedure from C.
+ * See sage/src/script/vm.c for details.
+ */
+extern bool sage_script_call(sage_value_t proc, const sage_value_t *argv,
+        size_t argc, sage_value_t *ret);
+
+
+/*
+ * sage_script_apply() - call a script procedure from a primitive.
+ * See sage/src/script/vm.c for details.
+ */
+extern sage_value_t sage_script_apply(sage_value_t proc,
+        const sage_value_t *argv, size_t argc);
+
+
+/*
+ * sage_script_error() - raise a script error.
+ * See sage/src/script/vm.c for details.
+ */
+extern SAGE_COLD _Noreturn void sage_script_error(const char *fmt, ...);
+
+
+/*
+ * sage_script_global_cell() - get the cell of a global variable.
+ * See sage/src/script/vm.c for details.
+ */
+extern struct sage_script_global_t *sage_script_global_cell(sage_value_t sym);
+
+
+/*
+ * sage_script_global() - get the value of a global variable.
+ * See sage/src/script/vm.c for details.
+ */
+extern sage_value_t sage_script_global(const char *name);
+
+
+/*
+ * sage_script_global_set() - define a global variable.
+ * See sage/src/script/vm.c for details.
+ */
+extern void sage_script_global_set(const char *name, sage_value_t val);
+
+
+/*
+ * sage_script_primitive() - define a global primitive procedure.
+ * See sage/src/script/vm.c for details.
+ */
+extern sage_value_t sage_script_primitive(const char *name,
+        sage_value_primitive_f *fn, uint8_t min, uint8_t max);
+
+
+/*
+ * sage_script_inline_op() - get the inline operation for a global.
+ * See sage/src/script/vm.c for details.
+ */
+extern enum sage_script_op_t sage_script_inline_op(sage_value_t sym,
+        size_t argc);
+
+
+/*
+ * sage_script_verify() - check that code from outside the VM is safe to run.
+ * See sage/src/script/vm.c for details.
+ */
+extern bool sage_script_verify(const struct sage_value_proto_t *p);
+
+
+/*
+ * sage_script_pin() - keep a value alive for the life of the VM.
+ * See sage/src/script/vm.c for details.
+ */
+extern void sage_script_pin(sage_value_t val);
+
+
+/*
+ * sage_script_roots() - visit the roots of the VM.
+ * See sage/src/script/vm.c for details.
+ */
+extern void sage_script_roots(sage_value_visit_f *visit);
+
+
+/*
+ * sage_script_collect() - collect garbage within a time budget.
+ * See sage/src/script/vm.c for details.
+ */
+extern void sage_script_collect(uint32_t budget);
+
+
+/*
+ * sage_script_primitives_register() - define the standard primitives.
+ * See sage/src/script/primitives.c for details.
+ */
+extern void sage_script_primitives_register(void);
+
+
+/*
+ * sage_script_primitives_seed() - seed the random primitive of this thread.
+ * See sage/src/script/primitives.c for details.
+ */
+extern void sage_script_primitives_seed(uint64_t val);
+
+
+/******************************************************************************
+ * BIND
+ */
+
+
+/*
+ * sage_script_bind_start() - start binding entities and scenes to scripts.
+ * See sage/src/script/bind.c for details.
+ */
+extern void sage_script_bind_start(void);
+
+
+/*
+ * sage_script_bind_input() - define the input primitives on this thread.
+ * See sage/src/script/bind.c for details.
+ */
+extern void sage_script_bind_input(void);
+
+
+/*
+ * sage_script_bind_stop() - stop binding entities and scenes to scripts.
+ * See sage/src/script/bind.c for details.
+ */
+extern void sage_script_bind_stop(void);
+
+
+/*
+ * sage_script_entity_bind() - bind an entity class to script procedures.
+ * See sage/src/script/bind.c for details.
+ */
+extern struct sage_entity_vtable sage_script_entity_bind(sage_id cls,
+        const char *update, const char *draw);
+
+
+/*
+ * sage_script_entity_batch_bind() - bind an entity class in batches.
+ * See sage/src/script/bind.c for details.
+ */
+extern struct sage_entity_vtable sage_script_entity_batch_bind(sage_id cls,
+        const char *update, const char *draw);
+
+
+/*
+ * sage_script_scene_bind() - bind a scene to script procedures.
+ * See sage/src/script/bind.c for details.
+ */
+extern struct sage_scene_vtable sage_script_scene_bind(sage_id id,
+        const char *start, const char *stop, const char *update);
+
+
+/******************************************************************************
+ * WORKERS
+ */
+
+
+/*
+ * sage_script_workers_start() - start a pool of threads with VMs of their own.
+ * See sage/src/script/worker.c for details.
+ */
+extern bool sage_script_workers_start(size_t count, const char *const *paths,
+        size_t npaths);
+
+
+/*
+ * sage_script_workers_stop() - stop the pool of script worker threads.
+ * See sage/src/script/worker.c for details.
+ */
+extern void sage_script_workers_stop(void);
+
+
+/*
+ * sage_script_workers_send() - set a global in the VM of every worker.
+ * See sage/src/script/worker.c for details.
+ */
+extern bool sage_script_workers_send(const char *name, sage_value_t val);
+
+
+/*
+ * sage_script_entity_parallel_bind() - bind an entity class across workers.
+ * See sage/src/script/worker.c for details.
+ */
+extern struct sage_entity_vtable sage_script_entity_parallel_bind(sage_id cls,
+        const char *update, const char *draw);
+
+
+#endif /* SCHEME_ASSISTED_GAME_ENGINE_SCRIPT_HEADER */
+
+
+/******************************************************************************
+ *                                   __.-._
+ *                                   '-._"7'
+ *                                    /'.-c
+ *                                    |  /T
+ *                                   _)_/LI
+ ******************************************************************************/
+
@@ -0,0 +1,1168 @@
+#include <SDL2/SDL.h>
+#include "script.h"
+
+
+/*
+ * The script heap has two generations. New objects are bump-allocated in a
+ * nursery, and whatever is still reachable in the nursery at a safe point is
+ * copied out of it, after which the nursery is reset in one step. Safe points
+ * are the times between calls into the VM, when no script code is running, so
+ * the roots are only the globals, the constants of loaded code and anything
+ * pinned by C code; values in registers are never live at that point and need
+ * not be scanned. The game loop reaches a safe point once per frame, so the
+ * garbage that scripts make every tick never gets past the nursery.
+ *
+ * Much of what survives a frame dies a frame or two later, such as the state
+ * that a script rebuilds every tick, so survivors are first copied into one of
+ * two small survivor spaces, which swap roles at each safe point, and are only
+ * promoted into the old generation once they have survived SURVIVOR_AGE safe
+ * points, or the survivor space is full. Copying into a survivor space is a
+ * bump and a copy, where promotion is an allocation, so short-lived survivors
+ * cost little and the work of a safe point stays small.
+ *
+ * Old objects are allocated on their own and threaded onto a list, and are
+ * collected by a mark-sweep that runs a slice at a time within a time budget.
+ * Objects that are too large for the nursery, or that own memory outside the
+ * heap, are allocated straight into the old generation. A write barrier keeps
+ * a remembered set of the old objects that have been made to refer to young
+ * ones, whose fields are roots for emptying the nursery; while the old
+ * generation is being marked, the same barrier marks any old object stored into
+ * an object that has already been marked, promoted objects are marked as they
+ * are copied, and the fields of the survivors are scanned along with the roots,
+ * so that no live object is left unmarked when the slices finish.
+ *
+ * Symbols are interned in a hash table so that two symbols with the same name
+ * are the same object and can be compared by value; interned symbols are never
+ * collected.
+ */
+
+
+#define HEAP_LIMIT ((size_t) 1 << 20)
+#define NURSERY_LEN ((size_t) 1 << 19)
+#define NURSERY_OBJ_MAX ((size_t) 1 << 12)
+#define SURVIVOR_LEN ((size_t) 1 << 18)
+#define SURVIVOR_AGE ((uint8_t) 2)
+#define SYMBOLS_LEN ((size_t) 256)
+#define STEP_CHECK ((size_t) 64)
+
+
+#define FLAG_REMEMBERED ((uint8_t) 1)
+#define FLAG_FORWARDED ((uint8_t) 2)
+#define FLAG_INTERNED ((uint8_t) 4)
+#define FLAG_AGE ((uint8_t) 24)
+#define FLAG_AGE_SHIFT 3
+
+
+enum phase_t {
+    PHASE_IDLE,
+    PHASE_MARK,
+    PHASE_SWEEP
+};
+
+
+struct stack {
+    struct sage_value_obj_t **items;
+    size_t len;
+    size_t cap;
+};
+
+
+static thread_local struct {
+    uint8_t *nursery;
+    uint8_t *top;
+    uint8_t *from;
+    uint8_t *from_top;
+    uint8_t *to;
+    uint8_t *to_top;
+    bool young_ref;
+    struct sage_value_obj_t *all;
+    struct sage_value_obj_t *sweep;
+    size_t bytes;
+    size_t limit;
+    enum phase_t phase;
+    struct sage_value_symbol_t **syms;
+    size_t nsyms;
+    size_t capsyms;
+    struct stack gray;
+    struct stack remembered;
+    struct stack scan;
+    size_t gensym;
+} *heap = NULL;
+
+
+extern inline bool sage_value_is_number(sage_value_t val);
+
+extern inline sage_value_t sage_value_number(double num);
+
+extern inline double sage_value_to_number(sage_value_t val);
+
+extern inline sage_value_t sage_value_bool(bool pred);
+
+extern inline bool sage_value_is_object(sage_value_t val);
+
+extern inline void *sage_value_object(sage_value_t val);
+
+extern inline sage_value_t sage_value_from_object(const void *obj);
+
+extern inline bool sage_value_is(sage_value_t val,
+        enum sage_value_type_t type);
+
+extern inline sage_value_t sage_value_car(sage_value_t val);
+
+extern inline sage_value_t sage_value_cdr(sage_value_t val);
+
+extern inline void sage_value_barrier(void *obj, sage_value_t val);
+
+
+static void stack_start(struct stack *stk)
+{
+    stk->cap = 256;
+    stk->len = 0;
+    stk->items = sage_heap_new(sizeof *stk->items * stk->cap);
+}
+
+
+static void stack_push(struct stack *stk, struct sage_value_obj_t *obj)
+{
+    if (sage_unlikely (stk->len == stk->cap)) {
+        stk->cap *= 2;
+        stk->items = sage_heap_resize(stk->items, sizeof *stk->items
+                * stk->cap);
+    }
+
+    stk->items[stk->len++] = obj;
+}
+
+
+/*
+ * The young() helper function checks whether an object is in the young
+ * generation, which is the nursery and the two survivor spaces after it.
+ */
+static inline bool young(const void *obj)
+{
+    return (const uint8_t *) obj >= heap->nursery
+        && (const uint8_t *) obj < heap->nursery + NURSERY_LEN
+            + 2 * SURVIVOR_LEN;
+}
+
+
+static inline size_t young_size(size_t sz)
+{
+    return (sz + 15) & ~(size_t) 15;
+}
+
+
+static inline void remember(struct sage_value_obj_t *obj)
+{
+    if (!(obj->flags & FLAG_REMEMBERED)) {
+        obj->flags |= FLAG_REMEMBERED;
+        stack_push(&heap->remembered, obj);
+    }
+}
+
+
+static inline void gray(struct sage_value_obj_t *obj)
+{
+    if (!obj->mark) {
+        obj->mark = 1;
+        stack_push(&heap->gray, obj);
+    }
+}
+
+
+static size_t obj_size(const struct sage_value_obj_t *obj)
+{
+    switch (obj->type) {
+        case SAGE_VALUE_TYPE_PAIR:
+            return sizeof (struct sage_value_pair_t);
+
+        case SAGE_VALUE_TYPE_STRING:
+            return sizeof (struct sage_value_string_t)
+                + ((const struct sage_value_string_t *) obj)->len + 1;
+
+        case SAGE_VALUE_TYPE_SYMBOL:
+            return sizeof (struct sage_value_symbol_t)
+                + ((const struct sage_value_symbol_t *) obj)->len + 1;
+
+        case SAGE_VALUE_TYPE_BOX:
+            return sizeof (struct sage_value_box_t);
+
+        case SAGE_VALUE_TYPE_VECTOR:
+            return sizeof (struct sage_value_vector_t) + sizeof (sage_value_t)
+                * ((const struct sage_value_vector_t *) obj)->len;
+
+        case SAGE_VALUE_TYPE_PROTO:
+            return sizeof (struct sage_value_proto_t);
+
+        case SAGE_VALUE_TYPE_CLOSURE:
+            return sizeof (struct sage_value_closure_t) + sizeof (sage_value_t)
+                * ((const struct sage_value_closure_t *) obj)->nups;
+
+        case SAGE_VALUE_TYPE_PRIMITIVE:
+            return sizeof (struct sage_value_primitive_t);
+
+        default:
+            return sizeof (struct sage_value_handle_t);
+    }
+}
+
+
+static void obj_free(struct sage_value_obj_t *obj)
+{
+    if (obj->type == SAGE_VALUE_TYPE_PROTO) {
+        struct sage_value_proto_t *p = (struct sage_value_proto_t *) obj;
+
+        sage_heap_free((void **) &p->code);
+        sage_heap_free((void **) &p->consts);
+        sage_heap_free((void **) &p->icsyms);
+        sage_heap_free((void **) &p->ics);
+        sage_heap_free((void **) &p->ups);
+    } else if (obj->type == SAGE_VALUE_TYPE_HANDLE) {
+        struct sage_value_handle_t *hnd = (struct sage_value_handle_t *) obj;
+
+        if (hnd->kind == SAGE_VALUE_HANDLE_OBJECT)
+            sage_object_free((sage_object **) &hnd->ptr);
+    }
+
+    sage_heap_free((void **) &obj);
+}
+
+
+/*
+ * The old_link() helper function adds an object to the old generation. Objects
+ * that become old while the old generation is being marked are marked at once,
+ * since they may be reachable from objects that have already been scanned.
+ */
+static void old_link(struct sage_value_obj_t *obj, size_t sz)
+{
+    obj->next = heap->all;
+    obj->mark = heap->phase == PHASE_MARK;
+    heap->all = obj;
+    heap->bytes += sz;
+}
+
+
+/*
+ * The obj_new() helper function allocates a new object of a given type and
+ * size. Objects that are allocated straight into the old generation are
+ * remembered until the next promotion, so that anything young they are made to
+ * refer to while being set up is found.
+ */
+static void *obj_new(enum sage_value_type_t type, size_t sz)
+{
+    sage_assert (heap);
+
+    const size_t len = young_size(sz);
+    const bool small = type == SAGE_VALUE_TYPE_PAIR
+        || type == SAGE_VALUE_TYPE_BOX || type == SAGE_VALUE_TYPE_CLOSURE
+        || ((type == SAGE_VALUE_TYPE_STRING || type == SAGE_VALUE_TYPE_VECTOR)
+                && len <= NURSERY_OBJ_MAX);
+    struct sage_value_obj_t *obj;
+
+    if (sage_likely (small && heap->top + len <= heap->nursery
+                + NURSERY_LEN)) {
+        obj = (struct sage_value_obj_t *) heap->top;
+        heap->top += len;
+
+        obj->next = NULL;
+        obj->mark = 0;
+        obj->flags = 0;
+    } else {
+        obj = sage_heap_new(sz);
+        old_link(obj, sz);
+        remember(obj);
+    }
+
+    obj->type = (uint8_t) type;
+    return obj;
+}
+
+
+static uint64_t name_hash(const char *name, size_t len)
+{
+    uint64_t hash = 14695981039346656037u;
+
+    for (register size_t i = 0; i < len; i++)
+        hash = (hash ^ (uint8_t) name[i]) * 1099511628211u;
+
+    return hash;
+}
+
+
+static void symbols_grow(void)
+{
+    size_t cap = heap->capsyms * 2;
+    struct sage_value_symbol_t **syms = sage_heap_new(sizeof *syms * cap);
+
+    for (register size_t i = 0; i < heap->capsyms; i++) {
+        struct sage_value_symbol_t *sym = heap->syms[i], *next;
+
+        for (; sym; sym = next) {
+            next = sym->chain;
+            sym->chain = syms[sym->hash & (cap - 1)];
+            syms[sym->hash & (cap - 1)] = sym;
+        }
+    }
+
+    sage_heap_free((void **) &heap->syms);
+    heap->syms = syms;
+    heap->capsyms = cap;
+}
+
+
+extern void sage_value_heap_start(void)
+{
+    if (sage_unlikely (heap))
+        return;
+
+    heap = sage_heap_new(sizeof *heap);
+    heap->nursery = heap->top = sage_heap_new(NURSERY_LEN + 2 * SURVIVOR_LEN);
+    heap->from = heap->from_top = heap->nursery + NURSERY_LEN;
+    heap->to = heap->to_top = heap->from + SURVIVOR_LEN;
+    heap->all = heap->sweep = NULL;
+    heap->bytes = heap->nsyms = heap->gensym = 0;
+    heap->limit = HEAP_LIMIT;
+    heap->phase = PHASE_IDLE;
+
+    heap->capsyms = SYMBOLS_LEN;
+    heap->syms = sage_heap_new(sizeof *heap->syms * heap->capsyms);
+
+    stack_start(&heap->gray);
+    stack_start(&heap->remembered);
+    stack_start(&heap->scan);
+}
+
+
+static void list_free(struct sage_value_obj_t *obj)
+{
+    struct sage_value_obj_t *next;
+
+    for (; obj; obj = next) {
+        next = obj->next;
+        obj_free(obj);
+    }
+}
+
+
+extern void sage_value_heap_stop(void)
+{
+    if (sage_likely (heap)) {
+        list_free(heap->all);
+        list_free(heap->sweep);
+
+        sage_heap_free((void **) &heap->nursery);
+        sage_heap_free((void **) &heap->syms);
+        sage_heap_free((void **) &heap->gray.items);
+        sage_heap_free((void **) &heap->remembered.items);
+        sage_heap_free((void **) &heap->scan.items);
+        sage_heap_free((void **) &heap);
+    }
+}
+
+
+extern sage_value_t sage_value_cons(sage_value_t car, sage_value_t cdr)
+{
+    struct sage_value_pair_t *pair = obj_new(SAGE_VALUE_TYPE_PAIR,
+            sizeof *pair);
+
+    pair->car = car;
+    pair->cdr = cdr;
+
+    return sage_value_from_object(pair);
+}
+
+
+extern sage_value_t sage_value_string(const char *str, size_t len)
+{
+    struct sage_value_string_t *s = obj_new(SAGE_VALUE_TYPE_STRING,
+            sizeof *s + len + 1);
+
+    s->len = len;
+    memcpy(s->str, str, len);
+    s->str[len] = '\0';
+
+    return sage_value_from_object(s);
+}
+
+
+static struct sage_value_symbol_t *symbol_new(const char *name, size_t len,
+        uint64_t hash)
+{
+    struct sage_value_symbol_t *sym = obj_new(SAGE_VALUE_TYPE_SYMBOL,
+            sizeof *sym + len + 1);
+
+    sym->hash = hash;
+    sym->chain = NULL;
+    sym->len = len;
+    memcpy(sym->name, name, len);
+    sym->name[len] = '\0';
+
+    return sym;
+}
+
+
+/*
+ * The sage_value_symbol() interface function gets the symbol with a given
+ * name, creating and interning it if it does not exist yet.
+ */
+extern sage_value_t sage_value_symbol(const char *name, size_t len)
+{
+    sage_assert (heap && name);
+    const uint64_t hash = name_hash(name, len);
+
+    struct sage_value_symbol_t *sym = heap->syms[hash & (heap->capsyms - 1)];
+    for (; sym; sym = sym->chain) {
+        if (sym->hash == hash && sym->len == len
+                && !memcmp(sym->name, name, len))
+            return sage_value_from_object(sym);
+    }
+
+    if (sage_unlikely (heap->nsyms >= heap->capsyms))
+        symbols_grow();
+
+    sym = symbol_new(name, len, hash);
+    sym->hdr.flags |= FLAG_INTERNED;
+    sym->chain = heap->syms[hash & (heap->capsyms - 1)];
+    heap->syms[hash & (heap->capsyms - 1)] = sym;
+    heap->nsyms++;
+
+    return sage_value_from_object(sym);
+}
+
+
+/*
+ * The sage_value_symbol_unique() interface function creates a symbol that is
+ * not interned, and so is different from every other symbol, even one with the
+ * same name. The compiler uses these for the variables it introduces.
+ */
+extern sage_value_t sage_value_symbol_unique(const char *prefix)
+{
+    char name[64];
+    int len = snprintf(name, sizeof name, "%s%zu", prefix, ++heap->gensym);
+
+    sage_assert (len > 0 && (size_t) len < sizeof name);
+    return sage_value_from_object(symbol_new(name, (size_t) len,
+                name_hash(name, (size_t) len)));
+}
+
+
+extern bool sage_value_symbol_interned(sage_value_t sym)
+{
+    sage_assert (sage_value_is(sym, SAGE_VALUE_TYPE_SYMBOL));
+
+    return ((const struct sage_value_obj_t *) sage_value_object(sym))->flags
+        & FLAG_INTERNED;
+}
+
+
+extern sage_value_t sage_value_box(sage_value_t val)
+{
+    struct sage_value_box_t *box = obj_new(SAGE_VALUE_TYPE_BOX, sizeof *box);
+    box->val = val;
+
+    return sage_value_from_object(box);
+}
+
+
+extern sage_value_t sage_value_vector(size_t len, sage_value_t fill)
+{
+    struct sage_value_vector_t *vec = obj_new(SAGE_VALUE_TYPE_VECTOR,
+            sizeof *vec + sizeof *vec->items * len);
+
+    vec->len = len;
+    for (register size_t i = 0; i < len; i++)
+        vec->items[i] = fill;
+
+    return sage_value_from_object(vec);
+}
+
+
+extern struct sage_value_proto_t *sage_value_proto(void)
+{
+    struct sage_value_proto_t *p = obj_new(SAGE_VALUE_TYPE_PROTO, sizeof *p);
+
+    p->code = NULL;
+    p->consts = p->icsyms = NULL;
+    p->ics = NULL;
+    p->ups = NULL;
+    p->ncode = p->nconsts = p->nics = 0;
+    p->nups = p->nparams = p->nregs = 0;
+    p->rest = false;
+    p->name = SAGE_VALUE_FALSE;
+
+    return p;
+}
+
+
+extern struct sage_value_closure_t *sage_value_closure(
+        struct sage_value_proto_t *proto)
+{
+    struct sage_value_closure_t *cl = obj_new(SAGE_VALUE_TYPE_CLOSURE,
+            sizeof *cl + sizeof *cl->ups * proto->nups);
+
+    cl->proto = proto;
+    cl->nups = proto->nups;
+
+    return cl;
+}
+
+
+extern sage_value_t sage_value_primitive(const char *name,
+        sage_value_primitive_f *fn, uint8_t min, uint8_t max)
+{
+    struct sage_value_primitive_t *prim = obj_new(SAGE_VALUE_TYPE_PRIMITIVE,
+            sizeof *prim);
+
+    prim->fn = fn;
+    prim->name = name;
+    prim->min = min;
+    prim->max = max;
+
+    return sage_value_from_object(prim);
+}
+
+
+extern sage_value_t sage_value_handle(uint8_t kind)
+{
+    struct sage_value_handle_t *hnd = obj_new(SAGE_VALUE_TYPE_HANDLE,
+            sizeof *hnd);
+
+    hnd->kind = kind;
+    hnd->mutable = false;
+    hnd->ptr = NULL;
+
+    return sage_value_from_object(hnd);
+}
+
+
+/*
+ * The sage_value_bridge() interface function creates a handle through which
+ * scripts can hold on to the object obj. The handle takes a copy of obj, which
+ * only adds a reference since objects are copied on write, and releases it
+ * when the handle is collected; C code can free its own reference to obj at
+ * any time without affecting the handle.
+ */
+extern sage_value_t sage_value_bridge(const sage_object *obj)
+{
+    sage_assert (obj);
+    sage_value_t val = sage_value_handle(SAGE_VALUE_HANDLE_OBJECT);
+
+    ((struct sage_value_handle_t *) sage_value_object(val))->ptr
+        = sage_object_copy(obj);
+
+    return val;
+}
+
+
+extern const sage_object *sage_value_bridged(sage_value_t val)
+{
+    if (!sage_value_is(val, SAGE_VALUE_TYPE_HANDLE))
+        return NULL;
+
+    const struct sage_value_handle_t *hnd = sage_value_object(val);
+    return hnd->kind == SAGE_VALUE_HANDLE_OBJECT ? hnd->ptr : NULL;
+}
+
+
+/*
+ * The sage_value_barrier_slow() interface function is the out-of-line part of
+ * sage_value_barrier(), called when an object value val is stored into obj.
+ */
+extern void sage_value_barrier_slow(void *obj, sage_value_t val)
+{
+    struct sage_value_obj_t *src = obj;
+    struct sage_value_obj_t *dst = sage_value_object(val);
+
+    if (young(src))
+        return;
+
+    if (young(dst))
+        remember(src);
+    else if (heap->phase == PHASE_MARK && src->mark)
+        gray(dst);
+}
+
+
+static void fields(struct sage_value_obj_t *obj, sage_value_visit_f *visit)
+{
+    switch (obj->type) {
+        case SAGE_VALUE_TYPE_PAIR: {
+            struct sage_value_pair_t *pair = (struct sage_value_pair_t *) obj;
+            visit(&pair->car);
+            visit(&pair->cdr);
+            break;
+        }
+
+        case SAGE_VALUE_TYPE_BOX:
+            visit(&((struct sage_value_box_t *) obj)->val);
+            break;
+
+        case SAGE_VALUE_TYPE_VECTOR: {
+            struct sage_value_vector_t *vec
+                = (struct sage_value_vector_t *) obj;
+
+            for (register size_t i = 0; i < vec->len; i++)
+                visit(&vec->items[i]);
+            break;
+        }
+
+        case SAGE_VALUE_TYPE_PROTO: {
+            struct sage_value_proto_t *p = (struct sage_value_proto_t *) obj;
+
+            for (register size_t i = 0; i < p->nconsts; i++)
+                visit(&p->consts[i]);
+
+            for (register size_t i = 0; i < p->nics; i++)
+                visit(&p->icsyms[i]);
+
+            visit(&p->name);
+            break;
+        }
+
+        case SAGE_VALUE_TYPE_CLOSURE: {
+            struct sage_value_closure_t *cl
+                = (struct sage_value_closure_t *) obj;
+            sage_value_t proto = sage_value_from_object(cl->proto);
+
+            visit(&proto);
+            for (register size_t i = 0; i < cl->nups; i++)
+                visit(&cl->ups[i]);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+
+/*
+ * The forward() helper function updates a reference to a young object to point
+ * to its copy, copying the object if it has not been copied yet: into the to
+ * survivor space if it is young enough and there is room, and otherwise into
+ * the old generation. The young copy is left with a forwarding pointer in place
+ * of its list link. Whether the reference is still to a young object is noted,
+ * so that old objects holding it can be remembered.
+ */
+static void forward(sage_value_t *slot)
+{
+    if (!sage_value_is_object(*slot))
+        return;
+
+    struct sage_value_obj_t *obj = sage_value_object(*slot);
+
+    if (!young(obj)) {
+        if (heap->phase == PHASE_MARK)
+            gray(obj);
+        return;
+    }
+
+    if (!(obj->flags & FLAG_FORWARDED)) {
+        const size_t sz = obj_size(obj);
+        const size_t len = young_size(sz);
+        const uint8_t age = (obj->flags & FLAG_AGE) >> FLAG_AGE_SHIFT;
+        struct sage_value_obj_t *cp;
+
+        if (age < SURVIVOR_AGE && heap->to_top + len <= heap->to
+                + SURVIVOR_LEN) {
+            cp = (struct sage_value_obj_t *) heap->to_top;
+            heap->to_top += len;
+
+            memcpy(cp, obj, sz);
+            cp->flags = (uint8_t) ((age + 1) << FLAG_AGE_SHIFT);
+        } else {
+            cp = sage_heap_new(sz);
+
+            memcpy(cp, obj, sz);
+            cp->flags = 0;
+            old_link(cp, sz);
+        }
+
+        stack_push(&heap->scan, cp);
+
+        obj->flags |= FLAG_FORWARDED;
+        obj->next = cp;
+    }
+
+    *slot = sage_value_from_object(obj->next);
+    heap->young_ref |= young(obj->next);
+}
+
+
+/*
+ * The scan() helper function forwards the fields of an object that survived,
+ * and remembers it if it is old and still refers to a young object.
+ */
+static void scan(struct sage_value_obj_t *obj)
+{
+    heap->young_ref = false;
+    fields(obj, forward);
+
+    if (heap->young_ref && !young(obj))
+        remember(obj);
+}
+
+
+/*
+ * The promote() helper function copies everything that is reachable in the
+ * nursery and the from survivor space out of them, and resets both, swapping
+ * the survivor spaces. Its roots are the roots of the VM and the fields of the
+ * remembered objects; remembered objects that still refer to young ones after
+ * that stay remembered.
+ */
+static void promote(void)
+{
+    sage_script_roots(forward);
+
+    const size_t nrem = heap->remembered.len;
+    for (register size_t i = 0; i < nrem; i++) {
+        struct sage_value_obj_t *obj = heap->remembered.items[i];
+
+        obj->flags &= (uint8_t) ~FLAG_REMEMBERED;
+        scan(obj);
+    }
+
+    while (heap->scan.len)
+        scan(heap->scan.items[--heap->scan.len]);
+
+    heap->remembered.len -= nrem;
+    memmove(heap->remembered.items, heap->remembered.items + nrem,
+            sizeof *heap->remembered.items * heap->remembered.len);
+
+    uint8_t *tmp = heap->from;
+    heap->from = heap->to;
+    heap->from_top = heap->to_top;
+    heap->to = heap->to_top = tmp;
+    heap->top = heap->nursery;
+}
+
+
+/*
+ * The gray_slot() helper function grays an old object referred to from a slot.
+ * Young objects are never marked; instead, the old objects they refer to are
+ * grayed by gray_roots().
+ */
+static void gray_slot(sage_value_t *slot)
+{
+    if (sage_value_is_object(*slot) && !young(sage_value_object(*slot)))
+        gray(sage_value_object(*slot));
+}
+
+
+/*
+ * The gray_roots() helper function grays the old objects referred to from the
+ * roots of the VM and from the survivors, which are all the young objects there
+ * are at a safe point once the nursery has been emptied.
+ */
+static void gray_roots(void)
+{
+    sage_script_roots(gray_slot);
+
+    for (uint8_t *pos = heap->from; pos < heap->from_top; ) {
+        struct sage_value_obj_t *obj = (struct sage_value_obj_t *) pos;
+
+        fields(obj, gray_slot);
+        pos += young_size(obj_size(obj));
+    }
+}
+
+
+static inline bool expired(uint64_t deadline, size_t count)
+{
+    return !(count % STEP_CHECK) && SDL_GetPerformanceCounter() >= deadline;
+}
+
+
+/*
+ * The remembered_prune() helper function drops the old objects that are about
+ * to be swept from the remembered set. An unreachable old object that refers
+ * to a survivor stays remembered, as nothing stores into it to make it forget,
+ * and would otherwise be scanned by the next promotion after it is freed.
+ */
+static void remembered_prune(void)
+{
+    struct stack *rem = &heap->remembered;
+    size_t len = 0;
+
+    for (register size_t i = 0; i < rem->len; i++) {
+        struct sage_value_obj_t *obj = rem->items[i];
+
+        if (obj->mark || (obj->flags & FLAG_INTERNED))
+            rem->items[len++] = obj;
+        else
+            obj->flags &= (uint8_t) ~FLAG_REMEMBERED;
+    }
+
+    rem->len = len;
+}
+
+
+/*
+ * The mark() helper function traces the old generation from the gray objects
+ * until there are none left or the deadline passes, and returns whether it
+ * finished. Once the gray objects run out, the roots are grayed again, since
+ * they may have changed since marking started, and tracing goes on within the
+ * same deadline; marking only finishes when graying the roots finds nothing
+ * new. As objects that become old while marking are marked at once, the old
+ * objects left to find only ever shrink, so this comes to an end. Graying the
+ * roots costs a pass over the roots and the survivor space, which cannot be
+ * cut short, so it is done at most once after the deadline has passed, and
+ * whatever it finds is traced in the next step.
+ */
+static bool mark(uint64_t deadline)
+{
+    size_t count = 0;
+
+    do {
+        while (heap->gray.len) {
+            fields(heap->gray.items[--heap->gray.len], gray_slot);
+
+            if (expired(deadline, ++count))
+                return false;
+        }
+
+        gray_roots();
+
+        if (heap->gray.len && SDL_GetPerformanceCounter() >= deadline)
+            return false;
+    } while (heap->gray.len);
+
+    remembered_prune();
+    heap->sweep = heap->all;
+    heap->all = NULL;
+    heap->phase = PHASE_SWEEP;
+
+    return true;
+}
+
+
+/*
+ * The sweep() helper function frees the unmarked objects of the old generation
+ * until there are none left to look at or the deadline passes, and returns
+ * whether it finished. The objects being swept are kept on a list of their own,
+ * so that objects promoted in the meantime are not swept before they could be
+ * marked.
+ */
+static bool sweep(uint64_t deadline)
+{
+    size_t count = 0;
+
+    while (heap->sweep) {
+        struct sage_value_obj_t *obj = heap->sweep;
+        heap->sweep = obj->next;
+
+        if (obj->mark || (obj->flags & FLAG_INTERNED)) {
+            obj->mark = 0;
+            obj->next = heap->all;
+            heap->all = obj;
+        } else {
+            heap->bytes -= obj_size(obj);
+            obj_free(obj);
+        }
+
+        if (expired(deadline, ++count))
+            return false;
+    }
+
+    heap->phase = PHASE_IDLE;
+    heap->limit = heap->bytes * 2 > HEAP_LIMIT ? heap->bytes * 2 : HEAP_LIMIT;
+
+    return true;
+}
+
+
+/*
+ * The sage_value_collect_step() interface function empties the nursery, and
+ * then collects the old generation if a collection is due or under way, for
+ * whatever is left of budget microseconds. Emptying the nursery is not bounded
+ * by the budget: it always runs to the end, taking time in proportion to the
+ * roots, the remembered objects and the survivors, of which there are at most
+ * SURVIVOR_LEN bytes plus whatever is promoted. The budget only bounds the
+ * collection of the old generation, which gets none of it if the nursery took
+ * it all. A collection of the old generation starts once as much again has
+ * been allocated as survived the last one, but never before HEAP_LIMIT bytes.
+ * It must only be called at a safe point.
+ */
+extern void sage_value_collect_step(uint32_t budget)
+{
+    sage_assert (heap);
+
+    const uint64_t deadline = SDL_GetPerformanceCounter()
+        + SDL_GetPerformanceFrequency() * budget / 1000000;
+
+    promote();
+
+    if (heap->phase == PHASE_IDLE) {
+        if (heap->bytes < heap->limit)
+            return;
+
+        heap->phase = PHASE_MARK;
+        gray_roots();
+    }
+
+    if (heap->phase == PHASE_MARK && !mark(deadline))
+        return;
+
+    sweep(deadline);
+}
+
+
+/*
+ * The sage_value_collect_due() interface function checks whether collecting
+ * would do much good: whether the nursery is more than half full, or the old
+ * generation is being collected or is due to be. Code that reaches safe points
+ * far more often than once a frame, such as the loaders, checks this first, as
+ * emptying the nursery costs a scan of the roots however little it holds.
+ */
+extern bool sage_value_collect_due(void)
+{
+    sage_assert (heap);
+
+    return heap->phase != PHASE_IDLE || heap->bytes >= heap->limit
+        || (size_t) (heap->top - heap->nursery) >= NURSERY_LEN / 2;
+}
+
+
+/*
+ * The sage_value_collect() interface function collects every object that is
+ * unreachable, finishing any collection under way and then running a whole one
+ * without a time budget. It must only be called at a safe point.
+ */
+extern void sage_value_collect(void)
+{
+    sage_assert (heap);
+    promote();
+
+    for (register int pass = heap->phase == PHASE_IDLE; pass < 2; pass++) {
+        if (heap->phase == PHASE_IDLE) {
+            heap->phase = PHASE_MARK;
+            gray_roots();
+        }
+
+        if (heap->phase == PHASE_MARK)
+            mark(UINT64_MAX);
+
+        sweep(UINT64_MAX);
+    }
+}
+
+
+/*
+ * The sage_value_equal() interface function checks whether two values are
+ * equal in the sense of the Scheme equal? predicate: pairs and vectors are
+ * compared element by element, and strings by their contents.
+ */
+extern bool sage_value_equal(sage_value_t lhs, sage_value_t rhs)
+{
+    while (lhs != rhs) {
+        if (sage_value_is_number(lhs) && sage_value_is_number(rhs))
+            return sage_value_to_number(lhs) == sage_value_to_number(rhs);
+
+        if (!sage_value_is_object(lhs) || !sage_value_is_object(rhs))
+            return false;
+
+        struct sage_value_obj_t *l = sage_value_object(lhs);
+        struct sage_value_obj_t *r = sage_value_object(rhs);
+
+        if (l->type != r->type)
+            return false;
+
+        switch (l->type) {
+            case SAGE_VALUE_TYPE_STRING: {
+                struct sage_value_string_t *ls
+                    = (struct sage_value_string_t *) l;
+                struct sage_value_string_t *rs
+                    = (struct sage_value_string_t *) r;
+
+                return ls->len == rs->len && !memcmp(ls->str, rs->str,
+                        ls->len);
+            }
+
+            case SAGE_VALUE_TYPE_VECTOR: {
+                struct sage_value_vector_t *lv
+                    = (struct sage_value_vector_t *) l;
+                struct sage_value_vector_t *rv
+                    = (struct sage_value_vector_t *) r;
+
+                if (lv->len != rv->len)
+                    return false;
+
+                for (register size_t i = 0; i < lv->len; i++) {
+                    if (!sage_value_equal(lv->items[i], rv->items[i]))
+                        return false;
+                }
+
+                return true;
+            }
+
+            case SAGE_VALUE_TYPE_PAIR:
+                if (!sage_value_equal(sage_value_car(lhs),
+                            sage_value_car(rhs)))
+                    return false;
+
+                lhs = sage_value_cdr(lhs);
+                rhs = sage_value_cdr(rhs);
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void string_write(FILE *file, const struct sage_value_string_t *str)
+{
+    fputc('"', file);
+
+    for (register size_t i = 0; i < str->len; i++) {
+        switch (str->str[i]) {
+            case '"':
+                fputs("\\\"", file);
+                break;
+
+            case '\\':
+                fputs("\\\\", file);
+                break;
+
+            case '\n':
+                fputs("\\n", file);
+                break;
+
+            case '\t':
+                fputs("\\t", file);
+                break;
+
+            default:
+                fputc(str->str[i], file);
+                break;
+        }
+    }
+
+    fputc('"', file);
+}
+
+
+/*
+ * The sage_value_print() interface function prints a value in the manner of
+ * the Scheme write procedure if write is true, and of display otherwise; the
+ * only difference is that display prints strings without quotes or escapes.
+ */
+extern void sage_value_print(FILE *file, sage_value_t val, bool write)
+{
+    if (sage_value_is_number(val)) {
+        const double num = sage_value_to_number(val);
+        char bfr[32];
+
+        for (int prec = 15; prec <= 17; prec++) {
+            snprintf(bfr, sizeof bfr, "%.*g", prec, num);
+            if (strtod(bfr, NULL) == num)
+                break;
+        }
+
+        fputs(bfr, file);
+        return;
+    }
+
+    switch (val) {
+        case SAGE_VALUE_NIL:
+            fputs("()", file);
+            return;
+
+        case SAGE_VALUE_FALSE:
+            fputs("#f", file);
+            return;
+
+        case SAGE_VALUE_TRUE:
+            fputs("#t", file);
+            return;
+
+        case SAGE_VALUE_VOID:
+            return;
+
+        case SAGE_VALUE_UNDEF:
+            fputs("#<undefined>", file);
+            return;
+    }
+
+    struct sage_value_obj_t *obj = sage_value_object(val);
+
+    switch (obj->type) {
+        case SAGE_VALUE_TYPE_PAIR:
+            fputc('(', file);
+            sage_value_print(file, sage_value_car(val), write);
+
+            for (val = sage_value_cdr(val); sage_value_is(val,
+                        SAGE_VALUE_TYPE_PAIR); val = sage_value_cdr(val)) {
+                fputc(' ', file);
+                sage_value_print(file, sage_value_car(val), write);
+            }
+
+            if (val != SAGE_VALUE_NIL) {
+                fputs(" . ", file);
+                sage_value_print(file, val, write);
+            }
+
+            fputc(')', file);
+            break;
+
+        case SAGE_VALUE_TYPE_STRING:
+            if (write)
+                string_write(file, (struct sage_value_string_t *) obj);
+            else
+                fputs(((struct sage_value_string_t *) obj)->str, file);
+            break;
+
+        case SAGE_VALUE_TYPE_SYMBOL:
+            fputs(((struct sage_value_symbol_t *) obj)->name, file);
+            break;
+
+        case SAGE_VALUE_TYPE_VECTOR: {
+            struct sage_value_vector_t *vec
+                = (struct sage_value_vector_t *) obj;
+
+            fputs("#(", file);
+            for (register size_t i = 0; i < vec->len; i++) {
+                if (i)
+                    fputc(' ', file);
+                sage_value_print(file, vec->items[i], write);
+            }
+            fputc(')', file);
+            break;
+        }
+
+        case SAGE_VALUE_TYPE_CLOSURE: {
+            struct sage_value_proto_t *p
+                = ((struct sage_value_closure_t *) obj)->proto;
+
+            fputs("#<procedure", file);
+            if (p->name != SAGE_VALUE_FALSE) {
+                fputc(' ', file);
+                sage_value_print(file, p->name, false);
+            }
+            fputc('>', file);
+            break;
+        }
+
+        case SAGE_VALUE_TYPE_PRIMITIVE:
+            fprintf(file, "#<primitive %s>",
+                    ((struct sage_value_primitive_t *) obj)->name);
+            break;
+
+        case SAGE_VALUE_TYPE_BOX:
+            fputs("#<box>", file);
+            break;
+
+        case SAGE_VALUE_TYPE_PROTO:
+            fputs("#<prototype>", file);
+            break;
+
+        case SAGE_VALUE_TYPE_HANDLE:
+            fprintf(file, "#<handle %u>",
+                    ((struct sage_value_handle_t *) obj)->kind);
+            break;
+    }
+}
+
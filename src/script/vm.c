@@ -0,0 +1,1031 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include "script.h"
+
+
+/*
+ * The VM runs compiled code on a register machine. Each call gets a frame
+ * whose registers are a window onto a single value stack: a call instruction
+ * names the register holding the procedure, with its arguments in the
+ * registers after it, and the frame of the callee starts at the first of its
+ * arguments, so that arguments are never copied. The result is returned into
+ * the register that held the procedure, just below the frame. Tail calls
+ * reuse the frame of the caller, so loops written as recursion run in
+ * constant space.
+ *
+ * Global variables live in cells that never move. When code is compiled, each
+ * global it refers to is resolved to its cell once, and the instruction that
+ * reads or writes it goes through the cached cell pointer without looking the
+ * name up again. The inline operations compare the cell of the primitive they
+ * stand for against the primitive that was defined under that name when the VM
+ * started, and call whatever the global holds instead if it has changed.
+ *
+ * Errors unwind to the innermost call into the VM from C code, which reports
+ * failure. Garbage is only collected between calls, when no script code is
+ * running, so the registers never need to be scanned and objects are free to
+ * move; sage_script_collect() is called once per frame by the game loop with a
+ * time budget, and the collector in value.c keeps within it.
+ */
+
+
+#define STACK_LEN ((size_t) 1 << 16)
+#define FRAMES_LEN ((size_t) 4096)
+#define GLOBALS_LEN ((size_t) 256)
+#define CELLS_LEN ((size_t) 256)
+#define ERROR_LEN ((size_t) 256)
+
+
+#define OP_A(i) (((i) >> 8) & 0xFF)
+#define OP_B(i) (((i) >> 16) & 0xFF)
+#define OP_C(i) ((i) >> 24)
+#define OP_BX(i) ((i) >> 16)
+#define OP_SBX(i) ((int32_t) OP_BX(i) - SAGE_SCRIPT_SBX_BIAS)
+
+
+struct frame {
+    struct sage_value_closure_t *cl;
+    const uint32_t *pc;
+    sage_value_t *base;
+};
+
+
+struct cells {
+    struct cells *next;
+    size_t len;
+    struct sage_script_global_t cell[CELLS_LEN];
+};
+
+
+static const struct {
+    const char *name;
+    enum sage_script_op_t op;
+    uint8_t min;
+    uint8_t max;
+} INLINES[] = {
+    { "+", SAGE_SCRIPT_OP_ADD, 2, SAGE_VALUE_VARIADIC },
+    { "-", SAGE_SCRIPT_OP_SUB, 1, SAGE_VALUE_VARIADIC },
+    { "*", SAGE_SCRIPT_OP_MUL, 2, SAGE_VALUE_VARIADIC },
+    { "/", SAGE_SCRIPT_OP_DIV, 2, SAGE_VALUE_VARIADIC },
+    { "<", SAGE_SCRIPT_OP_LT, 2, 2 },
+    { "<=", SAGE_SCRIPT_OP_LE, 2, 2 },
+    { ">", SAGE_SCRIPT_OP_GT, 2, 2 },
+    { ">=", SAGE_SCRIPT_OP_GE, 2, 2 },
+    { "=", SAGE_SCRIPT_OP_NUMEQ, 2, 2 },
+    { "eq?", SAGE_SCRIPT_OP_EQ, 2, 2 },
+    { "cons", SAGE_SCRIPT_OP_CONS, 2, 2 },
+    { "vector-ref", SAGE_SCRIPT_OP_VREF, 2, 2 },
+    { "car", SAGE_SCRIPT_OP_CAR, 1, 1 },
+    { "cdr", SAGE_SCRIPT_OP_CDR, 1, 1 },
+    { "not", SAGE_SCRIPT_OP_NOT, 1, 1 },
+    { "null?", SAGE_SCRIPT_OP_NULLP, 1, 1 },
+    { "pair?", SAGE_SCRIPT_OP_PAIRP, 1, 1 }
+};
+
+
+static thread_local struct {
+    sage_value_t *stack;
+    sage_value_t *floor;
+    struct frame *frames;
+    size_t nframes;
+    struct sage_script_global_t **globals;
+    size_t nglobals;
+    size_t capglobals;
+    struct cells *cells;
+    sage_value_t syms[SAGE_SCRIPT_OP_COUNT];
+    sage_value_t prims[SAGE_SCRIPT_OP_COUNT];
+    sage_value_t *pins;
+    size_t npins;
+    size_t cappins;
+    jmp_buf *jmp;
+    char err[ERROR_LEN];
+} *vm = NULL;
+
+
+static inline struct sage_value_symbol_t *symbol(sage_value_t sym)
+{
+    return sage_value_object(sym);
+}
+
+
+static void globals_grow(void)
+{
+    size_t cap = vm->capglobals * 2;
+    struct sage_script_global_t **globals = sage_heap_new(sizeof *globals
+            * cap);
+
+    for (register size_t i = 0; i < vm->capglobals; i++) {
+        struct sage_script_global_t *g = vm->globals[i];
+
+        if (g) {
+            size_t idx = symbol(g->sym)->hash & (cap - 1);
+            while (globals[idx])
+                idx = (idx + 1) & (cap - 1);
+
+            globals[idx] = g;
+        }
+    }
+
+    sage_heap_free((void **) &vm->globals);
+    vm->globals = globals;
+    vm->capglobals = cap;
+}
+
+
+static struct sage_script_global_t *cell_new(sage_value_t sym)
+{
+    if (!vm->cells || vm->cells->len == CELLS_LEN) {
+        struct cells *blk = sage_heap_new(sizeof *blk);
+
+        blk->next = vm->cells;
+        blk->len = 0;
+        vm->cells = blk;
+    }
+
+    struct sage_script_global_t *g = &vm->cells->cell[vm->cells->len++];
+    g->sym = sym;
+    g->val = SAGE_VALUE_UNDEF;
+
+    return g;
+}
+
+
+extern void sage_script_start(void)
+{
+    if (sage_unlikely (vm))
+        return;
+
+    vm = sage_heap_new(sizeof *vm);
+    vm->stack = sage_heap_new(sizeof *vm->stack * STACK_LEN);
+    vm->floor = vm->stack;
+    vm->frames = sage_heap_new(sizeof *vm->frames * FRAMES_LEN);
+    vm->nframes = 0;
+
+    vm->capglobals = GLOBALS_LEN;
+    vm->globals = sage_heap_new(sizeof *vm->globals * vm->capglobals);
+    vm->nglobals = 0;
+    vm->cells = NULL;
+
+    vm->cappins = 16;
+    vm->pins = sage_heap_new(sizeof *vm->pins * vm->cappins);
+    vm->npins = 0;
+    vm->jmp = NULL;
+
+    sage_value_heap_start();
+    sage_script_compiler_start();
+    sage_script_primitives_register();
+
+    for (register size_t i = 0; i < SAGE_SCRIPT_OP_COUNT; i++)
+        vm->syms[i] = vm->prims[i] = SAGE_VALUE_FALSE;
+
+    for (register size_t i = 0; i < sizeof INLINES / sizeof *INLINES; i++) {
+        vm->syms[INLINES[i].op] = sage_value_symbol(INLINES[i].name,
+                strlen(INLINES[i].name));
+        vm->prims[INLINES[i].op] = sage_script_global(INLINES[i].name);
+    }
+
+    sage_script_bind_start();
+}
+
+
+extern void sage_script_stop(void)
+{
+    if (sage_likely (vm)) {
+        sage_script_bind_stop();
+        sage_script_compiler_stop();
+        sage_value_heap_stop();
+
+        struct cells *blk = vm->cells, *next;
+        for (; blk; blk = next) {
+            next = blk->next;
+            sage_heap_free((void **) &blk);
+        }
+
+        sage_heap_free((void **) &vm->stack);
+        sage_heap_free((void **) &vm->frames);
+        sage_heap_free((void **) &vm->globals);
+        sage_heap_free((void **) &vm->pins);
+        sage_heap_free((void **) &vm);
+    }
+}
+
+
+/*
+ * The sage_script_error() interface function reports an error in running
+ * script code, naming the procedure it occurred in, and unwinds to the
+ * innermost call into the VM from C code. It is meant to be called by
+ * primitives when they are given arguments they cannot handle.
+ */
+extern SAGE_COLD _Noreturn void sage_script_error(const char *fmt, ...)
+{
+    sage_assert (vm && vm->jmp);
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(vm->err, sizeof vm->err, fmt, args);
+    va_end(args);
+
+    printf("script error: %s", vm->err);
+
+    if (vm->nframes) {
+        sage_value_t name = vm->frames[vm->nframes - 1].cl->proto->name;
+
+        if (name != SAGE_VALUE_FALSE) {
+            printf(" [in ");
+            sage_value_print(stdout, name, false);
+            printf("]");
+        }
+    }
+
+    printf("\n");
+    longjmp(*vm->jmp, 1);
+}
+
+
+/*
+ * The sage_script_global_cell() interface function gets the cell that holds
+ * the global variable named by the symbol sym, creating it unbound if it does
+ * not exist yet. The cell stays at the same address for the life of the VM.
+ */
+extern struct sage_script_global_t *sage_script_global_cell(sage_value_t sym)
+{
+    sage_assert (vm && sage_value_is(sym, SAGE_VALUE_TYPE_SYMBOL));
+
+    size_t idx = symbol(sym)->hash & (vm->capglobals - 1);
+    for (; vm->globals[idx]; idx = (idx + 1) & (vm->capglobals - 1)) {
+        if (vm->globals[idx]->sym == sym)
+            return vm->globals[idx];
+    }
+
+    if (sage_unlikely ((vm->nglobals + 1) * 2 > vm->capglobals)) {
+        globals_grow();
+        return sage_script_global_cell(sym);
+    }
+
+    vm->nglobals++;
+    return vm->globals[idx] = cell_new(sym);
+}
+
+
+extern sage_value_t sage_script_global(const char *name)
+{
+    sage_assert (name);
+    return sage_script_global_cell(sage_value_symbol(name, strlen(name)))->val;
+}
+
+
+extern void sage_script_global_set(const char *name, sage_value_t val)
+{
+    sage_assert (name);
+    sage_script_global_cell(sage_value_symbol(name, strlen(name)))->val = val;
+}
+
+
+extern sage_value_t sage_script_primitive(const char *name,
+        sage_value_primitive_f *fn, uint8_t min, uint8_t max)
+{
+    sage_value_t prim = sage_value_primitive(name, fn, min, max);
+
+    sage_script_global_set(name, prim);
+    return prim;
+}
+
+
+/*
+ * The sage_script_inline_op() interface function gets the inline operation
+ * that a call with argc arguments to the global named by the symbol sym can be
+ * compiled into, or SAGE_SCRIPT_OP_COUNT if there is none.
+ */
+extern enum sage_script_op_t sage_script_inline_op(sage_value_t sym,
+        size_t argc)
+{
+    sage_assert (vm);
+
+    for (register size_t i = 0; i < sizeof INLINES / sizeof *INLINES; i++) {
+        if (vm->syms[INLINES[i].op] == sym) {
+            if (argc < INLINES[i].min || (INLINES[i].max != SAGE_VALUE_VARIADIC
+                        && argc > INLINES[i].max))
+                break;
+
+            return INLINES[i].op;
+        }
+    }
+
+    return SAGE_SCRIPT_OP_COUNT;
+}
+
+
+/*
+ * The sage_script_verify() interface function checks that the code of the
+ * prototype p, and of every prototype among its constants, is safe to run:
+ * that each register, constant, global and upvalue it names is in range, that
+ * each inline operation has the word that follows it, that each jump lands on
+ * an instruction, and that the code cannot run off its end. It is meant for
+ * code that was not compiled in this VM, such as code read from a bytecode
+ * cache; it takes one pass over the code, plus one over its jumps. Which type
+ * of value a register holds is not tracked, so the operations on boxes check
+ * their operand when they run.
+ */
+extern bool sage_script_verify(const struct sage_value_proto_t *p)
+{
+    sage_assert (p);
+    const size_t n = p->ncode, nregs = p->nregs;
+
+    if (!n || (size_t) p->nparams + p->rest > nregs)
+        return false;
+
+    uint8_t *start = sage_heap_new(n);
+    size_t last = 0;
+    bool ok = true;
+
+    for (register size_t pc = 0; ok && pc < n; pc++) {
+        const uint32_t i = p->code[pc];
+        const enum sage_script_op_t op = i & 0xFF;
+
+        start[pc] = 1;
+        last = pc;
+
+        switch (op) {
+            case SAGE_SCRIPT_OP_MOVE:
+            case SAGE_SCRIPT_OP_BOX:
+            case SAGE_SCRIPT_OP_UNBOX:
+            case SAGE_SCRIPT_OP_SETBOX:
+                ok = OP_A(i) < nregs && OP_B(i) < nregs;
+                break;
+
+            case SAGE_SCRIPT_OP_CONST:
+                ok = OP_A(i) < nregs && OP_BX(i) < p->nconsts;
+                break;
+
+            case SAGE_SCRIPT_OP_GLOBAL:
+            case SAGE_SCRIPT_OP_DEFINE:
+            case SAGE_SCRIPT_OP_SETGLOBAL:
+                ok = OP_A(i) < nregs && OP_BX(i) < p->nics;
+                break;
+
+            case SAGE_SCRIPT_OP_UPVAL:
+                ok = OP_A(i) < nregs && OP_B(i) < p->nups;
+                break;
+
+            case SAGE_SCRIPT_OP_CLOSURE: {
+                const struct sage_value_proto_t *q;
+
+                if (!(ok = OP_A(i) < nregs && OP_BX(i) < p->nconsts
+                            && sage_value_is(p->consts[OP_BX(i)],
+                                SAGE_VALUE_TYPE_PROTO)))
+                    break;
+
+                q = sage_value_object(p->consts[OP_BX(i)]);
+                for (register size_t j = 0; ok && j < q->nups; j++) {
+                    const uint16_t up = q->ups[j];
+                    ok = up < 0x200 && (up & 0xFF) < (up & 0x100 ? nregs
+                            : p->nups);
+                }
+                break;
+            }
+
+            case SAGE_SCRIPT_OP_JUMP:
+                break;
+
+            case SAGE_SCRIPT_OP_JUMPF:
+            case SAGE_SCRIPT_OP_JUMPT:
+            case SAGE_SCRIPT_OP_RETURN:
+                ok = OP_A(i) < nregs;
+                break;
+
+            case SAGE_SCRIPT_OP_CALL:
+            case SAGE_SCRIPT_OP_TAILCALL:
+                ok = OP_A(i) + OP_B(i) < nregs;
+                break;
+
+            case SAGE_SCRIPT_OP_CAR:
+            case SAGE_SCRIPT_OP_CDR:
+            case SAGE_SCRIPT_OP_NOT:
+            case SAGE_SCRIPT_OP_NULLP:
+            case SAGE_SCRIPT_OP_PAIRP:
+                ok = OP_A(i) < nregs && OP_B(i) < nregs && ++pc < n
+                    && p->code[pc] < p->nics;
+                break;
+
+            default:
+                ok = op < SAGE_SCRIPT_OP_COUNT && OP_A(i) < nregs
+                    && OP_B(i) < nregs && OP_C(i) < nregs && ++pc < n
+                    && p->code[pc] < p->nics;
+                break;
+        }
+    }
+
+    const enum sage_script_op_t end = p->code[last] & 0xFF;
+    ok = ok && (end == SAGE_SCRIPT_OP_RETURN || end == SAGE_SCRIPT_OP_JUMP
+            || end == SAGE_SCRIPT_OP_TAILCALL);
+
+    for (register size_t pc = 0; ok && pc < n; pc++) {
+        const uint32_t i = p->code[pc];
+        const enum sage_script_op_t op = i & 0xFF;
+
+        if (start[pc] && (op == SAGE_SCRIPT_OP_JUMP
+                    || op == SAGE_SCRIPT_OP_JUMPF
+                    || op == SAGE_SCRIPT_OP_JUMPT)) {
+            const int64_t to = (int64_t) pc + 1 + OP_SBX(i);
+            ok = to >= 0 && to < (int64_t) n && start[to];
+        }
+    }
+
+    sage_heap_free((void **) &start);
+
+    for (register size_t k = 0; ok && k < p->nconsts; k++) {
+        if (sage_value_is(p->consts[k], SAGE_VALUE_TYPE_PROTO))
+            ok = sage_script_verify(sage_value_object(p->consts[k]));
+    }
+
+    return ok;
+}
+
+
+/*
+ * The sage_script_pin() interface function keeps val alive for the life of the
+ * VM. Young objects are moved when they are promoted, so C code that holds on
+ * to a pinned value should only pin objects that never move, such as handles,
+ * or else look the value up through a global.
+ */
+extern void sage_script_pin(sage_value_t val)
+{
+    sage_assert (vm);
+
+    if (sage_unlikely (vm->npins == vm->cappins)) {
+        vm->cappins *= 2;
+        vm->pins = sage_heap_resize(vm->pins, sizeof *vm->pins * vm->cappins);
+    }
+
+    vm->pins[vm->npins++] = val;
+}
+
+
+/*
+ * The sage_script_roots() interface function calls visit on each root of the
+ * VM: the global variables, the primitives behind the inline operations and
+ * the values pinned by C code. The collector may update a root in place when
+ * the object it refers to moves.
+ */
+extern void sage_script_roots(sage_value_visit_f *visit)
+{
+    sage_assert (vm);
+
+    for (struct cells *blk = vm->cells; blk; blk = blk->next) {
+        for (register size_t i = 0; i < blk->len; i++) {
+            visit(&blk->cell[i].sym);
+            visit(&blk->cell[i].val);
+        }
+    }
+
+    for (register size_t i = 0; i < SAGE_SCRIPT_OP_COUNT; i++)
+        visit(&vm->prims[i]);
+
+    for (register size_t i = 0; i < vm->npins; i++)
+        visit(&vm->pins[i]);
+}
+
+
+/*
+ * The sage_script_collect() interface function collects garbage, spending no
+ * more than about budget microseconds on the old generation once the nursery
+ * has been emptied, which is not bounded; see sage_value_collect_step(). It
+ * does nothing while script code is running, so it is safe to call from
+ * anywhere.
+ */
+extern void sage_script_collect(uint32_t budget)
+{
+    if (sage_likely (vm) && !vm->nframes && vm->floor == vm->stack)
+        sage_value_collect_step(budget);
+}
+
+
+static inline sage_value_t *stack_top(void)
+{
+    sage_value_t *top = vm->floor;
+
+    if (vm->nframes) {
+        const struct frame *f = &vm->frames[vm->nframes - 1];
+        sage_value_t *ftop = f->base + f->cl->proto->nregs;
+
+        if (ftop > top)
+            top = ftop;
+    }
+
+    return top;
+}
+
+
+/*
+ * The frame_enter() helper function checks the arguments passed to a closure
+ * whose frame starts at base, gathering any arguments beyond the parameters
+ * into a list for a rest parameter.
+ */
+static inline void frame_enter(const struct sage_value_proto_t *p,
+        sage_value_t *base, size_t argc)
+{
+    if (sage_unlikely (base + p->nregs > vm->stack + STACK_LEN))
+        sage_script_error("stack overflow");
+
+    if (sage_likely (argc == p->nparams && !p->rest))
+        return;
+
+    if (!p->rest || argc < p->nparams)
+        sage_script_error("expected %s%u arguments, got %zu", p->rest
+                ? "at least " : "", (unsigned) p->nparams, argc);
+
+    sage_value_t lst = SAGE_VALUE_NIL;
+    for (register size_t i = argc; i-- > p->nparams;)
+        lst = sage_value_cons(base[i], lst);
+
+    base[p->nparams] = lst;
+}
+
+
+static inline struct frame *frame_push(struct sage_value_closure_t *cl,
+        sage_value_t *base, size_t argc)
+{
+    if (sage_unlikely (vm->nframes == FRAMES_LEN))
+        sage_script_error("too many nested calls");
+
+    frame_enter(cl->proto, base, argc);
+
+    struct frame *f = &vm->frames[vm->nframes++];
+    f->cl = cl;
+    f->pc = cl->proto->code;
+    f->base = base;
+
+    return f;
+}
+
+
+static inline sage_value_t primitive_call(sage_value_t fn, sage_value_t *argv,
+        size_t argc)
+{
+    const struct sage_value_primitive_t *prim = sage_value_object(fn);
+
+    if (sage_unlikely (argc < prim->min || (prim->max != SAGE_VALUE_VARIADIC
+                    && argc > prim->max)))
+        sage_script_error("%s: wrong number of arguments", prim->name);
+
+    return prim->fn(argv, argc);
+}
+
+
+static SAGE_COLD _Noreturn void not_procedure(sage_value_t fn)
+{
+    if (fn == SAGE_VALUE_UNDEF)
+        sage_script_error("call to an undefined procedure");
+
+    sage_script_error("call to a value that is not a procedure");
+}
+
+
+/*
+ * The inline_slow() helper function carries out an inline operation whose
+ * operands are not of the types it handles directly, or whose global no longer
+ * holds the primitive it was compiled for, by calling whatever the global
+ * holds.
+ */
+static SAGE_COLD sage_value_t inline_slow(struct sage_script_global_t *g,
+        sage_value_t *argv, size_t argc)
+{
+    if (sage_unlikely (g->val == SAGE_VALUE_UNDEF))
+        sage_script_error("unbound variable %s", symbol(g->sym)->name);
+
+    return sage_script_apply(g->val, argv, argc);
+}
+
+
+#define ARITH(op, expr)                                                      \
+    case op: {                                                               \
+        sage_value_t b = R[OP_B(i)], c = R[OP_C(i)];                         \
+        struct sage_script_global_t *g = p->ics[*pc++];                      \
+        if (sage_likely (sage_value_is_number(b) && sage_value_is_number(c)  \
+                    && g->val == vm->prims[op])) {                           \
+            const double x = sage_value_to_number(b);                        \
+            const double y = sage_value_to_number(c);                        \
+            R[OP_A(i)] = (expr);                                             \
+        } else {                                                             \
+            sage_value_t argv[2] = { b, c };                                 \
+            R[OP_A(i)] = inline_slow(g, argv, 2);                            \
+        }                                                                    \
+        break;                                                               \
+    }
+
+
+/*
+ * The run() helper function runs the frame at the top of the frame stack
+ * until it returns into the frame below floor, and gets the value it returns.
+ */
+static SAGE_HOT sage_value_t run(size_t floor)
+{
+    struct frame *f = &vm->frames[vm->nframes - 1];
+    struct sage_value_closure_t *cl = f->cl;
+    struct sage_value_proto_t *p = cl->proto;
+    const sage_value_t *K = p->consts;
+    const uint32_t *pc = f->pc;
+    sage_value_t *R = f->base;
+
+    while (true) {
+        const uint32_t i = *pc++;
+
+        switch ((enum sage_script_op_t) (i & 0xFF)) {
+            case SAGE_SCRIPT_OP_MOVE:
+                R[OP_A(i)] = R[OP_B(i)];
+                break;
+
+            case SAGE_SCRIPT_OP_CONST:
+                R[OP_A(i)] = K[OP_BX(i)];
+                break;
+
+            case SAGE_SCRIPT_OP_GLOBAL: {
+                struct sage_script_global_t *g = p->ics[OP_BX(i)];
+
+                if (sage_unlikely (g->val == SAGE_VALUE_UNDEF))
+                    sage_script_error("unbound variable %s",
+                            symbol(g->sym)->name);
+
+                R[OP_A(i)] = g->val;
+                break;
+            }
+
+            case SAGE_SCRIPT_OP_DEFINE:
+                p->ics[OP_BX(i)]->val = R[OP_A(i)];
+                break;
+
+            case SAGE_SCRIPT_OP_SETGLOBAL: {
+                struct sage_script_global_t *g = p->ics[OP_BX(i)];
+
+                if (sage_unlikely (g->val == SAGE_VALUE_UNDEF))
+                    sage_script_error("set! of unbound variable %s",
+                            symbol(g->sym)->name);
+
+                g->val = R[OP_A(i)];
+                break;
+            }
+
+            case SAGE_SCRIPT_OP_UPVAL:
+                R[OP_A(i)] = cl->ups[OP_B(i)];
+                break;
+
+            case SAGE_SCRIPT_OP_BOX:
+                R[OP_A(i)] = sage_value_box(R[OP_B(i)]);
+                break;
+
+            case SAGE_SCRIPT_OP_UNBOX: {
+                if (sage_unlikely (!sage_value_is(R[OP_B(i)],
+                        SAGE_VALUE_TYPE_BOX)))
+                    sage_script_error("bad variable reference");
+
+                sage_value_t val = ((struct sage_value_box_t *)
+                        sage_value_object(R[OP_B(i)]))->val;
+
+                if (sage_unlikely (val == SAGE_VALUE_UNDEF))
+                    sage_script_error("variable used before it is defined");
+
+                R[OP_A(i)] = val;
+                break;
+            }
+
+            case SAGE_SCRIPT_OP_SETBOX: {
+                if (sage_unlikely (!sage_value_is(R[OP_A(i)],
+                        SAGE_VALUE_TYPE_BOX)))
+                    sage_script_error("bad variable reference");
+
+                struct sage_value_box_t *box = sage_value_object(R[OP_A(i)]);
+
+                sage_value_barrier(box, R[OP_B(i)]);
+                box->val = R[OP_B(i)];
+                break;
+            }
+
+            case SAGE_SCRIPT_OP_CLOSURE: {
+                struct sage_value_proto_t *q = sage_value_object(K[OP_BX(i)]);
+                struct sage_value_closure_t *fn = sage_value_closure(q);
+
+                for (register size_t j = 0; j < q->nups; j++) {
+                    const uint16_t up = q->ups[j];
+                    fn->ups[j] = up & 0x100 ? R[up & 0xFF] : cl->ups[up & 0xFF];
+                }
+
+                R[OP_A(i)] = sage_value_from_object(fn);
+                break;
+            }
+
+            case SAGE_SCRIPT_OP_JUMP:
+                pc += OP_SBX(i);
+                break;
+
+            case SAGE_SCRIPT_OP_JUMPF:
+                if (R[OP_A(i)] == SAGE_VALUE_FALSE)
+                    pc += OP_SBX(i);
+                break;
+
+            case SAGE_SCRIPT_OP_JUMPT:
+                if (R[OP_A(i)] != SAGE_VALUE_FALSE)
+                    pc += OP_SBX(i);
+                break;
+
+            case SAGE_SCRIPT_OP_CALL: {
+                sage_value_t fn = R[OP_A(i)];
+                sage_value_t *argv = &R[OP_A(i) + 1];
+
+                if (sage_value_is(fn, SAGE_VALUE_TYPE_CLOSURE)) {
+                    f->pc = pc;
+                    f = frame_push(sage_value_object(fn), argv, OP_B(i));
+                    cl = f->cl;
+                    p = cl->proto;
+                    K = p->consts;
+                    pc = f->pc;
+                    R = f->base;
+                } else if (sage_value_is(fn, SAGE_VALUE_TYPE_PRIMITIVE))
+                    R[OP_A(i)] = primitive_call(fn, argv, OP_B(i));
+                else
+                    not_procedure(fn);
+                break;
+            }
+
+            case SAGE_SCRIPT_OP_TAILCALL: {
+                sage_value_t fn = R[OP_A(i)], ret;
+                const size_t argc = OP_B(i);
+
+                if (sage_value_is(fn, SAGE_VALUE_TYPE_CLOSURE)) {
+                    memmove(R - 1, &R[OP_A(i)], sizeof *R * (argc + 1));
+
+                    cl = sage_value_object(fn);
+                    p = cl->proto;
+                    frame_enter(p, R, argc);
+
+                    f->cl = cl;
+                    K = p->consts;
+                    pc = p->code;
+                    break;
+                }
+
+                if (sage_value_is(fn, SAGE_VALUE_TYPE_PRIMITIVE))
+                    ret = primitive_call(fn, &R[OP_A(i) + 1], argc);
+                else
+                    not_procedure(fn);
+
+                R[-1] = ret;
+                if (--vm->nframes == floor)
+                    return ret;
+
+                f = &vm->frames[vm->nframes - 1];
+                cl = f->cl;
+                p = cl->proto;
+                K = p->consts;
+                pc = f->pc;
+                R = f->base;
+                break;
+            }
+
+            case SAGE_SCRIPT_OP_RETURN: {
+                sage_value_t ret = R[OP_A(i)];
+
+                R[-1] = ret;
+                if (--vm->nframes == floor)
+                    return ret;
+
+                f = &vm->frames[vm->nframes - 1];
+                cl = f->cl;
+                p = cl->proto;
+                K = p->consts;
+                pc = f->pc;
+                R = f->base;
+                break;
+            }
+
+            ARITH(SAGE_SCRIPT_OP_ADD, sage_value_number(x + y))
+            ARITH(SAGE_SCRIPT_OP_SUB, sage_value_number(x - y))
+            ARITH(SAGE_SCRIPT_OP_MUL, sage_value_number(x * y))
+            ARITH(SAGE_SCRIPT_OP_DIV, sage_value_number(x / y))
+            ARITH(SAGE_SCRIPT_OP_LT, sage_value_bool(x < y))
+            ARITH(SAGE_SCRIPT_OP_LE, sage_value_bool(x <= y))
+            ARITH(SAGE_SCRIPT_OP_GT, sage_value_bool(x > y))
+            ARITH(SAGE_SCRIPT_OP_GE, sage_value_bool(x >= y))
+            ARITH(SAGE_SCRIPT_OP_NUMEQ, sage_value_bool(x == y))
+
+            case SAGE_SCRIPT_OP_EQ:
+            case SAGE_SCRIPT_OP_CONS:
+            case SAGE_SCRIPT_OP_VREF: {
+                sage_value_t argv[2] = { R[OP_B(i)], R[OP_C(i)] };
+                struct sage_script_global_t *g = p->ics[*pc++];
+                const enum sage_script_op_t op = i & 0xFF;
+
+                if (sage_unlikely (g->val != vm->prims[op])) {
+                    R[OP_A(i)] = inline_slow(g, argv, 2);
+                    break;
+                }
+
+                if (op == SAGE_SCRIPT_OP_EQ)
+                    R[OP_A(i)] = sage_value_bool(argv[0] == argv[1]);
+                else if (op == SAGE_SCRIPT_OP_CONS)
+                    R[OP_A(i)] = sage_value_cons(argv[0], argv[1]);
+                else {
+                    struct sage_value_vector_t *vec;
+                    double idx;
+
+                    if (sage_value_is(argv[0], SAGE_VALUE_TYPE_VECTOR)
+                            && sage_value_is_number(argv[1])
+                            && (vec = sage_value_object(argv[0]),
+                                idx = sage_value_to_number(argv[1]),
+                                idx >= 0 && idx < (double) vec->len))
+                        R[OP_A(i)] = vec->items[(size_t) idx];
+                    else
+                        R[OP_A(i)] = inline_slow(g, argv, 2);
+                }
+                break;
+            }
+
+            case SAGE_SCRIPT_OP_CAR:
+            case SAGE_SCRIPT_OP_CDR:
+            case SAGE_SCRIPT_OP_NOT:
+            case SAGE_SCRIPT_OP_NULLP:
+            case SAGE_SCRIPT_OP_PAIRP: {
+                sage_value_t b = R[OP_B(i)];
+                struct sage_script_global_t *g = p->ics[*pc++];
+                const enum sage_script_op_t op = i & 0xFF;
+
+                if (sage_unlikely (g->val != vm->prims[op])) {
+                    R[OP_A(i)] = inline_slow(g, &b, 1);
+                    break;
+                }
+
+                switch (op) {
+                    case SAGE_SCRIPT_OP_NOT:
+                        R[OP_A(i)] = sage_value_bool(b == SAGE_VALUE_FALSE);
+                        break;
+
+                    case SAGE_SCRIPT_OP_NULLP:
+                        R[OP_A(i)] = sage_value_bool(b == SAGE_VALUE_NIL);
+                        break;
+
+                    case SAGE_SCRIPT_OP_PAIRP:
+                        R[OP_A(i)] = sage_value_bool(sage_value_is(b,
+                                    SAGE_VALUE_TYPE_PAIR));
+                        break;
+
+                    default:
+                        if (sage_likely (sage_value_is(b,
+                                        SAGE_VALUE_TYPE_PAIR)))
+                            R[OP_A(i)] = op == SAGE_SCRIPT_OP_CAR
+                                ? sage_value_car(b) : sage_value_cdr(b);
+                        else
+                            R[OP_A(i)] = inline_slow(g, &b, 1);
+                        break;
+                }
+                break;
+            }
+
+            default:
+                sage_script_error("bad instruction %u", (unsigned) (i & 0xFF));
+        }
+    }
+}
+
+
+/*
+ * The sage_script_apply() interface function calls the procedure proc with
+ * the argc arguments in argv and gets the value it returns. It is meant for
+ * primitives that call back into script code, such as apply, and raises a
+ * script error rather than returning if anything goes wrong; C code that is
+ * not itself called from the VM should use sage_script_call() instead.
+ */
+extern sage_value_t sage_script_apply(sage_value_t proc,
+        const sage_value_t *argv, size_t argc)
+{
+    sage_assert (vm && vm->jmp);
+
+    sage_value_t *slot = stack_top();
+    if (sage_unlikely (slot + argc + 1 > vm->stack + STACK_LEN))
+        sage_script_error("stack overflow");
+
+    slot[0] = proc;
+    if (argc)
+        memcpy(&slot[1], argv, sizeof *argv * argc);
+
+    if (sage_value_is(proc, SAGE_VALUE_TYPE_PRIMITIVE)) {
+        sage_value_t *floor = vm->floor;
+
+        vm->floor = &slot[argc + 1];
+        sage_value_t ret = primitive_call(proc, &slot[1], argc);
+        vm->floor = floor;
+
+        return ret;
+    }
+
+    if (!sage_value_is(proc, SAGE_VALUE_TYPE_CLOSURE))
+        not_procedure(proc);
+
+    const size_t floor = vm->nframes;
+    frame_push(sage_value_object(proc), &slot[1], argc);
+
+    return run(floor);
+}
+
+
+/*
+ * The sage_script_call() interface function calls the procedure proc with the
+ * argc arguments in argv from C code, storing the value it returns in ret if
+ * ret is not NULL. It returns false if an error was raised, in which case the
+ * error has already been reported.
+ */
+extern bool sage_script_call(sage_value_t proc, const sage_value_t *argv,
+        size_t argc, sage_value_t *ret)
+{
+    sage_assert (vm && (argv || !argc));
+
+    jmp_buf jmp, *prev = vm->jmp;
+    const size_t nframes = vm->nframes;
+    sage_value_t *floor = vm->floor;
+
+    vm->jmp = &jmp;
+
+    if (setjmp(jmp)) {
+        vm->nframes = nframes;
+        vm->floor = floor;
+        vm->jmp = prev;
+
+        return false;
+    }
+
+    sage_value_t val = sage_script_apply(proc, argv, argc);
+    vm->jmp = prev;
+
+    if (ret)
+        *ret = val;
+
+    return true;
+}
+
+
+/*
+ * The sage_script_load() interface function reads, compiles and runs each form
+ * in the source text src in turn, so that later forms see the definitions made
+ * by earlier ones. It stops at the first error, reporting it against name and
+ * the line it was found on, and returns false.
+ */
+extern bool sage_script_load(const char *src, const char *name)
+{
+    sage_assert (vm && src && name);
+
+    struct sage_script_reader_t rdr;
+    sage_value_t form;
+    const char *err;
+
+    sage_script_reader_start(&rdr, src);
+
+    while (sage_script_read(&rdr, &form)) {
+        struct sage_value_proto_t *p = sage_script_compile(form, &err);
+
+        if (!p) {
+            printf("%s:%zu: %s\n", name, rdr.line, err);
+            return false;
+        }
+
+        sage_value_t proc = sage_value_from_object(sage_value_closure(p));
+
+        if (!sage_script_call(proc, NULL, 0, NULL)) {
+            printf("%s:%zu: error in form\n", name, rdr.line);
+            return false;
+        }
+
+        if (sage_value_collect_due())
+            sage_script_collect(SAGE_SCRIPT_LOAD_BUDGET);
+    }
+
+    if (rdr.err) {
+        printf("%s:%zu: %s\n", name, rdr.line, rdr.err);
+        return false;
+    }
+
+    return true;
+}
+
+
+extern bool sage_script_load_file(const char *path)
+{
+    sage_assert (path);
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("%s: cannot open script\n", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long len = ftell(file);
+    rewind(file);
+
+    char *src = sage_heap_new((size_t) (len > 0 ? len : 0) + 1);
+    size_t rd = fread(src, 1, (size_t) (len > 0 ? len : 0), file);
+    src[rd] = '\0';
+    fclose(file);
+
+    bool ok = sage_script_load(src, path);
+    sage_heap_free((void **) &src);
+
+    return ok;
+}
+
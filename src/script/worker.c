@@ -0,0 +1,493 @@
+#include <unistd.h>
+#include "script.h"
+
+
+/*
+ * Each thread that starts a VM gets one of its own, with its own heap, as all
+ * the state of the VM is thread local; no lock is ever taken to run script
+ * code. The worker pool builds on this to run the update procedures of entity
+ * classes bound in parallel across several cores. Every worker loads the same
+ * scripts into its VM when the pool starts, and from then on is only handed
+ * data: a snapshot of the positions of the entities of a class, of which each
+ * worker updates a share in its own VM and writes back new positions, which
+ * the thread that owns the arena then applies once all the workers are done.
+ *
+ * Objects cannot be shared between heaps, so other state of the world is sent
+ * to the workers as messages, each of which sets a global in the VM of every
+ * worker to a copy of a value. Messages wait in an inbox for each worker, and
+ * are delivered before the next update the worker runs. Input is state of the
+ * world too, and so the primitives that read it are not defined in workers;
+ * scripts that need it send it as a message. The random primitive of each
+ * worker is seeded apart from the others.
+ *
+ * The pool is shared between the thread that owns the arena and the workers,
+ * and so unlike the other singletons in the library it is not thread local;
+ * the state of each worker and the count of pending work are guarded by the
+ * lock, and the rest is only touched by the owning thread while no work is
+ * pending.
+ */
+
+
+#define WORKERS_MAX ((size_t) 8)
+#define CLASSES_LEN ((size_t) 16)
+#define WORKER_BUDGET ((uint32_t) 500)
+
+
+enum column_t {
+    COLUMN_X = 0,
+    COLUMN_Y,
+    COLUMN_PAYLOAD,
+
+    COLUMN_COUNT
+};
+
+
+struct message {
+    char *name;
+    struct sage_script_bytes_t val;
+    struct message *next;
+};
+
+
+/*
+ * A job asks a worker to update the entities from index from up to index to in
+ * the snapshot, by calling the procedure held by the global named update.
+ */
+struct job {
+    const char *update;
+    size_t from;
+    size_t to;
+};
+
+
+struct worker {
+    thrd_t thrd;
+    struct job job;
+    bool busy;
+    struct message *inbox;
+    struct message *tail;
+};
+
+
+struct binding {
+    sage_id cls;
+    char *update;
+};
+
+
+struct pool {
+    mtx_t lock;
+    cnd_t work;
+    cnd_t done;
+    struct worker workers[WORKERS_MAX];
+    size_t nworkers;
+    size_t pending;
+    size_t loading;
+    bool failed;
+    bool stop;
+    const char *const *paths;
+    size_t npaths;
+    struct binding binds[CLASSES_LEN];
+    size_t nbinds;
+    float *cols;
+    size_t len;
+    size_t cap;
+};
+
+
+static struct pool *pool = NULL;
+
+
+static thread_local struct sage_script_global_t *columns[COLUMN_COUNT];
+
+
+static void message_free(struct message **ctx)
+{
+    struct message *hnd;
+
+    if (sage_likely (ctx && (hnd = *ctx))) {
+        sage_heap_free((void **) &hnd->name);
+        sage_heap_free((void **) &hnd->val.bfr);
+        sage_heap_free((void **) ctx);
+    }
+}
+
+
+static void inbox_deliver(struct message *msg)
+{
+    struct message *next;
+    sage_value_t val;
+
+    for (; msg; msg = next) {
+        next = msg->next;
+
+        if (sage_script_decode(msg->val.bfr, msg->val.len, &val))
+            sage_script_global_set(msg->name, val);
+
+        message_free(&msg);
+    }
+}
+
+
+/*
+ * The column() helper function gets the vector of a worker's VM that holds
+ * column col, sized for len entities. As with batches bound on the arena
+ * thread, the vectors are kept in globals that scripts cannot name, and are
+ * reused from one update to the next.
+ */
+static struct sage_value_vector_t *column(enum column_t col, size_t len)
+{
+    if (sage_unlikely (!columns[col]))
+        columns[col] = sage_script_global_cell(sage_value_symbol_unique(
+                    "column"));
+
+    struct sage_script_global_t *g = columns[col];
+
+    if (!sage_value_is(g->val, SAGE_VALUE_TYPE_VECTOR) || ((struct
+                    sage_value_vector_t *) sage_value_object(g->val))->len
+            != len)
+        g->val = sage_value_vector(len, SAGE_VALUE_FALSE);
+
+    return sage_value_object(g->val);
+}
+
+
+/*
+ * The job_run() helper function runs a job in the VM of the calling worker.
+ * The snapshot holds four columns of pool->len floats each: the x and y
+ * positions read from the arena, followed by the x and y positions to write
+ * back, which the job fills in for its share of the entities. The payload
+ * column is always false, as payloads belong to the arena thread. If the
+ * procedure fails, the positions of its share are left as they were.
+ */
+static void job_run(const struct job *job)
+{
+    const size_t len = job->to - job->from;
+    const float *in = pool->cols;
+    float *out = pool->cols + 2 * pool->len;
+
+    sage_value_t argv[COLUMN_COUNT];
+    struct sage_value_vector_t *cols[COLUMN_COUNT];
+
+    for (register size_t i = 0; i < COLUMN_COUNT; i++) {
+        cols[i] = column((enum column_t) i, len);
+        argv[i] = sage_value_from_object(cols[i]);
+    }
+
+    for (register size_t i = 0; i < len; i++) {
+        cols[COLUMN_X]->items[i] = sage_value_number(in[job->from + i]);
+        cols[COLUMN_Y]->items[i] = sage_value_number(in[pool->len + job->from
+                + i]);
+        cols[COLUMN_PAYLOAD]->items[i] = SAGE_VALUE_FALSE;
+    }
+
+    const bool ok = sage_script_call(sage_script_global(job->update), argv,
+            COLUMN_COUNT, NULL);
+
+    for (register size_t i = 0; i < len; i++) {
+        const size_t x = job->from + i, y = pool->len + job->from + i;
+        const sage_value_t vx = cols[COLUMN_X]->items[i];
+        const sage_value_t vy = cols[COLUMN_Y]->items[i];
+
+        out[x] = ok && sage_value_is_number(vx)
+            ? (float) sage_value_to_number(vx) : in[x];
+        out[y] = ok && sage_value_is_number(vy)
+            ? (float) sage_value_to_number(vy) : in[y];
+    }
+
+    sage_script_collect(WORKER_BUDGET);
+}
+
+
+static int worker(void *arg)
+{
+    struct worker *ctx = arg;
+    bool ok = true;
+
+    sage_script_start();
+    sage_script_primitives_seed((uint64_t) (ctx - pool->workers) + 1);
+
+    for (register size_t i = 0; i < pool->npaths && ok; i++)
+        ok = sage_script_load_file(pool->paths[i]);
+
+    mtx_lock(&pool->lock);
+    pool->failed |= !ok;
+    pool->loading--;
+    cnd_broadcast(&pool->done);
+
+    while (true) {
+        while (!pool->stop && !ctx->busy)
+            cnd_wait(&pool->work, &pool->lock);
+
+        if (pool->stop)
+            break;
+
+        struct message *msg = ctx->inbox;
+        ctx->inbox = ctx->tail = NULL;
+        mtx_unlock(&pool->lock);
+
+        inbox_deliver(msg);
+        job_run(&ctx->job);
+
+        mtx_lock(&pool->lock);
+        ctx->busy = false;
+        if (!--pool->pending)
+            cnd_broadcast(&pool->done);
+    }
+
+    mtx_unlock(&pool->lock);
+    sage_script_stop();
+
+    return 0;
+}
+
+
+/*
+ * The sage_script_workers_start() interface function starts a pool of count
+ * worker threads, or of one fewer than the number of cores if count is zero,
+ * each of which starts a VM of its own and loads the npaths script files at
+ * paths into it. It waits until every worker has loaded the scripts, and
+ * returns false, leaving no pool running, if any of them failed to.
+ */
+extern bool sage_script_workers_start(size_t count, const char *const *paths,
+        size_t npaths)
+{
+    if (sage_unlikely (pool))
+        return true;
+
+    if (!count) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        count = ncpu > 1 ? (size_t) ncpu - 1 : 1;
+    }
+
+    pool = sage_heap_new(sizeof *pool);
+    sage_require (mtx_init(&pool->lock, mtx_plain) == thrd_success);
+    sage_require (cnd_init(&pool->work) == thrd_success);
+    sage_require (cnd_init(&pool->done) == thrd_success);
+
+    pool->nworkers = count < WORKERS_MAX ? count : WORKERS_MAX;
+    pool->pending = pool->nbinds = pool->len = 0;
+    pool->loading = pool->nworkers;
+    pool->failed = pool->stop = false;
+    pool->paths = paths;
+    pool->npaths = npaths;
+
+    pool->cap = 256;
+    pool->cols = sage_heap_new(sizeof *pool->cols * 4 * pool->cap);
+
+    for (register size_t i = 0; i < pool->nworkers; i++) {
+        pool->workers[i].busy = false;
+        pool->workers[i].inbox = pool->workers[i].tail = NULL;
+
+        sage_require (thrd_create(&pool->workers[i].thrd, &worker,
+                    &pool->workers[i]) == thrd_success);
+    }
+
+    mtx_lock(&pool->lock);
+    while (pool->loading)
+        cnd_wait(&pool->done, &pool->lock);
+    mtx_unlock(&pool->lock);
+
+    pool->paths = NULL;
+    pool->npaths = 0;
+
+    if (sage_unlikely (pool->failed)) {
+        sage_script_workers_stop();
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * The sage_script_workers_stop() interface function stops the workers and their
+ * VMs, dropping any messages they have not been delivered, and unbinds the
+ * entity classes bound in parallel from the arena, which must still be running.
+ */
+extern void sage_script_workers_stop(void)
+{
+    if (sage_likely (pool)) {
+        mtx_lock(&pool->lock);
+        pool->stop = true;
+        cnd_broadcast(&pool->work);
+        mtx_unlock(&pool->lock);
+
+        for (register size_t i = 0; i < pool->nworkers; i++) {
+            thrd_join(pool->workers[i].thrd, NULL);
+
+            struct message *msg = pool->workers[i].inbox, *next;
+            for (; msg; msg = next) {
+                next = msg->next;
+                message_free(&msg);
+            }
+        }
+
+        for (register size_t i = 0; i < pool->nbinds; i++) {
+            sage_arena_batch(pool->binds[i].cls, NULL);
+            sage_heap_free((void **) &pool->binds[i].update);
+        }
+
+        cnd_destroy(&pool->done);
+        cnd_destroy(&pool->work);
+        mtx_destroy(&pool->lock);
+
+        sage_heap_free((void **) &pool->cols);
+        sage_heap_free((void **) &pool);
+    }
+}
+
+
+/*
+ * The sage_script_workers_send() interface function sends every worker a copy
+ * of the value val, to be bound to the global named name in its VM before it
+ * next runs an update. It returns false if val cannot be copied between heaps,
+ * which is the case if it holds procedures or handles.
+ */
+extern bool sage_script_workers_send(const char *name, sage_value_t val)
+{
+    sage_assert (pool && name);
+
+    struct sage_script_bytes_t enc = { .bfr = NULL, .len = 0, .cap = 0 };
+    if (!sage_script_encode(&enc, val)) {
+        sage_heap_free((void **) &enc.bfr);
+        return false;
+    }
+
+    const size_t len = strlen(name);
+
+    for (register size_t i = 0; i < pool->nworkers; i++) {
+        struct message *msg = sage_heap_new(sizeof *msg);
+
+        msg->name = sage_heap_new(len + 1);
+        memcpy(msg->name, name, len);
+        msg->val.bfr = sage_heap_new(enc.len ? enc.len : 1);
+        memcpy(msg->val.bfr, enc.bfr, enc.len);
+        msg->val.len = msg->val.cap = enc.len;
+        msg->next = NULL;
+
+        struct worker *w = &pool->workers[i];
+
+        mtx_lock(&pool->lock);
+        if (w->tail)
+            w->tail->next = msg;
+        else
+            w->inbox = msg;
+        w->tail = msg;
+        mtx_unlock(&pool->lock);
+    }
+
+    sage_heap_free((void **) &enc.bfr);
+    return true;
+}
+
+
+static struct binding *binding_find(sage_id cls)
+{
+    for (register size_t i = 0; i < pool->nbinds; i++) {
+        if (pool->binds[i].cls == cls)
+            return &pool->binds[i];
+    }
+
+    return NULL;
+}
+
+
+/*
+ * The entity_parallel() helper function is the arena batch callback of classes
+ * bound in parallel. It takes the snapshot of positions, splits the entities
+ * evenly between the workers, and waits for them all before writing back the
+ * positions that changed.
+ */
+static void entity_parallel(sage_id cls, const size_t *idx, size_t len)
+{
+    const struct binding *b = binding_find(cls);
+    sage_assert (b);
+
+    if (sage_unlikely (len > pool->cap)) {
+        pool->cap = len * 2;
+        pool->cols = sage_heap_resize(pool->cols, sizeof *pool->cols * 4
+                * pool->cap);
+    }
+
+    pool->len = len;
+    float *in = pool->cols;
+    const float *out = pool->cols + 2 * len;
+
+    for (register size_t i = 0; i < len; i++) {
+        sage_vector *pos = sage_entity_position(*sage_arena_entity_mutable(
+                    idx[i]));
+        struct sage_point_t pt = sage_vector_point(pos);
+
+        in[i] = pt.x;
+        in[len + i] = pt.y;
+        sage_vector_free(&pos);
+    }
+
+    const size_t share = (len + pool->nworkers - 1) / pool->nworkers;
+
+    mtx_lock(&pool->lock);
+    for (register size_t i = 0; i < pool->nworkers; i++) {
+        struct worker *w = &pool->workers[i];
+
+        w->job.update = b->update;
+        w->job.from = i * share < len ? i * share : len;
+        w->job.to = w->job.from + share < len ? w->job.from + share : len;
+
+        if (w->job.from < w->job.to) {
+            w->busy = true;
+            pool->pending++;
+        }
+    }
+
+    cnd_broadcast(&pool->work);
+    while (pool->pending)
+        cnd_wait(&pool->done, &pool->lock);
+    mtx_unlock(&pool->lock);
+
+    for (register size_t i = 0; i < len; i++) {
+        if (out[i] != in[i] || out[len + i] != in[len + i]) {
+            sage_vector *pos = sage_vector_new(out[i], out[len + i]);
+
+            sage_entity_position_set(sage_arena_entity_mutable(idx[i]), pos);
+            sage_vector_free(&pos);
+        }
+    }
+}
+
+
+/*
+ * The sage_script_entity_parallel_bind() interface function binds the entity
+ * class cls so that the procedure held by the global named update in the VMs
+ * of the workers is called once per frame for all the entities of that class,
+ * split between the workers, with the same columns as a procedure bound by
+ * sage_script_entity_batch_bind() except that payloads are not available. The
+ * procedure held by the global named draw is called on the calling thread for
+ * each entity, as with sage_script_entity_bind(). The pool and the arena must
+ * have been started.
+ */
+extern struct sage_entity_vtable sage_script_entity_parallel_bind(sage_id cls,
+        const char *update, const char *draw)
+{
+    sage_assert (pool);
+    struct binding *b = binding_find(cls);
+
+    if (!b) {
+        sage_require (pool->nbinds < CLASSES_LEN);
+        b = &pool->binds[pool->nbinds++];
+        b->cls = cls;
+        b->update = NULL;
+    }
+
+    sage_heap_free((void **) &b->update);
+
+    if (update) {
+        const size_t len = strlen(update);
+
+        b->update = sage_heap_new(len + 1);
+        memcpy(b->update, update, len);
+    }
+
+    sage_arena_batch(cls, update ? entity_parallel : NULL);
+    return sage_script_entity_bind(cls, NULL, draw);
+}
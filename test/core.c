@@ -0,0 +1,119 @@
+#include <string.h>
+#include "../src/core/core.h"
+#include "test.h"
+
+
+/*
+ * The LZ4 checks compress a buffer that mixes runs, repeated text and noise,
+ * so that both literals and matches of every length class are produced, and
+ * check that it comes back as it was. Malformed blocks must be rejected rather
+ * than read or written out of bounds.
+ */
+
+
+#define LZ4_LEN ((size_t) 100000)
+
+
+static void
+lz4_fill(uint8_t *bfr, size_t len)
+{
+    static const char text[] = "the quick brown fox jumps over the lazy dog ";
+    uint32_t seed = 0x9E3779B9u;
+
+    for (register size_t i = 0; i < len; i++) {
+        seed = seed * 1664525u + 1013904223u;
+
+        if ((i / 4096) % 3 == 0)
+            bfr[i] = (uint8_t) text[i % (sizeof text - 1)];
+        else if ((i / 4096) % 3 == 1)
+            bfr[i] = (uint8_t) (i / 700);
+        else
+            bfr[i] = (uint8_t) (seed >> 24);
+    }
+}
+
+
+static void
+lz4_roundtrip(void)
+{
+    uint8_t *src = sage_heap_new(LZ4_LEN);
+    uint8_t *out = sage_heap_new(LZ4_LEN);
+    const size_t cap = sage_lz4_bound(LZ4_LEN);
+    uint8_t *packed = sage_heap_new(cap);
+
+    lz4_fill(src, LZ4_LEN);
+    const size_t len = sage_lz4_compress(src, LZ4_LEN, packed, cap);
+
+    TEST_CHECK (len && len < LZ4_LEN);
+    TEST_CHECK (sage_lz4_decompress(packed, len, out, LZ4_LEN) == LZ4_LEN);
+    TEST_CHECK (!memcmp(src, out, LZ4_LEN));
+
+    TEST_CHECK (!sage_lz4_decompress(packed, len, out, LZ4_LEN - 1));
+    TEST_CHECK (!sage_lz4_decompress(packed, len - 1, out, LZ4_LEN));
+
+    sage_heap_free((void **) &packed);
+    sage_heap_free((void **) &out);
+    sage_heap_free((void **) &src);
+}
+
+
+static void
+lz4_incompressible(void)
+{
+    uint8_t src[4096], out[4096], packed[4096 + 4096 / 255 + 16];
+    uint32_t seed = 1;
+
+    for (register size_t i = 0; i < sizeof src; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        src[i] = (uint8_t) seed;
+    }
+
+    TEST_CHECK (sage_lz4_bound(sizeof src) == sizeof packed);
+    const size_t len = sage_lz4_compress(src, sizeof src, packed,
+            sizeof packed);
+
+    TEST_CHECK (len);
+    TEST_CHECK (sage_lz4_decompress(packed, len, out, sizeof out)
+            == sizeof src);
+    TEST_CHECK (!memcmp(src, out, sizeof src));
+}
+
+
+static void
+lz4_malformed(void)
+{
+    uint8_t out[64];
+
+    const uint8_t zero[] = { 0x10, 'a', 0x00, 0x00 };
+    TEST_CHECK (!sage_lz4_decompress(zero, sizeof zero, out, sizeof out));
+
+    const uint8_t behind[] = { 0x10, 'a', 0x05, 0x00 };
+    TEST_CHECK (!sage_lz4_decompress(behind, sizeof behind, out, sizeof out));
+
+    const uint8_t overrun[] = { 0x1F, 'a', 0x01, 0x00, 0xFF };
+    TEST_CHECK (!sage_lz4_decompress(overrun, sizeof overrun, out,
+                sizeof out));
+
+    const uint8_t literals[] = { 0x50, 'a', 'b' };
+    TEST_CHECK (!sage_lz4_decompress(literals, sizeof literals, out,
+                sizeof out));
+
+    const uint8_t run[] = { 0x1F, 'a', 0x01, 0x00, 0x0B };
+    TEST_CHECK (sage_lz4_decompress(run, sizeof run, out, sizeof out) == 31);
+    TEST_CHECK (out[0] == 'a' && out[30] == 'a');
+}
+
+
+/*
+ * The test_core() interface function checks the parts of the core library
+ * that do not depend on the screen.
+ */
+extern void
+test_core(void)
+{
+    lz4_roundtrip();
+    lz4_incompressible();
+    lz4_malformed();
+}
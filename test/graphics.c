@@ -0,0 +1,428 @@
+#include <SDL2/SDL.h>
+#include "../src/graphics/graphics.h"
+#include "test.h"
+
+
+/*
+ * The queue checks draw solid squares into the cells of a grid on the software
+ * screen, each cell covered by many squares pushed in a shuffled order of
+ * layers, depths, texture keys and materials, and read back the colour left in
+ * each cell. The square left on top must be the last pushed of those with the
+ * highest sort key; that is, the sort must order squares by layer, depth,
+ * texture key and material in turn, and keep the order in which squares with
+ * equal keys were pushed. More squares are pushed than the queue has room for
+ * at first, so that it also has to grow while open.
+ */
+
+
+#define QUEUE_CELL ((uint16_t) 8)
+#define QUEUE_GRID ((size_t) 8)
+#define QUEUE_COLOURS ((size_t) 4)
+#define QUEUE_PUSHES ((size_t) 3000)
+
+
+struct square {
+    uint8_t layer;
+    int depth;
+    uint32_t tkey;
+    uint8_t material;
+};
+
+
+static const uint32_t colours[QUEUE_COLOURS] = {
+    0xFFFF0000u, 0xFF00FF00u, 0xFF0000FFu, 0xFFFFFF00u
+};
+
+
+static void
+screen_clear(void)
+{
+    SDL_SetRenderDrawColor(sage_screen_brush(), 0, 0, 0, 0xFF);
+    SDL_RenderClear(sage_screen_brush());
+}
+
+
+static uint32_t *
+screen_read(struct sage_area_t *area)
+{
+    *area = sage_screen_pixels();
+    uint32_t *pixels = sage_heap_new((size_t) area->w * area->h * 4);
+    sage_screen_read(pixels, (size_t) area->w * 4);
+
+    return pixels;
+}
+
+
+static SDL_Texture *
+square_texture(uint32_t colour)
+{
+    uint32_t pixels[QUEUE_CELL * QUEUE_CELL];
+
+    for (register size_t i = 0; i < QUEUE_CELL * QUEUE_CELL; i++)
+        pixels[i] = colour;
+
+    SDL_Texture *tex = SDL_CreateTexture(sage_screen_brush(),
+            SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, QUEUE_CELL,
+            QUEUE_CELL);
+
+    if (tex) {
+        SDL_UpdateTexture(tex, NULL, pixels, QUEUE_CELL * 4);
+        SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+    }
+
+    return tex;
+}
+
+
+static bool
+square_above(const struct square *lhs, const struct square *rhs)
+{
+    if (lhs->layer != rhs->layer)
+        return lhs->layer > rhs->layer;
+
+    if (lhs->depth != rhs->depth)
+        return lhs->depth > rhs->depth;
+
+    if (lhs->tkey != rhs->tkey)
+        return lhs->tkey > rhs->tkey;
+
+    return lhs->material >= rhs->material;
+}
+
+
+static void
+queue_order(void)
+{
+    SDL_Texture *tex[QUEUE_COLOURS];
+    struct square top[QUEUE_GRID * QUEUE_GRID];
+    size_t want[QUEUE_GRID * QUEUE_GRID];
+    bool ok = true;
+
+    for (register size_t i = 0; i < QUEUE_COLOURS; i++)
+        ok = (tex[i] = square_texture(colours[i])) && ok;
+
+    TEST_CHECK (ok);
+    if (!ok)
+        return;
+
+    const struct sage_area_t size = { .w = QUEUE_CELL, .h = QUEUE_CELL };
+    const struct sage_point_t nw = { .x = 0.0f, .y = 0.0f };
+    uint32_t seed = 0x2545F491u;
+
+    screen_clear();
+    sage_batch_begin();
+    sage_queue_begin();
+
+    for (register size_t i = 0; i < QUEUE_PUSHES; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        const size_t cell = i < QUEUE_GRID * QUEUE_GRID
+            ? i : (seed >> 4) % (QUEUE_GRID * QUEUE_GRID);
+        const size_t colour = (seed >> 12) % QUEUE_COLOURS;
+        const struct square sq = {
+            .layer = (uint8_t) ((seed >> 16) % 3),
+            .depth = (int) ((seed >> 20) % 5) * 1000 - 2000,
+            .tkey = (seed >> 24) % 3,
+            .material = (uint8_t) ((seed >> 28) % 2)
+        };
+
+        if (i < QUEUE_GRID * QUEUE_GRID || square_above(&sq, &top[cell])) {
+            top[cell] = sq;
+            want[cell] = colour;
+        }
+
+        const struct sage_point_t dst = {
+            .x = (float) (cell % QUEUE_GRID * QUEUE_CELL),
+            .y = (float) (cell / QUEUE_GRID * QUEUE_CELL)
+        };
+
+        sage_queue_context(sq.layer, (float) sq.depth, sq.material);
+        sage_queue_push(sq.tkey, tex[colour], size, nw, size, dst, size);
+    }
+
+    sage_queue_end();
+    sage_batch_end();
+
+    struct sage_area_t area;
+    uint32_t *pixels = screen_read(&area);
+
+    size_t wrong = 0;
+    for (register size_t i = 0; i < QUEUE_GRID * QUEUE_GRID; i++) {
+        const size_t x = i % QUEUE_GRID * QUEUE_CELL + QUEUE_CELL / 2;
+        const size_t y = i / QUEUE_GRID * QUEUE_CELL + QUEUE_CELL / 2;
+
+        if (pixels[y * area.w + x] != colours[want[i]])
+            wrong++;
+    }
+
+    TEST_CHECK (wrong == 0);
+
+    sage_heap_free((void **) &pixels);
+    for (register size_t i = 0; i < QUEUE_COLOURS; i++)
+        SDL_DestroyTexture(tex[i]);
+}
+
+
+/*
+ * The raster checks draw through the sprite batch on the software screen, which
+ * is what the tile rasteriser draws. A texture scaled up must put each texel on
+ * the block of pixels under it and nothing outside, a translucent texel must
+ * be blended over what is already drawn, and a batch large enough to be shared
+ * out between the workers must leave the same pixels as drawing its quads one
+ * after the other would.
+ */
+
+
+#define RASTER_TEXELS ((uint16_t) 4)
+#define RASTER_SCALE ((uint16_t) 4)
+#define RASTER_QUADS ((size_t) 400)
+#define RASTER_QUAD ((uint16_t) 16)
+
+
+static uint32_t
+texel(size_t idx)
+{
+    return 0xFF000000u | (uint32_t) (idx * 16) << 16
+        | (uint32_t) (0xFF - idx * 16) << 8 | (uint32_t) idx;
+}
+
+
+static void
+raster_scale(void)
+{
+    uint32_t pixels[RASTER_TEXELS * RASTER_TEXELS];
+    const struct sage_area_t area = { .w = RASTER_TEXELS, .h = RASTER_TEXELS };
+
+    for (register size_t i = 0; i < RASTER_TEXELS * RASTER_TEXELS; i++)
+        pixels[i] = texel(i);
+
+    sage_texture *tex = sage_texture_new_pixels(1, pixels, area,
+            RASTER_TEXELS * 4, SDL_PIXELFORMAT_ARGB8888);
+
+    const struct sage_point_t nw = { .x = 0.0f, .y = 0.0f };
+    const struct sage_point_t dst = { .x = 5.0f, .y = 3.0f };
+    const struct sage_area_t proj = {
+        .w = RASTER_TEXELS * RASTER_SCALE,
+        .h = RASTER_TEXELS * RASTER_SCALE
+    };
+
+    screen_clear();
+    sage_batch_begin();
+    sage_texture_draw_clip(tex, nw, area, proj, dst);
+    sage_batch_end();
+
+    struct sage_area_t size;
+    uint32_t *fb = screen_read(&size);
+    size_t wrong = 0;
+
+    for (register size_t y = 0; y < RASTER_TEXELS * RASTER_SCALE; y++) {
+        for (register size_t x = 0; x < RASTER_TEXELS * RASTER_SCALE; x++) {
+            const size_t idx = y / RASTER_SCALE * RASTER_TEXELS
+                + x / RASTER_SCALE;
+
+            if (fb[(y + 3) * size.w + x + 5] != texel(idx))
+                wrong++;
+        }
+    }
+
+    TEST_CHECK (wrong == 0);
+    TEST_CHECK (fb[3 * size.w + 4] == 0xFF000000u);
+    TEST_CHECK (fb[2 * size.w + 5] == 0xFF000000u);
+    TEST_CHECK (fb[3 * size.w + 5 + proj.w] == 0xFF000000u);
+    TEST_CHECK (fb[(3 + proj.h) * size.w + 5] == 0xFF000000u);
+
+    sage_heap_free((void **) &fb);
+    sage_texture_free(&tex);
+}
+
+
+static void
+raster_blend(void)
+{
+    const uint32_t pixel = 0x80FFFFFFu;
+    const struct sage_area_t area = { .w = 1, .h = 1 };
+    const struct sage_area_t proj = { .w = 8, .h = 8 };
+    const struct sage_point_t nw = { .x = 0.0f, .y = 0.0f };
+
+    sage_texture *tex = sage_texture_new_pixels(1, &pixel, area, 4,
+            SDL_PIXELFORMAT_ARGB8888);
+
+    screen_clear();
+    sage_batch_begin();
+    sage_texture_draw_clip(tex, nw, area, proj, nw);
+    sage_batch_end();
+
+    struct sage_area_t size;
+    uint32_t *fb = screen_read(&size);
+    const uint32_t grey = fb[4 * size.w + 4] & 0xFF;
+
+    TEST_CHECK (fb[4 * size.w + 4] >> 24 == 0xFF);
+    TEST_CHECK (grey >= 0x7F && grey <= 0x81);
+    TEST_CHECK (fb[4 * size.w + 4] == (0xFF000000u | grey * 0x010101u));
+
+    sage_heap_free((void **) &fb);
+    sage_texture_free(&tex);
+}
+
+
+static void
+raster_tiles(void)
+{
+    uint32_t pixels[RASTER_TEXELS];
+    const struct sage_area_t area = { .w = RASTER_TEXELS, .h = 1 };
+    const struct sage_area_t clip = { .w = 1, .h = 1 };
+    const struct sage_area_t proj = { .w = RASTER_QUAD, .h = RASTER_QUAD };
+
+    for (register size_t i = 0; i < RASTER_TEXELS; i++)
+        pixels[i] = texel(i * 5);
+
+    sage_texture *tex = sage_texture_new_pixels(1, pixels, area,
+            sizeof pixels, SDL_PIXELFORMAT_ARGB8888);
+
+    const struct sage_area_t size = sage_screen_pixels();
+    uint32_t *want = sage_heap_new((size_t) size.w * size.h * 4);
+    uint32_t seed = 0x9E3779B9u;
+
+    for (register size_t i = 0; i < (size_t) size.w * size.h; i++)
+        want[i] = 0xFF000000u;
+
+    screen_clear();
+    sage_batch_begin();
+
+    for (register size_t i = 0; i < RASTER_QUADS; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        const int x = (int) (seed % (size.w + RASTER_QUAD)) - RASTER_QUAD / 2;
+        const int y = (int) (seed / 256 % (size.h + RASTER_QUAD))
+            - RASTER_QUAD / 2;
+        const size_t idx = seed / 65536 % RASTER_TEXELS;
+        const struct sage_point_t nw = { .x = (float) idx, .y = 0.0f };
+        const struct sage_point_t dst = { .x = (float) x, .y = (float) y };
+
+        sage_texture_draw_clip(tex, nw, clip, proj, dst);
+
+        for (register int py = y; py < y + RASTER_QUAD; py++) {
+            for (register int px = x; px < x + RASTER_QUAD; px++) {
+                if (px >= 0 && py >= 0 && px < size.w && py < size.h)
+                    want[py * size.w + px] = pixels[idx];
+            }
+        }
+    }
+
+    sage_batch_end();
+
+    struct sage_area_t got;
+    uint32_t *fb = screen_read(&got);
+    size_t wrong = 0;
+
+    for (register size_t i = 0; i < (size_t) size.w * size.h; i++)
+        wrong += fb[i] != want[i];
+
+    TEST_CHECK (wrong == 0);
+
+    sage_heap_free((void **) &fb);
+    sage_heap_free((void **) &want);
+    sage_texture_free(&tex);
+}
+
+
+/*
+ * The tilemap checks draw a tilemap whose tiles are solid colours, and expect
+ * drawing to leave the tilemap as it was, revision and all. A copy that has a
+ * tile set after the two were drawn must draw the new tile, and the original
+ * the old one, each from a chunk cache of its own.
+ */
+
+
+#define TILEMAP_TEX ((sage_id) 200)
+#define TILEMAP_TILE ((uint16_t) 4)
+
+
+static uint32_t
+tilemap_pixel(const struct sage_point_t at)
+{
+    struct sage_area_t area;
+    uint32_t *fb = screen_read(&area);
+    const uint32_t pixel = fb[(size_t) at.y * area.w + (size_t) at.x];
+
+    sage_heap_free((void **) &fb);
+    return pixel;
+}
+
+
+static void
+tilemap_draw(const sage_tilemap *map, struct sage_point_t dst)
+{
+    screen_clear();
+    sage_batch_begin();
+    sage_tilemap_draw(map, dst);
+    sage_batch_end();
+}
+
+
+static void
+tilemap_cache(void)
+{
+    uint32_t pixels[TILEMAP_TILE * TILEMAP_TILE * 2];
+    const struct sage_area_t area = { .w = TILEMAP_TILE * 2, .h = TILEMAP_TILE };
+    const struct sage_area_t tile = { .w = TILEMAP_TILE, .h = TILEMAP_TILE };
+    const struct sage_area_t len = { .w = 3, .h = 3 };
+
+    for (register size_t i = 0; i < TILEMAP_TILE * TILEMAP_TILE * 2; i++)
+        pixels[i] = i % (TILEMAP_TILE * 2) < TILEMAP_TILE
+            ? colours[0] : colours[1];
+
+    sage_texture *tex = sage_texture_new_pixels(TILEMAP_TEX, pixels, area,
+            sizeof pixels / TILEMAP_TILE, SDL_PIXELFORMAT_ARGB8888);
+    sage_texture_factory_register_texture(tex);
+    sage_texture_free(&tex);
+
+    sage_tilemap *map = sage_tilemap_new(1, TILEMAP_TEX, tile, len);
+    sage_tilemap_tile_set(&map, 0, 0, 1);
+    sage_tilemap_tile_set(&map, 1, 0, 2);
+
+    const struct sage_point_t dst = { .x = 8.0f, .y = 8.0f };
+    const struct sage_point_t lhs = { .x = 9.0f, .y = 9.0f };
+    const struct sage_point_t rhs = { .x = 9.0f + TILEMAP_TILE, .y = 9.0f };
+    const uint64_t rev = sage_object_revision(map);
+
+    tilemap_draw(map, dst);
+    TEST_CHECK (sage_object_revision(map) == rev);
+    TEST_CHECK (tilemap_pixel(lhs) == colours[0]);
+    TEST_CHECK (tilemap_pixel(rhs) == colours[1]);
+
+    sage_tilemap *cp = sage_tilemap_copy(map);
+    tilemap_draw(cp, dst);
+    sage_tilemap_tile_set(&cp, 0, 0, 2);
+
+    tilemap_draw(cp, dst);
+    TEST_CHECK (tilemap_pixel(lhs) == colours[1]);
+    TEST_CHECK (sage_tilemap_tile(map, 0, 0) == 1);
+
+    tilemap_draw(map, dst);
+    TEST_CHECK (tilemap_pixel(lhs) == colours[0]);
+    TEST_CHECK (sage_object_revision(map) == rev);
+
+    sage_tilemap_free(&cp);
+    sage_tilemap_free(&map);
+}
+
+
+/*
+ * The test_graphics() interface function checks the draw queue, the tile
+ * rasteriser and the tilemap chunk caches on the software screen that the
+ * runner starts, which must be at least 64 pixels square.
+ */
+extern void
+test_graphics(void)
+{
+    queue_order();
+    raster_scale();
+    raster_blend();
+    raster_tiles();
+    tilemap_cache();
+}
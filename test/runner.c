@@ -1,6 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include "../src/arena/arena.h"
+#include "test.h"
 
 
 enum {
@@ -31,13 +34,61 @@ entity_register(void)
 }
 
 
+static size_t checks = 0;
+static size_t failures = 0;
+
+
+/*
+ * The test_check() interface function records the result ok of the check expr
+ * made at line of file, and reports it if it failed.
+ */
+extern void
+test_check(bool ok, const char *expr, const char *file, int line)
+{
+    checks++;
+
+    if (!ok) {
+        failures++;
+        printf("%s:%d: check failed: %s\n", file, line, expr);
+    }
+}
+
+
+/*
+ * The check() helper function runs every check without a window, on a small
+ * software screen, and returns the exit status of the runner.
+ */
+static int
+check(void)
+{
+    const struct sage_area_t res = {.w = 64, .h = 64};
+    const struct sage_screen_opt_t opt = {
+        .backend = SAGE_SCREEN_BACKEND_SOFTWARE
+    };
+
+    sage_screen_start("Sage Check", res, &opt);
+    sage_game_start();
+
+    test_core();
+    test_script();
+    test_graphics();
+    test_arena();
+
+    sage_game_stop();
+    sage_screen_stop();
+
+    printf("%zu of %zu checks failed\n", failures, checks);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
 int main(int argc, char *argv[])
 {
-    (void) argc;
-    (void) argv;
+    if (argc > 1 && !strcmp(argv[1], "check"))
+        return check();
 
     register struct sage_area_t res = {.w = 640, .h = 480};
-    sage_screen_start("Sage Test", res);
+    sage_screen_start("Sage Test", res, NULL);
 
     sage_game_start();
     texture_register();
@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include "../src/script/script.h"
+#include "test.h"
+
+
+/*
+ * The script checks run in the VM of the main thread, which the game has
+ * already started. Each expression under test is bound to a global by loading
+ * a definition, so that its value is a root and survives any collection that
+ * loading triggers.
+ */
+
+
+#define SCRIPT_SRC "bld/check.scm"
+#define SCRIPT_CACHE "bld/check.sbc"
+
+
+static bool
+yields(const char *expr)
+{
+    char src[1024];
+    snprintf(src, sizeof src, "(define test-result %s)", expr);
+
+    return sage_script_load(src, "check")
+        && sage_script_global("test-result") == SAGE_VALUE_TRUE;
+}
+
+
+static void
+semantics(void)
+{
+    TEST_CHECK (sage_script_load(
+                "(define (count-down n)\n"
+                "  (if (= n 0) 'done (count-down (- n 1))))\n"
+                "(define (even-odd? n even)\n"
+                "  (if (= n 0) even (even-odd? (- n 1) (not even))))\n",
+                "check"));
+
+    TEST_CHECK (yields("(eq? (count-down 1000000) 'done)"));
+    TEST_CHECK (yields("(even-odd? 100001 #f)"));
+    TEST_CHECK (yields("(eq? (apply count-down '(100000)) 'done)"));
+
+    TEST_CHECK (sage_script_load(
+                "(define (make-adder n) (lambda (x) (+ x n)))\n"
+                "(define (make-counter)\n"
+                "  (let ((n 0)) (lambda () (set! n (+ n 1)) n)))\n"
+                "(define c1 (make-counter))\n"
+                "(define c2 (make-counter))\n",
+                "check"));
+
+    TEST_CHECK (yields("(= ((make-adder 3) 4) 7)"));
+    TEST_CHECK (yields("(begin (c1) (c1) (c2) (= (c1) 3))"));
+    TEST_CHECK (yields("(= (c2) 2)"));
+    TEST_CHECK (yields("(equal? ((lambda xs xs) 1 2 3) '(1 2 3))"));
+
+    TEST_CHECK (sage_script_load(
+                "(define (add a b) (+ a b))\n"
+                "(define saved-add +)\n",
+                "check"));
+
+    TEST_CHECK (yields("(= (add 2 5) 7)"));
+    TEST_CHECK (sage_script_load("(define (+ a b) (* a b))", "check"));
+    TEST_CHECK (yields("(= (add 2 5) 10)"));
+    TEST_CHECK (sage_script_load("(set! + saved-add)", "check"));
+    TEST_CHECK (yields("(= (add 2 5) 7)"));
+
+    TEST_CHECK (!sage_script_load("(car 1)", "check"));
+    TEST_CHECK (!sage_script_load(
+                "(define (deep n) (if (= n 0) 0 (+ 1 (deep (- n 1)))))\n"
+                "(deep 1000000)\n",
+                "check"));
+    TEST_CHECK (yields("(= (add 1 1) 2)"));
+}
+
+
+/*
+ * The collection checks build a structure that spans the old generation, the
+ * survivor spaces and the nursery, churn garbage through frames collected with
+ * budgets from nothing up to a whole frame, and check that the structure comes
+ * through whole.
+ */
+static void
+collection(void)
+{
+    static const uint32_t budgets[] = { 0, 1, 50, 1000, 16000 };
+
+    TEST_CHECK (sage_script_load(
+                "(define keep (make-vector 1000 0))\n"
+                "(define chain '())\n"
+                "(define (junk n acc)\n"
+                "  (if (= n 0) acc (junk (- n 1) (cons n acc))))\n"
+                "(define (tick k)\n"
+                "  (vector-set! keep (remainder k 1000) (list k (* k 2)))\n"
+                "  (if (= (remainder k 7) 0) (set! chain (cons k chain)))\n"
+                "  (junk 500 '()))\n"
+                "(define (keep-ok? i n)\n"
+                "  (or (= i n)\n"
+                "      (let ((e (vector-ref keep i)))\n"
+                "        (and (pair? e) (= (cadr e) (* 2 (car e)))\n"
+                "             (= (remainder (car e) 1000) i)\n"
+                "             (keep-ok? (+ i 1) n)))))\n"
+                "(define (chain-ok? l k)\n"
+                "  (or (null? l)\n"
+                "      (and (= (car l) k) (chain-ok? (cdr l) (- k 7)))))\n",
+                "check"));
+
+    char src[64];
+    bool ok = true;
+
+    for (register int k = 0; k < 3000 && ok; k++) {
+        snprintf(src, sizeof src, "(tick %d)", k);
+        ok = sage_script_load(src, "check");
+        sage_script_collect(budgets[k % (sizeof budgets / sizeof *budgets)]);
+    }
+
+    TEST_CHECK (ok);
+    TEST_CHECK (yields("(keep-ok? 0 1000)"));
+    TEST_CHECK (yields("(chain-ok? chain 2996)"));
+
+    sage_value_collect();
+    TEST_CHECK (yields("(keep-ok? 0 1000)"));
+    TEST_CHECK (yields("(chain-ok? chain 2996)"));
+}
+
+
+/*
+ * The remembered set checks drop an old object right after a young one was
+ * stored in it, while it is on the remembered set, and collect frame by frame
+ * until it has been swept; the collections after that must not scan it.
+ */
+static void
+remembered(void)
+{
+    bool ok = true;
+
+    for (register int k = 0; k < 20 && ok; k++) {
+        ok = sage_script_load("(define dropped (make-vector 1000 0))",
+                "check");
+        sage_script_collect(1000);
+
+        ok = ok && sage_script_load(
+                "(vector-set! dropped 0 (cons 1 2))\n"
+                "(set! dropped #f)\n",
+                "check");
+        sage_value_collect();
+
+        ok = ok && sage_script_load(
+                "(define refill (make-vector 1000 (cons 3 4)))", "check");
+
+        for (register int i = 0; i < 4; i++)
+            sage_script_collect(k % 2 ? 0 : 1000);
+    }
+
+    TEST_CHECK (ok);
+    TEST_CHECK (yields("(equal? (vector-ref refill 999) '(3 . 4))"));
+}
+
+
+static void
+encoding(void)
+{
+    TEST_CHECK (sage_script_load(
+                "(define payload\n"
+                "  (list 1 -2.5 \"two\" 'three (vector 4 #t #f '())\n"
+                "        (cons 'a 'b)))\n",
+                "check"));
+
+    const sage_value_t val = sage_script_global("payload");
+    struct sage_script_bytes_t bytes = { .bfr = NULL, .len = 0, .cap = 0 };
+    sage_value_t out;
+
+    TEST_CHECK (sage_script_encode(&bytes, val));
+    TEST_CHECK (sage_script_decode(bytes.bfr, bytes.len, &out));
+    TEST_CHECK (sage_value_equal(val, out));
+
+    TEST_CHECK (!sage_script_decode(bytes.bfr, bytes.len - 1, &out));
+
+    const size_t len = bytes.len;
+    TEST_CHECK (!sage_script_encode(&bytes, sage_script_global("add")));
+    TEST_CHECK (bytes.len == len);
+
+    sage_heap_free((void **) &bytes.bfr);
+}
+
+
+/*
+ * The cache checks load the same source cold, warm and through a damaged cache,
+ * and expect the same globals each time; a damaged cache must be ignored and
+ * the source compiled again.
+ */
+static void
+cache(void)
+{
+    static const char src[] =
+        "(define (cached-fib n)\n"
+        "  (if (< n 2) n (+ (cached-fib (- n 1)) (cached-fib (- n 2)))))\n"
+        "(define cached-value (cached-fib 20))\n"
+        "(define cached-list (list \"x\" 'y 3))\n";
+
+    FILE *file = fopen(SCRIPT_SRC, "w");
+    TEST_CHECK (file && fputs(src, file) >= 0);
+    if (file)
+        fclose(file);
+
+    remove(SCRIPT_CACHE);
+
+    for (register int pass = 0; pass < 3; pass++) {
+        sage_script_global_set("cached-value", SAGE_VALUE_FALSE);
+
+        TEST_CHECK (sage_script_load_cached(SCRIPT_SRC, SCRIPT_CACHE));
+        TEST_CHECK (yields("(= cached-value 6765)"));
+        TEST_CHECK (yields("(equal? cached-list '(\"x\" y 3))"));
+
+        if (pass == 1 && (file = fopen(SCRIPT_CACHE, "r+b"))) {
+            fseek(file, -3, SEEK_END);
+            fputc(0xFF, file);
+            fclose(file);
+        }
+    }
+
+    remove(SCRIPT_CACHE);
+    remove(SCRIPT_SRC);
+}
+
+
+/*
+ * The test_script() interface function checks the script compiler and VM, the
+ * heap and collector, and the encodings shared by the bytecode cache and the
+ * worker pool.
+ */
+extern void
+test_script(void)
+{
+    semantics();
+    collection();
+    remembered();
+    encoding();
+    cache();
+}
@@ -0,0 +1,89 @@
+/******************************************************************************
+ *                           ____   __    ___  ____
+ *                          / ___) / _\  / __)(  __)
+ *                          \___ \/    \( (_ \ ) _)
+ *                          (____/\_/\_/ \___/(____)
+ *
+ * Schemable? Game Engine (SAGE) Library
+ * Copyright (c) 2020 Abhishek Chakravarti <abhishek@taranjali.org>.
+ *
+ * This code is released under the MIT License. See the accompanying
+ * sage/LICENSE.md file or <http://opensource.org/licenses/MIT> for complete
+ * licensing details.
+ *
+ * BY CONTINUING TO USE AND/OR DISTRIBUTE THIS FILE, YOU ACKNOWLEDGE THAT YOU
+ * HAVE UNDERSTOOD THESE LICENSE TERMS AND ACCEPT THEM.
+ *
+ * This is the sage/test/test.h header file; it declares the checks run by the
+ * SAGE Library test runner.
+ ******************************************************************************/
+
+
+#ifndef SCHEME_ASSISTED_GAME_ENGINE_TEST_HEADER
+#define SCHEME_ASSISTED_GAME_ENGINE_TEST_HEADER
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/*
+ * The checks run by `sage-runner check`. Each suite lives in a file of its own
+ * under sage/test and records its results through TEST_CHECK(), which reports
+ * a failing check along with where it is and carries on with the rest.
+ */
+
+
+#define TEST_CHECK(expr) test_check((expr), #expr, __FILE__, __LINE__)
+
+
+/*
+ * test_check() - record the result of a check.
+ * See sage/test/runner.c for details.
+ */
+extern void
+test_check(bool ok, const char *expr, const char *file, int line);
+
+
+/*
+ * test_core() - check the core library.
+ * See sage/test/core.c for details.
+ */
+extern void
+test_core(void);
+
+
+/*
+ * test_script() - check the script compiler, VM and heap.
+ * See sage/test/script.c for details.
+ */
+extern void
+test_script(void);
+
+
+/*
+ * test_graphics() - check the draw queue, rasteriser and tilemaps.
+ * See sage/test/graphics.c for details.
+ */
+extern void
+test_graphics(void);
+
+
+/*
+ * test_arena() - check snapshots and baked levels.
+ * See sage/test/arena.c for details.
+ */
+extern void
+test_arena(void);
+
+
+#endif /* SCHEME_ASSISTED_GAME_ENGINE_TEST_HEADER */
+
+
+/******************************************************************************
+ *                                   __.-._
+ *                                   '-._"7'
+ *                                    /'.-c
+ *                                    |  /T
+ *                                   _)_/LI
+ ******************************************************************************/
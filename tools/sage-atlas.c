@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include "../src/graphics/graphics.h"
+
+
+/*
+ * sage-atlas - bake a texture atlas offline.
+ *
+ * Usage: sage-atlas STEM WIDTH HEIGHT PADDING ID=PATH...
+ *
+ * Packs the images at each PATH into pages of WIDTH x HEIGHT pixels with
+ * PADDING pixels around each image, and writes the pages to STEM-<n>.png and
+ * the metadata to STEM.atlas. The baked atlas is loaded at runtime with
+ * sage_atlas_load() followed by sage_atlas_register().
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 6) {
+        fprintf(stderr, "usage: %s STEM WIDTH HEIGHT PADDING ID=PATH...\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct sage_area_t page = {
+        .w = (uint16_t) atoi(argv[2]),
+        .h = (uint16_t) atoi(argv[3])
+    };
+
+    sage_require (IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG);
+    sage_atlas_start(page, (uint16_t) atoi(argv[4]));
+
+    for (register int i = 5; i < argc; i++) {
+        char *path = strchr(argv[i], '=');
+        sage_require (path);
+
+        *path++ = '\0';
+        sage_atlas_add((sage_id) strtoull(argv[i], NULL, 10), path);
+    }
+
+    size_t npages = sage_atlas_pack();
+    sage_atlas_save(argv[1]);
+    printf("%s: packed %d images into %zu pages\n", argv[1], argc - 5, npages);
+
+    sage_atlas_stop();
+    IMG_Quit();
+
+    return EXIT_SUCCESS;
+}
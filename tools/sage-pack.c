@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include "../src/graphics/graphics.h"
+
+
+/*
+ * sage-pack - bake images into a texture pack.
+ *
+ * Usage: sage-pack [-z] PACK ID=PATH...
+ *
+ * Converts the image at each PATH to the renderer's native pixel format and
+ * writes it to the texture pack file PACK under ID. With -z, the pixel data is
+ * LZ4 compressed. The pack is loaded at runtime with sage_texture_pack_open()
+ * followed by sage_texture_pack_register().
+ */
+int main(int argc, char *argv[])
+{
+    bool lz4 = argc > 1 && !strcmp(argv[1], "-z");
+    int first = lz4 ? 3 : 2;
+
+    if (argc < first + 1) {
+        fprintf(stderr, "usage: %s [-z] PACK ID=PATH...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t len = (size_t) (argc - first);
+    sage_id *ids = sage_heap_new(sizeof *ids * len);
+    const char **srcs = sage_heap_new(sizeof *srcs * len);
+
+    for (register size_t i = 0; i < len; i++) {
+        char *path = strchr(argv[first + i], '=');
+        sage_require (path);
+
+        *path++ = '\0';
+        ids[i] = (sage_id) strtoull(argv[first + i], NULL, 10);
+        srcs[i] = path;
+    }
+
+    sage_require (IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG);
+    sage_texture_pack_write(argv[first - 1], len, ids, srcs, lz4);
+    printf("%s: baked %zu textures\n", argv[first - 1], len);
+    IMG_Quit();
+
+    sage_heap_free((void **) &srcs);
+    sage_heap_free((void **) &ids);
+
+    return EXIT_SUCCESS;
+}